@@ -0,0 +1,273 @@
+#include <video.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Times the library on a headless display so it can run
+ * anywhere (no /dev/fbN, no console needed).
+ *
+ * make bench
+ *
+ * or by hand:
+ *
+ * gcc -O2 -I. test/video_bench.c lib/libvideo.a -o vidbench -pthread
+ * ./vidbench [-n frames] [-k kernels] [-o results.json]
+ *
+ * Results are JSON: one entry per case and resolution with
+ * the mean ns/frame, GB/s and percentiles.
+ *
+ **/
+
+#define BENCH_FRAMES                            200
+
+#define BLACK                                   0xFF000000
+#define RED                                     0xFFFF0000
+#define GREEN                                   0xFF00FF00
+#define BLUE                                    0xFF0000FF
+
+#define BOX_WIDTH                               150
+#define BOX_HEIGHT                              150
+
+#define SET_ALPHA( alpha, color )               ((((uint8_t)alpha) << 24) | (color & 0x00FFFFFF))
+
+typedef struct _u_rgba_ {
+    union {
+        uint32_t        color;
+        struct {
+            uint8_t     b;
+            uint8_t     g;
+            uint8_t     r;
+            uint8_t     a;
+        }__attribute__((packed)) vals;
+    };
+}__attribute__((packed))                        URGBA, *PURGBA;
+
+/* Same as test/video_test.c, that's the loop we're timing */
+static inline void blend_colors( PURGBA dst, PURGBA src ) {
+    int     ia  = 0;
+    int     a   = 0;
+
+    if (src->vals.a == 0) return;
+    if (src->vals.a == 0xFF) {
+        dst->color = src->color;
+        return;
+    }
+    a = dst->vals.a + src->vals.a;
+    ia = (255 - src->vals.a);
+    dst->vals.b = ((src->vals.a * src->vals.b + ia * dst->vals.b) >> 8);
+    dst->vals.g = ((src->vals.a * src->vals.g + ia * dst->vals.g) >> 8);
+    dst->vals.r = ((src->vals.a * src->vals.r + ia * dst->vals.r) >> 8);
+    dst->vals.a = ((a > 0xFF)?0xFF:(uint8_t)a);
+}
+
+struct bench_display {
+    int         width,
+                height,
+                bpp,
+                buffers;
+};
+
+static const struct bench_display displays[] = {
+    {  800,  480, 32, 1 },      /* Pi 7" touchscreen */
+    {  800,  480, 16, 1 },
+    { 1280,  720, 32, 1 },
+    { 1920, 1080, 32, 1 },
+    { 1920, 1080, 32, 2 },      /* Page flipping */
+    { 1920, 1080, 16, 1 }
+};
+
+static int              nframes     = BENCH_FRAMES;
+static const char       *kernels    = 0;
+static FILE             *out;
+static int              nresults    = 0;
+
+static inline uint64_t now_ns( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64( const void *a, const void *b ) {
+    uint64_t x = *(const uint64_t *)a,
+             y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report( VIDEO v, const struct bench_display *d, const char *name,
+                    uint64_t *t, size_t bytes_per_frame )
+{
+    uint64_t    total = 0;
+    double      mean;
+    int         i;
+
+    for (i = 0; i < nframes; i++) total += t[i];
+    qsort(t, nframes, sizeof(uint64_t), &cmp_u64);
+    mean = (double)total / nframes;
+
+    fprintf(out, "%s\n    { \"case\": \"%s\", \"width\": %d, \"height\": %d, \"bpp\": %d, "
+                 "\"buffers\": %d, \"format\": \"%s\", \"kernels\": \"%s\", \"frames\": %d, "
+                 "\"bytes_per_frame\": %zu, \"ns_per_frame\": %.0f, \"gb_per_s\": %.3f, "
+                 "\"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu }",
+            nresults++ ? "," : "",
+            name, d->width, d->height, d->bpp, video_get_buffer_count(v),
+            video_get_pixel_format(v), video_get_kernel_set(v), nframes,
+            bytes_per_frame, mean, (mean > 0) ? (double)bytes_per_frame / mean : 0.0,
+            (unsigned long long)t[0],
+            (unsigned long long)t[(nframes * 50) / 100],
+            (unsigned long long)t[(nframes * 90) / 100],
+            (unsigned long long)t[(nframes * 99) / 100],
+            (unsigned long long)t[nframes - 1]);
+}
+
+/**
+ * The drawing loop from test/video_test.c: clear the buffer to
+ * black and alpha blend three boxes on it.
+ *
+ * \return Bytes touched.
+ **/
+static size_t blend_frame( uint32_t *prerender_buffer, int screen_width, int screen_height, int frame ) {
+    int         i,
+                x,
+                y,
+                bx,
+                by,
+                screen_px_count = screen_width * screen_height;
+    uint32_t    *dst,
+                color;
+    const uint32_t colors[3] = { RED, GREEN, BLUE };
+
+    for (i = 0; i < screen_px_count; i++) {
+        prerender_buffer[i] = BLACK;
+    }
+
+    for (i = 0; i < 3; i++) {
+        color = SET_ALPHA((frame * (i + 1)) & 0xFF, colors[i]);
+        bx    = ((frame * 2) + (i * 200)) % (screen_width - BOX_WIDTH);
+        by    = ((frame * 3) + (i * 100)) % (screen_height - BOX_HEIGHT);
+        dst   = &prerender_buffer[(by * screen_width) + bx];
+
+        for (y = 0; y < BOX_HEIGHT; y++) {
+            for (x = 0; x < BOX_WIDTH; x++) {
+                if (dst < prerender_buffer || dst > &prerender_buffer[screen_px_count]) continue;
+                blend_colors((PURGBA)dst++, (PURGBA)&color);
+            }
+            dst+=(screen_width - BOX_WIDTH);
+        }
+    }
+    return (screen_px_count + (3 * BOX_WIDTH * BOX_HEIGHT * 2)) * sizeof(uint32_t);
+}
+
+static int bench_display( const struct bench_display *d, uint64_t *t ) {
+    struct video_headless   h;
+    struct video_options    opts;
+    VIDEO                   v;
+    uint32_t                *buf;
+    size_t                  frame_bytes,
+                            blend_bytes = 0;
+    uint64_t                t0;
+    int                     i;
+
+    memset(&h, 0, sizeof(h));
+    memset(&opts, 0, sizeof(opts));
+    h.width         = d->width;
+    h.height        = d->height;
+    h.bpp           = d->bpp;
+    opts.buffers    = d->buffers;
+    opts.kernels    = kernels;
+    opts.headless   = &h;
+
+    if (!(v = video_start_ex(0, &opts))) {
+        fprintf(stderr, "ERROR: video_start_ex() failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    buf         = video_get_empty_buffer(v);
+    frame_bytes = (size_t)d->width * d->height * (d->bpp / 8);
+
+    for (i = 0; i < video_get_pixel_count(v); i++) buf[i] = (uint32_t)i * 2654435761u;
+
+    /* Warm up: fault everything in */
+    video_submit_frame(v, buf);
+    video_get_current_pixel_data(v, buf, video_get_req_buffer_size(v));
+
+    for (i = 0; i < nframes; i++) {
+        t0 = now_ns();
+        video_submit_frame(v, buf);
+        t[i] = now_ns() - t0;
+    }
+    report(v, d, "submit", t, frame_bytes);
+
+    for (i = 0; i < nframes; i++) {
+        t0 = now_ns();
+        video_clear_screen(v);
+        t[i] = now_ns() - t0;
+    }
+    report(v, d, "clear", t, frame_bytes);
+
+    for (i = 0; i < nframes; i++) {
+        t0 = now_ns();
+        video_set_screen_color(v, (i & 1) ? RED : BLUE);
+        t[i] = now_ns() - t0;
+    }
+    report(v, d, "fill", t, frame_bytes);
+
+    for (i = 0; i < nframes; i++) {
+        t0 = now_ns();
+        video_get_current_pixel_data(v, buf, video_get_req_buffer_size(v));
+        t[i] = now_ns() - t0;
+    }
+    report(v, d, "readback", t, frame_bytes);
+
+    for (i = 0; i < nframes; i++) {
+        t0 = now_ns();
+        blend_bytes = blend_frame(buf, d->width, d->height, i);
+        t[i] = now_ns() - t0;
+    }
+    report(v, d, "blend", t, blend_bytes);
+
+    video_stop(v);
+    free(buf);
+    return 0;
+}
+
+int main( int argc, char **argv ) {
+    const char  *path = 0;
+    uint64_t    *t;
+    int         i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            nframes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+            kernels = argv[++i];
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-n frames] [-k scalar|sse2|avx2|neon] [-o results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nframes < 1) nframes = 1;
+
+    out = stdout;
+    if (path && !(out = fopen(path, "w"))) {
+        fprintf(stderr, "ERROR: can't write %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (!(t = (uint64_t *)malloc(sizeof(uint64_t) * nframes))) return 1;
+
+    fprintf(out, "{\n  \"frames\": %d,\n  \"results\": [", nframes);
+    for (i = 0; i < sizeof(displays) / sizeof(displays[0]); i++) {
+        if (bench_display(&displays[i], t)) return 1;
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) fclose(out);
+    free(t);
+    return 0;
+}
@@ -0,0 +1,372 @@
+#include <video.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Checks that a display list draws the same frame, bit for
+ * bit, with one worker as with several, and the same as
+ * drawing its calls one by one.  Each round records a random
+ * mix of fills, blits (partly off the edges), rotated and
+ * scaled sprites with both filters, paths and text, on a
+ * frame whose size isn't a multiple of the tile size.  No
+ * display is needed.
+ *
+ * make dlistcheck
+ *
+ * or by hand:
+ *
+ * gcc -O2 -I. test/video_dlist_check.c lib/libvideo.a -o viddlistcheck -pthread -lm
+ * ./viddlistcheck [-n rounds] [-t threads] [-f font.ttf]
+ *
+ * Exits non-zero on the first frame that differs.
+ *
+ **/
+
+#define CHECK_ROUNDS                            50
+#define CHECK_THREADS                           4
+#define CHECK_WIDTH                             403     /* Not a multiple of the 64 pixel tiles     */
+#define CHECK_HEIGHT                            301
+#define CHECK_CMDS                              60
+
+#define SPRITE_WIDTH                            96
+#define SPRITE_HEIGHT                           72
+
+#define KEY_COLOR                               0x00FF00FF
+
+#define DEFAULT_FONT                            "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
+
+/**
+ * Where the scene goes: recorded into "dl", or drawn straight
+ * onto "s" when "dl" is NULL.
+ **/
+struct target {
+    struct video_dlist          *dl;
+    const struct video_surface  *s;
+};
+
+struct assets {
+    struct video_surface        sprite,         /* Straight alpha, a gradient with holes   */
+                                premul,         /* The same, premultiplied                 */
+                                keyed;          /* Opaque with KEY_COLOR in places         */
+    struct video_font           *psf,
+                                *ttf;           /* NULL if there's none                    */
+    struct video_glyph_cache    *cache;
+    struct video_path           *path;
+};
+
+static uint32_t rng;
+
+static uint32_t rnd( void ) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/* From lo up to and including hi */
+static int rnd_in( int lo, int hi ) {
+    return lo + (int)(rnd() % (uint32_t)(hi - lo + 1));
+}
+
+static uint32_t rnd_color( void ) {
+    static const uint8_t    alphas[] = { 0x00, 0x01, 0x40, 0x80, 0xFE, 0xFF };
+
+    return ((uint32_t)alphas[rnd() % sizeof(alphas)] << 24) | (rnd() & 0x00FFFFFF);
+}
+
+static int surface_alloc( struct video_surface *s, int width, int height ) {
+    s->width    = width;
+    s->height   = height;
+    s->stride   = (size_t)width * sizeof(uint32_t);
+    return (s->pixels = (uint32_t *)malloc(s->stride * height)) ? 0 : -1;
+}
+
+static void sprites_fill( struct assets *a ) {
+    uint32_t    p, al;
+    int         x, y;
+
+    for (y = 0; y < SPRITE_HEIGHT; y++) {
+        for (x = 0; x < SPRITE_WIDTH; x++) {
+            al  = ((x / 12 + y / 12) & 3) ? (uint32_t)(x * 255 / (SPRITE_WIDTH - 1)) : 0;
+            p   = (uint32_t)(x * 7 + y * 3) << 16 | (uint32_t)(y * 5) << 8 | (uint32_t)(x ^ y);
+            p  &= 0x00FFFFFF;
+            a->sprite.pixels[y * SPRITE_WIDTH + x] = al << 24 | p;
+            a->premul.pixels[y * SPRITE_WIDTH + x] = al << 24 |
+                                                     (((p >> 16) & 0xFF) * al / 255) << 16 |
+                                                     (((p >> 8) & 0xFF) * al / 255) << 8 |
+                                                     ((p & 0xFF) * al / 255);
+            a->keyed.pixels[y * SPRITE_WIDTH + x]  = ((x - 48) * (x - 48) + (y - 36) * (y - 36) < 600) ?
+                                                     (0xFF000000 | KEY_COLOR) : (0xFF000000 | p);
+        }
+    }
+}
+
+/**
+ * A PSF1 font made up on the spot, so text is always checked
+ * whether or not the machine has fonts installed.
+ **/
+static struct video_font *psf_make( void ) {
+    uint8_t             data[4 + 256 * 16];
+    int                 i;
+
+    data[0] = 0x36;
+    data[1] = 0x04;
+    data[2] = 0;
+    data[3] = 16;
+    for (i = 0; i < 256 * 16; i++) data[4 + i] = (uint8_t)((i * 37) ^ (i >> 4) * 91);
+    return video_font_load_mem(data, sizeof(data));
+}
+
+static struct video_surface *pick_sprite( struct assets *a, int mode ) {
+    if (mode == VIDEO_BLIT_PREMUL) return &a->premul;
+    if (mode == VIDEO_BLIT_KEY) return &a->keyed;
+    return &a->sprite;
+}
+
+static void random_path( struct video_path *p ) {
+    float   x = (float)rnd_in(-40, CHECK_WIDTH + 40),
+            y = (float)rnd_in(-40, CHECK_HEIGHT + 40);
+    int     i, n = rnd_in(2, 6);
+
+    video_path_reset(p);
+    video_path_move_to(p, x, y);
+    for (i = 0; i < n; i++) {
+        x += (float)rnd_in(-120, 120) + 0.25f * (float)rnd_in(0, 3);
+        y += (float)rnd_in(-120, 120) + 0.25f * (float)rnd_in(0, 3);
+        switch (rnd() % 3) {
+        case 0:
+            video_path_line_to(p, x, y);
+            break;
+        case 1:
+            video_path_quad_to(p, x + (float)rnd_in(-60, 60), y + (float)rnd_in(-60, 60), x, y);
+            break;
+        default:
+            video_path_cubic_to(p, x + (float)rnd_in(-60, 60), y + (float)rnd_in(-60, 60),
+                                x + (float)rnd_in(-60, 60), y + (float)rnd_in(-60, 60), x, y);
+            break;
+        }
+    }
+    if (rnd() & 1) video_path_close(p);
+}
+
+/**
+ * Draws round "seed"'s scene onto "t".  Everything random is
+ * drawn from the seed, so every target gets the same calls.
+ **/
+static void scene( const struct target *t, struct assets *a, uint32_t seed ) {
+    static const char       *texts[] = { "Hello, tiles!", "0123456789", "Température: 21 °C", "WWWWiiii" };
+    struct video_rect       r;
+    struct video_matrix     m;
+    struct video_stroke     st;
+    struct video_font       *font;
+    float                   ang, sc;
+    int                     i, mode, filter, rule, size, x, y;
+    uint32_t                color, opacity;
+
+    rng = seed ? seed : 1;
+
+    r.x = 0;
+    r.y = 0;
+    r.width  = CHECK_WIDTH;
+    r.height = CHECK_HEIGHT;
+    color    = 0xFF000000 | (rnd() & 0x00FFFFFF);
+    if (t->dl) video_dlist_fill_rect(t->dl, &r, color, VIDEO_BLEND_COPY);
+    else video_fill_rect(t->s, &r, color, VIDEO_BLEND_COPY);
+
+    for (i = 0; i < CHECK_CMDS; i++) {
+        switch (rnd() % 5) {
+        case 0:
+            r.x         = rnd_in(-80, CHECK_WIDTH);
+            r.y         = rnd_in(-80, CHECK_HEIGHT);
+            r.width     = rnd_in(1, 200);
+            r.height    = rnd_in(1, 200);
+            color       = rnd_color();
+            mode        = (rnd() & 1) ? VIDEO_BLEND_OVER : VIDEO_BLEND_COPY;
+            if (t->dl) video_dlist_fill_rect(t->dl, &r, color, mode);
+            else video_fill_rect(t->s, &r, color, mode);
+            break;
+
+        case 1:
+            /* Off the top left too, the tiles see negative offsets into the sprite */
+            mode        = (int)(rnd() % 4);
+            r.x         = rnd_in(-SPRITE_WIDTH + 1, CHECK_WIDTH - 1);
+            r.y         = rnd_in(-SPRITE_HEIGHT + 1, CHECK_HEIGHT - 1);
+            r.width     = rnd_in(1, SPRITE_WIDTH + 20);
+            r.height    = rnd_in(1, SPRITE_HEIGHT + 20);
+            opacity     = (rnd() & 1) ? 255 : (uint32_t)rnd_in(0, 255);
+            if (t->dl) video_dlist_blit(t->dl, pick_sprite(a, mode), &r, mode, opacity, KEY_COLOR);
+            else video_blit_ex(t->s, pick_sprite(a, mode), &r, mode, opacity, KEY_COLOR);
+            break;
+
+        case 2:
+            ang         = (float)rnd_in(0, 359) * 3.14159265f / 180.0f;
+            sc          = (float)rnd_in(25, 300) / 100.0f;
+            x           = rnd_in(-40, CHECK_WIDTH + 40);
+            y           = rnd_in(-40, CHECK_HEIGHT + 40);
+            m.xx        =  cosf(ang) * sc;
+            m.xy        = -sinf(ang) * sc;
+            m.yx        =  sinf(ang) * sc;
+            m.yy        =  cosf(ang) * sc;
+            m.tx        = (float)x - (m.xx * SPRITE_WIDTH + m.xy * SPRITE_HEIGHT) / 2;
+            m.ty        = (float)y - (m.yx * SPRITE_WIDTH + m.yy * SPRITE_HEIGHT) / 2;
+            mode        = (int)(rnd() % 4);
+            filter      = (rnd() & 1) ? VIDEO_FILTER_BILINEAR : VIDEO_FILTER_NEAREST;
+            opacity     = (rnd() & 1) ? 255 : (uint32_t)rnd_in(0, 255);
+            if (mode == VIDEO_BLIT_KEY) mode = VIDEO_BLIT_OVER;
+            if (t->dl) video_dlist_blit_affine(t->dl, pick_sprite(a, mode), &m, mode, filter, opacity);
+            else video_blit_affine(t->s, pick_sprite(a, mode), &m, mode, filter, opacity);
+            break;
+
+        case 3:
+            random_path(a->path);
+            color       = rnd_color();
+            mode        = (rnd() & 1) ? VIDEO_BLEND_OVER : VIDEO_BLEND_COPY;
+            if (rnd() & 1) {
+                rule    = (rnd() & 1) ? VIDEO_FILL_EVENODD : VIDEO_FILL_NONZERO;
+                if (t->dl) video_dlist_fill_path(t->dl, a->path, color, mode, rule);
+                else video_fill_path(t->s, a->path, color, mode, rule);
+            } else {
+                st.width        = (float)rnd_in(1, 40) / 2.0f;
+                st.join         = (int)(rnd() % 3);
+                st.cap          = (int)(rnd() % 3);
+                st.miter_limit  = 4.0f;
+                if (t->dl) video_dlist_stroke_path(t->dl, a->path, &st, color, mode);
+                else video_stroke_path(t->s, a->path, &st, color, mode);
+            }
+            break;
+
+        default:
+            font        = (a->ttf && (rnd() & 1)) ? a->ttf : a->psf;
+            size        = (font == a->psf) ? 16 * rnd_in(1, 3) : rnd_in(8, 64);
+            x           = rnd_in(-100, CHECK_WIDTH);
+            y           = rnd_in(-20, CHECK_HEIGHT + 20);
+            color       = rnd_color();
+            if (t->dl) video_dlist_text(t->dl, a->cache, font, size, x, y, texts[rnd() % 4], color);
+            else video_draw_text(t->s, a->cache, font, size, x, y, texts[rnd() % 4], color);
+            break;
+        }
+    }
+}
+
+/**
+ * \return ZERO if "a" and "b" are the same, otherwise says
+ * where they first differ.
+ **/
+static int compare( const char *what, const struct video_surface *a, const struct video_surface *b, uint32_t seed ) {
+    int x, y;
+
+    if (!memcmp(a->pixels, b->pixels, a->stride * a->height)) return 0;
+    for (y = 0; y < a->height; y++) {
+        for (x = 0; x < a->width; x++) {
+            if (a->pixels[y * a->width + x] == b->pixels[y * a->width + x]) continue;
+            fprintf(stderr, "MISMATCH: seed %u, %s: pixel (%d, %d) is %08X, expected %08X\n", seed, what, x, y,
+                    b->pixels[y * a->width + x], a->pixels[y * a->width + x]);
+            return -1;
+        }
+    }
+    return -1;
+}
+
+int main( int argc, char **argv ) {
+    struct assets           a;
+    struct target           t;
+    struct video_surface    ref,
+                            one,
+                            many;
+    struct video_dlist      *dl1,
+                            *dln;
+    const char              *font_path = DEFAULT_FONT;
+    uint32_t                seed;
+    int                     rounds = CHECK_ROUNDS,
+                            threads = CHECK_THREADS,
+                            i,
+                            failed = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            font_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-n rounds] [-t threads] [-f font.ttf]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    memset(&a, 0, sizeof(a));
+    if (surface_alloc(&a.sprite, SPRITE_WIDTH, SPRITE_HEIGHT) ||
+        surface_alloc(&a.premul, SPRITE_WIDTH, SPRITE_HEIGHT) ||
+        surface_alloc(&a.keyed, SPRITE_WIDTH, SPRITE_HEIGHT) ||
+        surface_alloc(&ref, CHECK_WIDTH, CHECK_HEIGHT) ||
+        surface_alloc(&one, CHECK_WIDTH, CHECK_HEIGHT) ||
+        surface_alloc(&many, CHECK_WIDTH, CHECK_HEIGHT))
+    {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 2;
+    }
+    sprites_fill(&a);
+
+    a.psf   = psf_make();
+    a.ttf   = video_font_load(font_path);
+    a.cache = video_glyph_cache_create(1 << 20);
+    a.path  = video_path_create();
+    dl1     = video_dlist_create(1);
+    dln     = video_dlist_create(threads);
+    if (!a.psf || !a.cache || !a.path || !dl1 || !dln) {
+        fprintf(stderr, "ERROR: setting up failed: %s\n", strerror(errno));
+        return 2;
+    }
+    if (!a.ttf) printf("No TrueType font at %s, text is PSF only\n", font_path);
+
+    for (i = 0; i < rounds && !failed; i++) {
+        seed = 0x9E3779B9u * (uint32_t)(i + 1);
+
+        t.dl = 0;
+        t.s  = &ref;
+        scene(&t, &a, seed);
+
+        video_dlist_reset(dl1);
+        t.dl = dl1;
+        scene(&t, &a, seed);
+        memset(one.pixels, 0x5A, one.stride * one.height);
+        if (video_dlist_execute(dl1, &one)) {
+            fprintf(stderr, "ERROR: video_dlist_execute() failed: %s\n", strerror(errno));
+            return 2;
+        }
+
+        video_dlist_reset(dln);
+        t.dl = dln;
+        scene(&t, &a, seed);
+        memset(many.pixels, 0xA5, many.stride * many.height);
+        if (video_dlist_execute(dln, &many)) {
+            fprintf(stderr, "ERROR: video_dlist_execute() failed: %s\n", strerror(errno));
+            return 2;
+        }
+
+        if (compare("1 thread vs drawn directly", &ref, &one, seed) ||
+            compare("many threads vs 1 thread", &one, &many, seed)) failed = 1;
+    }
+
+    video_dlist_destroy(dln);
+    video_dlist_destroy(dl1);
+    video_path_destroy(a.path);
+    video_glyph_cache_destroy(a.cache);
+    video_font_free(a.ttf);
+    video_font_free(a.psf);
+    free(ref.pixels);
+    free(one.pixels);
+    free(many.pixels);
+    free(a.sprite.pixels);
+    free(a.premul.pixels);
+    free(a.keyed.pixels);
+
+    if (failed) return 1;
+    printf("%d rounds, %dx%d, 1 and %d threads: identical\n", rounds, CHECK_WIDTH, CHECK_HEIGHT, threads);
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <video.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Checks lines and filled polygons against a reference that
+ * works every pixel of the surface out on its own, with no
+ * clipping, so endpoints anywhere from INT_MIN to INT_MAX
+ * can be compared.  Ellipses and circles centered far off
+ * the surface must leave it alone.  No display is needed.
+ *
+ * make drawcheck
+ *
+ * or by hand:
+ *
+ * gcc -O2 -I. test/video_draw_check.c lib/libvideo.a -o viddrawcheck -pthread
+ * ./viddrawcheck [-n rounds]
+ *
+ * Exits non-zero on the first shape that differs.
+ *
+ **/
+
+#define CHECK_ROUNDS                            2000
+#define CHECK_WIDTH                             61
+#define CHECK_HEIGHT                            47
+#define CHECK_VERTICES                          6
+
+#define INK                                     0xFFFFFFFF
+
+static uint32_t rng = 0x2545F491;
+
+static uint32_t rnd( void ) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/**
+ * A coordinate: on or near the surface, a long way off, or
+ * at the ends of an int.
+ **/
+static int rnd_coord( int size ) {
+    switch (rnd() % 6) {
+    case 0:     return INT_MIN + (int)(rnd() % 3);
+    case 1:     return INT_MAX - (int)(rnd() % 3);
+    case 2:     return (int)(rnd() % (1u << 21)) - (1 << 20);
+    default:    return (int)(rnd() % (uint32_t)(size * 2)) - size / 2;
+    }
+}
+
+static int floor_div( __int128 a, __int128 b ) {
+    __int128 q = a / b;
+
+    if (a % b && (a < 0) != (b < 0)) q--;
+    return (int)q;
+}
+
+/**
+ * For each row (or column) of the surface along the major
+ * axis: which step of the line that is, and where the
+ * minor axis is at that step, m(k) = floor((2 k dv + du) / (2 du)).
+ **/
+static void ref_line( uint32_t *px, int x0, int y0, int x1, int y1 ) {
+    int64_t     dx = (x1 > x0) ? (int64_t)x1 - x0 : (int64_t)x0 - x1,
+                dy = (y1 > y0) ? (int64_t)y1 - y0 : (int64_t)y0 - y1;
+    int         xmajor = dx >= dy,
+                usize = xmajor ? CHECK_WIDTH : CHECK_HEIGHT,
+                u, v;
+    int64_t     du = xmajor ? dx : dy,
+                dv = xmajor ? dy : dx,
+                u0 = xmajor ? x0 : y0,
+                v0 = xmajor ? y0 : x0,
+                su = (xmajor ? x1 >= x0 : y1 >= y0) ? 1 : -1,
+                sv = (xmajor ? y1 >= y0 : x1 >= x0) ? 1 : -1,
+                k, m;
+
+    for (u = 0; u < usize; u++) {
+        k = su * (u - u0);
+        if (k < 0 || k > du) continue;
+        m = du ? floor_div((__int128)2 * k * dv + du, (__int128)2 * du) : 0;
+        v = (int)(v0 + sv * m);
+        if (xmajor && v >= 0 && v < CHECK_HEIGHT) px[v * CHECK_WIDTH + u] = INK;
+        if (!xmajor && v >= 0 && v < CHECK_WIDTH) px[u * CHECK_WIDTH + v] = INK;
+    }
+}
+
+/**
+ * Non-zero winding at each pixel center: an edge counts if it
+ * crosses the row at or left of the center.
+ **/
+static void ref_polygon( uint32_t *px, const struct video_point *pts, size_t n ) {
+    const struct video_point    *a,
+                                *b;
+    int                         x, y, wind, dir;
+    size_t                      i;
+    __int128                    dx, dy;
+
+    for (y = 0; y < CHECK_HEIGHT; y++) {
+        for (x = 0; x < CHECK_WIDTH; x++) {
+            for (i = 0, wind = 0; i < n; i++) {
+                a   = &pts[i];
+                b   = &pts[(i + 1) % n];
+                dir = (a->y < b->y) ? 1 : -1;
+                if (a->y == b->y) continue;
+                if (dir < 0) {
+                    a = b;
+                    b = &pts[i];
+                }
+                if (y < a->y || y >= b->y) continue;
+
+                dx = (__int128)b->x - a->x;
+                dy = (__int128)b->y - a->y;
+                if (2 * dy * a->x + (__int128)(2 * ((int64_t)y - a->y) + 1) * dx <= (__int128)(2 * x + 1) * dy) wind += dir;
+            }
+            if (wind) px[y * CHECK_WIDTH + x] = INK;
+        }
+    }
+}
+
+static int compare( const char *what, int round, const uint32_t *got, const uint32_t *want,
+                    const struct video_point *pts, size_t n )
+{
+    size_t  i;
+    int     x, y;
+
+    for (y = 0; y < CHECK_HEIGHT; y++) {
+        for (x = 0; x < CHECK_WIDTH; x++) {
+            if (got[y * CHECK_WIDTH + x] == want[y * CHECK_WIDTH + x]) continue;
+
+            fprintf(stderr, "Round %d: %s differs at (%d, %d), drew %08X, expected %08X.  Points:",
+                    round, what, x, y, (unsigned)got[y * CHECK_WIDTH + x], (unsigned)want[y * CHECK_WIDTH + x]);
+            for (i = 0; i < n; i++) fprintf(stderr, " (%d, %d)", pts[i].x, pts[i].y);
+            fprintf(stderr, "\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main( int argc, char **argv ) {
+    static uint32_t         got[CHECK_WIDTH * CHECK_HEIGHT],
+                            want[CHECK_WIDTH * CHECK_HEIGHT];
+    struct video_surface    s = { got, CHECK_WIDTH, CHECK_HEIGHT, CHECK_WIDTH * sizeof(uint32_t) };
+    struct video_point      pts[CHECK_VERTICES];
+    int                     rounds = CHECK_ROUNDS,
+                            round, i, n;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) rounds = atoi(argv[++i]);
+    }
+
+    for (round = 0; round < rounds; round++) {
+        for (i = 0; i < 2; i++) {
+            pts[i].x = rnd_coord(CHECK_WIDTH);
+            pts[i].y = rnd_coord(CHECK_HEIGHT);
+        }
+        memset(got, 0, sizeof(got));
+        memset(want, 0, sizeof(want));
+        video_draw_line(&s, pts[0].x, pts[0].y, pts[1].x, pts[1].y, INK, VIDEO_BLEND_COPY);
+        ref_line(want, pts[0].x, pts[0].y, pts[1].x, pts[1].y);
+        if (compare("line", round, got, want, pts, 2)) return 1;
+
+        n = 3 + (int)(rnd() % (CHECK_VERTICES - 2));
+        for (i = 0; i < n; i++) {
+            pts[i].x = rnd_coord(CHECK_WIDTH);
+            pts[i].y = rnd_coord(CHECK_HEIGHT);
+        }
+        memset(got, 0, sizeof(got));
+        memset(want, 0, sizeof(want));
+        if (video_fill_polygon(&s, pts, (size_t)n, INK, VIDEO_BLEND_COPY)) {
+            perror("video_fill_polygon()");
+            return 1;
+        }
+        ref_polygon(want, pts, (size_t)n);
+        if (compare("polygon", round, got, want, pts, (size_t)n)) return 1;
+
+        /* Far enough off that even the largest radius can't reach */
+        pts[0].x = (rnd() & 1) ? INT_MIN : INT_MAX;
+        pts[0].y = (rnd() & 1) ? INT_MIN : INT_MAX;
+        memset(got, 0, sizeof(got));
+        memset(want, 0, sizeof(want));
+        video_fill_ellipse(&s, CHECK_WIDTH / 2, pts[0].y, INT_MAX, INT_MAX, INK, VIDEO_BLEND_COPY);
+        video_draw_ellipse(&s, pts[0].x, CHECK_HEIGHT / 2, INT_MAX, (int)(rnd() % 100), INK, VIDEO_BLEND_COPY);
+        video_fill_circle(&s, pts[0].x, pts[0].y, INT_MAX, INK, VIDEO_BLEND_COPY);
+        if (compare("ellipse", round, got, want, pts, 1)) return 1;
+    }
+
+    printf("%d rounds of lines, polygons and ellipses match.\n", rounds);
+    return 0;
+}
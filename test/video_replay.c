@@ -0,0 +1,102 @@
+#include <video.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Plays back a recording made with video_record_start()
+ * at the speed it was recorded.
+ *
+ * make replay
+ *
+ * or by hand:
+ *
+ * gcc -O2 -I. test/video_replay.c lib/libvideo.a -o vidreplay -pthread
+ * ./vidreplay [-d framebuffer] [-l loops] [-i] [-H] recording.vrec
+ *
+ * -i only prints what's in the recording, -H plays it on a
+ * headless display (no screen, for checking a recording
+ * decodes on a machine without one).
+ *
+ **/
+
+static void print_info( const char *path, const struct video_record_info *info ) {
+    time_t  start = (time_t)(info->start_ns / 1000000000ULL);
+    char    when[64];
+
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&start));
+    printf("%s: %dx%d, %llu frames over %.3f s, recorded %s\n", path,
+           info->width, info->height, (unsigned long long)info->frames,
+           info->duration_ns / 1e9, when);
+    printf("    %llu bytes, %.1f%% of raw\n", (unsigned long long)info->bytes,
+           info->frames ? 100.0 * info->bytes / (info->frames * (double)info->width * info->height * 4) : 0.0);
+}
+
+int main( int argc, char **argv ) {
+    struct video_record_info    info;
+    struct video_options        opts;
+    struct video_headless       h;
+    const char                  *path = 0;
+    VIDEO                       v;
+    ssize_t                     shown;
+    int                         fb = 0,
+                                loops = 1,
+                                info_only = 0,
+                                headless = 0,
+                                i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            fb = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            loops = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-i")) {
+            info_only = 1;
+        } else if (!strcmp(argv[i], "-H")) {
+            headless = 1;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = 0;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [-d framebuffer] [-l loops] [-i] [-H] recording\n", argv[0]);
+        return 1;
+    }
+
+    if (video_record_info(path, &info)) {
+        fprintf(stderr, "ERROR: can't read %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    print_info(path, &info);
+    if (info_only) return 0;
+
+    memset(&opts, 0, sizeof(opts));
+    if (headless) {
+        memset(&h, 0, sizeof(h));
+        h.width         = info.width;
+        h.height        = info.height;
+        h.refresh_us    = 16667;
+        opts.headless   = &h;
+    }
+    if (!(v = video_start_ex(fb, &opts))) {
+        fprintf(stderr, "ERROR: video_start_ex() failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    for (i = 0; loops <= 0 || i < loops; i++) {
+        if ((shown = video_replay(v, path)) < 0) {
+            fprintf(stderr, "ERROR: video_replay() failed: %s\n", strerror(errno));
+            break;
+        }
+        printf("    played %zd frames\n", shown);
+    }
+
+    video_stop(v);
+    return 0;
+}
@@ -19,15 +19,41 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  **/
+#define _GNU_SOURCE
 #include "video.h"
+#include "video_kernels.h"
+#include "video_format.h"
+#include "video_backend.h"
+#include "video_stats.h"
+#include "video_perf.h"
+#include "video_trace.h"
+#include "video_pool.h"
+#include "video_record.h"
+#include "video_pace.h"
+#include "video_latency.h"
+
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #define FB_FS_LOCATION  "/dev/fb%d"
 
-#define _VWHITE64_      0xFFFFFFFFFFFFFFFF
+#define VIDEO_SLOT_FRESH    4           /* Set in the mailbox's middle slot when it holds an unpresented frame */
+
+#define VIDEO_DAMAGE_MAX    32          /* Rectangles remembered per page flip, beyond that we keep the bounds */
+
+#define VIDEO_VSYNC_NONE    0           /* How video_get_vsync_fd() is backed */
+#define VIDEO_VSYNC_THREAD  1
+#define VIDEO_VSYNC_TIMER   2
+
+#define VIDEO_TILE_W        64          /* Change detection tiles (video_options.tile_diff), pixels */
+#define VIDEO_TILE_H        16
 
 union px_pointer {
     uint32_t    *ptr32;
-    uint64_t    *ptr64;
     void        *ptr;
 };
 
@@ -36,7 +62,7 @@ union px_pointer {
  * 
  **/ 
 typedef struct video_mutex {
-    pid_t           owner;
+    pid_t           owner;              /* Thread id (not process id) holding the lock */
     pid_t           lock_count;
     pthread_mutex_t mutex;
 }                       VMUTEX, *PVMUTEX;
@@ -44,6 +70,11 @@ typedef struct video_mutex {
 struct video_setup {
     pid_t               pid;
     int                 fbid;
+    int                 fbnum;                  /* N of /dev/fbN, as given to video_start()                 */
+
+    struct video_backend 
+                        be;                     /* /dev/fbN, or headless memory                             */
+    int                 headless;               /* No console to take over                                  */
 
     int                 active;
 
@@ -53,41 +84,155 @@ struct video_setup {
     int                 tty_fd;
 
     size_t              px_count,
-                        px_count64,
                         width,
                         height;
 
     union px_pointer    ptr,
                         clrb;
 
+    const struct video_kernels 
+                        *kern;                  /* Copy/fill/read loops picked for this CPU at start */
+
+    struct video_format fmt;                    /* The panel's pixel layout                                 */
+    int                 direct;                 /* Panel is ARGB8888 with packed rows, no conversion needed */
+    int                 native;                 /* Panel is ARGB8888, maybe with padded rows                */
+    size_t              origin,                 /* Offset of the visible screen in video memory (copy mode) */
+                        frame_bytes;            /* Bytes of video memory one frame covers (no padding)      */
+    void                *row_buf;               /* One row of video memory, for readback                    */
+
     PVMUTEX             mtx_prerender;          /* Used so that only one thread at a time may access the pre-
                                                  * rendering buffer for this video display.
                                                  **/ 
 
+    int                 nbuffers,               /* Pages in video memory. 1 = copy mode, 2/3 = page flipping */
+                        front;                  /* Page last panned to (being scanned, or about to be)      */
+    unsigned long       flips;                  /* Pans so far, to spot stale video_acquire_back_buffer()s  */
+    void                *acq_buf;               /* video_acquire_back_buffer() when it can't give a page    */
+
+    size_t              page_size,              /* Bytes between the start of two pages                     */
+                        buf_size;               /* Bytes in a buffer given to video_submit_frame(): always
+                                                 * ARGB8888, width * height, no padding
+                                                 **/ 
+
     struct fb_var_screeninfo 
-                        var_info;
+                        var_info,
+                        var_orig;               /* Mode as we found it, restored by video_stop()            */
 
     struct fb_fix_screeninfo 
                         fix_info;
 
+    /**
+     * When page flipping, the back page is missing whatever changed
+     * in the frames presented since it was last written.  We keep
+     * the damage of the last few presents so video_submit_regions()
+     * can bring it up to date.  A count of -1 means "everything".
+     **/ 
+    struct video_rect   damage[VIDEO_MAX_BUFFERS][VIDEO_DAMAGE_MAX];
+    int                 ndamage[VIDEO_MAX_BUFFERS],
+                        damage_pos;
+    struct video_rect   *page_rects;            /* What the last video_update_back_page() wrote             */
+    size_t              page_cap;
+
+    /**
+     * Presenter thread.  When running, video_submit_frame() drops
+     * frames into a three slot mailbox and returns.  The presenter
+     * always takes the newest complete frame and does the VBLANK
+     * wait, so frames submitted faster than the display refreshes
+     * are replaced rather than queued.
+     **/ 
+    pthread_t           presenter;
+    sem_t               pres_sem;
+    volatile int        pres_running;
+
+    void                *slots[3];
+    int                 slot_wr,                /* Owned by the submitting thread                           */
+                        slot_rd;                /* Owned by the presenter                                   */
+    atomic_int          slot_mid;               /* Slot in the middle, ORed with VIDEO_SLOT_FRESH when new  */
+
+    /**
+     * VBLANK events (video_get_vsync_fd()).  Either a waiter
+     * thread sits in FBIO_WAITFORVSYNC and bumps an eventfd, or
+     * when the driver can't wait for VBLANK a timerfd ticks at
+     * the refresh rate, in phase with the last VBLANK seen.
+     * Both read as a count of VBLANKs.
+     **/ 
+    int                 vs_mode,                /* VIDEO_VSYNC_*                                            */
+                        vs_fd;
+    pthread_t           vs_thread;
+    atomic_int          vs_running;
+    uint64_t            vs_count,               /* Waiter: VBLANKs seen, then their time (atomics)          */
+                        vs_ts,
+                        vs_t0,                  /* Timer: first tick and period                             */
+                        vs_period,
+                        vs_read;                /* Timer: ticks read by video_read_vsync()                  */
+
+    int                 pan_pending;            /* video_present_nowait() panned at VBLANK pan_vblank and   */
+    uint64_t            pan_vblank;             /* it may not have landed yet                               */
+    uint64_t            vblank_ns;              /* When the last VBLANK waited for came                     */
+
+#ifndef VIDEO_NO_STATS
+    struct video_stats_acc 
+                        stats;                  /* See video_get_stats()                                    */
+#endif
+
+    struct video_perf_ctx 
+                        perf;                   /* Hardware counters, see video_get_perf()                  */
+
+    struct video_pool   pool;                   /* video_buffer_acquire()                                   */
+
+    struct video_pace   pace;                   /* video_wait_until_render_start()                          */
+
+    /**
+     * Change detection.  One hash per tile of the last frame
+     * presented, and room for the rectangles that changed.  
+     * tile_valid is cleared whenever video memory is written
+     * some other way, the next frame is then written whole.
+     **/ 
+    uint64_t            *tile_hash;
+    struct video_rect   *tile_rects;
+    int                 tiles_x,
+                        tiles_y,
+                        tile_valid;
+
+    /**
+     * Shadow of the frame on screen in ordinary (cached) memory,
+     * as it was submitted (ARGB8888, packed), for readback.  Not
+     * valid after a frame was drawn straight into video memory
+     * until the next full readback refreshes it.
+     **/ 
+    uint32_t            *shadow;
+    int                 shadow_valid;
+
+    struct video_recorder 
+                        *rec;                   /* video_record_start(), set and cleared under the lock     */
+
+    struct video_latency
+                        *lat;                   /* video_latency_open(), set and cleared under the lock     */
 };
 
 /**
  * Using O(n) because this is
- * infrequently used.
+ * infrequently used.  Each display is its own allocation so
+ * a VIDEO handle (and the threads holding one) never moves
+ * when the list grows.  The lock only covers taking and
+ * giving back a slot, not opening or closing the device.
  **/
 static struct {
-    VIDEO       video_list;
+    VIDEO       *video_list;
     size_t      count;
     size_t      used;
     PVMUTEX     vmutex;
 }                       video_monitor;
 
+static inline pid_t video_gettid( void ) {
+    return (pid_t)syscall(SYS_gettid);
+}
+
 /**
  * \return ZERO on success.
  **/ 
 static int video_lock( PVMUTEX pvm ) {
-    int pid = getpid(),
+    int pid = video_gettid(),
         rv;
 
     if (pvm->owner == pid) {
@@ -96,6 +241,7 @@ static int video_lock( PVMUTEX pvm ) {
     }
     rv = pthread_mutex_lock(&pvm->mutex);
     pvm->owner = pid;
+    pvm->lock_count = 1;
     return rv;
 }
 
@@ -107,7 +253,7 @@ static int video_lock( PVMUTEX pvm ) {
  * zero if it wants to...
  **/ 
 static int video_unlock( PVMUTEX pvm ) {
-    int pid = getpid();
+    int pid = video_gettid();
 
     if ( pvm->owner != pid) return EPERM;
     if (--pvm->lock_count == 0) {
@@ -134,268 +280,1666 @@ static void video_mutex_destroy( PVMUTEX *ppvm ) {
 }
 
 /**
- * Yes, we're locking a mutex in a signal handler.
+ * Returns a pointer to page "n" of video memory.  In copy
+ * mode there's one page: the visible part of the screen.
  **/ 
-void vtsig( int signum ) {
-    int     i;
-    pid_t   pid;
+static inline void *video_page_ptr( VIDEO v, int n ) {
+    return (uint8_t *)v->ptr.ptr + v->origin + (v->page_size * n);
+}
 
-    if (signum == SIGHUP) {
-        pid = getpid();
-        video_lock(video_monitor.vmutex);
-        for (i = 0; i < video_monitor.count; i++ ) {
-            if (video_monitor.video_list[i].pid == pid) {
-                video_monitor.video_list[i].active = 0;
-                break;
-            }
-        }
-        video_unlock(video_monitor.vmutex);
-    }
+static inline int video_wait_vsync( VIDEO v ) {
+    int ioc_ctl = 0;
+    return video_backend_ioctl(&v->be, FBIO_WAITFORVSYNC, &ioc_ctl);
 }
 
-void video_stop( VIDEO v ) {
-    size_t  i = 0;
+/**
+ * \return VBLANKs since video_get_vsync_fd() set up events,
+ * ZERO if it hasn't.
+ **/ 
+static uint64_t video_vsync_count( VIDEO v ) {
+    uint64_t    now;
 
-    if (v->fbid <= 0 || !v->active) return;
+    switch (v->vs_mode) {
+    case VIDEO_VSYNC_THREAD:
+        return __atomic_load_n(&v->vs_count, __ATOMIC_ACQUIRE);
 
-    video_lock(video_monitor.vmutex);
-    for (; i < video_monitor.count; i++) {
-        if (v->active == 1 && 
-            v->fbid == video_monitor.video_list[i].fbid)
-        {
-            goto vsid_found;
-        }
+    case VIDEO_VSYNC_TIMER:
+        now = video_pace_now();
+        return (now < v->vs_t0) ? 0 : (now - v->vs_t0) / v->vs_period + 1;
     }
-    video_unlock(video_monitor.vmutex);
-    return;
+    return 0;
+}
 
-    vsid_found:
+/**
+ * Point the display at page "n".  The driver latches
+ * the new offset at the next VBLANK.
+ **/ 
+static int video_pan( VIDEO v, int n ) {
+    v->var_info.xoffset = 0;
+    v->var_info.yoffset = v->var_info.yres * n;
+    return video_backend_ioctl(&v->be, FBIOPAN_DISPLAY, &v->var_info);
+}
 
-    free(v->clrb.ptr);
+/**
+ * Ask the driver for a virtual resolution "nbuffers" screens
+ * tall so that we can draw off-screen and flip with 
+ * FBIOPAN_DISPLAY.  If the driver refuses (or gives us less
+ * video memory than we need) we try one buffer fewer, and
+ * finally settle on the copy path with the original mode.
+ * 
+ * Must be called before video memory is mapped.
+ * 
+ * \return The number of pages in use (1 means copy mode).
+ **/ 
+static int video_setup_flip( VIDEO v, int nbuffers ) {
+    struct fb_var_screeninfo var;
 
-    /**
-     * Shut down rendering/timing thread.
-     **/ 
-    v->active = 0;
+    if (nbuffers > VIDEO_MAX_BUFFERS) nbuffers = VIDEO_MAX_BUFFERS;
 
-    /** 
-     * Rendering thread for this display is down.  
-     * clear everything up.
-     * 
-     **/ 
-    munmap(v->ptr.ptr, v->fix_info.smem_len);
+    for (; nbuffers > 1; nbuffers--) {
+        var                 = v->var_orig;
+        var.yres_virtual    = var.yres * nbuffers;
+        var.xoffset         = 0;
+        var.yoffset         = 0;
 
-    close(v->fbid);
+        if (video_backend_ioctl(&v->be, FBIOPUT_VSCREENINFO, &var)) continue;
 
-	tcsetattr(STDIN_FILENO, TCSANOW, &v->term_prev);
+        if (video_backend_ioctl(&v->be, FBIOGET_VSCREENINFO, &v->var_info) ||
+            video_backend_ioctl(&v->be, FBIOGET_FSCREENINFO, &v->fix_info)) 
+        {
+            break;
+        }
 
-    ioctl(v->tty_fd, KDSETMODE, KD_TEXT);
+        if (v->var_info.yres_virtual >= v->var_info.yres * nbuffers &&
+            v->fix_info.smem_len >= v->fix_info.line_length * v->var_info.yres * nbuffers)
+        {
+            return nbuffers;
+        }
+    }
 
-    close(v->tty_fd);
+    /* No luck, put things back the way we found them. */
+    video_backend_ioctl(&v->be, FBIOPUT_VSCREENINFO, &v->var_orig);
+    video_backend_ioctl(&v->be, FBIOGET_VSCREENINFO, &v->var_info);
+    video_backend_ioctl(&v->be, FBIOGET_FSCREENINFO, &v->fix_info);
+    return 1;
+}
 
-    video_mutex_destroy(&v->mtx_prerender);
+/**
+ * Writes a whole ARGB8888 frame to a page of video memory,
+ * converting and stepping by the stride as it goes.  
+ **/ 
+static void video_copy_frame( VIDEO v, void *pdst, const void *psrc ) {
+    const uint32_t  *src = (const uint32_t *)psrc;
+    uint8_t         *dst = (uint8_t *)pdst;
+    int             y;
 
-    /* Clear the structure */
-    memset(v, 0, sizeof(struct video_setup));
+    if (v->direct) {
+        v->kern->copy(dst, src, v->buf_size);
+        return;
+    }
 
-    video_monitor.used--;
+    for (y = 0; y < v->height; y++) {
+        video_format_put_row(&v->fmt, v->kern, dst, src, v->width, 0, y);
+        dst += v->fix_info.line_length;
+        src += v->width;
+    }
+}
 
-    video_unlock(video_monitor.vmutex);
+/**
+ * Clips "r" to the screen.
+ * 
+ * \return ZERO if nothing is left of it.
+ **/ 
+static int video_clip_rect( VIDEO v, struct video_rect *r ) {
+    int x1 = r->x + r->width,
+        y1 = r->y + r->height;
+
+    if (r->x < 0) r->x = 0;
+    if (r->y < 0) r->y = 0;
+    if (x1 > (int)v->width)  x1 = v->width;
+    if (y1 > (int)v->height) y1 = v->height;
+    if (x1 <= r->x || y1 <= r->y) return 0;
+    r->width  = x1 - r->x;
+    r->height = y1 - r->y;
+    return 1;
 }
 
-VIDEO video_start( int nframebuffer ) {
-    int     i;
-    VIDEO   swap,
-            v;
-    char    fb_file_path[50];   /* <--- Any changes, pay attention to this.  Only _50_ */
+static int video_cmp_int( const void *a, const void *b ) {
+    return *(const int *)a - *(const int *)b;
+}
 
-    if (nframebuffer < 0 || nframebuffer > 100) {
-        /**
-         * Sorry, I'm not writing this for over
-         * 100 screens or for if you don't have
-         * a screen but intend to buy one later...
-         **/ 
-        errno = EINVAL;
-        return 0;
-    }
+static int video_cmp_rect_x( const void *a, const void *b ) {
+    return ((const struct video_rect *)a)->x - ((const struct video_rect *)b)->x;
+}
 
-    sprintf(fb_file_path, FB_FS_LOCATION, nframebuffer);
+/**
+ * Writes the area covered by "rects" (already clipped) from
+ * the ARGB8888 frame "psrc" to the page of video memory 
+ * "pdst", converting as it goes.
+ * 
+ * The screen is cut into horizontal bands at every top and
+ * bottom edge.  Within a band the same rectangles cover every
+ * row, so their overlapping and touching x ranges are merged
+ * once into spans and each row copies just those spans.
+ * Nothing is copied twice.
+ * 
+ * \return The number of bytes copied.
+ **/ 
+static size_t video_copy_regions( VIDEO v, void *pdst, const void *psrc, 
+                                  struct video_rect *rects, size_t n )
+{
+    const size_t    pitch   = v->fix_info.line_length;
+    int             stack_edges[VIDEO_DAMAGE_MAX * VIDEO_MAX_BUFFERS * 2],
+                    stack_spans[VIDEO_DAMAGE_MAX * VIDEO_MAX_BUFFERS * 2],
+                    *edges  = stack_edges,
+                    *spans  = stack_spans,
+                    nedges  = 0,
+                    nspans,
+                    y;
+    size_t          i,
+                    k,
+                    off,
+                    copied  = 0;
+
+    if (n == 0) return 0;
+
+    if (n > VIDEO_DAMAGE_MAX * VIDEO_MAX_BUFFERS) {
+        edges = (int *)malloc(sizeof(int) * n * 4);
+        if (!edges) return 0;
+        spans = edges + n * 2;
+    }
 
-    video_lock(video_monitor.vmutex);
-    if (video_monitor.used == video_monitor.count) {
-        swap = (VIDEO) realloc(video_monitor.video_list,
-                                sizeof(struct video_setup) * (video_monitor.count + 10));
-        if (!swap) {
-            errno = ENOMEM;
-            video_unlock(video_monitor.vmutex);
-            return 0;
-        }
-        memset(&swap[video_monitor.count], 0, sizeof(struct video_setup) * 10 );
-        video_monitor.video_list = swap;
-        video_monitor.count+=10;
-        v = &video_monitor.video_list[video_monitor.used];
-    } else {
-        v = 0;
-        for (i = 0; i < video_monitor.count; i++) {
-            if (video_monitor.video_list[i].pid == 0) {
-                v = &video_monitor.video_list[i];
-                break;
+    for (i = 0; i < n; i++) {
+        edges[nedges++] = rects[i].y;
+        edges[nedges++] = rects[i].y + rects[i].height;
+    }
+    qsort(edges, nedges, sizeof(int), &video_cmp_int);
+    qsort(rects, n, sizeof(struct video_rect), &video_cmp_rect_x);
+
+    for (k = 0; k + 1 < nedges; k++) {
+        if (edges[k] == edges[k + 1]) continue;
+
+        /* Merge the x ranges of everything covering this band */
+        nspans = 0;
+        for (i = 0; i < n; i++) {
+            if (rects[i].y > edges[k] || rects[i].y + rects[i].height < edges[k + 1]) continue;
+            if (nspans && rects[i].x <= spans[nspans - 1]) {
+                if (rects[i].x + rects[i].width > spans[nspans - 1]) 
+                    spans[nspans - 1] = rects[i].x + rects[i].width;
+            } else {
+                spans[nspans++] = rects[i].x;
+                spans[nspans++] = rects[i].x + rects[i].width;
             }
         }
-        if (v == 0) {
-            video_unlock(video_monitor.vmutex);
-            return 0;
+
+        for (y = edges[k]; y < edges[k + 1]; y++) {
+            for (i = 0; i < nspans; i += 2) {
+                off = (y * pitch) + (spans[i] * v->fmt.bytespp);
+                video_format_put_row(&v->fmt, v->kern, (uint8_t *)pdst + off, 
+                                     (const uint32_t *)psrc + (y * v->width) + spans[i], 
+                                     spans[i + 1] - spans[i], spans[i], y);
+                copied += (spans[i + 1] - spans[i]) * v->fmt.bytespp;
+            }
         }
     }
 
-    v->fbid = open(fb_file_path, O_RDWR);
+    if (edges != stack_edges) free(edges);
+    return copied;
+}
+
+/**
+ * Remembers what this page flip changed.  NULL "rects"
+ * means the whole screen.
+ **/ 
+static void video_record_damage( VIDEO v, const struct video_rect *rects, size_t n ) {
+    struct video_rect   *d;
+    size_t              i;
+    int                 x1, 
+                        y1;
+
+    v->damage_pos = (v->damage_pos + 1) % VIDEO_MAX_BUFFERS;
+    d = v->damage[v->damage_pos];
 
-    if (v->fbid < 0) {
-        goto vs_fail;
+    if (!rects) {
+        v->ndamage[v->damage_pos] = -1;
+        return;
     }
 
-    if (ioctl(v->fbid, FBIOGET_FSCREENINFO, &v->fix_info)) goto vs_fail;
+    if (n <= VIDEO_DAMAGE_MAX) {
+        memcpy(d, rects, sizeof(struct video_rect) * n);
+        v->ndamage[v->damage_pos] = n;
+        return;
+    }
 
-    if (ioctl(v->fbid, FBIOGET_VSCREENINFO, &v->var_info)) goto vs_fail;
+    /* Too many to keep, the bounding box will do. */
+    d[0] = rects[0];
+    x1 = d[0].x + d[0].width;
+    y1 = d[0].y + d[0].height;
+    for (i = 1; i < n; i++) {
+        if (rects[i].x < d[0].x) d[0].x = rects[i].x;
+        if (rects[i].y < d[0].y) d[0].y = rects[i].y;
+        if (rects[i].x + rects[i].width  > x1) x1 = rects[i].x + rects[i].width;
+        if (rects[i].y + rects[i].height > y1) y1 = rects[i].y + rects[i].height;
+    }
+    d[0].width  = x1 - d[0].x;
+    d[0].height = y1 - d[0].y;
+    v->ndamage[v->damage_pos] = 1;
+}
 
-	if (tcgetattr(STDIN_FILENO, &v->term_prev) != 0) goto vs_fail;
+/**
+ * Brings page "back" up to date with "buf_pixels" where "rects"
+ * (clipped, may be reordered) say it changed, plus whatever the
+ * presents since that page was last written changed.  The
+ * areas written are left in "written" and "nwritten" (valid
+ * until the next call), "written" is NULL if it was all of it.
+ * 
+ * \return Bytes copied.
+ **/ 
+static size_t video_update_back_page( VIDEO v, void *dst, void *buf_pixels, 
+                                      struct video_rect *rects, size_t n,
+                                      const struct video_rect **written, size_t *nwritten ) 
+{
+    struct video_rect   *all;
+    size_t              nall    = n;
+    int                 i,
+                        h;
+
+    *written    = 0;
+    *nwritten   = 0;
+
+    /* Anything older than nbuffers - 1 presents is already on this page */
+    for (i = 0; i < v->nbuffers - 1; i++) {
+        h = (v->damage_pos - i + VIDEO_MAX_BUFFERS) % VIDEO_MAX_BUFFERS;
+        if (v->ndamage[h] < 0) {
+            video_copy_frame(v, dst, buf_pixels);
+            return v->frame_bytes;
+        }
+        nall += v->ndamage[h];
+    }
 
-    v->term_curr = v->term_prev;
+    if (nall > v->page_cap) {
+        if (!(all = (struct video_rect *)realloc(v->page_rects, sizeof(struct video_rect) * nall))) {
+            video_copy_frame(v, dst, buf_pixels);
+            return v->frame_bytes;
+        }
+        v->page_rects   = all;
+        v->page_cap     = nall;
+    }
+    all = v->page_rects;
+
+    memcpy(all, rects, sizeof(struct video_rect) * n);
+    nall = n;
+    for (i = 0; i < v->nbuffers - 1; i++) {
+        h = (v->damage_pos - i + VIDEO_MAX_BUFFERS) % VIDEO_MAX_BUFFERS;
+        memcpy(&all[nall], v->damage[h], sizeof(struct video_rect) * v->ndamage[h]);
+        nall += v->ndamage[h];
+    }
 
-	v->term_curr.c_lflag &= (~ICANON & ~ECHO);
+    *written    = all;
+    *nwritten   = nall;
+    return video_copy_regions(v, dst, buf_pixels, all, nall);
+}
 
-	if (tcsetattr(STDIN_FILENO, TCSANOW, &v->term_curr) != 0) goto vs_fail;
+/**
+ * \return Non-zero if "p" points into our video memory.
+ **/ 
+static inline int video_in_vram( VIDEO v, const void *p ) {
+    return (const uint8_t *)p >= (const uint8_t *)v->ptr.ptr &&
+           (const uint8_t *)p <  (const uint8_t *)v->ptr.ptr + v->fix_info.smem_len;
+}
 
-    v->width  = v->var_info.xres_virtual;
-    v->height = v->var_info.yres_virtual;
-    v->px_count = v->width*v->height;
+/**
+ * Hashes every tile of "buf_pixels" and compares it with
+ * the last frame's.  Changed tiles next to each other in a
+ * row of tiles are merged into one rectangle in tile_rects.
+ * 
+ * \return The number of rectangles, ZERO if nothing changed,
+ * -1 if the whole frame should just be written (no previous
+ * frame to compare with, or most of it changed).
+ **/ 
+static long video_tile_diff( VIDEO v, const uint32_t *buf_pixels ) {
+    struct video_rect   *r = v->tile_rects;
+    uint32_t            lanes[8];
+    uint64_t            h,
+                        *th;
+    size_t              changed = 0;
+    long                n = 0;
+    int                 tx, ty, 
+                        x0, y0, 
+                        w, rows, 
+                        y, l,
+                        diff,
+                        run;
+
+    for (ty = 0; ty < v->tiles_y; ty++) {
+        y0      = ty * VIDEO_TILE_H;
+        rows    = ((size_t)y0 + VIDEO_TILE_H > v->height) ? (int)v->height - y0 : VIDEO_TILE_H;
+        th      = &v->tile_hash[(size_t)ty * v->tiles_x];
+        run     = -1;
+
+        /* One step past the last tile closes the last run */
+        for (tx = 0; tx <= v->tiles_x; tx++) {
+            diff = 0;
+            if (tx < v->tiles_x) {
+                x0  = tx * VIDEO_TILE_W;
+                w   = ((size_t)x0 + VIDEO_TILE_W > v->width) ? (int)v->width - x0 : VIDEO_TILE_W;
+
+                for (l = 0; l < 8; l++) lanes[l] = 0x811C9DC5u + l;
+                for (y = 0; y < rows; y++) {
+                    v->kern->hash(lanes, buf_pixels + (size_t)(y0 + y) * v->width + x0, w * sizeof(uint32_t));
+                }
+                for (h = 0xCBF29CE484222325ULL, l = 0; l < 8; l++) {
+                    h = (h ^ lanes[l]) * 0x100000001B3ULL;
+                }
+
+                if (!v->tile_valid || th[tx] != h) {
+                    th[tx]  = h;
+                    diff    = 1;
+                    changed++;
+                }
+            }
 
-    if (v->px_count % 2 == 0) v->px_count64 = v->px_count/2;
+            if (diff && run < 0) {
+                run = tx;
+            } else if (!diff && run >= 0) {
+                r->x        = run * VIDEO_TILE_W;
+                r->y        = y0;
+                r->width    = ((tx * VIDEO_TILE_W > (int)v->width) ? (int)v->width : tx * VIDEO_TILE_W) - r->x;
+                r->height   = rows;
+                r++;
+                n++;
+                run = -1;
+            }
+        }
+    }
 
-    if ( ((int)(v->ptr.ptr = 
-                mmap(0, 
-                    v->fix_info.smem_len, 
-                    PROT_READ | PROT_WRITE, MAP_SHARED, 
-                    v->fbid, 0))) == -1 ) 
-    {
-        goto vs_fail;
+    if (!v->tile_valid || changed * 2 > (size_t)v->tiles_x * v->tiles_y) {
+        v->tile_valid = 1;
+        return -1;
     }
-    v->pid = getpid();
-    video_monitor.used++;
+    return n;
+}
 
-    if ( !(v->mtx_prerender = video_mutex_create()) ) goto vs_fail_rstty;
+/**
+ * Brings the shadow up to date with a frame that was just
+ * written to video memory.  "rects" as for video_present_frame().
+ **/ 
+static void video_shadow_update( VIDEO v, const void *buf_pixels, 
+                                 const struct video_rect *rects, size_t n ) 
+{
+    const uint32_t  *src = (const uint32_t *)buf_pixels;
+    size_t          i;
+    int             y;
 
-    v->clrb.ptr = video_get_empty_buffer(v);
+    if (!v->shadow) return;
 
-    v->tty_fd = open("/dev/tty0", O_RDWR);
-    ioctl(v->tty_fd, KDSETMODE, KD_GRAPHICS);
+    if (video_in_vram(v, buf_pixels)) {
+        v->shadow_valid = 0;
+        return;
+    }
+    if (!rects || !v->shadow_valid) {
+        memcpy(v->shadow, src, v->buf_size);
+        v->shadow_valid = 1;
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        for (y = rects[i].y; y < rects[i].y + rects[i].height; y++) {
+            memcpy(v->shadow + (size_t)y * v->width + rects[i].x,
+                   src + (size_t)y * v->width + rects[i].x,
+                   rects[i].width * sizeof(uint32_t));
+        }
+    }
+}
 
-    v->active = 1;
+/**
+ * Hands a frame that was just presented to the recorder.  If
+ * "rects" isn't NULL only those "n" areas of it reached the
+ * screen.  Frames drawn in place are read from video memory,
+ * which only happens when it's ARGB8888.
+ **/ 
+static void video_record_present( VIDEO v, const void *buf_pixels, const struct video_rect *rects, size_t n ) {
+    if (!v->rec) return;
+
+    VTRACE_BEGIN("record", v->fbnum);
+    if (!video_in_vram(v, buf_pixels)) {
+        video_recorder_frame(v->rec, buf_pixels, v->width * sizeof(uint32_t), rects, n);
+    } else if (v->native) {
+        video_recorder_frame(v->rec, buf_pixels, v->fix_info.line_length, 0, 0);
+    } else {
+        __atomic_fetch_add(&v->rec->dropped, 1, __ATOMIC_RELAXED);
+    }
+    VTRACE_END("record", v->fbnum);
+}
 
-    goto vsdone;                /* Success, jump past error crap and be done. */
-    
-    /*------------------------ Error handling --------------------------------*/
+/**
+ * Ends a present: lets go of the display.
+ **/ 
+static inline void video_present_done( VIDEO v ) {
+    VTRACE_INSTANT("lock_release", v->fbnum);
+    video_unlock(v->mtx_prerender);
+    VTRACE_END("present", v->fbnum);
+}
 
-    vs_fail_rstty:
-	tcsetattr(STDIN_FILENO, TCSANOW, &v->term_prev);
+/**
+ * VBLANK wait for a present, timed and counted.
+ **/ 
+static int video_present_wait( VIDEO v ) {
+    struct video_perf_mark  m;
+    uint64_t                t0, 
+                            t1;
+    int                     rv;
+
+    VTRACE_BEGIN("vsync", v->fbnum);
+    VPERF_BEGIN(&v->perf, &m);
+    VSTAT_CLOCK(t0);
+    rv = video_wait_vsync(v);
+    t1 = video_pace_now();
+    VPERF_END(&v->perf, VIDEO_PHASE_VSYNC, &m);
+    VTRACE_END("vsync", v->fbnum);
+
+    if (rv != 0) {
+        fprintf(stderr, "libvideo/video_submit_frame(): ERROR - FBIO_WAITFORVSYNC failed.\n");
+        return rv;
+    }
+    video_pace_vblank(&v->pace, t1);
+    v->vblank_ns = t1;
+    VSTAT_RECORD(&v->stats, vsync_wait, t1 - t0);
+    return 0;
+}
 
-    vs_fail:
-    memset(v, 0, sizeof(struct video_setup));
-    v = 0;      /* The last statement of our error handling sections. */
+/**
+ * When the VBLANK after "now" should come, from the pace
+ * kept so far; "now" if there's none yet.
+ **/ 
+static uint64_t video_next_vblank( VIDEO v, uint64_t now ) {
+    struct video_pace_stats ps;
 
-    vsdone:
-    video_unlock(video_monitor.vmutex);
-    return v;
+    video_pace_get_stats(&v->pace, &ps);
+    if (!ps.period_ns || !ps.vblank_ns || ps.vblank_ns > now) return now;
+    return ps.vblank_ns + ((now - ps.vblank_ns) / ps.period_ns + 1) * ps.period_ns;
 }
 
-int video_get_width( VIDEO v ) {
-    return v->var_info.xres_virtual;
+/**
+ * A frame was submitted.  The latency hook isn't locked,
+ * video_latency_close() is made from the submitting thread.
+ **/ 
+static inline void video_frame_submitted( VIDEO v ) {
+    struct video_latency    *l;
+
+    video_pace_submit(&v->pace);
+    if ((l = __atomic_load_n(&v->lat, __ATOMIC_ACQUIRE))) video_latency_submitted(l);
 }
 
-int video_get_height( VIDEO v ) {
-    return v->var_info.yres_virtual;
+/**
+ * The present that started at "start" is on the screen from
+ * "shown" (ZERO = now), lock held.
+ **/ 
+static inline void video_present_shown( VIDEO v, uint64_t start, uint64_t shown ) {
+    if (v->lat) video_latency_shown(v->lat, start, shown ? shown : video_pace_now());
 }
 
 /**
- * This function is called when a buffer has pixel
- * color data i.e. has been drawn on by an application,
- * and is ready to be rendered to the monitor.
+ * Puts "buf_pixels" on the screen at the next VBLANK and
+ * returns once that's done.  This is the whole job when
+ * there's no presenter thread, and what the presenter
+ * thread calls when there is.
+ * 
+ * If "rects" isn't NULL, only those "n" (clipped) areas of
+ * the frame have changed since the last present.
  * 
- * It copies the given data to the video system's
- * "pre-render" buffer and signals the video system
- * that it has fresh data to render.
+ * Without "wait" (video_present_nowait()) nothing waits for
+ * VBLANK: the frame is copied now, or the pan queued.
  * 
+ * \return The number of bytes written to video memory.
  **/ 
-void video_submit_frame( VIDEO v, void *buf_pixels ) {
-    int                 i       = 0,
-			ioc_ctl = 0;
-    union px_pointer    src;
-    
-    if (!v->active) {
-        fprintf(stderr, "libvideo/video_submit_frame(): ERROR - Video not active\n");
-        return;
+static size_t video_present_frame( VIDEO v, void *buf_pixels, 
+                                   struct video_rect *rects, size_t n, int wait ) 
+{
+    struct video_perf_mark  m;
+    const struct video_rect *written = 0;       /* What reached the back page, NULL for all of it */
+    int                     back;
+    void                    *dst;
+    size_t                  copied = 0,
+                            nwritten = 0;
+    long                    nt;
+    uint64_t                start = __atomic_load_n(&v->lat, __ATOMIC_RELAXED) ? video_pace_now() : 0,
+                            t0, 
+                            t1;
+
+    VTRACE_BEGIN("present", v->fbnum);
+    VTRACE_BEGIN("lock_wait", v->fbnum);
+    VSTAT_CLOCK(t0);
+    video_lock(v->mtx_prerender);
+    VSTAT_CLOCK(t1);
+    VTRACE_END("lock_wait", v->fbnum);
+    VSTAT_RECORD(&v->stats, lock_wait, t1 - t0);
+
+    /**
+     * Change detection: only write the tiles that are different
+     * from the last frame.  Frames already in video memory were
+     * drawn in place (and are slow to read), and regions from the
+     * caller say for themselves what changed; either way we no 
+     * longer know what's on screen.
+     **/ 
+    if (v->tile_hash) {
+        if (rects || video_in_vram(v, buf_pixels)) {
+            v->tile_valid = 0;
+        } else if (!(nt = video_tile_diff(v, (const uint32_t *)buf_pixels))) {
+            VTRACE_INSTANT("unchanged", v->fbnum);
+            VSTAT_COUNT(&v->stats, frames_unchanged, 1);
+
+            /* Nothing to write or flip, but keep the caller's pace */
+            if (!wait) {
+                VSTAT_PRESENTED(&v->stats, 0);
+                video_present_shown(v, start, 0);
+            } else if (!video_present_wait(v)) {
+                VSTAT_PRESENTED(&v->stats, 0);
+                video_present_shown(v, start, v->vblank_ns);
+            }
+            video_present_done(v);
+            return 0;
+        } else if (nt > 0) {
+            rects   = v->tile_rects;
+            n       = nt;
+        }
     }
 
-    src.ptr = buf_pixels;
+    if (v->nbuffers > 1) {
+        /**
+         * Page flipping.  The back page isn't being scanned out
+         * so we can fill it without waiting on anything, then
+         * pan to it.
+         **/ 
+        back    = (v->front + 1) % v->nbuffers;
+        dst     = video_page_ptr(v, back);
+
+        if (buf_pixels != dst) {
+            VTRACE_BEGIN("copy", v->fbnum);
+            VPERF_BEGIN(&v->perf, &m);
+            if (rects) {
+                copied = video_update_back_page(v, dst, buf_pixels, rects, n, &written, &nwritten);
+            } else {
+                video_copy_frame(v, dst, buf_pixels);
+                copied = v->frame_bytes;
+            }
+            VPERF_END(&v->perf, VIDEO_PHASE_COPY, &m);
+            VTRACE_END("copy", v->fbnum);
+            VSTAT_CLOCK(t0);
+            VSTAT_RECORD(&v->stats, copy, t0 - t1);
+        }
+        video_shadow_update(v, buf_pixels, rects, n);
+        video_record_damage(v, (buf_pixels != dst) ? rects : 0, n);
 
-    video_lock(v->mtx_prerender);
+        /**
+         * With three pages the previous flip may still be pending,
+         * let it land before queueing this one.  The page we just
+         * drew on is the one that was displayed two flips ago.
+         **/ 
+        if (wait && v->nbuffers > 2 && video_present_wait(v) != 0) {
+            video_present_done(v);
+            return copied;
+        }
 
-    if (ioctl(v->fbid, FBIO_WAITFORVSYNC, &ioc_ctl) != 0) {
-        fprintf(stderr, "libvideo/video_submit_frame(): ERROR - FBIO_WAITFORVSYNC failed.\n");
-        video_unlock(v->mtx_prerender);
-        return;
+        if (video_pan(v, back) != 0) {
+            fprintf(stderr, "libvideo/video_submit_frame(): ERROR - FBIOPAN_DISPLAY failed.\n");
+            video_present_done(v);
+            return copied;
+        }
+        v->front = back;
+        v->flips++;
+        v->pan_pending  = !wait;
+        v->pan_vblank   = video_vsync_count(v);
+        VTRACE_INSTANT("flip", v->fbnum);
+        VSTAT_PRESENTED(&v->stats, copied);
+        video_record_present(v, buf_pixels, written, nwritten);
+
+        /**
+         * Double buffered, the page we're leaving becomes the next
+         * back page so it must be off the screen before we return.
+         **/ 
+        if (wait && v->nbuffers == 2 && !video_present_wait(v)) {
+            video_present_shown(v, start, v->vblank_ns);
+        } else if (v->lat) {
+            video_present_shown(v, start, video_next_vblank(v, video_pace_now()));
+        }
+
+        video_present_done(v);
+        return copied;
+    }
+
+    if (wait && video_present_wait(v) != 0) {
+        video_present_done(v);
+        return 0;
     }
 
-    if (v->px_count64) {
-        for (i = 0; i < v->px_count64; i++)
-            v->ptr.ptr64[i] = src.ptr64[i];
+    VSTAT_CLOCK(t1);
+    VTRACE_BEGIN("copy", v->fbnum);
+    VPERF_BEGIN(&v->perf, &m);
+    if (rects) {
+        copied = video_copy_regions(v, video_page_ptr(v, 0), buf_pixels, rects, n);
     } else {
-        for (i = 0; i < v->px_count; i++)
-            v->ptr.ptr32[i] = src.ptr32[i];
+        video_copy_frame(v, video_page_ptr(v, 0), buf_pixels);
+        copied = v->frame_bytes;
     }
-    video_unlock(v->mtx_prerender);
+    VPERF_END(&v->perf, VIDEO_PHASE_COPY, &m);
+    VTRACE_END("copy", v->fbnum);
+    VSTAT_CLOCK(t0);
+    VSTAT_RECORD(&v->stats, copy, t0 - t1);
+    VSTAT_PRESENTED(&v->stats, copied);
+    video_shadow_update(v, buf_pixels, rects, n);
+    video_record_present(v, buf_pixels, rects, n);
+    video_present_shown(v, start, 0);
+
+    video_present_done(v);
+    return copied;
 }
 
-size_t video_get_req_buffer_size( VIDEO v ) {
-    return v->fix_info.smem_len;
-}
+/**
+ * \return The display's refresh period in nanoseconds worked
+ * out from the mode's timings, or ZERO if the driver doesn't
+ * fill them in.
+ **/ 
+static uint64_t video_refresh_ns( VIDEO v ) {
+    const struct fb_var_screeninfo *m = &v->var_info;
+    uint64_t                        htotal,
+                                    vtotal;
 
-size_t video_get_stride_pitch( VIDEO v ) {
-    return v->fix_info.line_length;
-}
+    if (v->headless) return (v->be.vsync_ns > 0) ? (uint64_t)v->be.vsync_ns : 0;
+    if (!m->pixclock) return 0;
 
-void *video_get_empty_buffer( VIDEO v ) {
-    return calloc(1, v->fix_info.smem_len);
+    htotal = (uint64_t)m->xres + m->left_margin + m->right_margin + m->hsync_len;
+    vtotal = (uint64_t)m->yres + m->upper_margin + m->lower_margin + m->vsync_len;
+
+    /* pixclock is picoseconds per pixel */
+    return ((uint64_t)m->pixclock * htotal * vtotal) / 1000;
 }
 
-void video_set_screen_color( VIDEO v, uint32_t color) {
-    int         i = 0;
-    uint64_t    c;
-    if (v->px_count64 > 0) {
-        c = (color << 24 | color);
-        for (; i < v->px_count64; i++)
-            v->clrb.ptr64[i] = c;
-    } else {
-        for (; i < v->px_count; i++)
-            v->clrb.ptr32[i] = color;
+/**
+ * Presenter thread.  Sleeps until a frame is published, swaps
+ * the newest one out of the mailbox and presents it.  On the
+ * way out it presents whatever was submitted last so that the
+ * final frame before video_stop() isn't lost.
+ **/ 
+static void *video_presenter( void *arg ) {
+    VIDEO   v = (VIDEO)arg;
+    int     mid;
+
+    for (;;) {
+        while (sem_wait(&v->pres_sem) != 0 && errno == EINTR);
+
+        if (atomic_load_explicit(&v->slot_mid, memory_order_relaxed) & VIDEO_SLOT_FRESH) {
+            mid = atomic_exchange_explicit(&v->slot_mid, v->slot_rd, memory_order_acq_rel);
+            v->slot_rd = mid & ~VIDEO_SLOT_FRESH;
+            video_present_frame(v, v->slots[v->slot_rd], 0, 0, 1);
+        }
+
+        if (!v->pres_running) break;
     }
-    video_submit_frame(v, v->clrb.ptr);
+    return 0;
 }
 
-void video_screen_white( VIDEO v ) {
-    video_set_screen_color(v, 0xFFFFFFFF);
-}
+/**
+ * Allocates the mailbox and starts the presenter.  Asks for
+ * SCHED_FIFO if a priority was given and pins the thread if
+ * a CPU mask was given.  Neither is fatal: without privileges
+ * we carry on with the default policy and say so.
+ * 
+ * \return ZERO on success.
+ **/ 
+static int video_start_presenter( VIDEO v, const struct video_options *opts ) {
+    pthread_attr_t      attr;
+    struct sched_param  sp;
+    cpu_set_t           cpus;
+    int                 i,
+                        rv;
+
+    for (i = 0; i < 3; i++) {
+        if (posix_memalign(&v->slots[i], 64, v->buf_size)) goto vsp_fail;
+        memset(v->slots[i], 0, v->buf_size);
+    }
+    v->slot_wr = 0;
+    atomic_init(&v->slot_mid, 1);
+    v->slot_rd = 2;
+
+    if (sem_init(&v->pres_sem, 0, 0)) goto vsp_fail;
+
+    v->pres_running = 1;
+
+    rv = -1;
+    if (opts->presenter_priority > 0) {
+        pthread_attr_init(&attr);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = opts->presenter_priority;
+        pthread_attr_setschedparam(&attr, &sp);
+        rv = pthread_create(&v->presenter, &attr, &video_presenter, v);
+        pthread_attr_destroy(&attr);
+        if (rv) {
+            fprintf(stderr, "libvideo/video_start(): WARNING - SCHED_FIFO presenter refused (%s), using default policy.\n", strerror(rv));
+        }
+    }
+    if (rv && pthread_create(&v->presenter, 0, &video_presenter, v)) {
+        sem_destroy(&v->pres_sem);
+        goto vsp_fail;
+    }
 
-void video_clear_screen( VIDEO v ) {
-    int i = 0;
-    if (v->px_count64 > 0) {
-        for (; i < v->px_count64; i++)
-            v->clrb.ptr64[i] = 0;
+    pthread_setname_np(v->presenter, "vid-present");
+
+    if (opts->presenter_cpus) {
+        CPU_ZERO(&cpus);
+        for (i = 0; i < sizeof(opts->presenter_cpus) * 8 && i < CPU_SETSIZE; i++) {
+            if (opts->presenter_cpus & (1UL << i)) CPU_SET(i, &cpus);
+        }
+        if ((rv = pthread_setaffinity_np(v->presenter, sizeof(cpus), &cpus))) {
+            fprintf(stderr, "libvideo/video_start(): WARNING - Could not pin presenter thread (%s).\n", strerror(rv));
+        }
+    }
+    return 0;
+
+    vsp_fail:
+    v->pres_running = 0;
+    for (i = 0; i < 3; i++) {
+        free(v->slots[i]);
+        v->slots[i] = 0;
+    }
+    return -1;
+}
+
+static void video_stop_presenter( VIDEO v ) {
+    int i;
+
+    v->pres_running = 0;
+    sem_post(&v->pres_sem);
+    pthread_join(v->presenter, 0);
+    sem_destroy(&v->pres_sem);
+    for (i = 0; i < 3; i++) {
+        free(v->slots[i]);
+        v->slots[i] = 0;
+    }
+}
+
+/**
+ * Waiter thread for video_get_vsync_fd(): one event per
+ * VBLANK, which also feeds frame pacing.
+ **/ 
+static void *video_vsync_waiter( void *arg ) {
+    VIDEO       v = (VIDEO)arg;
+    uint64_t    one = 1,
+                t;
+
+    while (atomic_load_explicit(&v->vs_running, memory_order_relaxed)) {
+        if (video_wait_vsync(v)) {
+            fprintf(stderr, "libvideo/video_get_vsync_fd(): ERROR - FBIO_WAITFORVSYNC failed, no more VBLANK events.\n");
+            break;
+        }
+        t = video_pace_now();
+        VTRACE_INSTANT("vblank", v->fbnum);
+        __atomic_store_n(&v->vs_ts, t, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&v->vs_count, 1, __ATOMIC_RELEASE);
+        video_pace_vblank(&v->pace, t);
+        if (write(v->vs_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) break;
+    }
+    return 0;
+}
+
+/**
+ * Sets up VBLANK events, lock held.  "probe" is what a
+ * FBIO_WAITFORVSYNC returned.
+ * 
+ * \return ZERO, -1 with errno set.
+ **/ 
+static int video_vsync_open( VIDEO v, int probe ) {
+    struct video_pace_stats ps;
+    struct itimerspec       its;
+    uint64_t                now;
+    int                     rv;
+
+    if (!probe) {
+        if ((v->vs_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) return -1;
+        atomic_store(&v->vs_running, 1);
+        if ((rv = pthread_create(&v->vs_thread, 0, &video_vsync_waiter, v))) {
+            close(v->vs_fd);
+            errno = rv;
+            return -1;
+        }
+        pthread_setname_np(v->vs_thread, "vid-vsync");
+        v->vs_mode = VIDEO_VSYNC_THREAD;
+        return 0;
+    }
+
+    /**
+     * No VBLANK from the driver: tick at the refresh rate, in
+     * phase with the last VBLANK seen if there ever was one.
+     **/ 
+    video_pace_get_stats(&v->pace, &ps);
+    if (!(v->vs_period = ps.period_ns ? ps.period_ns : video_refresh_ns(v))) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    now = video_pace_now();
+    v->vs_t0 = now + v->vs_period;
+    if (ps.vblank_ns && ps.vblank_ns <= now) {
+        v->vs_t0 = ps.vblank_ns + ((now - ps.vblank_ns) / v->vs_period + 1) * v->vs_period;
+    }
+    v->vs_read = 0;
+
+    if ((v->vs_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) return -1;
+    its.it_value.tv_sec     = (time_t)(v->vs_t0 / 1000000000ULL);
+    its.it_value.tv_nsec    = (long)(v->vs_t0 % 1000000000ULL);
+    its.it_interval.tv_sec  = (time_t)(v->vs_period / 1000000000ULL);
+    its.it_interval.tv_nsec = (long)(v->vs_period % 1000000000ULL);
+    if (timerfd_settime(v->vs_fd, TFD_TIMER_ABSTIME, &its, 0)) {
+        close(v->vs_fd);
+        return -1;
+    }
+    fprintf(stderr, "libvideo/video_get_vsync_fd(): WARNING - No FBIO_WAITFORVSYNC, VBLANK events from a timer.\n");
+    v->vs_mode = VIDEO_VSYNC_TIMER;
+    return 0;
+}
+
+static void video_vsync_close( VIDEO v ) {
+    if (v->vs_mode == VIDEO_VSYNC_THREAD) {
+        atomic_store(&v->vs_running, 0);
+        pthread_join(v->vs_thread, 0);
+    }
+    if (v->vs_mode != VIDEO_VSYNC_NONE) close(v->vs_fd);
+    v->vs_mode = VIDEO_VSYNC_NONE;
+}
+
+/**
+ * A signal handler can't take the lock, so the list is read
+ * with atomic loads (its length first: the list grows before
+ * its length does) and every display this process has open
+ * is marked stopped with an atomic store.
+ **/ 
+void vtsig( int signum ) {
+    VIDEO   *list,
+            v;
+    size_t  i, n;
+    pid_t   pid;
+
+    if (signum == SIGHUP) {
+        pid  = getpid();
+        n    = __atomic_load_n(&video_monitor.count, __ATOMIC_ACQUIRE);
+        list = __atomic_load_n(&video_monitor.video_list, __ATOMIC_ACQUIRE);
+        for (i = 0; i < n; i++) {
+            v = __atomic_load_n(&list[i], __ATOMIC_ACQUIRE);
+            if (v && v->pid == pid) __atomic_store_n(&v->active, 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void video_stop( VIDEO v ) {
+    size_t  i = 0;
+
+    if (v->fbid <= 0 || !v->active) return;
+
+    /* Stopping (active 2) keeps anyone else from stopping it too */
+    video_lock(video_monitor.vmutex);
+    for (; i < video_monitor.count; i++) {
+        if (v->active == 1 && v == video_monitor.video_list[i]) {
+            v->active = 2;
+            goto vsid_found;
+        }
+    }
+    video_unlock(video_monitor.vmutex);
+    return;
+
+    vsid_found:
+    video_unlock(video_monitor.vmutex);
+
+    /**
+     * Shut down rendering/timing thread.  It presents one last
+     * frame on the way out, so before anything it uses is freed.
+     **/ 
+    if (v->slots[0]) video_stop_presenter(v);
+
+    video_vsync_close(v);
+
+    if (v->rec) video_recorder_stop(v->rec);
+    __atomic_store_n(&v->lat, 0, __ATOMIC_RELEASE);
+
+    free(v->clrb.ptr);
+    free(v->row_buf);
+    free(v->acq_buf);
+    free(v->tile_hash);
+    free(v->tile_rects);
+    free(v->page_rects);
+    free(v->shadow);
+    video_pool_destroy(&v->pool);
+    video_pace_destroy(&v->pace);
+
+    v->active = 0;
+
+    /** 
+     * Rendering thread for this display is down.  
+     * clear everything up.
+     * 
+     **/ 
+    video_backend_unmap(&v->be, v->ptr.ptr, v->fix_info.smem_len);
+
+    if (v->nbuffers > 1) video_backend_ioctl(&v->be, FBIOPUT_VSCREENINFO, &v->var_orig);
+
+    video_backend_close(&v->be);
+
+    if (!v->headless) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &v->term_prev);
+
+        ioctl(v->tty_fd, KDSETMODE, KD_TEXT);
+
+        close(v->tty_fd);
+    }
+
+    video_mutex_destroy(&v->mtx_prerender);
+
+    video_perf_close(&v->perf);
+
+    /* Clear the structure, which gives the slot back */
+    video_lock(video_monitor.vmutex);
+    memset(v, 0, sizeof(struct video_setup));
+    video_monitor.used--;
+    video_unlock(video_monitor.vmutex);
+}
+
+VIDEO video_start( int nframebuffer ) {
+    return video_start_ex(nframebuffer, 0);
+}
+
+VIDEO video_start_ex( int nframebuffer, const struct video_options *opts ) {
+    size_t  i;
+    VIDEO   *swap,
+            v;
+    char    fb_file_path[50];   /* <--- Any changes, pay attention to this.  Only _50_ */
+
+    if ((!opts || !opts->headless) && (nframebuffer < 0 || nframebuffer > 100)) {
+        /**
+         * Sorry, I'm not writing this for over
+         * 100 screens or for if you don't have
+         * a screen but intend to buy one later...
+         **/ 
+        errno = EINVAL;
+        return 0;
+    }
+
+    sprintf(fb_file_path, FB_FS_LOCATION, nframebuffer);
+
+    /**
+     * Take a slot: a free display, or a new one.  Its pid marks
+     * it taken, then the lock is let go while the device is
+     * opened so other displays can start and stop meanwhile.
+     **/ 
+    video_lock(video_monitor.vmutex);
+    v = 0;
+    for (i = 0; i < video_monitor.count; i++) {
+        if (!video_monitor.video_list[i]) {
+            if (!(v = (VIDEO)calloc(1, sizeof(struct video_setup)))) break;
+            __atomic_store_n(&video_monitor.video_list[i], v, __ATOMIC_RELEASE);
+            v = 0;
+        }
+        if (video_monitor.video_list[i]->pid == 0) {
+            v = video_monitor.video_list[i];
+            break;
+        }
+    }
+    if (!v && i == video_monitor.count) {
+        swap = (VIDEO *)realloc(video_monitor.video_list, sizeof(VIDEO) * (video_monitor.count + 10));
+        if (swap) {
+            memset(&swap[video_monitor.count], 0, sizeof(VIDEO) * 10);
+            __atomic_store_n(&video_monitor.video_list, swap, __ATOMIC_RELEASE);
+            __atomic_store_n(&video_monitor.count, video_monitor.count + 10, __ATOMIC_RELEASE);
+            v = (VIDEO)calloc(1, sizeof(struct video_setup));
+            __atomic_store_n(&swap[i], v, __ATOMIC_RELEASE);
+        }
+    }
+    if (!v) {
+        errno = ENOMEM;
+        video_unlock(video_monitor.vmutex);
+        return 0;
+    }
+    v->pid = getpid();
+    video_unlock(video_monitor.vmutex);
+
+    if (opts && opts->headless) {
+        v->headless = 1;
+        if (video_backend_open_headless(&v->be, opts->headless)) goto vs_fail;
+    } else {
+        if (video_backend_open_fbdev(&v->be, fb_file_path)) goto vs_fail;
+    }
+    v->fbid = v->be.fd;
+    v->fbnum = nframebuffer;
+
+    if (video_backend_ioctl(&v->be, FBIOGET_FSCREENINFO, &v->fix_info)) goto vs_fail;
+
+    if (video_backend_ioctl(&v->be, FBIOGET_VSCREENINFO, &v->var_info)) goto vs_fail;
+
+    v->var_orig = v->var_info;
+
+    if (!v->headless) {
+        if (tcgetattr(STDIN_FILENO, &v->term_prev) != 0) goto vs_fail;
+
+        v->term_curr = v->term_prev;
+
+        v->term_curr.c_lflag &= (~ICANON & ~ECHO);
+
+        if (tcsetattr(STDIN_FILENO, TCSANOW, &v->term_curr) != 0) goto vs_fail;
+    }
+
+    v->nbuffers = 1;
+    if (opts && opts->buffers > 1) v->nbuffers = video_setup_flip(v, opts->buffers);
+
+    if (video_format_init(&v->fmt, &v->var_info, opts ? opts->dither : 0)) {
+        errno = ENOTSUP;
+        goto vs_fail_rsmode;
+    }
+
+    v->width  = v->var_info.xres;
+    v->height = v->var_info.yres;
+    v->px_count     = v->width*v->height;
+    v->buf_size     = v->px_count * sizeof(uint32_t);
+    v->frame_bytes  = v->px_count * v->fmt.bytespp;
+    v->native       = (v->fmt.id == VIDEO_FMT_XRGB8888);
+    v->direct       = (v->native && v->fix_info.line_length == v->width * sizeof(uint32_t));
+
+    if (v->nbuffers > 1) {
+        v->page_size    = v->fix_info.line_length * v->height;
+        v->front        = v->var_info.yoffset / v->var_info.yres;
+        for (i = 0; i < VIDEO_MAX_BUFFERS; i++) v->ndamage[i] = -1;
+    } else {
+        v->origin       = (v->var_info.yoffset * v->fix_info.line_length) + 
+                          (v->var_info.xoffset * v->fmt.bytespp);
+    }
+
+    if ( !(v->row_buf = malloc(v->fix_info.line_length + sizeof(uint32_t))) ) goto vs_fail_rsmode;
+
+    if (video_pool_init(&v->pool, v->buf_size, opts ? opts->pool_flags : 0, opts ? opts->pool_buffers : 0)) {
+        goto vs_fail_rsmode;
+    }
+
+    if (opts && opts->tile_diff) {
+        v->tiles_x      = (v->width + VIDEO_TILE_W - 1) / VIDEO_TILE_W;
+        v->tiles_y      = (v->height + VIDEO_TILE_H - 1) / VIDEO_TILE_H;
+        v->tile_hash    = (uint64_t *)calloc((size_t)v->tiles_x * v->tiles_y, sizeof(uint64_t));
+        v->tile_rects   = (struct video_rect *)malloc((size_t)v->tiles_x * v->tiles_y * sizeof(struct video_rect));
+        if (!v->tile_hash || !v->tile_rects) goto vs_fail_rsmode;
+    }
+
+    if (opts && opts->shadow) {
+        if (posix_memalign((void **)&v->shadow, 64, v->buf_size)) {
+            v->shadow = 0;
+            goto vs_fail_rsmode;
+        }
+    }
+
+    v->kern = video_kernels_select(opts ? opts->kernels : 0);
+
+#ifndef VIDEO_NO_STATS
+    v->stats.refresh_ns = video_refresh_ns(v);
+#endif
+    video_pace_init(&v->pace, video_refresh_ns(v), opts ? opts->pace_margin_us * 1000ULL : 0);
+
+    if ( (v->ptr.ptr = video_backend_map(&v->be, v->fix_info.smem_len)) == MAP_FAILED ) {
+        goto vs_fail_rsmode;
+    }
+
+    if (v->nbuffers > 1 && video_pan(v, v->front)) {
+        video_backend_unmap(&v->be, v->ptr.ptr, v->fix_info.smem_len);
+        goto vs_fail_rsmode;
+    }
+    if ( !(v->mtx_prerender = video_mutex_create()) ) goto vs_fail_rsmode;
+
+    v->clrb.ptr = video_get_empty_buffer(v);
+
+    if (!v->headless) {
+        v->tty_fd = open("/dev/tty0", O_RDWR);
+        ioctl(v->tty_fd, KDSETMODE, KD_GRAPHICS);
+    }
+
+    v->active = 1;
+
+    if (opts && opts->perf_counters) video_perf_init(&v->perf);
+
+    if (opts && opts->presenter && video_start_presenter(v, opts)) {
+        fprintf(stderr, "libvideo/video_start(): WARNING - Presenter thread failed to start, presenting synchronously.\n");
+    }
+
+    video_lock(video_monitor.vmutex);
+    video_monitor.used++;
+    goto vsdone;                /* Success, jump past error crap and be done. */
+    
+    /*------------------------ Error handling --------------------------------*/
+
+    vs_fail_rsmode:
+    if (v->nbuffers > 1) video_backend_ioctl(&v->be, FBIOPUT_VSCREENINFO, &v->var_orig);
+    free(v->row_buf);
+    free(v->tile_hash);
+    free(v->tile_rects);
+    free(v->shadow);
+    if (v->pool.size) video_pool_destroy(&v->pool);
+    if (v->pace.margin_ns) video_pace_destroy(&v->pace);
+
+    if (!v->headless) tcsetattr(STDIN_FILENO, TCSANOW, &v->term_prev);
+
+    vs_fail:
+    if (v->be.ops && v->be.fd >= 0) video_backend_close(&v->be);
+    video_lock(video_monitor.vmutex);
+    memset(v, 0, sizeof(struct video_setup));
+    v = 0;      /* The last statement of our error handling sections. */
+
+    vsdone:
+    video_unlock(video_monitor.vmutex);
+    return v;
+}
+
+int video_get_width( VIDEO v ) {
+    return v->width;
+}
+
+int video_get_height( VIDEO v ) {
+    return v->height;
+}
+
+int video_get_bpp( VIDEO v ) {
+    return v->var_info.bits_per_pixel;
+}
+
+const char *video_get_pixel_format( VIDEO v ) {
+    if (!video_is_active(v)) return 0;
+    return video_format_name(&v->fmt);
+}
+
+int video_get_buffer_count( VIDEO v ) {
+    if (!video_is_active(v)) return 0;
+    return v->nbuffers;
+}
+
+void *video_get_back_buffer( VIDEO v ) {
+    if (!video_is_active(v)) return 0;
+    VTRACE_INSTANT("acquire", v->fbnum);
+    if (v->slots[0]) return v->slots[v->slot_wr];
+    if (v->nbuffers < 2 || !v->direct) return 0;
+    return video_page_ptr(v, (v->front + 1) % v->nbuffers);
+}
+
+int video_acquire_back_buffer( VIDEO v, struct video_frame *frame ) {
+    if (!frame || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    VTRACE_INSTANT("acquire", v->fbnum);
+
+    memset(frame, 0, sizeof(*frame));
+    frame->width    = v->width;
+    frame->height   = v->height;
+
+    video_lock(v->mtx_prerender);
+    if (!v->slots[0] && v->nbuffers > 1 && v->native) {
+        frame->pixels   = (uint32_t *)video_page_ptr(v, (v->front + 1) % v->nbuffers);
+        frame->stride   = v->fix_info.line_length;
+        frame->scanout  = 1;
+        frame->seq      = v->flips;
+        video_unlock(v->mtx_prerender);
+        return 0;
+    }
+
+    if (v->slots[0]) {
+        frame->pixels = (uint32_t *)v->slots[v->slot_wr];
+    } else {
+        if (!v->acq_buf && posix_memalign(&v->acq_buf, 64, v->buf_size)) {
+            v->acq_buf = 0;
+            video_unlock(v->mtx_prerender);
+            errno = ENOMEM;
+            return -1;
+        }
+        frame->pixels = (uint32_t *)v->acq_buf;
+    }
+    frame->stride = v->width * sizeof(uint32_t);
+    video_unlock(v->mtx_prerender);
+    return 0;
+}
+
+int video_present( VIDEO v, struct video_frame *frame ) {
+    void    *pixels;
+
+    if (!frame || !frame->pixels || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    pixels          = frame->pixels;
+    frame->pixels   = 0;
+
+    if (v->slots[0]) {
+        video_submit_frame(v, pixels);
+        return 0;
+    }
+    video_frame_submitted(v);
+
+    /**
+     * Take the lock before looking at the page so nothing can
+     * flip between the check and our present (it's recursive,
+     * video_present_frame() takes it again).
+     **/ 
+    video_lock(v->mtx_prerender);
+    if (frame->scanout && (frame->seq != v->flips || 
+                           pixels != video_page_ptr(v, (v->front + 1) % v->nbuffers))) 
+    {
+        video_unlock(v->mtx_prerender);
+        fprintf(stderr, "libvideo/video_present(): ERROR - Display presented since the frame was acquired.\n");
+        errno = ESTALE;
+        return -1;
+    }
+    video_present_frame(v, pixels, 0, 0, 1);
+    video_unlock(v->mtx_prerender);
+    return 0;
+}
+
+/**
+ * This function is called when a buffer has pixel
+ * color data i.e. has been drawn on by an application,
+ * and is ready to be rendered to the monitor.
+ * 
+ * Without a presenter thread it presents the frame
+ * itself.  With one, it copies the frame into the
+ * mailbox (unless the app drew right in it), publishes
+ * it and wakes the presenter.
+ * 
+ **/ 
+void video_submit_frame( VIDEO v, void *buf_pixels ) {
+    int     mid;
+
+    if (!v->active) {
+        fprintf(stderr, "libvideo/video_submit_frame(): ERROR - Video not active\n");
+        return;
+    }
+    video_frame_submitted(v);
+
+    if (!v->slots[0]) {
+        video_present_frame(v, buf_pixels, 0, 0, 1);
+        return;
+    }
+
+    VTRACE_INSTANT("submit", v->fbnum);
+    if (buf_pixels != v->slots[v->slot_wr]) {
+        VTRACE_BEGIN("copy_slot", v->fbnum);
+        v->kern->copy(v->slots[v->slot_wr], buf_pixels, v->buf_size);
+        VTRACE_END("copy_slot", v->fbnum);
+    }
+    mid = atomic_exchange_explicit(&v->slot_mid, v->slot_wr | VIDEO_SLOT_FRESH, memory_order_acq_rel);
+    v->slot_wr = mid & ~VIDEO_SLOT_FRESH;
+    if (mid & VIDEO_SLOT_FRESH) VSTAT_COUNT(&v->stats, frames_replaced, 1);
+    sem_post(&v->pres_sem);
+}
+
+/**
+ * Clips "rects" to the screen and presents the frame with
+ * only those areas changed.
+ * 
+ * \return Bytes written, -1 if out of memory.
+ **/ 
+static ssize_t video_present_clipped( VIDEO v, void *buf_pixels, const struct video_rect *rects, size_t nrects, int wait ) {
+    struct video_rect   stack_clip[VIDEO_DAMAGE_MAX],
+                        *clip   = stack_clip;
+    size_t              i,
+                        n       = 0;
+    ssize_t             copied;
+
+    if (nrects > VIDEO_DAMAGE_MAX) {
+        if (!(clip = (struct video_rect *)malloc(sizeof(struct video_rect) * nrects))) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    for (i = 0; i < nrects; i++) {
+        clip[n] = rects[i];
+        if (video_clip_rect(v, &clip[n])) n++;
+    }
+
+    copied = video_present_frame(v, buf_pixels, clip, n, wait);
+
+    if (clip != stack_clip) free(clip);
+    return copied;
+}
+
+ssize_t video_submit_regions( VIDEO v, void *buf_pixels, const struct video_rect *rects, size_t nrects ) {
+    if (!v || !v->active || !buf_pixels || (!rects && nrects)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /**
+     * The mailbox slots rotate and none of them knows what the
+     * others hold, so with a presenter the whole frame goes.
+     **/ 
+    if (v->slots[0]) {
+        video_submit_frame(v, buf_pixels);
+        return v->frame_bytes;
+    }
+    video_frame_submitted(v);
+
+    return video_present_clipped(v, buf_pixels, rects, nrects, 1);
+}
+
+ssize_t video_present_nowait( VIDEO v, void *buf_pixels, const struct video_rect *rects, size_t nrects ) {
+    ssize_t copied;
+
+    if (!v || !v->active || !buf_pixels || (!rects && nrects)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (v->slots[0]) {
+        video_submit_frame(v, buf_pixels);
+        return v->frame_bytes;
+    }
+    video_frame_submitted(v);
+
+    video_lock(v->mtx_prerender);
+
+    /* The page we'd draw on may still be on the screen */
+    if (v->pan_pending && v->vs_mode != VIDEO_VSYNC_NONE && video_vsync_count(v) == v->pan_vblank) {
+        video_unlock(v->mtx_prerender);
+        errno = EAGAIN;
+        return -1;
+    }
+    if (rects) {
+        copied = video_present_clipped(v, buf_pixels, rects, nrects, 0);
+    } else {
+        copied = (ssize_t)video_present_frame(v, buf_pixels, 0, 0, 0);
+    }
+    video_unlock(v->mtx_prerender);
+    return copied;
+}
+
+int video_get_vsync_fd( VIDEO v ) {
+    int probe,
+        fd;
+
+    if (!video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (v->vs_mode != VIDEO_VSYNC_NONE) return v->vs_fd;
+
+    /**
+     * A headless display with no refresh never waits, there'd
+     * be no end of events.  Otherwise see if the driver can
+     * wait for VBLANK (up to a frame), outside the lock so
+     * presents carry on meanwhile.
+     **/ 
+    if (v->headless && v->be.vsync_ns <= 0) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    probe = video_wait_vsync(v);
+
+    video_lock(v->mtx_prerender);
+    fd = -1;
+    if (v->vs_mode != VIDEO_VSYNC_NONE || !video_vsync_open(v, probe)) fd = v->vs_fd;
+    video_unlock(v->mtx_prerender);
+    return fd;
+}
+
+int video_read_vsync( VIDEO v, struct video_vsync *ev ) {
+    uint64_t    n,
+                count;
+
+    if (!ev || !video_is_active(v) || v->vs_mode == VIDEO_VSYNC_NONE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (read(v->vs_fd, &n, sizeof(n)) != sizeof(n)) return -1;
+
+    ev->elapsed = n;
+    if (v->vs_mode == VIDEO_VSYNC_THREAD) {
+        /* The time of the count we read, not of a newer VBLANK */
+        do {
+            count               = __atomic_load_n(&v->vs_count, __ATOMIC_ACQUIRE);
+            ev->timestamp_ns    = __atomic_load_n(&v->vs_ts, __ATOMIC_RELAXED);
+        } while (count != __atomic_load_n(&v->vs_count, __ATOMIC_ACQUIRE));
+        ev->count = count;
+    } else {
+        v->vs_read         += n;
+        ev->count           = v->vs_read;
+        ev->timestamp_ns    = v->vs_t0 + (v->vs_read - 1) * v->vs_period;
+    }
+    return 0;
+}
+
+size_t video_get_req_buffer_size( VIDEO v ) {
+    return v->buf_size;
+}
+
+void *video_get_raw_ptr( VIDEO v ) {
+    if (!video_is_active(v)) return 0;
+    return video_page_ptr(v, (v->nbuffers > 1) ? v->front : 0);
+}
+
+size_t video_get_stride_pitch( VIDEO v ) {
+    return v->fix_info.line_length;
+}
+
+void *video_get_empty_buffer( VIDEO v ) {
+    return calloc(1, v->buf_size);
+}
+
+void *video_buffer_acquire( VIDEO v ) {
+    if (!video_is_active(v)) return 0;
+    return video_pool_acquire(&v->pool);
+}
+
+void video_buffer_release( VIDEO v, void *buf ) {
+    if (!buf || !video_is_active(v)) return;
+    if (video_pool_release(&v->pool, buf)) {
+        fprintf(stderr, "libvideo/video_buffer_release(): ERROR - %p isn't an acquired buffer of this display.\n", buf);
+    }
+}
+
+int video_get_pool_stats( VIDEO v, struct video_pool_stats *st ) {
+    if (!st || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    video_pool_get_stats(&v->pool, st);
+    return 0;
+}
+
+int video_record_start( VIDEO v, const char *path, int queue_frames ) {
+    struct video_recorder   *r;
+    uint32_t                *screen;
+
+    if (!path || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(r = video_recorder_start(path, v->width, v->height, queue_frames))) {
+        fprintf(stderr, "libvideo/video_record_start(): ERROR - Couldn't start recording to %s (%s).\n", path, strerror(errno));
+        return -1;
+    }
+
+    video_lock(v->mtx_prerender);
+    if (v->rec) {
+        video_unlock(v->mtx_prerender);
+        video_recorder_stop(r);
+        errno = EBUSY;
+        return -1;
+    }
+    v->rec = r;
+
+    /**
+     * Frames from video_submit_regions() only change part of
+     * the screen, the recording starts from what's on it.
+     **/ 
+    if ((screen = (uint32_t *)malloc(v->buf_size))) {
+        if (!video_get_current_pixel_data(v, screen, v->buf_size)) {
+            video_recorder_frame(r, screen, v->width * sizeof(uint32_t), 0, 0);
+        }
+        free(screen);
+    }
+    video_unlock(v->mtx_prerender);
+    return 0;
+}
+
+int video_record_stop( VIDEO v ) {
+    struct video_recorder   *r;
+
+    if (!video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Once it's off the display no present can be using it */
+    video_lock(v->mtx_prerender);
+    r       = v->rec;
+    v->rec  = 0;
+    video_unlock(v->mtx_prerender);
+
+    if (!r) {
+        errno = EINVAL;
+        return -1;
+    }
+    video_recorder_stop(r);
+    return 0;
+}
+
+int video_latency_attach( VIDEO v, struct video_latency *l ) {
+    video_lock(v->mtx_prerender);
+    if (v->lat) {
+        video_unlock(v->mtx_prerender);
+        errno = EBUSY;
+        return -1;
+    }
+    __atomic_store_n(&v->lat, l, __ATOMIC_RELEASE);
+    video_unlock(v->mtx_prerender);
+    return 0;
+}
+
+void video_latency_detach( VIDEO v, struct video_latency *l ) {
+    if (!video_is_active(v)) return;
+    video_lock(v->mtx_prerender);
+    if (v->lat == l) __atomic_store_n(&v->lat, 0, __ATOMIC_RELEASE);
+    video_unlock(v->mtx_prerender);
+}
+
+int video_get_record_stats( VIDEO v, struct video_record_stats *st ) {
+    int rv = 0;
+
+    if (!st || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    video_lock(v->mtx_prerender);
+    if (v->rec) {
+        video_recorder_get_stats(v->rec, st);
     } else {
-        for (; i < v->px_count; i++)
-            v->clrb.ptr32[i] = 0;
+        errno = EINVAL;
+        rv = -1;
     }
-    video_submit_frame(v, v->clrb.ptr);
+    video_unlock(v->mtx_prerender);
+    return rv;
+}
+
+void video_set_screen_color( VIDEO v, uint32_t color) {
+    struct video_perf_mark  m;
+    void                    *d;
+
+    if (!(d = video_get_back_buffer(v))) d = v->clrb.ptr;
+
+    VPERF_BEGIN(&v->perf, &m);
+    v->kern->fill(d, color, v->px_count * sizeof(uint32_t));
+    VPERF_END(&v->perf, VIDEO_PHASE_FILL, &m);
+    video_submit_frame(v, d);
+}
+
+void video_screen_white( VIDEO v ) {
+    video_set_screen_color(v, 0xFFFFFFFF);
+}
+
+void video_clear_screen( VIDEO v ) {
+    video_set_screen_color(v, 0);
+}
+
+const char *video_get_kernel_set( VIDEO v ) {
+    if (!video_is_active(v)) return 0;
+    return v->kern->name;
+}
+
+#ifndef VIDEO_NO_STATS
+static void video_stat_copy( struct video_stat *dst, struct video_stat_acc *src ) {
+    int     i;
+
+    dst->count      = VSTAT_LOAD(&src->count);
+    dst->total_ns   = VSTAT_LOAD(&src->total_ns);
+    dst->min_ns     = VSTAT_LOAD(&src->min_ns);
+    dst->max_ns     = VSTAT_LOAD(&src->max_ns);
+    dst->last_ns    = VSTAT_LOAD(&src->last_ns);
+    for (i = 0; i < VIDEO_STATS_BUCKETS; i++) {
+        dst->hist[i] = VSTAT_LOAD(&src->hist[i]);
+    }
+}
+#endif
+
+int video_get_stats( VIDEO v, struct video_stats *st ) {
+#ifdef VIDEO_NO_STATS
+    errno = ENOTSUP;
+    return -1;
+#else
+    if (!st || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    st->frames_presented    = VSTAT_LOAD(&v->stats.frames_presented);
+    st->frames_replaced     = VSTAT_LOAD(&v->stats.frames_replaced);
+    st->frames_unchanged    = VSTAT_LOAD(&v->stats.frames_unchanged);
+    st->vblanks_missed      = VSTAT_LOAD(&v->stats.vblanks_missed);
+    st->bytes_written       = VSTAT_LOAD(&v->stats.bytes_written);
+    st->refresh_ns          = VSTAT_LOAD(&v->stats.refresh_ns);
+    video_stat_copy(&st->vsync_wait, &v->stats.vsync_wait);
+    video_stat_copy(&st->copy, &v->stats.copy);
+    video_stat_copy(&st->lock_wait, &v->stats.lock_wait);
+    video_stat_copy(&st->interval, &v->stats.interval);
+    return 0;
+#endif
+}
+
+int video_get_perf( VIDEO v, struct video_perf *perf ) {
+    if (!perf || !video_is_active(v) || !v->perf.enabled) {
+        errno = EINVAL;
+        return -1;
+    }
+    video_perf_get(&v->perf, perf);
+    return 0;
+}
+
+void video_reset_stats( VIDEO v ) {
+#ifndef VIDEO_NO_STATS
+    uint64_t    refresh;
+
+    if (!video_is_active(v)) return;
+
+    /* Under the lock so a present doesn't land half in, half out */
+    video_lock(v->mtx_prerender);
+    refresh = v->stats.refresh_ns;
+    memset(&v->stats, 0, sizeof(v->stats));
+    v->stats.refresh_ns = refresh;
+    video_unlock(v->mtx_prerender);
+#endif
+}
+
+int video_wait_until_render_start( VIDEO v, uint64_t *vblank_ns ) {
+    if (!video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return video_pace_wait(&v->pace, vblank_ns);
+}
+
+int video_get_pace_stats( VIDEO v, struct video_pace_stats *st ) {
+    if (!st || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    video_pace_get_stats(&v->pace, st);
+    return 0;
 }
 
 int video_is_active( VIDEO v ) {
@@ -420,7 +1964,7 @@ int video_get_fb_fix_screeninfo( VIDEO v, void *pdest, size_t buf_len ) {
 }
 
 int video_get_fb_var_screeninfo( VIDEO v, void *pdest, size_t buf_len ) {
-    const size_t len = sizeof(struct fb_fix_screeninfo);
+    const size_t len = sizeof(struct fb_var_screeninfo);
     if (!pdest || !v->active) return -1;
     if (buf_len < len) return len;
     memcpy(pdest, &v->var_info, len);
@@ -428,23 +1972,81 @@ int video_get_fb_var_screeninfo( VIDEO v, void *pdest, size_t buf_len ) {
 }
 
 
+/**
+ * Reads "r" (on screen) from the page being displayed into
+ * "dst", rows "stride" bytes apart, converted to ARGB8888.
+ **/ 
+static void video_read_vram( VIDEO v, const struct video_rect *r, uint32_t *dst, size_t stride ) {
+    const uint8_t   *src;
+    int             y;
+
+    src = (const uint8_t *)video_page_ptr(v, (v->nbuffers > 1) ? v->front : 0) +
+          (size_t)r->y * v->fix_info.line_length + (size_t)r->x * v->fmt.bytespp;
+
+    if (v->direct && r->x == 0 && r->width == v->width && stride == v->width * sizeof(uint32_t)) {
+        v->kern->read(dst, src, (size_t)r->height * stride);
+        return;
+    }
+
+    for (y = 0; y < r->height; y++) {
+        if (v->native) {
+            v->kern->read(dst, src, r->width * sizeof(uint32_t));
+        } else {
+            video_format_get_row(&v->fmt, v->kern, dst, src, r->width, v->row_buf);
+        }
+        src += v->fix_info.line_length;
+        dst  = (uint32_t *)((uint8_t *)dst + stride);
+    }
+}
+
 int video_get_current_pixel_data( VIDEO v, void *pdest, size_t buf_len ) {
-    union px_pointer    d;
-    int                 i;
-    
+    struct video_rect   all = { 0, 0, 0, 0 };
+
     if (!pdest || !v->active) return -1;
 
-    if (buf_len < v->fix_info.smem_len) return v->fix_info.smem_len;
+    if (buf_len < v->buf_size) return v->buf_size;
+
+    all.width   = v->width;
+    all.height  = v->height;
+
+    video_lock(v->mtx_prerender);
+    if (v->shadow && v->shadow_valid) {
+        memcpy(pdest, v->shadow, v->buf_size);
+    } else {
+        video_read_vram(v, &all, (uint32_t *)pdest, v->width * sizeof(uint32_t));
+        if (v->shadow) {
+            memcpy(v->shadow, pdest, v->buf_size);
+            v->shadow_valid = 1;
+        }
+    }
+    video_unlock(v->mtx_prerender);
+    return 0;
+}
+
+int video_read_region( VIDEO v, const struct video_rect *rect, void *pdest, size_t stride ) {
+    const uint32_t  *src;
+    uint8_t         *dst = (uint8_t *)pdest;
+    int             y;
 
-    d.ptr = pdest;
+    if (!rect || !pdest || !video_is_active(v) ||
+        rect->x < 0 || rect->y < 0 || rect->width <= 0 || rect->height <= 0 ||
+        (size_t)rect->x + rect->width > v->width || (size_t)rect->y + rect->height > v->height) 
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!stride) stride = rect->width * sizeof(uint32_t);
 
-    if (v->px_count64) {
-        for (i = 0; i < v->px_count64; i++)
-            d.ptr64[i] = v->ptr.ptr64[i];
+    video_lock(v->mtx_prerender);
+    if (v->shadow && v->shadow_valid) {
+        src = v->shadow + (size_t)rect->y * v->width + rect->x;
+        for (y = 0; y < rect->height; y++, dst += stride, src += v->width) {
+            memcpy(dst, src, rect->width * sizeof(uint32_t));
+        }
     } else {
-        for (i = 0; i < v->px_count; i++)
-            d.ptr32[i] = v->ptr.ptr32[i];
+        video_read_vram(v, rect, (uint32_t *)pdest, stride);
     }
+    video_unlock(v->mtx_prerender);
     return 0;
 }
 
@@ -457,7 +2059,7 @@ int video_get_current_pixel_data( VIDEO v, void *pdest, size_t buf_len ) {
 
 
 void __attribute__((constructor)) initLibrary(void) {
-    video_monitor.video_list    = (VIDEO)calloc(10, sizeof(struct video_setup));
+    video_monitor.video_list    = (VIDEO *)calloc(10, sizeof(VIDEO));
     video_monitor.used          = 0;
     if (!video_monitor.video_list) {
         video_monitor.count         = 0;
@@ -471,10 +2073,11 @@ void __attribute__((destructor)) cleanUpLibrary(void) {
     int i = 0;
     video_lock(video_monitor.vmutex);
     for (; i < video_monitor.count; i++) {
-        if (video_monitor.video_list[i].active) {
-            video_stop(&video_monitor.video_list[i]);
-        }
+        if (!video_monitor.video_list[i]) continue;
+        if (video_monitor.video_list[i]->active) video_stop(video_monitor.video_list[i]);
+        free(video_monitor.video_list[i]);
     }
+    free(video_monitor.video_list);
     video_unlock(video_monitor.vmutex);
     video_mutex_destroy(&video_monitor.vmutex);
 }
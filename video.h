@@ -36,14 +36,27 @@
  * Quick Function list (See actual definitions below comments for more info):
  * 
  * VIDEO       video_start( int framebuffer );
+ * VIDEO       video_start_ex( int framebuffer, const struct video_options *opts );
  * void        video_stop( VIDEO v );
  * void        video_submit_frame( VIDEO v, void *buf_pixels );
+ * ssize_t     video_submit_regions( VIDEO v, void *buf_pixels, const struct video_rect *rects, size_t nrects );
+ * ssize_t     video_present_nowait( VIDEO v, void *buf_pixels, const struct video_rect *rects, size_t nrects );
+ * int         video_get_vsync_fd( VIDEO v );
+ * int         video_read_vsync( VIDEO v, struct video_vsync *ev );
+ * struct video_group *video_group_create( const VIDEO *displays, size_t n, unsigned flags );
+ * void        video_group_destroy( struct video_group *g );
+ * int         video_group_submit( struct video_group *g, void *const *frames );
+ * int         video_group_get_stats( struct video_group *g, size_t i, struct video_group_stats *st );
  * int         video_get_width( VIDEO v );
  * int         video_get_height( VIDEO v );
  * int         video_get_bpp( VIDEO v );
  * size_t      video_get_req_buffer_size( VIDEO v );
  * void        *video_get_empty_buffer( VIDEO v );
+ * void        *video_buffer_acquire( VIDEO v );
+ * void        video_buffer_release( VIDEO v, void *buf );
+ * int         video_get_pool_stats( VIDEO v, struct video_pool_stats *st );
  * int         video_get_current_pixel_data( VIDEO v, void *pdest, size_t buf_len );
+ * int         video_read_region( VIDEO v, const struct video_rect *rect, void *pdest, size_t stride );
  * void        video_clear_screen( VIDEO v );
  * void        video_screen_white( VIDEO v );
  * void        video_set_screen_color( VIDEO v, uint32_t color);
@@ -53,6 +66,95 @@
  * size_t      video_get_pixel_count( VIDEO v );
  * int         video_get_fb_var_screeninfo( VIDEO v, void *pdest, size_t buf_len );
  * int         video_get_fb_fix_screeninfo( VIDEO v, void *pdest, size_t buf_len );
+ * int         video_get_buffer_count( VIDEO v );
+ * void        *video_get_back_buffer( VIDEO v );
+ * int         video_acquire_back_buffer( VIDEO v, struct video_frame *frame );
+ * int         video_present( VIDEO v, struct video_frame *frame );
+ * const char  *video_get_kernel_set( VIDEO v );
+ * const char  *video_get_pixel_format( VIDEO v );
+ * int         video_get_stats( VIDEO v, struct video_stats *st );
+ * void        video_reset_stats( VIDEO v );
+ * int         video_get_perf( VIDEO v, struct video_perf *perf );
+ * int         video_wait_until_render_start( VIDEO v, uint64_t *vblank_ns );
+ * int         video_get_pace_stats( VIDEO v, struct video_pace_stats *st );
+ * struct video_latency *video_latency_open( VIDEO v, const char *path );
+ * void        video_latency_close( struct video_latency *l );
+ * int         video_latency_get_fd( struct video_latency *l );
+ * int         video_latency_mark( struct video_latency *l );
+ * int         video_latency_get_stats( struct video_latency *l, struct video_latency_stats *st );
+ * void        video_latency_reset( struct video_latency *l );
+ * uint64_t    video_latency_percentile( const struct video_latency_hist *h, unsigned pct );
+ * int         video_trace_start( size_t events_per_thread );
+ * void        video_trace_stop( void );
+ * int         video_trace_dump( const char *path );
+ * void        video_trace_begin( const char *name );
+ * void        video_trace_end( const char *name );
+ * void        video_trace_instant( const char *name );
+ * int         video_record_start( VIDEO v, const char *path, int queue_frames );
+ * int         video_record_stop( VIDEO v );
+ * int         video_get_record_stats( VIDEO v, struct video_record_stats *st );
+ * int         video_record_info( const char *path, struct video_record_info *info );
+ * ssize_t     video_replay( VIDEO v, const char *path );
+ * int         video_get_surface( VIDEO v, void *buf_pixels, struct video_surface *s );
+ * int         video_surface_sub( const struct video_surface *s, const struct video_rect *r, struct video_surface *sub );
+ * void        video_fill_rect( const struct video_surface *s, const struct video_rect *r, uint32_t color, int mode );
+ * void        video_draw_rect( const struct video_surface *s, const struct video_rect *r, uint32_t color, int mode );
+ * void        video_draw_hline( const struct video_surface *s, int x, int y, int len, uint32_t color, int mode );
+ * void        video_draw_vline( const struct video_surface *s, int x, int y, int len, uint32_t color, int mode );
+ * void        video_draw_line( const struct video_surface *s, int x0, int y0, int x1, int y1, uint32_t color, int mode );
+ * void        video_draw_ellipse( const struct video_surface *s, int cx, int cy, int rx, int ry, uint32_t color, int mode );
+ * void        video_fill_ellipse( const struct video_surface *s, int cx, int cy, int rx, int ry, uint32_t color, int mode );
+ * void        video_draw_circle( const struct video_surface *s, int cx, int cy, int r, uint32_t color, int mode );
+ * void        video_fill_circle( const struct video_surface *s, int cx, int cy, int r, uint32_t color, int mode );
+ * void        video_draw_polygon( const struct video_surface *s, const struct video_point *pts, size_t n, uint32_t color, int mode );
+ * int         video_fill_polygon( const struct video_surface *s, const struct video_point *pts, size_t n, uint32_t color, int mode );
+ * struct video_path *video_path_create( void );
+ * void        video_path_destroy( struct video_path *p );
+ * void        video_path_reset( struct video_path *p );
+ * int         video_path_move_to( struct video_path *p, float x, float y );
+ * int         video_path_line_to( struct video_path *p, float x, float y );
+ * int         video_path_quad_to( struct video_path *p, float cx, float cy, float x, float y );
+ * int         video_path_cubic_to( struct video_path *p, float c1x, float c1y, float c2x, float c2y, float x, float y );
+ * int         video_path_close( struct video_path *p );
+ * int         video_path_stroke( struct video_path *dst, const struct video_path *src, const struct video_stroke *stroke );
+ * int         video_fill_path( const struct video_surface *s, const struct video_path *p, uint32_t color, int mode, int rule );
+ * int         video_stroke_path( const struct video_surface *s, const struct video_path *p, const struct video_stroke *stroke, uint32_t color, int mode );
+ * int         video_blit( const struct video_surface *dst, const struct video_surface *src, const struct video_rect *r, int mode );
+ * int         video_blit_ex( const struct video_surface *dst, const struct video_surface *src, const struct video_rect *r, int mode, uint32_t opacity, uint32_t key );
+ * int         video_blit_affine( const struct video_surface *dst, const struct video_surface *src, const struct video_matrix *m, int mode, int filter, uint32_t opacity );
+ * struct video_font *video_font_load( const char *path );
+ * struct video_font *video_font_load_mem( const void *data, size_t len );
+ * void        video_font_free( struct video_font *f );
+ * int         video_font_metrics( const struct video_font *f, int size, struct video_font_metrics *m );
+ * struct video_glyph_cache *video_glyph_cache_create( size_t budget );
+ * void        video_glyph_cache_destroy( struct video_glyph_cache *c );
+ * void        video_glyph_cache_get_stats( struct video_glyph_cache *c, struct video_glyph_cache_stats *st );
+ * int         video_text_width( const struct video_font *f, int size, const char *utf8 );
+ * int         video_draw_text( const struct video_surface *s, struct video_glyph_cache *c, const struct video_font *f, int size, int x, int y, const char *utf8, uint32_t color );
+ * struct video_dlist *video_dlist_create( int threads );
+ * void        video_dlist_destroy( struct video_dlist *dl );
+ * void        video_dlist_reset( struct video_dlist *dl );
+ * int         video_dlist_fill_rect( struct video_dlist *dl, const struct video_rect *r, uint32_t color, int mode );
+ * int         video_dlist_blit( struct video_dlist *dl, const struct video_surface *src, const struct video_rect *r, int mode, uint32_t opacity, uint32_t key );
+ * int         video_dlist_blit_affine( struct video_dlist *dl, const struct video_surface *src, const struct video_matrix *m, int mode, int filter, uint32_t opacity );
+ * int         video_dlist_fill_path( struct video_dlist *dl, const struct video_path *p, uint32_t color, int mode, int rule );
+ * int         video_dlist_stroke_path( struct video_dlist *dl, const struct video_path *p, const struct video_stroke *stroke, uint32_t color, int mode );
+ * int         video_dlist_text( struct video_dlist *dl, struct video_glyph_cache *cache, const struct video_font *font, int size, int x, int y, const char *utf8, uint32_t color );
+ * int         video_dlist_execute( struct video_dlist *dl, const struct video_surface *s );
+ * int         video_dlist_submit( VIDEO v, struct video_dlist *dl, void *buf_pixels );
+ * struct video_compositor *video_compositor_create( VIDEO v, uint32_t background );
+ * void        video_compositor_destroy( struct video_compositor *c );
+ * void        video_compositor_set_background( struct video_compositor *c, uint32_t background );
+ * ssize_t     video_compositor_present( struct video_compositor *c );
+ * void        video_compositor_get_stats( struct video_compositor *c, struct video_compositor_stats *st );
+ * struct video_layer *video_layer_create( struct video_compositor *c, int width, int height, int z, unsigned flags );
+ * void        video_layer_destroy( struct video_layer *l );
+ * int         video_layer_get_surface( struct video_layer *l, struct video_surface *s );
+ * void        video_layer_move( struct video_layer *l, int x, int y );
+ * void        video_layer_set_z( struct video_layer *l, int z );
+ * void        video_layer_set_opacity( struct video_layer *l, uint32_t opacity );
+ * void        video_layer_set_visible( struct video_layer *l, int visible );
+ * void        video_layer_damage( struct video_layer *l, const struct video_rect *r );
  * 
  **/ 
 
@@ -77,6 +179,509 @@
 
 typedef struct video_setup              *VIDEO;
 
+/**
+ * Most pages of video memory we'll ask the driver for
+ * when page flipping.
+ **/ 
+#define VIDEO_MAX_BUFFERS                       3
+
+/**
+ * A rectangle of pixels, in screen coordinates.
+ **/ 
+struct video_rect {
+    int         x,
+                y,
+                width,
+                height;
+};
+
+/**
+ * A point, in pixels.
+ **/ 
+struct video_point {
+    int         x,
+                y;
+};
+
+/**
+ * Somewhere to draw: any block of 32 bit ARGB pixels with 
+ * rows "stride" bytes apart.  A buffer from 
+ * video_get_empty_buffer() (see video_get_surface()), a 
+ * struct video_frame, or your own sprites and layers.  
+ * Drawing is clipped to width x height.
+ *
+ * A surface isn't tied to a display, so drawing on one
+ * always uses the fastest loops this CPU has, whatever
+ * video_options.kernels says.
+ **/ 
+struct video_surface {
+    uint32_t    *pixels;                        /* Row y starts at (char *)pixels + y * stride          */
+    int         width,
+                height;
+    size_t      stride;
+};
+
+/**
+ * How drawing combines a color with what's already there.
+ **/ 
+#define VIDEO_BLEND_COPY                        0       /* Replace the pixels, alpha and all            */
+#define VIDEO_BLEND_OVER                        1       /* Color over the pixels by its alpha (straight,
+                                                         * not premultiplied).  0xFF is the same as
+                                                         * COPY, ZERO draws nothing.
+                                                         **/ 
+
+/**
+ * How video_blit() puts one surface onto another.
+ **/ 
+#define VIDEO_BLIT_COPY                         0       /* Replace the pixels, alpha and all            */
+#define VIDEO_BLIT_KEY                          1       /* Copy all but the pixels whose RGB is the key
+                                                         * color (alpha isn't compared)
+                                                         **/ 
+#define VIDEO_BLIT_OVER                         2       /* Source over by its alpha, straight           */
+#define VIDEO_BLIT_PREMUL                       3       /* Source over by its alpha, premultiplied
+                                                         * (color channels already times alpha)
+                                                         **/ 
+
+/**
+ * 2x3 affine matrix for video_blit_affine(): source point
+ * (x, y) lands on the destination at
+ * 
+ *      X = xx * x + xy * y + tx
+ *      Y = yx * x + yy * y + ty
+ * 
+ * Identity is { 1, 0, 0, 0, 1, 0 }.  Rotating by "a" about
+ * the source's center (cx, cy) and putting that at (px, py):
+ * { cos a, -sin a, px - cx cos a + cy sin a,
+ *   sin a,  cos a, py - cx sin a - cy cos a }
+ **/ 
+struct video_matrix {
+    float       xx, xy, tx,
+                yx, yy, ty;
+};
+
+/* Sampling for video_blit_affine() */
+#define VIDEO_FILTER_NEAREST                    0
+#define VIDEO_FILTER_BILINEAR                   1
+
+/**
+ * A font (video_font_load()): TrueType outlines or a PSF
+ * console bitmap font.
+ **/
+struct video_font;
+
+/**
+ * Rasterized glyphs shared by every font and size drawn
+ * through it (video_glyph_cache_create()).
+ **/
+struct video_glyph_cache;
+
+/**
+ * Drawing calls recorded to run later, spread over several
+ * cores (video_dlist_create()).
+ **/
+struct video_dlist;
+
+/**
+ * Layers stacked on the display and composited into it
+ * (video_compositor_create()), and one of them
+ * (video_layer_create()).
+ **/
+struct video_compositor;
+struct video_layer;
+
+/* video_layer_create() flags */
+#define VIDEO_LAYER_OPAQUE                      0x01    /* Every pixel's alpha is 0xFF: hides what's under
+                                                         * it, copied instead of blended                */
+#define VIDEO_LAYER_PREMUL                      0x02    /* Pixels are premultiplied                     */
+
+/**
+ * What the compositor has done, see
+ * video_compositor_get_stats().  Pixels are counted on the
+ * screen, over every frame.
+ **/
+struct video_compositor_stats {
+    uint64_t    frames,
+                rects,                          /* Damaged rectangles composited (disjoint)             */
+                damaged_pixels,                 /* Pixels composited again                              */
+                composited_pixels,              /* Layer pixels drawn into them                         */
+                occluded_pixels;                /* Damaged layer pixels skipped, hidden by opaque ones  */
+};
+
+/* Pixels at a size, see video_font_metrics() */
+struct video_font_metrics {
+    int         ascent,                         /* Baseline to the top of the tallest glyphs            */
+                descent,                        /* Baseline down to the bottom of the lowest, positive  */
+                line_height;                    /* Baseline to baseline                                 */
+};
+
+/**
+ * How the glyph cache is doing, see
+ * video_glyph_cache_get_stats().
+ **/
+struct video_glyph_cache_stats {
+    uint64_t    hits,
+                misses,                         /* Glyphs that had to be rasterized                     */
+                evictions,                      /* Glyphs dropped to make room for others               */
+                uncached;                       /* Too big for an atlas page, rasterized every time     */
+    size_t      glyphs,                         /* In the cache now                                     */
+                pages,                          /* Atlas pages allocated, 64 KB each                    */
+                bytes,
+                budget;                         /* Most bytes the pages will take                       */
+};
+
+/**
+ * A vector path (video_path_create()): subpaths of lines and
+ * curves in surface coordinates, pixel centers at x + 0.5.
+ **/ 
+struct video_path;
+
+/* Which parts of a path are inside, for video_fill_path() */
+#define VIDEO_FILL_NONZERO                      0       /* Winding number isn't ZERO                    */
+#define VIDEO_FILL_EVENODD                      1       /* Crossed an odd number of edges (holes in
+                                                         * shapes that overlap themselves)
+                                                         **/ 
+
+/* Corners and ends of a stroke */
+#define VIDEO_JOIN_MITER                        0
+#define VIDEO_JOIN_ROUND                        1
+#define VIDEO_JOIN_BEVEL                        2
+#define VIDEO_CAP_BUTT                          0       /* Stops at the end point                       */
+#define VIDEO_CAP_ROUND                         1
+#define VIDEO_CAP_SQUARE                        2       /* Goes on half the width past the end point    */
+
+struct video_stroke {
+    float       width;
+    int         join,                           /* VIDEO_JOIN_*                                         */
+                cap;                            /* VIDEO_CAP_*                                          */
+    float       miter_limit;                    /* Miter tips more than this many half widths
+                                                 * from the corner are beveled instead (SVG's
+                                                 * stroke-miterlimit).  Under 1 means 4.
+                                                 **/ 
+};
+
+/**
+ * A frame to draw on, from video_acquire_back_buffer().
+ * Pixels are always 32 bit ARGB (alpha ignored) but rows
+ * are "stride" bytes apart, which may be more than
+ * width * 4 when they're in video memory.
+ **/ 
+struct video_frame {
+    uint32_t    *pixels;                        /* Row y starts at (char *)pixels + y * stride          */
+    int         width,
+                height;
+    size_t      stride;                         /* Bytes from one row to the next                       */
+    int         scanout;                        /* Non-zero: pixels ARE video memory (a page that isn't
+                                                 * on screen), video_present() just flips to it.  ZERO:
+                                                 * a library buffer that's copied on present.
+                                                 **/ 
+    unsigned long 
+                seq;                            /* Internal, don't touch                                */
+};
+
+/**
+ * A display with no screen behind it: video memory is
+ * ordinary memory (or a file) and VBLANK is simulated.
+ * For benchmarks and tests that have to run without a
+ * /dev/fbN or a console.  Zeroed fields get defaults.
+ **/ 
+struct video_headless {
+    int         width,                          /* Pixels, default 800                                  */
+                height,                         /* Pixels, default 480                                  */
+                bpp,                            /* 16 (RGB565), 24 or 32 (default)                      */
+                stride,                         /* Bytes per row of video memory, 0 for no padding      */
+                refresh_us;                     /* Simulated VBLANK period in microseconds e.g. 16667.
+                                                 * ZERO: never wait.
+                                                 **/ 
+    const char  *path;                          /* NULL: anonymous memory (memfd).  Otherwise video 
+                                                 * memory is this file, created or resized as needed,
+                                                 * so another process can watch it.
+                                                 **/ 
+};
+
+/**
+ * Histogram buckets in a struct video_stat.  Bucket i
+ * counts samples of 2^i to 2^(i+1) microseconds; the
+ * first also takes anything shorter, the last anything
+ * longer (over half a second).
+ **/ 
+#define VIDEO_STATS_BUCKETS                     20
+
+/**
+ * One timing measured on every present.  All times are
+ * in nanoseconds.
+ **/ 
+struct video_stat {
+    uint64_t    count,
+                total_ns,                       /* total_ns / count is the mean                         */
+                min_ns,
+                max_ns,
+                last_ns,
+                hist[VIDEO_STATS_BUCKETS];
+};
+
+/**
+ * Frame timing for one display, see video_get_stats().
+ * Counters run from video_start() or the last call to
+ * video_reset_stats(); take two snapshots and subtract
+ * for a rate over any window you like.
+ **/ 
+struct video_stats {
+    uint64_t    frames_presented,               /* Frames shown (with tile_diff, unchanged ones too)    */
+                frames_replaced,                /* Presenter thread only: frames submitted but replaced
+                                                 * by a newer one before they could be shown.
+                                                 **/ 
+                frames_unchanged,               /* tile_diff only: frames identical to the last one, 
+                                                 * nothing was written.
+                                                 **/ 
+                vblanks_missed,                 /* Refreshes that went by without a new frame between
+                                                 * two presents (late frames).
+                                                 **/ 
+                bytes_written,                  /* To video memory, in the panel's format               */
+                refresh_ns;                     /* Refresh period used to count missed VBLANKs, from the
+                                                 * display mode.  ZERO if unknown (nothing is counted).
+                                                 **/ 
+
+    struct video_stat 
+                vsync_wait,                     /* Blocked in FBIO_WAITFORVSYNC                         */
+                copy,                           /* Writing (and converting) the frame to video memory   */
+                lock_wait,                      /* Waiting on another thread to finish with the display */
+                interval;                       /* From one present to the next                         */
+};
+
+/**
+ * Phases of a present that hardware counters are kept
+ * for, see video_get_perf().
+ **/ 
+#define VIDEO_PHASE_VSYNC                       0       /* Waiting for VBLANK                           */
+#define VIDEO_PHASE_COPY                        1       /* Frame into video memory (with conversion)    */
+#define VIDEO_PHASE_FILL                        2       /* Solid fills, video_set_screen_color()        */
+#define VIDEO_PHASES                            3
+
+/**
+ * Hardware counters, indexes into video_perf_phase.count.
+ **/ 
+#define VIDEO_PERF_CYCLES                       0
+#define VIDEO_PERF_INSTRUCTIONS                 1
+#define VIDEO_PERF_CACHE_MISSES                 2
+#define VIDEO_PERF_STALLED_CYCLES               3       /* Backend stalls, mostly waiting on memory     */
+#define VIDEO_PERF_COUNTERS                     4
+
+struct video_perf_phase {
+    uint64_t    calls,
+                time_ns,
+                count[VIDEO_PERF_COUNTERS];
+};
+
+/**
+ * Per display totals since video_start(), when it was
+ * started with perf_counters set.
+ **/ 
+struct video_perf {
+    unsigned    available;                      /* Bit (1 << VIDEO_PERF_*) set for each counter this
+                                                 * machine gave us.  Counters without a bit read ZERO.
+                                                 **/ 
+    int         kernel;                         /* Non-zero if time spent in the kernel is counted
+                                                 * (needs perf_event_paranoid <= 1 or CAP_PERFMON).
+                                                 **/ 
+    struct video_perf_phase 
+                phase[VIDEO_PHASES];
+};
+
+/**
+ * Flags for video_options.pool_flags, how the buffers from
+ * video_buffer_acquire() are backed.  All are best effort:
+ * if the system says no you get ordinary pages (and one
+ * warning on stderr).
+ **/ 
+#define VIDEO_POOL_HUGETLB                      0x01    /* MAP_HUGETLB, needs pages reserved in
+                                                         * /proc/sys/vm/nr_hugepages
+                                                         **/ 
+#define VIDEO_POOL_THP                          0x02    /* madvise(MADV_HUGEPAGE) so transparent huge
+                                                         * pages back them (fewer TLB misses)
+                                                         **/ 
+#define VIDEO_POOL_PREFAULT                     0x04    /* Touch every page up front, no page faults
+                                                         * on the first frames
+                                                         **/ 
+#define VIDEO_POOL_MLOCK                        0x08    /* mlock() so they're never paged out        */
+
+/**
+ * A VBLANK event, see video_read_vsync().
+ **/ 
+struct video_vsync {
+    uint64_t    count,                          /* VBLANKs since video_get_vsync_fd() was first called  */
+                elapsed,                        /* Since the last read, more than one if some were missed */
+                timestamp_ns;                   /* When the last one was, CLOCK_MONOTONIC               */
+};
+
+/**
+ * Several displays presented together (video_group_create()).
+ **/ 
+struct video_group;
+
+/* video_group_create() flags */
+#define VIDEO_GROUP_SYNC                        0x01    /* Every display starts presenting at once      */
+
+/**
+ * One display of a group, see video_group_get_stats().
+ * Times are CLOCK_MONOTONIC.
+ **/ 
+struct video_group_stats {
+    uint64_t    frames,                         /* Presented through the group                          */
+                skipped,                        /* Rounds it had no frame in                            */
+                presented_ns,                   /* When its last present returned                       */
+                skew_ns;                        /* How long after the first display of that round       */
+};
+
+/**
+ * Frame pacing, see video_wait_until_render_start() and
+ * video_get_pace_stats().  Times are CLOCK_MONOTONIC.
+ **/ 
+struct video_pace_stats {
+    uint64_t    period_ns,                      /* Refresh period measured from VBLANKs (the mode's until
+                                                 * then).  ZERO if not known yet.
+                                                 **/ 
+                vblank_ns,                      /* Last VBLANK seen                                     */
+                render_ns,                      /* 95th percentile of the last 64 render times          */
+                margin_ns,                      /* Safety margin now, with any back off                 */
+                frames,                         /* Paced frames submitted                               */
+                misses;                         /* Of those, submitted after the VBLANK they were for   */
+};
+
+/**
+ * Input to photon latency (video_latency_open()).
+ **/ 
+struct video_latency;
+
+#define VIDEO_LATENCY_BUCKETS                   64      /* 1 ms each, the last one takes anything longer */
+
+struct video_latency_hist {
+    uint64_t    count,
+                total_ns,
+                min_ns,
+                max_ns,
+                hist[VIDEO_LATENCY_BUCKETS];    /* hist[i] counts samples from i up to i + 1 ms         */
+};
+
+struct video_latency_stats {
+    uint64_t    inputs,                         /* Reports with a key, button, axis or motion in them   */
+                marked,                         /* Frames marked as answering one                       */
+                dropped,                        /* Times the kernel dropped events (SYN_DROPPED)        */
+                lost;                           /* Marked frames never seen on the screen               */
+
+    struct video_latency_hist
+                input_to_submit,                /* Input event to the frame's submit                    */
+                submit_to_photon,               /* Submit to when the frame is on the screen            */
+                input_to_photon;                /* The whole way                                        */
+};
+
+/**
+ * Buffer pool sizing, see video_get_pool_stats().
+ **/ 
+struct video_pool_stats {
+    size_t      buffers,                        /* Allocated (in use or waiting to be reused)           */
+                in_use,
+                peak_in_use,                    /* Most ever out at once, what the pool grows to        */
+                buffer_bytes,                   /* Size of each, width * height * 4                     */
+                mapped_bytes,                   /* Memory all of them take, rounded up to pages         */
+                hugetlb,                        /* How many are on MAP_HUGETLB pages                    */
+                locked;                         /* How many are mlock()ed                               */
+    uint64_t    acquires,
+                misses;                         /* Acquires that had to allocate a new buffer           */
+};
+
+/**
+ * How a recording is going, see video_get_record_stats().
+ **/ 
+struct video_record_stats {
+    uint64_t    frames_recorded,                /* Encoded and written                                  */
+                frames_dropped,                 /* Presented while the recorder was behind, not in the
+                                                 * recording.
+                                                 **/ 
+                bytes_raw,                      /* What the recorded frames would take uncompressed     */
+                bytes_written;                  /* What they took                                       */
+};
+
+/**
+ * What's in a recording, see video_record_info().
+ **/ 
+struct video_record_info {
+    int         width,
+                height;
+    uint64_t    start_ns,                       /* CLOCK_REALTIME when recording started                */
+                frames,
+                duration_ns,                    /* From the start of recording to the last frame        */
+                bytes;                          /* Of the file, up to the last whole frame              */
+};
+
+/**
+ * Options for video_start_ex().  A zeroed structure
+ * gives you the same behavior as video_start().
+ **/ 
+struct video_options {
+    int         buffers;                        /* 0 or 1: copy each frame into video memory (default).
+                                                 * 2: double buffered, 3: triple buffered page flipping.
+                                                 **/ 
+
+    int         presenter;                      /* Non-zero: start a presenter thread for this display so
+                                                 * video_submit_frame() never waits on VBLANK.
+                                                 **/ 
+
+    int         presenter_priority;             /* If > 0, run the presenter SCHED_FIFO at this priority
+                                                 * (1-99).  Needs CAP_SYS_NICE, falls back to the default
+                                                 * policy without it.
+                                                 **/ 
+
+    unsigned long 
+                presenter_cpus;                 /* If non-zero, a bit mask of CPUs the presenter may run
+                                                 * on e.g. 0x8 pins it to CPU 3.
+                                                 **/ 
+
+    const char  *kernels;                       /* NULL: the fastest copy/fill/read loops this CPU has.
+                                                 * Or force a set by name: "scalar", "sse2", "avx2", 
+                                                 * "neon".  See video_get_kernel_set().  Only the
+                                                 * display's own copies: drawing on a surface always
+                                                 * uses the fastest set.
+                                                 **/ 
+
+    int         dither;                         /* Non-zero: ordered dither when the panel is RGB565
+                                                 * (smooths gradients, costs a little per pixel).
+                                                 **/ 
+
+    int         perf_counters;                  /* Non-zero: count CPU cycles, instructions, cache misses
+                                                 * and stalls around each phase of a present with
+                                                 * perf_event_open().  See video_get_perf().
+                                                 **/ 
+
+    int         tile_diff;                      /* Non-zero: compare each frame from video_submit_frame()
+                                                 * with the last one in 64x16 pixel tiles (by hash) and
+                                                 * only write the tiles that changed.  An identical
+                                                 * frame writes nothing and doesn't flip.
+                                                 **/ 
+
+    int         shadow;                         /* Non-zero: keep a copy of the frame on screen in 
+                                                 * ordinary memory so readback (video_read_region(),
+                                                 * video_get_current_pixel_data()) doesn't have to read
+                                                 * video memory, which is slow and uncached on the Pi.
+                                                 * Costs a memcpy() per present.
+                                                 **/ 
+
+    int         pool_buffers;                   /* Buffers for video_buffer_acquire() to allocate at
+                                                 * start.  ZERO: allocate on first use.
+                                                 **/ 
+
+    unsigned    pool_flags;                     /* VIDEO_POOL_* for those buffers                       */
+
+    unsigned    pace_margin_us;                 /* video_wait_until_render_start(): time kept spare
+                                                 * before VBLANK on top of the expected render time.
+                                                 * ZERO: 1000.
+                                                 **/ 
+
+    const struct video_headless 
+                *headless;                      /* Non-NULL: don't open /dev/fbN (the framebuffer number
+                                                 * is ignored) or touch the console, use this instead.
+                                                 **/ 
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -100,6 +705,32 @@ extern "C" {
  **/ 
 VIDEO       video_start( int framebuffer );
 
+/**
+ * Same as video_start() but with options.
+ * 
+ * \param const struct video_options *opts
+ * May be NULL for defaults.  
+ * 
+ * If opts->buffers is 2 or 3, the virtual resolution of
+ * the display is made that many screens tall and frames
+ * are presented by panning the display (FBIOPAN_DISPLAY)
+ * to the page that was drawn on instead of copying the
+ * frame during VBLANK.  If the driver won't give us the
+ * larger virtual resolution we fall back to fewer pages,
+ * and finally to copying.  Use video_get_buffer_count()
+ * to see what you got.  The original mode is restored
+ * by video_stop().
+ * 
+ * If opts->presenter is set, a thread is started for
+ * this display that does all the waiting on VBLANK.
+ * video_submit_frame() then hands the frame to it through
+ * a three slot mailbox and returns right away.  If you
+ * submit more than one frame between refreshes, only the
+ * newest is shown.
+ * 
+ **/ 
+VIDEO       video_start_ex( int framebuffer, const struct video_options *opts );
+
 /**
  * Shut down the video display.  After this
  * call, the VIDEO handle is no longer valid
@@ -123,28 +754,792 @@ void        video_stop( VIDEO v );
  * may obtain a properly-sized buffer for drawing by
  * calling video_get_empty_buffer().
  * 
+ * When page flipping, the frame is copied to the back
+ * page outside of VBLANK and the display is panned to
+ * it.  If buf_pixels IS the back page (see 
+ * video_get_back_buffer()) nothing is copied at all.
+ * 
+ * With a presenter thread this returns as soon as the
+ * frame is in the mailbox, the buffer may be reused
+ * immediately.  Only one thread should submit frames
+ * to a display with a presenter.
+ * 
  **/ 
 void        video_submit_frame( VIDEO v, void *buf_pixels );
 
+/**
+ * Like video_submit_frame(), but only the areas of
+ * "buf_pixels" covered by "rects" have changed since
+ * the last frame so only they are copied.  Rectangles
+ * are clipped to the screen and may overlap; overlapping
+ * and touching ones are merged into row spans so no pixel
+ * is copied twice.  "buf_pixels" is a whole frame, laid
+ * out the same way a buffer from video_get_empty_buffer()
+ * is.
+ * 
+ * When page flipping the back page is also brought up to 
+ * date with what changed in the frames it missed.  With
+ * a presenter thread the whole frame is submitted.
+ * 
+ * Passing ZERO rectangles waits for VBLANK (or flips) 
+ * without copying anything.
+ * 
+ * \return The number of bytes written to video memory
+ * (in the panel's format, so half as many per pixel on
+ * a 16 bit panel), or -1 on error with errno set.
+ **/ 
+ssize_t     video_submit_regions( VIDEO v, void *buf_pixels, const struct video_rect *rects, size_t nrects );
+
+/**
+ * Presents "buf_pixels" without waiting for VBLANK, for an
+ * event loop driven by video_get_vsync_fd(): call it when the
+ * fd says a VBLANK went by.  The frame is copied to video
+ * memory right away, or with page flipping drawn on the back
+ * page and panned to (the driver shows it from the next
+ * VBLANK).  "rects" as for video_submit_regions(), NULL for
+ * the whole frame.  With a presenter thread it's the same as
+ * video_submit_frame().
+ * 
+ * \return As video_submit_regions().  EAGAIN when page
+ * flipping and the last pan from here hasn't had a VBLANK
+ * yet (only known once video_get_vsync_fd() was called):
+ * the back page may still be on the screen, try after the
+ * next event.
+ **/ 
+ssize_t     video_present_nowait( VIDEO v, void *buf_pixels, const struct video_rect *rects, size_t nrects );
+
+/**
+ * A file descriptor (non-blocking, close-on-exec) that's
+ * readable after every VBLANK, for poll()/epoll.  Read it
+ * with video_read_vsync().  The first call starts a thread
+ * that waits in FBIO_WAITFORVSYNC without holding the
+ * display, which may take a frame to set up; if the driver
+ * can't wait for VBLANK it's a timer at the refresh rate,
+ * in phase with the last VBLANK a present saw, if any.  The
+ * fd is the display's, video_stop() closes it.
+ * 
+ * \return The fd, -1 with errno set (EINVAL; ENOTSUP if the
+ * refresh rate isn't known, or on a headless display with
+ * no refresh).
+ **/ 
+int         video_get_vsync_fd( VIDEO v );
+
+/**
+ * Reads the event from video_get_vsync_fd() into "ev", from
+ * one thread.
+ * 
+ * \return ZERO, -1 with errno set (EAGAIN: no VBLANK since
+ * the last read; EINVAL).
+ **/ 
+int         video_read_vsync( VIDEO v, struct video_vsync *ev );
+
+/**
+ * Groups "n" displays to present together: a worker thread
+ * for each but the first (the submitting thread presents
+ * that one), so their VBLANK waits and copies overlap
+ * instead of following each other.  With VIDEO_GROUP_SYNC
+ * every display starts presenting at the same moment, so
+ * displays refreshing at the same rate show a round's frames
+ * at the same refresh; their rates must match (as far as
+ * they're known) or it's EINVAL.
+ * 
+ * The displays must be active and stay so while the group
+ * is used; nothing else should present on them meanwhile.
+ * 
+ * \return The group, NULL with errno set (EINVAL, ENOMEM,
+ * EAGAIN).
+ **/ 
+struct video_group *video_group_create( const VIDEO *displays, size_t n, unsigned flags );
+void        video_group_destroy( struct video_group *g );
+
+/**
+ * Presents frames[i] on display i (as video_submit_frame()),
+ * all at once, and returns when every one is done.  A NULL
+ * frame leaves that display as it is.  Submit from one
+ * thread.
+ * 
+ * \return ZERO, -1 with errno set (EINVAL; nothing is
+ * presented).
+ **/ 
+int         video_group_submit( struct video_group *g, void *const *frames );
+
+/**
+ * \return ZERO with display "i"'s counters in "st", -1 with
+ * errno set (EINVAL).
+ **/ 
+int         video_group_get_stats( struct video_group *g, size_t i, struct video_group_stats *st );
+
+/**
+ * \return The number of pages of video memory in use.
+ * ONE means frames are copied into video memory, TWO or
+ * THREE means frames are presented by page flipping.
+ * ZERO if the VIDEO handle isn't active.
+ **/ 
+int         video_get_buffer_count( VIDEO v );
+
+/**
+ * When page flipping, returns a pointer to the page of
+ * video memory that will be displayed next.  It is NOT
+ * being scanned out so you can draw on it directly and
+ * then pass it to video_submit_frame() which will skip
+ * the copy.  The pointer changes after every submission,
+ * call this again for each frame.
+ * 
+ * With a presenter thread, this is the mailbox slot the
+ * next submission will be published from, with the same
+ * no-copy benefit.
+ * 
+ * \return The back buffer, or NULL when in copy mode
+ * without a presenter thread.  Also NULL when page flipping
+ * on a panel that isn't ARGB8888 with unpadded rows, since
+ * then every frame has to be converted anyway.
+ **/ 
+void        *video_get_back_buffer( VIDEO v );
+
+/**
+ * Hands out the buffer the next frame should be drawn in,
+ * with its geometry in "frame".  When page flipping on a 32
+ * bit XRGB panel this is the back page of video memory
+ * itself, even if its rows are padded, so drawing lands
+ * where it's scanned out from and video_present() has
+ * nothing to copy.  The page isn't on screen and won't be
+ * until it's presented.
+ * 
+ * Otherwise (copy mode, presenter thread, panels that need
+ * converting) it's a buffer owned by the library with
+ * packed rows, and video_present() copies it like
+ * video_submit_frame() does.  Check frame->scanout to see
+ * which you got.  Either way don't assume stride is
+ * width * 4.
+ * 
+ * Acquire and present from one thread.  Nothing else may
+ * present on the display in between, the page would no
+ * longer be the back page.
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ **/ 
+int         video_acquire_back_buffer( VIDEO v, struct video_frame *frame );
+
+/**
+ * Presents a frame from video_acquire_back_buffer(), at the
+ * next VBLANK.  Returns once it's shown, or with a presenter
+ * thread, once it's in the mailbox.  "frame" is used up,
+ * acquire a new one for the next frame.
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ * ESTALE means something else presented on the display
+ * since the frame was acquired; nothing is shown.
+ **/ 
+int         video_present( VIDEO v, struct video_frame *frame );
+
 /**
  * \return The width of the screen in pixels
  **/ 
 int         video_get_width( VIDEO v );
 
 /**
- * \return The height of the screen in pixels
+ * \return The height of the screen in pixels (one page
+ * when page flipping).
  **/ 
 int         video_get_height( VIDEO v );
 
 /**
- * \return The number of BITS per pixel.
+ * \return The number of BITS per pixel of the panel.
+ * Buffers you draw on are always 32 bits per pixel,
+ * see video_get_empty_buffer().
  **/ 
 int         video_get_bpp( VIDEO v );
 
+/**
+ * \return The panel's pixel layout: "XRGB8888" (no
+ * conversion), "XBGR8888", "RGB888", "RGB565" or
+ * "generic" (converted a pixel at a time using the
+ * mode's bitfields).  NULL if the handle isn't active.
+ **/ 
+const char  *video_get_pixel_format( VIDEO v );
+
+/**
+ * Copies the display's frame timing counters into "st".
+ * Cheap enough to call every frame, it doesn't stop
+ * presents in other threads.
+ * 
+ * \return ZERO on success.  -1 if the handle isn't active,
+ * "st" is NULL or the library was built without stats
+ * (-DVIDEO_NO_STATS), with errno set.
+ **/ 
+int         video_get_stats( VIDEO v, struct video_stats *st );
+
+/**
+ * Zeroes the display's frame timing counters.
+ **/ 
+void        video_reset_stats( VIDEO v );
+
+/**
+ * Copies the display's hardware counter totals per phase
+ * into "perf".  Cycles per byte and stalled cycles per
+ * cycle of VIDEO_PHASE_COPY tell you whether writes to
+ * video memory are limited by bandwidth or by stalls.
+ * 
+ * Counters are opened for the first few threads that
+ * present on the display.  Ones the CPU or kernel won't
+ * give us (virtual machines, perf_event_paranoid) are
+ * left out and their bit in "available" is clear; calls
+ * and time are kept regardless.
+ * 
+ * \return ZERO on success.  -1 if the handle isn't active,
+ * "perf" is NULL or the display wasn't started with
+ * perf_counters set, with errno set.
+ **/ 
+int         video_get_perf( VIDEO v, struct video_perf *perf );
+
+/**
+ * Paces the app's frames so they're drawn as late as they
+ * can be, for the least time between input and the screen.
+ * Call before drawing a frame, then draw and submit it: this
+ * sleeps until the expected render time plus the safety
+ * margin (video_options.pace_margin_us) before the next
+ * VBLANK there's time for, never the one the last frame
+ * went for.
+ * 
+ * The refresh period and phase are measured from every
+ * VBLANK a present waits for, and the render time is the
+ * 95th percentile of recent frames, from the return of this
+ * call to the submit.  A frame submitted after its VBLANK
+ * is a miss: the margin doubles (up to half a period) and
+ * eases back after a second or so on time.
+ * 
+ * Until a VBLANK has been seen it returns at once.
+ * 
+ * \return ZERO with the VBLANK the frame is for in 
+ * "vblank_ns" (may be NULL; ZERO if not known), -1 with
+ * errno set (EINVAL).
+ **/ 
+int         video_wait_until_render_start( VIDEO v, uint64_t *vblank_ns );
+
+/**
+ * \return ZERO with the pacing state in "st", -1 with errno
+ * set (EINVAL).
+ **/ 
+int         video_get_pace_stats( VIDEO v, struct video_pace_stats *st );
+
+/**
+ * Measures input to photon latency on "v": the time from an
+ * input event to the VBLANK that puts the frame answering it
+ * on the screen.
+ * 
+ * "path" is an evdev device (/dev/input/eventN), whose events
+ * are timestamped by the kernel on CLOCK_MONOTONIC, or a file
+ * of events recorded from one (cat /dev/input/eventN > file)
+ * which is played back in real time from now on, for testing
+ * without a touch screen.
+ * 
+ * Call video_latency_mark() before submitting a frame that
+ * responds to input.  The earliest input since the last mark
+ * goes with the next frame submitted, and once the present
+ * that shows it is done (the VBLANK it waited for or, if it
+ * didn't wait, the one the flip lands on) the times go into
+ * the histograms.  Only one per display.
+ * 
+ * \return The measurement, NULL with errno set (EINVAL, 
+ * EBUSY if the display has one, ENODEV if "path" isn't an
+ * input device or recording, or from open()).
+ **/ 
+struct video_latency *video_latency_open( VIDEO v, const char *path );
+
+/**
+ * Stops measuring.  Call it from the thread that submits
+ * frames, before video_stop().
+ **/ 
+void        video_latency_close( struct video_latency *l );
+
+/**
+ * \return The device's file descriptor, to poll() for input
+ * alongside the app's own; -1 (EINVAL) when playing back a
+ * recording.  Events are read by the calls below, don't read
+ * it.
+ **/ 
+int         video_latency_get_fd( struct video_latency *l );
+
+/**
+ * Marks the next frame submitted as the response to the
+ * input that's come in since the last mark.
+ * 
+ * \return ZERO, -1 with errno set (EAGAIN if there's been no
+ * input since the last mark, EINVAL).
+ **/ 
+int         video_latency_mark( struct video_latency *l );
+
+/**
+ * \return ZERO with the counts and histograms in "st", -1
+ * with errno set (EINVAL).
+ **/ 
+int         video_latency_get_stats( struct video_latency *l, struct video_latency_stats *st );
+
+/* Clears the counts and histograms */
+void        video_latency_reset( struct video_latency *l );
+
+/**
+ * \return The "pct" percentile of "h" in nanoseconds, to the
+ * millisecond above it (never more than the max), or ZERO if
+ * it's empty.
+ **/ 
+uint64_t    video_latency_percentile( const struct video_latency_hist *h, unsigned pct );
+
+/**
+ * Starts recording trace events, for every display and
+ * thread in the process.  Each thread keeps its last
+ * "events_per_thread" events (ZERO for 16384, rounded
+ * up to a power of two) in a ring only it writes to, so
+ * recording costs a clock read and a few stores.  The
+ * ring size is fixed by the first call.  Calling this
+ * again (after video_trace_stop()) throws away what was
+ * recorded; threads still recording are safe, each one
+ * starts over at its next event.
+ * 
+ * The library records, per display:
+ *   present        span, from video_submit_frame() (or the
+ *                  presenter thread) taking the frame until
+ *                  it's on its way to the screen
+ *   lock_wait      span, waiting on another thread using
+ *                  the display
+ *   copy           span, the frame into video memory
+ *   vsync          span, waiting for VBLANK
+ *   copy_slot      span, into the presenter's mailbox
+ *   acquire        instant, video_get_back_buffer()
+ *   submit         instant, frame handed to the presenter
+ *   flip           instant, page flip queued
+ *   lock_release   instant
+ *   record         span, copying the frame for the recorder
+ * 
+ * \return ZERO, -1 (EINVAL) if "events_per_thread" isn't
+ * the size fixed by the first call (ZERO again keeps it).
+ **/ 
+int         video_trace_start( size_t events_per_thread );
+
+/**
+ * Stops recording.  What was recorded is kept for
+ * video_trace_dump().
+ **/ 
+void        video_trace_stop( void );
+
+/**
+ * Writes every thread's recorded events to "path" as
+ * Chrome trace-event JSON: open it in chrome://tracing
+ * or https://ui.perfetto.dev.  Can be called while
+ * tracing is still running.
+ * 
+ * \return ZERO on success, -1 with errno set if nothing
+ * was ever traced or the file couldn't be written.
+ **/ 
+int         video_trace_dump( const char *path );
+
+/**
+ * Your own events, on the calling thread's timeline next
+ * to the library's, e.g. around each phase of rendering:
+ * 
+ *      video_trace_begin("draw");
+ *      ...
+ *      video_trace_end("draw");
+ * 
+ * Begin/end pairs must nest on a thread.  "name" is kept
+ * as a pointer, not copied, so it must still be valid
+ * when the trace is dumped (use string literals).  Does
+ * nothing while tracing is stopped.
+ **/ 
+void        video_trace_begin( const char *name );
+void        video_trace_end( const char *name );
+void        video_trace_instant( const char *name );
+
+/**
+ * Starts recording every frame presented on the display to
+ * "path", for finding out later what the panel showed.  Each
+ * frame is copied into a queue of "queue_frames" (ZERO for
+ * 4) and a thread of the recorder's own compresses it and
+ * writes it out.  Frames are stored as what changed since
+ * the one before (runs of unchanged and repeated pixels),
+ * losslessly, with when they were presented.  If the disk
+ * or the encoder falls behind and the queue fills up, frames
+ * are dropped rather than holding up the present.
+ * 
+ * Presenting costs one extra copy of the frame while
+ * recording.  With tile_diff, frames identical to the last
+ * one aren't recorded (they don't change anything).
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ * EBUSY means the display is already recording.
+ **/ 
+int         video_record_start( VIDEO v, const char *path, int queue_frames );
+
+/**
+ * Writes out what's queued and closes the recording.  Also
+ * done by video_stop().
+ * 
+ * \return ZERO on success, -1 with errno set if the display
+ * wasn't recording.
+ **/ 
+int         video_record_stop( VIDEO v );
+
+/**
+ * \return ZERO on success, -1 with errno set if the display
+ * isn't recording.
+ **/ 
+int         video_get_record_stats( VIDEO v, struct video_record_stats *st );
+
+/**
+ * Reads a recording's size, length and frame count without
+ * playing it.  A recording that was cut short (the recorder
+ * never stopped) is good up to its last whole frame.
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ **/ 
+int         video_record_info( const char *path, struct video_record_info *info );
+
+/**
+ * Plays a recording back on the display through
+ * video_submit_frame(), frames as far apart as they were
+ * recorded.  The display has to be the size the recording
+ * was made at.  Returns when the recording ends (or where
+ * it's damaged).  See test/video_replay.c.
+ * 
+ * \return The number of frames shown, -1 with errno set
+ * if the file isn't a recording or doesn't fit the display.
+ **/ 
+ssize_t     video_replay( VIDEO v, const char *path );
+
+/**
+ * Fills in "s" for drawing on a frame buffer of this display
+ * (video_get_empty_buffer(), video_buffer_acquire()).
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ **/ 
+int         video_get_surface( VIDEO v, void *buf_pixels, struct video_surface *s );
+
+/**
+ * Makes "sub" the part of "s" under "r" (clipped to "s"),
+ * sharing its pixels.  Draw on it to clip drawing to "r";
+ * coordinates on it start at r's top left.
+ * 
+ * \return ZERO on success, -1 if nothing of "r" is on "s".
+ **/ 
+int         video_surface_sub( const struct video_surface *s, const struct video_rect *r, struct video_surface *sub );
+
+/**
+ * Drawing primitives.  Each one works out once what part of
+ * the shape is on the surface and then writes whole rows of
+ * pixels at a time with the same SIMD loops the display
+ * uses, there's no test per pixel.  "mode" is one of
+ * VIDEO_BLEND_*.  Outlines are one pixel wide; rectangle and
+ * ellipse outlines never draw a pixel twice, so blended ones
+ * come out even.
+ **/ 
+
+/* Solid rectangle */
+void        video_fill_rect( const struct video_surface *s, const struct video_rect *r, uint32_t color, int mode );
+
+/* Outline of a rectangle, inside its edges */
+void        video_draw_rect( const struct video_surface *s, const struct video_rect *r, uint32_t color, int mode );
+
+/* "len" pixels right (or down) from x, y */
+void        video_draw_hline( const struct video_surface *s, int x, int y, int len, uint32_t color, int mode );
+void        video_draw_vline( const struct video_surface *s, int x, int y, int len, uint32_t color, int mode );
+
+/**
+ * Bresenham line, both ends included.  Clipping doesn't
+ * move any of the pixels that are left.
+ **/ 
+void        video_draw_line( const struct video_surface *s, int x0, int y0, int x1, int y1, uint32_t color, int mode );
+
+/**
+ * Ellipse centered on cx, cy, "rx" pixels out to the left and
+ * right and "ry" up and down (a circle is 2r + 1 wide).  Radii
+ * over 16384 are cut to that.
+ **/ 
+void        video_draw_ellipse( const struct video_surface *s, int cx, int cy, int rx, int ry, uint32_t color, int mode );
+void        video_fill_ellipse( const struct video_surface *s, int cx, int cy, int rx, int ry, uint32_t color, int mode );
+void        video_draw_circle( const struct video_surface *s, int cx, int cy, int r, uint32_t color, int mode );
+void        video_fill_circle( const struct video_surface *s, int cx, int cy, int r, uint32_t color, int mode );
+
+/**
+ * Closed polygon through "n" points.  The fill covers the
+ * pixels whose centers are inside (non-zero winding, so 
+ * shapes that cross themselves are filled solid) and 
+ * polygons that share an edge don't overlap.
+ * 
+ * video_fill_polygon() returns ZERO, or -1 with errno set 
+ * if out of memory.
+ **/ 
+void        video_draw_polygon( const struct video_surface *s, const struct video_point *pts, size_t n, uint32_t color, int mode );
+int         video_fill_polygon( const struct video_surface *s, const struct video_point *pts, size_t n, uint32_t color, int mode );
+
+/**
+ * Building paths.  Each call returns ZERO, or -1 with errno
+ * set (ENOMEM, or EINVAL for a coordinate that's infinite
+ * or not a number).  A line or curve with no subpath under
+ * way starts one at the current point, which after a close
+ * is where the closed subpath began.  Reset empties a path
+ * but keeps its memory for building the next one.
+ **/ 
+struct video_path *video_path_create( void );
+void        video_path_destroy( struct video_path *p );
+void        video_path_reset( struct video_path *p );
+int         video_path_move_to( struct video_path *p, float x, float y );
+int         video_path_line_to( struct video_path *p, float x, float y );
+int         video_path_quad_to( struct video_path *p, float cx, float cy, float x, float y );
+int         video_path_cubic_to( struct video_path *p, float c1x, float c1y, float c2x, float c2y, float x, float y );
+int         video_path_close( struct video_path *p );
+
+/**
+ * Appends the outline of "src" stroked with "stroke" to
+ * "dst" (a different path), as pieces that overlap: fill it
+ * with VIDEO_FILL_NONZERO.
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ **/ 
+int         video_path_stroke( struct video_path *dst, const struct video_path *src, const struct video_stroke *stroke );
+
+/**
+ * Fills a path anti-aliased, every subpath closed, by "rule"
+ * (VIDEO_FILL_*).  Curves are flattened to within a tenth of
+ * a pixel.  Memory used is about 4 bytes per pixel of the
+ * path's bounding box on the surface, whatever the surface
+ * size.  With VIDEO_BLEND_COPY the color replaces what's
+ * there inside and is mixed in by coverage along the edges
+ * as if it were opaque.
+ * 
+ * video_stroke_path() strokes then fills in one go.
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ **/ 
+int         video_fill_path( const struct video_surface *s, const struct video_path *p, uint32_t color, int mode, int rule );
+int         video_stroke_path( const struct video_surface *s, const struct video_path *p, const struct video_stroke *stroke, uint32_t color, int mode );
+
+/**
+ * Draws "src" onto "dst" with its top left at r->x, r->y,
+ * at most r->width x r->height of it (NULL "r": all of it
+ * at 0, 0), clipped to "dst".  For part of a source, blit
+ * a video_surface_sub() of it.  "mode" is a VIDEO_BLIT_*.
+ * The surfaces mustn't overlap.
+ * 
+ * The whole rectangle goes to the SIMD loops in one call.
+ * Blending is rounded exactly (the same on every CPU) and
+ * runs of fully opaque or fully transparent source pixels
+ * are copied or skipped without it.
+ * 
+ * video_blit_ex() adds "opacity" (0 - 255) which fades the 
+ * source in the OVER modes, and "key", the color left out
+ * by VIDEO_BLIT_KEY.
+ * 
+ * \return ZERO on success, -1 with errno set (EINVAL)
+ * otherwise.
+ **/ 
+int         video_blit( const struct video_surface *dst, const struct video_surface *src, const struct video_rect *r, int mode );
+int         video_blit_ex( const struct video_surface *dst, const struct video_surface *src, const struct video_rect *r, 
+                           int mode, uint32_t opacity, uint32_t key );
+
+/**
+ * Draws "src" transformed by "m" (rotated, scaled, sheared)
+ * with VIDEO_BLIT_COPY, _OVER or _PREMUL and "opacity" as 
+ * video_blit_ex(), sampled by "filter" (VIDEO_FILTER_*).
+ * 
+ * The transformed source's bounding box is clipped to "dst"
+ * first, then each row works out in fixed point exactly which
+ * pixels sample inside the source, so the loops that step
+ * across it don't check bounds.  Bilinear fades the source's
+ * edge out over a pixel; it's best on premultiplied pixels,
+ * with straight alpha the color of clear texels bleeds into
+ * the edge.  Sources can be up to 32767 pixels each way.
+ * 
+ * \return ZERO on success (a matrix that flattens the source
+ * draws nothing), -1 with errno set (EINVAL) otherwise.
+ **/ 
+int         video_blit_affine( const struct video_surface *dst, const struct video_surface *src, const struct video_matrix *m,
+                               int mode, int filter, uint32_t opacity );
+
+/**
+ * Loads a font from a file or memory ("data" is copied):
+ * TrueType (.ttf, the first font of a .ttc) with glyf
+ * outlines, or PSF version 1 or 2 (.psf, Linux console
+ * fonts, not gzipped).  PSF glyphs are drawn at whole
+ * multiples of their size.
+ * 
+ * \return The font, NULL with errno set (EINVAL if it isn't
+ * a font we can read) otherwise.
+ **/ 
+struct video_font *video_font_load( const char *path );
+struct video_font *video_font_load_mem( const void *data, size_t len );
+void        video_font_free( struct video_font *f );
+
+/**
+ * Ascent, descent and line height of "f" at "size" pixels
+ * per em (1 - 1024).  PSF fonts have no baseline, it's taken
+ * to be a quarter of the height up from the bottom.
+ * 
+ * \return ZERO on success, -1 with errno set (EINVAL).
+ **/ 
+int         video_font_metrics( const struct video_font *f, int size, struct video_font_metrics *m );
+
+/**
+ * A cache of rasterized glyphs, keyed by font, size and
+ * code point, packed into 256x256 8 bit atlas pages.  At
+ * most "budget" bytes of pages (at least one) are made; when
+ * they're all full, the least recently used page is emptied.
+ * One cache can be shared by threads, draws through it take
+ * turns.
+ * 
+ * \return The cache, NULL if out of memory.
+ **/ 
+struct video_glyph_cache *video_glyph_cache_create( size_t budget );
+void        video_glyph_cache_destroy( struct video_glyph_cache *c );
+void        video_glyph_cache_get_stats( struct video_glyph_cache *c, struct video_glyph_cache_stats *st );
+
+/**
+ * \return How wide "utf8" is drawn with "f" at "size", in
+ * pixels (the widest line), -1 with errno set (EINVAL).
+ **/ 
+int         video_text_width( const struct video_font *f, int size, const char *utf8 );
+
+/**
+ * Draws UTF-8 "utf8" in "color" (its alpha blended with the
+ * glyphs' coverage) with the baseline's left end at (x, y),
+ * clipped to "s".  A newline starts a line one line height
+ * down.  Pairs kerned by the font's 'kern' table are moved
+ * closer; bytes that aren't UTF-8 draw as U+FFFD and missing
+ * characters as the font's missing glyph.
+ * 
+ * \return The width drawn as video_text_width(), -1 with
+ * errno set otherwise.
+ **/ 
+int         video_draw_text( const struct video_surface *s, struct video_glyph_cache *c, const struct video_font *f, int size,
+                             int x, int y, const char *utf8, uint32_t color );
+
+/**
+ * A display list with "threads" workers (ZERO for one per
+ * CPU, at most 16), the calling thread being one of them.
+ * The worker threads sleep between executes.
+ * 
+ * \return The list, NULL if out of memory.
+ **/ 
+struct video_dlist *video_dlist_create( int threads );
+void        video_dlist_destroy( struct video_dlist *dl );
+
+/**
+ * Forgets what was recorded, keeping the memory for the next
+ * frame.
+ **/ 
+void        video_dlist_reset( struct video_dlist *dl );
+
+/**
+ * Record the drawing calls of the same names, to be drawn in
+ * this order by video_dlist_execute().  Paths and text are
+ * copied.  Source surfaces, fonts and glyph caches are used
+ * at execute, they must still be there; a source must not be
+ * the surface the list is drawn on.
+ * 
+ * \return ZERO, -1 with errno set (EINVAL, ENOMEM).
+ **/ 
+int         video_dlist_fill_rect( struct video_dlist *dl, const struct video_rect *r, uint32_t color, int mode );
+int         video_dlist_blit( struct video_dlist *dl, const struct video_surface *src, const struct video_rect *r,
+                              int mode, uint32_t opacity, uint32_t key );
+int         video_dlist_blit_affine( struct video_dlist *dl, const struct video_surface *src, const struct video_matrix *m,
+                                     int mode, int filter, uint32_t opacity );
+int         video_dlist_fill_path( struct video_dlist *dl, const struct video_path *p, uint32_t color, int mode, int rule );
+int         video_dlist_stroke_path( struct video_dlist *dl, const struct video_path *p, const struct video_stroke *stroke,
+                                     uint32_t color, int mode );
+int         video_dlist_text( struct video_dlist *dl, struct video_glyph_cache *cache, const struct video_font *font, int size,
+                              int x, int y, const char *utf8, uint32_t color );
+
+/**
+ * Draws the list on "s".  Paths are rasterized and text laid
+ * out in parallel, then every command is binned into the
+ * 64x64 tiles it touches and the workers draw tiles, taking
+ * work from each other when they run out.  Within a tile the
+ * commands run in the order recorded, and the pixels are
+ * exactly what the calls made one by one would give.  The
+ * list is kept, execute it again or reset it.
+ * 
+ * \return ZERO, -1 with errno set (the rest of the list is
+ * still drawn).
+ **/ 
+int         video_dlist_execute( struct video_dlist *dl, const struct video_surface *s );
+
+/**
+ * Executes the list straight into "buf_pixels" (a buffer of
+ * this display) and passes it to video_submit_frame().
+ * 
+ * \return ZERO, -1 with errno set (nothing submitted).
+ **/ 
+int         video_dlist_submit( VIDEO v, struct video_dlist *dl, void *buf_pixels );
+
+/**
+ * A compositor for "v": layers in a retained frame that's
+ * "background" (0xAARRGGBB) where no layer covers it.
+ * Layers and the compositor are used from one thread.
+ * 
+ * \return The compositor, NULL with errno set (EINVAL,
+ * ENOMEM).
+ **/ 
+struct video_compositor *video_compositor_create( VIDEO v, uint32_t background );
+
+/* Frees it and every layer still in it */
+void        video_compositor_destroy( struct video_compositor *c );
+void        video_compositor_set_background( struct video_compositor *c, uint32_t background );
+
+/**
+ * Composites what changed since the last present and submits
+ * it with video_submit_regions().  What changed is what was
+ * passed to video_layer_damage(), plus where layers were and
+ * are now if they moved, appeared, went, or changed opacity
+ * or order; the first frame is all of it.  Damage is made
+ * disjoint, then for each part only what shows of each
+ * layer is drawn: what's under an opaque layer (see
+ * VIDEO_LAYER_OPAQUE) is skipped, the background is only
+ * filled where no opaque layer covers it.
+ * 
+ * Nothing changed: nothing's drawn, it waits for VBLANK.
+ * 
+ * \return As video_submit_regions(), -1 with errno set.
+ **/ 
+ssize_t     video_compositor_present( struct video_compositor *c );
+void        video_compositor_get_stats( struct video_compositor *c, struct video_compositor_stats *st );
+
+/**
+ * A "width" x "height" layer (at most 32768 each way) at 0, 0,
+ * shown and at full opacity, its pixels all 0x00000000.
+ * Higher "z" is on top, layers with the same z are stacked in
+ * the order made.  "flags" are VIDEO_LAYER_*.
+ * 
+ * \return The layer, NULL with errno set (EINVAL, ENOMEM).
+ **/ 
+struct video_layer *video_layer_create( struct video_compositor *c, int width, int height, int z, unsigned flags );
+
+/* Where it was is composited again at the next present */
+void        video_layer_destroy( struct video_layer *l );
+
+/**
+ * The layer's pixels, to draw on.  Say what was drawn with
+ * video_layer_damage() or the screen won't show it.
+ * 
+ * \return ZERO, -1 with errno set (EINVAL).
+ **/ 
+int         video_layer_get_surface( struct video_layer *l, struct video_surface *s );
+
+/* Take effect at the next present.  "opacity" is 0 - 255 */
+void        video_layer_move( struct video_layer *l, int x, int y );
+void        video_layer_set_z( struct video_layer *l, int z );
+void        video_layer_set_opacity( struct video_layer *l, uint32_t opacity );
+void        video_layer_set_visible( struct video_layer *l, int visible );
+
+/**
+ * "r" of the layer (its own coordinates; NULL for all of it)
+ * was drawn on and has to be composited again.  Past 16
+ * rectangles a frame they're kept as their bounds.
+ **/ 
+void        video_layer_damage( struct video_layer *l, const struct video_rect *r );
+
 /**
  * \return The size in bytes of a buffer required
  * to hold enough pixel color data to display on
- * the screen.
+ * the screen: width * height * 4.
  **/ 
 size_t      video_get_req_buffer_size( VIDEO v );
 
@@ -153,12 +1548,54 @@ size_t      video_get_req_buffer_size( VIDEO v );
  * buffer returned by a call to this function
  * may be passed to video_submit_frame().
  * 
+ * Pixels are always ARGB8888 (0xAARRGGBB) and rows
+ * are packed, one row is video_get_width() pixels
+ * whatever the panel's format or stride.  The frame 
+ * is converted for the panel when it's submitted.
+ * 
+ * Each call allocates a new buffer that's yours to
+ * free().  For buffers you'll keep getting and dropping
+ * use video_buffer_acquire().
+ * 
  * \return On success, a memory buffer sized
  * to represent all pixels comprising the video
  * device.  On failure, NULL/
  **/ 
 void        *video_get_empty_buffer( VIDEO v );
 
+/**
+ * Gets a frame buffer (width * height * 4 bytes, page 
+ * aligned) from the display's pool.  Give it back with
+ * video_buffer_release() instead of free() and the next
+ * acquire reuses it: no allocator churn, and no page
+ * faults after the first frame.  A buffer fresh from
+ * the system is zeroed, a reused one has whatever was
+ * drawn on it last.
+ * 
+ * The pool grows to the most buffers you've ever had out
+ * at once and is freed by video_stop().  Buffers can be
+ * given to video_submit_frame() like any other.  Safe to
+ * call from any thread.
+ * 
+ * \return The buffer, or NULL if out of memory or the
+ * handle isn't active.
+ **/ 
+void        *video_buffer_acquire( VIDEO v );
+
+/**
+ * Puts a buffer from video_buffer_acquire() back in the
+ * pool.  Don't use it after this.
+ **/ 
+void        video_buffer_release( VIDEO v, void *buf );
+
+/**
+ * How the display's buffer pool is doing.  Lots of
+ * misses after start up mean pool_buffers is too small.
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ **/ 
+int         video_get_pool_stats( VIDEO v, struct video_pool_stats *st );
+
 /**
  * Colors the screen BLACK i.e. sets video
  * buffer to all zeros.
@@ -198,7 +1635,9 @@ void        *video_get_raw_ptr( VIDEO v );
 
 /**
  * Returns the stride (pitch) of the current
- * video mode.
+ * video mode: bytes between rows in video memory.
+ * Not to be confused with the buffers you draw
+ * on, which have no padding.
  **/ 
 size_t      video_get_stride_pitch( VIDEO v );
 
@@ -210,9 +1649,24 @@ size_t      video_get_stride_pitch( VIDEO v );
  **/
 size_t      video_get_pixel_count( VIDEO v );
     
+/**
+ * \return The name of the set of copy/fill/read loops
+ * this display is using: "scalar" (plain C, the
+ * reference), "sse2", "avx2" or "neon".  The fastest one
+ * the CPU supports is picked by video_start() unless
+ * video_options.kernels says otherwise.  NULL if the
+ * VIDEO handle isn't active.
+ **/ 
+const char  *video_get_kernel_set( VIDEO v );
+
 /**
  * Get the underlying fb_var_screeninfo struct information.
  * 
+ * This reflects the mode that is active: when page flipping
+ * yres_virtual is a multiple of yres (the number of pages)
+ * and yoffset is the offset of the page being displayed.
+ * In copy mode it's the mode as we found it.
+ * 
  * \note This data should NOT BE CHANGED while a valid VIDEO
  * handle exists for the display in question.  If your plan
  * is to change the screen mode with an ioctl() call, first
@@ -248,7 +1702,15 @@ int         video_get_fb_fix_screeninfo( VIDEO v, void *pdest, size_t buf_len );
 
 /**
  * Copies the current pixel/color bits displayed on the 
- * display into the buffer "pdest"
+ * display into the buffer "pdest", converted to ARGB8888
+ * the same as a buffer from video_get_empty_buffer().
+ * 
+ * With the shadow option this is a plain memory copy of
+ * the frame as it was submitted, which on a 16 bit panel
+ * has more color precision than what's on the glass.
+ * Frames drawn straight into video memory (a back buffer
+ * or video_acquire_back_buffer()) are read from video
+ * memory the first time.
  * 
  * \return int
  * On success, this function returns ZERO.  If a NEGATIVE number
@@ -260,6 +1722,16 @@ int         video_get_fb_fix_screeninfo( VIDEO v, void *pdest, size_t buf_len );
  * 
  **/ 
 int         video_get_current_pixel_data( VIDEO v, void *pdest, size_t buf_len );
+
+/**
+ * Like video_get_current_pixel_data() but only the area
+ * "rect", which must be on the screen.  Row y of it is
+ * written at (char *)pdest + y * stride; a "stride" of 
+ * ZERO means rect->width * 4.
+ * 
+ * \return ZERO on success, -1 with errno set otherwise.
+ **/ 
+int         video_read_region( VIDEO v, const struct video_rect *rect, void *pdest, size_t stride );
   
   
 #ifdef __cplusplus
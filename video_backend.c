@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video.h"
+#include "video_backend.h"
+
+#define VIDEO_HEADLESS_WIDTH        800     /* Defaults: the Raspberry Pi 7" touchscreen */
+#define VIDEO_HEADLESS_HEIGHT       480
+
+
+/*
+ +================================================================================+
+ |                                 /dev/fbN                                       |
+ +================================================================================+
+*/
+
+static int fbdev_ioctl( struct video_backend *b, unsigned long req, void *arg ) {
+    return ioctl(b->fd, req, arg);
+}
+
+static void *fbdev_map( struct video_backend *b, size_t len ) {
+    return mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+}
+
+static void fbdev_unmap( struct video_backend *b, void *p, size_t len ) {
+    munmap(p, len);
+}
+
+static void fbdev_close( struct video_backend *b ) {
+    close(b->fd);
+    b->fd = -1;
+}
+
+static const struct video_backend_ops fbdev_ops = {
+    "fbdev",
+    &fbdev_ioctl,
+    &fbdev_map,
+    &fbdev_unmap,
+    &fbdev_close
+};
+
+int video_backend_open_fbdev( struct video_backend *b, const char *path ) {
+    memset(b, 0, sizeof(struct video_backend));
+    b->ops = &fbdev_ops;
+    b->fd  = open(path, O_RDWR);
+    return (b->fd < 0) ? -1 : 0;
+}
+
+
+/*
+ +================================================================================+
+ |                                  Headless                                      |
+ +================================================================================+
+*/
+
+/**
+ * Sleeps until the next multiple of the refresh period,
+ * counted from when the display was opened.
+ **/
+static int headless_wait_vsync( struct video_backend *b ) {
+    struct timespec now,
+                    next;
+    long long       elapsed,
+                    t;
+
+    if (b->vsync_ns <= 0) return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - b->epoch.tv_sec) * 1000000000LL + (now.tv_nsec - b->epoch.tv_nsec);
+    t       = ((elapsed / b->vsync_ns) + 1) * b->vsync_ns;
+
+    next.tv_sec  = b->epoch.tv_sec + (b->epoch.tv_nsec + t) / 1000000000LL;
+    next.tv_nsec = (b->epoch.tv_nsec + t) % 1000000000LL;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, 0) == EINTR);
+    return 0;
+}
+
+/**
+ * Only the geometry of the virtual screen can change, and only
+ * as far as the memory we allocated up front allows.
+ **/
+static int headless_put_var( struct video_backend *b, const struct fb_var_screeninfo *var ) {
+    if (var->xres != b->var.xres || var->yres != b->var.yres ||
+        var->bits_per_pixel != b->var.bits_per_pixel ||
+        var->xres_virtual != b->var.xres_virtual ||
+        var->yres_virtual < var->yres ||
+        (size_t)var->yres_virtual * b->fix.line_length > b->fix.smem_len ||
+        var->yoffset + var->yres > var->yres_virtual)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    b->var.yres_virtual = var->yres_virtual;
+    b->var.xoffset      = var->xoffset;
+    b->var.yoffset      = var->yoffset;
+    return 0;
+}
+
+static int headless_ioctl( struct video_backend *b, unsigned long req, void *arg ) {
+    const struct fb_var_screeninfo *var = (const struct fb_var_screeninfo *)arg;
+
+    switch (req) {
+        case FBIOGET_FSCREENINFO:
+            memcpy(arg, &b->fix, sizeof(struct fb_fix_screeninfo));
+            return 0;
+
+        case FBIOGET_VSCREENINFO:
+            memcpy(arg, &b->var, sizeof(struct fb_var_screeninfo));
+            return 0;
+
+        case FBIOPUT_VSCREENINFO:
+            return headless_put_var(b, var);
+
+        case FBIOPAN_DISPLAY:
+            if (var->yoffset + b->var.yres > b->var.yres_virtual) {
+                errno = EINVAL;
+                return -1;
+            }
+            b->var.xoffset = var->xoffset;
+            b->var.yoffset = var->yoffset;
+            return 0;
+
+        case FBIO_WAITFORVSYNC:
+            return headless_wait_vsync(b);
+    }
+    errno = ENOTTY;
+    return -1;
+}
+
+static const struct video_backend_ops headless_ops = {
+    "headless",
+    &headless_ioctl,
+    &fbdev_map,
+    &fbdev_unmap,
+    &fbdev_close
+};
+
+int video_backend_open_headless( struct video_backend *b, const struct video_headless *cfg ) {
+    struct fb_var_screeninfo    *var = &b->var;
+    struct fb_fix_screeninfo    *fix = &b->fix;
+    int                         bpp;
+
+    memset(b, 0, sizeof(struct video_backend));
+    b->ops = &headless_ops;
+    b->fd  = -1;
+
+    bpp = cfg->bpp ? cfg->bpp : 32;
+    if (bpp != 16 && bpp != 24 && bpp != 32) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    var->xres           = cfg->width  > 0 ? cfg->width  : VIDEO_HEADLESS_WIDTH;
+    var->yres           = cfg->height > 0 ? cfg->height : VIDEO_HEADLESS_HEIGHT;
+    var->xres_virtual   = var->xres;
+    var->yres_virtual   = var->yres;
+    var->bits_per_pixel = bpp;
+
+    if (bpp == 16) {
+        var->red.offset   = 11;  var->red.length   = 5;
+        var->green.offset = 5;   var->green.length = 6;
+        var->blue.offset  = 0;   var->blue.length  = 5;
+    } else {
+        var->red.offset   = 16;  var->red.length   = 8;
+        var->green.offset = 8;   var->green.length = 8;
+        var->blue.offset  = 0;   var->blue.length  = 8;
+        if (bpp == 32) {
+            var->transp.offset = 24;
+            var->transp.length = 8;
+        }
+    }
+
+    if (cfg->refresh_us > 0) {
+        /* Enough for the frame rate to show up in fbset and friends */
+        var->pixclock = (uint32_t)(((long long)cfg->refresh_us * 1000000LL) / 
+                                   ((long long)var->xres * var->yres));
+    }
+
+    memcpy(fix->id, "headless", sizeof("headless"));
+    fix->type           = FB_TYPE_PACKED_PIXELS;
+    fix->visual         = FB_VISUAL_TRUECOLOR;
+    fix->ypanstep       = 1;
+    fix->line_length    = (cfg->stride > 0) ? cfg->stride : var->xres * (bpp / 8);
+
+    if (fix->line_length < var->xres * (bpp / 8)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Room for page flipping */
+    fix->smem_len       = fix->line_length * var->yres * VIDEO_MAX_BUFFERS;
+
+    if (cfg->path) {
+        b->fd = open(cfg->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    } else {
+        b->fd = memfd_create("libvideo-headless", MFD_CLOEXEC);
+    }
+    if (b->fd < 0) return -1;
+
+    if (ftruncate(b->fd, fix->smem_len)) {
+        close(b->fd);
+        b->fd = -1;
+        return -1;
+    }
+
+    b->vsync_ns = (long long)cfg->refresh_us * 1000LL;
+    clock_gettime(CLOCK_MONOTONIC, &b->epoch);
+    return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_BACKEND_H_
+#define _VIDEO_BACKEND_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Where video memory comes from.  The library talks to its
+ * display through the handful of fbdev ioctls it needs and
+ * one mmap(), so a backend is just those calls:
+ *
+ *   fbdev      - a real /dev/fbN
+ *   headless   - memory (memfd or a file) that answers the
+ *                same ioctls, with VBLANK simulated by a
+ *                timer.  For benchmarks and CI.
+ **/
+
+#include <time.h>
+#include <linux/fb.h>
+
+struct video_headless;
+struct video_backend;
+
+struct video_backend_ops {
+    const char  *name;
+    int         (*ioctl)( struct video_backend *b, unsigned long req, void *arg );
+    void        *(*map)( struct video_backend *b, size_t len );
+    void        (*unmap)( struct video_backend *b, void *p, size_t len );
+    void        (*close)( struct video_backend *b );
+};
+
+struct video_backend {
+    const struct video_backend_ops  *ops;
+    int                             fd;
+
+    /* Headless only: the mode we pretend to have */
+    struct fb_var_screeninfo        var;
+    struct fb_fix_screeninfo        fix;
+    long long                       vsync_ns;
+    struct timespec                 epoch;
+};
+
+/**
+ * \return ZERO on success, -1 with errno set otherwise.
+ **/
+int         video_backend_open_fbdev( struct video_backend *b, const char *path );
+int         video_backend_open_headless( struct video_backend *b, const struct video_headless *cfg );
+
+static inline int video_backend_ioctl( struct video_backend *b, unsigned long req, void *arg ) {
+    return b->ops->ioctl(b, req, arg);
+}
+
+static inline void *video_backend_map( struct video_backend *b, size_t len ) {
+    return b->ops->map(b, len);
+}
+
+static inline void video_backend_unmap( struct video_backend *b, void *p, size_t len ) {
+    b->ops->unmap(b, p, len);
+}
+
+static inline void video_backend_close( struct video_backend *b ) {
+    b->ops->close(b);
+}
+
+#endif
@@ -0,0 +1,387 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#include "video.h"
+#include "video_draw.h"
+#include "video_blit.h"
+
+/**
+ * Clips "r" (src's top left lands on r->x, r->y, at most
+ * r->width x r->height of it) to both surfaces.
+ *
+ * \return ZERO with the pixels to blit in "d" (in dst) and
+ * "sx", "sy" (where they start in src), -1 if none.
+ **/
+static int blit_clip( const struct video_surface *dst, const struct video_surface *src, const struct video_rect *r,
+                      struct video_rect *d, int *sx, int *sy )
+{
+    int64_t x0, y0, x1, y1, w, h;
+
+    x0 = r ? r->x : 0;
+    y0 = r ? r->y : 0;
+    w  = r ? ((r->width < src->width) ? r->width : src->width) : src->width;
+    h  = r ? ((r->height < src->height) ? r->height : src->height) : src->height;
+    x1 = x0 + w;
+    y1 = y0 + h;
+
+    *sx = (x0 < 0) ? (int)-x0 : 0;
+    *sy = (y0 < 0) ? (int)-y0 : 0;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > dst->width) x1 = dst->width;
+    if (y1 > dst->height) y1 = dst->height;
+    if (x1 <= x0 || y1 <= y0) return -1;
+
+    d->x        = (int)x0;
+    d->y        = (int)y0;
+    d->width    = (int)(x1 - x0);
+    d->height   = (int)(y1 - y0);
+    return 0;
+}
+
+int video_blit_ex( const struct video_surface *dst, const struct video_surface *src, const struct video_rect *r,
+                   int mode, uint32_t opacity, uint32_t key )
+{
+    const struct video_kernels  *k = video_draw_kernels();
+    struct video_rect           d;
+    uint32_t                    *dp;
+    const uint32_t              *sp;
+    int                         sx, sy, y;
+
+    if (!dst || !src || mode < VIDEO_BLIT_COPY || mode > VIDEO_BLIT_PREMUL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!dst->pixels || !src->pixels || dst->width <= 0 || dst->height <= 0 || src->width <= 0 || src->height <= 0) return 0;
+    if (opacity > 255) opacity = 255;
+    if (!opacity && (mode == VIDEO_BLIT_OVER || mode == VIDEO_BLIT_PREMUL)) return 0;
+    if (blit_clip(dst, src, r, &d, &sx, &sy)) return 0;
+
+    dp = video_surface_row(dst, d.y) + d.x;
+    sp = video_surface_row(src, sy) + sx;
+
+    switch (mode) {
+    case VIDEO_BLIT_COPY:
+        for (y = 0; y < d.height; y++) {
+            memcpy(video_surface_row(dst, d.y + y) + d.x, video_surface_row(src, sy + y) + sx, (size_t)d.width * sizeof(uint32_t));
+        }
+        break;
+
+    case VIDEO_BLIT_KEY:
+        k->blit_key(dp, dst->stride, sp, src->stride, d.width, d.height, key);
+        break;
+
+    case VIDEO_BLIT_OVER:
+        k->blit_over(dp, dst->stride, sp, src->stride, d.width, d.height, opacity);
+        break;
+
+    case VIDEO_BLIT_PREMUL:
+        k->blit_premul(dp, dst->stride, sp, src->stride, d.width, d.height, opacity);
+        break;
+    }
+    return 0;
+}
+
+int video_blit( const struct video_surface *dst, const struct video_surface *src, const struct video_rect *r, int mode ) {
+    return video_blit_ex(dst, src, r, mode, 255, 0);
+}
+
+/*****************************************************************************
+ * Affine blits
+ *****************************************************************************/
+
+#define BLIT_CHUNK              256             /* Samples taken at a time, on the stack        */
+#define BLIT_MAX_SIZE           32767           /* Source width/height, keeps 16.16 in 32 bits  */
+#define BLIT_ONE                65536
+
+/* 16.16 of "x", kept well inside 64 bits for wild matrices */
+static inline int64_t blit_fixed( double x ) {
+    if (x > 1e9) x = 1e9;
+    if (x < -1e9) x = -1e9;
+    return (int64_t)(x * BLIT_ONE + ((x >= 0) ? 0.5 : -0.5));
+}
+
+static inline int64_t blit_min( int64_t a, int64_t b ) {
+    return (a < b) ? a : b;
+}
+
+static inline int64_t blit_max( int64_t a, int64_t b ) {
+    return (a > b) ? a : b;
+}
+
+static inline int64_t blit_floor_div( int64_t a, int64_t b ) {
+    int64_t q = a / b;
+    return (a % b && a < 0) ? q - 1 : q;
+}
+
+/**
+ * Narrows [*x0, *x1) to the x where lo <= a + x * d < hi,
+ * exactly, so sampling inside the span needs no checks.
+ **/
+static void blit_solve( int64_t a, int64_t d, int64_t lo, int64_t hi, int64_t *x0, int64_t *x1 ) {
+    int64_t s, e;
+
+    if (!d) {
+        if (a < lo || a >= hi) *x1 = *x0;
+        return;
+    }
+    if (d > 0) {
+        s = -blit_floor_div(a - lo, d);
+        e = -blit_floor_div(a - hi, d);
+    } else {
+        s = blit_floor_div(a - hi, -d) + 1;
+        e = blit_floor_div(a - lo, -d) + 1;
+    }
+    if (s > *x0) *x0 = s;
+    if (e < *x1) *x1 = e;
+    if (*x1 < *x0) *x1 = *x0;
+}
+
+static void blit_nearest( uint32_t *out, const struct video_surface *src, int64_t u, int64_t v, 
+                          int64_t du, int64_t dv, int n ) 
+{
+    int i;
+
+    for (i = 0; i < n; i++, u += du, v += dv) out[i] = video_surface_row(src, (int)(v >> 16))[u >> 16];
+}
+
+static inline uint32_t blit_texel( const struct video_surface *src, int64_t x, int64_t y ) {
+    if (x < 0 || y < 0 || x >= src->width || y >= src->height) return 0;
+    return video_surface_row(src, (int)y)[x];
+}
+
+/**
+ * Bilinear samples near the source's edge, where some of
+ * the four texels are outside it: those count as clear, so
+ * the edge fades out over a pixel instead of stepping.
+ **/
+static void blit_bilinear_edge( uint32_t *out, const struct video_surface *src, int64_t u, int64_t v, 
+                                int64_t du, int64_t dv, int n ) 
+{
+    int64_t x, y;
+    int     i;
+
+    for (i = 0; i < n; i++, u += du, v += dv) {
+        x       = u >> 16;
+        y       = v >> 16;
+        out[i]  = video_bilerp_px(blit_texel(src, x, y), blit_texel(src, x + 1, y),
+                                  blit_texel(src, x, y + 1), blit_texel(src, x + 1, y + 1),
+                                  (uint32_t)(u >> 8) & 0xFF, (uint32_t)(v >> 8) & 0xFF);
+    }
+}
+
+/**
+ * Samples "n" pixels starting at "d" on the destination and 
+ * puts them there by "mode", BLIT_CHUNK at a time.  "edge"
+ * picks the checked bilinear loop.
+ **/
+static void blit_span( const struct video_kernels *k, uint32_t *d, const struct video_surface *src, 
+                       int64_t u, int64_t v, int64_t du, int64_t dv, int n,
+                       int filter, int edge, int mode, uint32_t opacity ) 
+{
+    uint32_t    tmp[BLIT_CHUNK],
+                *out;
+    int         c;
+
+    for (; n > 0; n -= c, d += c, u += c * du, v += c * dv) {
+        c   = (n < BLIT_CHUNK) ? n : BLIT_CHUNK;
+        out = (mode == VIDEO_BLIT_COPY) ? d : tmp;
+
+        if (filter == VIDEO_FILTER_NEAREST) {
+            blit_nearest(out, src, u, v, du, dv, c);
+        } else if (edge) {
+            blit_bilinear_edge(out, src, u, v, du, dv, c);
+        } else {
+            k->sample_bilinear(out, src->pixels, src->stride, (int32_t)u, (int32_t)v, (int32_t)du, (int32_t)dv, (size_t)c);
+        }
+
+        if (mode == VIDEO_BLIT_OVER) {
+            k->blit_over(d, 0, tmp, 0, c, 1, opacity);
+        } else if (mode == VIDEO_BLIT_PREMUL) {
+            k->blit_premul(d, 0, tmp, 0, c, 1, opacity);
+        }
+    }
+}
+
+/**
+ * The inverse of "m" (destination to source) and the box on
+ * "dst" the source lands in, a texel bigger all round for
+ * bilinear's fade.
+ *
+ * \return ZERO, -1 if nothing is drawn (flat matrix, or off
+ * the surface).
+ **/
+static int blit_affine_box( const struct video_surface *dst, const struct video_surface *src, const struct video_matrix *m,
+                            int filter, double *inv, int64_t *box )
+{
+    double  det, cx[4], cy[4], minx, maxx, miny, maxy, fx, fy;
+    int     i, pad = (filter == VIDEO_FILTER_BILINEAR) ? 1 : 0;
+
+    det = (double)m->xx * m->yy - (double)m->xy * m->yx;
+    if (det == 0 || det - det != 0) return -1;
+    inv[0]  =  m->yy / det;
+    inv[1]  = -m->xy / det;
+    inv[2]  = -m->yx / det;
+    inv[3]  =  m->xx / det;
+
+    for (i = 0; i < 4; i++) {
+        fx      = (i & 1) ? src->width + pad : -pad;
+        fy      = (i & 2) ? src->height + pad : -pad;
+        cx[i]   = m->xx * fx + m->xy * fy + m->tx;
+        cy[i]   = m->yx * fx + m->yy * fy + m->ty;
+    }
+    minx = maxx = cx[0];
+    miny = maxy = cy[0];
+    for (i = 1; i < 4; i++) {
+        if (cx[i] < minx) minx = cx[i];
+        if (cx[i] > maxx) maxx = cx[i];
+        if (cy[i] < miny) miny = cy[i];
+        if (cy[i] > maxy) maxy = cy[i];
+    }
+    if (!(maxx > 0 && maxy > 0 && minx < dst->width && miny < dst->height)) return -1;
+    box[0] = (minx > 0) ? (int64_t)minx : 0;
+    box[1] = (miny > 0) ? (int64_t)miny : 0;
+    box[2] = (maxx < dst->width) ? (int64_t)maxx + 1 : dst->width;
+    box[3] = (maxy < dst->height) ? (int64_t)maxy + 1 : dst->height;
+    return 0;
+}
+
+int video_blit_affine_bounds( const struct video_surface *dst, const struct video_surface *src, const struct video_matrix *m,
+                              int filter, struct video_rect *r )
+{
+    double  inv[4];
+    int64_t box[4];
+
+    if (!dst->pixels || !src->pixels || dst->width <= 0 || dst->height <= 0 || src->width <= 0 || src->height <= 0 ||
+        blit_affine_box(dst, src, m, filter, inv, box))
+    {
+        return -1;
+    }
+    r->x        = (int)box[0];
+    r->y        = (int)box[1];
+    r->width    = (int)(box[2] - box[0]);
+    r->height   = (int)(box[3] - box[1]);
+    return 0;
+}
+
+int video_blit_affine_clip( const struct video_surface *dst, const struct video_surface *src, const struct video_matrix *m,
+                            int mode, int filter, uint32_t opacity, const struct video_rect *clip )
+{
+    const struct video_kernels  *k = video_draw_kernels();
+    double                      inv[4], fx, fy;
+    int64_t                     box[4], y, y0, y1, c0, c1,
+                                u, v, du, dv, lo_u, hi_u, lo_v, hi_v,
+                                o0, o1, i0, i1;
+    uint32_t                    *row;
+    int                         pad = (filter == VIDEO_FILTER_BILINEAR) ? 1 : 0;
+
+    if (!dst || !src || !m || (mode != VIDEO_BLIT_COPY && mode != VIDEO_BLIT_OVER && mode != VIDEO_BLIT_PREMUL) ||
+        (filter != VIDEO_FILTER_NEAREST && filter != VIDEO_FILTER_BILINEAR) ||
+        src->width > BLIT_MAX_SIZE || src->height > BLIT_MAX_SIZE) 
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!dst->pixels || !src->pixels || dst->width <= 0 || dst->height <= 0 || src->width <= 0 || src->height <= 0) return 0;
+    if (opacity > 255) opacity = 255;
+    if (!opacity && mode != VIDEO_BLIT_COPY) return 0;
+    if (blit_affine_box(dst, src, m, filter, inv, box)) return 0;
+
+    /**
+     * Rows and spans are worked out over the whole box whatever
+     * the clip, and only then cut down to it, so each pixel is
+     * sampled exactly as it would be unclipped.
+     **/
+    y0 = box[1];
+    y1 = box[3];
+    c0 = box[0];
+    c1 = box[2];
+    if (clip) {
+        if (y0 < clip->y) y0 = clip->y;
+        if (y1 > (int64_t)clip->y + clip->height) y1 = (int64_t)clip->y + clip->height;
+        if (c0 < clip->x) c0 = clip->x;
+        if (c1 > (int64_t)clip->x + clip->width) c1 = (int64_t)clip->x + clip->width;
+        if (c1 <= c0) return 0;
+    }
+    c0 -= box[0];
+    c1 -= box[0];
+
+    /**
+     * Nearest takes texel floor(u), so u must be in [0, w).
+     * Bilinear works on u - 1/2: texels floor() and floor() + 1
+     * all inside for the fast loop, at least one for the edge.
+     **/
+    du  = blit_fixed(inv[0]);
+    dv  = blit_fixed(inv[2]);
+    if (filter == VIDEO_FILTER_NEAREST) {
+        lo_u = lo_v = 0;
+        hi_u = (int64_t)src->width << 16;
+        hi_v = (int64_t)src->height << 16;
+    } else {
+        lo_u = lo_v = 1 - BLIT_ONE;
+        hi_u = (int64_t)src->width << 16;
+        hi_v = (int64_t)src->height << 16;
+    }
+
+    for (y = y0; y < y1; y++) {
+        /* Pixel centers, from the left of the box so the stepping error stays small */
+        fx  = box[0] + 0.5 - m->tx;
+        fy  = y + 0.5 - m->ty;
+        u   = blit_fixed(inv[0] * fx + inv[1] * fy) - pad * (BLIT_ONE / 2);
+        v   = blit_fixed(inv[2] * fx + inv[3] * fy) - pad * (BLIT_ONE / 2);
+
+        o0  = 0;
+        o1  = box[2] - box[0];
+        blit_solve(u, du, lo_u, hi_u, &o0, &o1);
+        blit_solve(v, dv, lo_v, hi_v, &o0, &o1);
+        if (o1 <= o0) continue;
+
+        row = video_surface_row(dst, (int)y) + box[0];
+        if (filter == VIDEO_FILTER_NEAREST) {
+            o0 = blit_max(o0, c0);
+            o1 = blit_min(o1, c1);
+            if (o1 > o0) blit_span(k, row + o0, src, u + o0 * du, v + o0 * dv, du, dv, (int)(o1 - o0), filter, 0, mode, opacity);
+            continue;
+        }
+
+        i0 = o0;
+        i1 = o1;
+        blit_solve(u, du, 0, hi_u - BLIT_ONE, &i0, &i1);
+        blit_solve(v, dv, 0, hi_v - BLIT_ONE, &i0, &i1);
+        if (i1 <= i0) i0 = i1 = o1;
+
+        /* Edge, inner, edge: each cut to the clip */
+        o0 = blit_max(o0, c0);
+        o1 = blit_min(o1, c1);
+        i0 = blit_min(blit_max(i0, o0), o1);
+        i1 = blit_min(blit_max(i1, i0), o1);
+        blit_span(k, row + o0, src, u + o0 * du, v + o0 * dv, du, dv, (int)(i0 - o0), filter, 1, mode, opacity);
+        blit_span(k, row + i0, src, u + i0 * du, v + i0 * dv, du, dv, (int)(i1 - i0), filter, 0, mode, opacity);
+        blit_span(k, row + i1, src, u + i1 * du, v + i1 * dv, du, dv, (int)(o1 - i1), filter, 1, mode, opacity);
+    }
+    return 0;
+}
+
+int video_blit_affine( const struct video_surface *dst, const struct video_surface *src, const struct video_matrix *m,
+                       int mode, int filter, uint32_t opacity )
+{
+    return video_blit_affine_clip(dst, src, m, mode, filter, opacity, 0);
+}
@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_BLIT_H_
+#define _VIDEO_BLIT_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Affine blits in pieces, for the display list: the box a
+ * blit lands in, and the blit cut down to part of it.
+ **/
+
+#include "video.h"
+
+/**
+ * The box on "dst" that video_blit_affine() of "src" through
+ * "m" may touch.
+ *
+ * \return ZERO, -1 if it draws nothing.
+ **/
+int         video_blit_affine_bounds( const struct video_surface *dst, const struct video_surface *src, const struct video_matrix *m,
+                                      int filter, struct video_rect *r );
+
+/**
+ * video_blit_affine(), only the pixels inside "clip" (NULL
+ * for all of them).  They come out exactly as unclipped.
+ **/
+int         video_blit_affine_clip( const struct video_surface *dst, const struct video_surface *src, const struct video_matrix *m,
+                                    int mode, int filter, uint32_t opacity, const struct video_rect *clip );
+
+#endif
@@ -0,0 +1,625 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video.h"
+
+/**
+ * Layers.  The compositor keeps the whole frame it last
+ * presented and only redoes what changed: what layers say
+ * they redrew, and the old and new place of layers that
+ * moved, appeared, went or changed opacity or order.
+ *
+ * Damage is kept as a list of rectangles, made disjoint (cut
+ * into bands of rows, runs merged) before compositing.  Each
+ * damaged rectangle is walked down from the top layer: a
+ * layer draws on what's still showing of it, and an opaque
+ * one hides that part from every layer under it.  What no
+ * opaque layer covers gets the background color, then the
+ * pieces are drawn from the bottom up, so every pixel is
+ * written once plus once per translucent layer over it.
+ **/
+
+#define COMP_LAYER_DAMAGE       16              /* Rectangles kept per layer, beyond that their bounds  */
+
+struct video_layer {
+    struct video_compositor *comp;
+    struct video_surface    s;
+    int                     x, y, z,
+                            visible;
+    uint32_t                opacity;
+    unsigned                flags;
+    uint64_t                seq;                /* Creation order, breaks ties in z                     */
+
+    struct video_rect       damage[COMP_LAYER_DAMAGE];
+    size_t                  ndamage;
+
+    /* As last presented */
+    struct video_rect       shown;              /* On the screen, zero width if it wasn't               */
+    int                     shown_z;
+    uint32_t                shown_opacity;
+};
+
+struct comp_region {
+    struct video_rect       *r;
+    size_t                  n,
+                            cap;
+};
+
+/* A layer's part of a damaged rectangle */
+struct comp_op {
+    struct video_layer      *l;
+    struct video_rect       r;
+    int                     copy;               /* Opaque: a straight copy                              */
+};
+
+struct video_compositor {
+    VIDEO                   v;
+    struct video_surface    out;                /* The frame as last presented                          */
+    uint32_t                background;
+    int                     first;              /* Nothing presented yet, everything is damaged         */
+
+    struct video_layer      **layers;           /* Bottom to top after sorting                          */
+    size_t                  nlayers,
+                            clayers;
+    uint64_t                seq;
+
+    struct comp_region      damage,             /* Screen, this frame                                   */
+                            norm,               /* The same made disjoint                               */
+                            vis,                /* Scratch: what's still showing of a rectangle         */
+                            tmp;
+    struct comp_op          *ops;
+    size_t                  nops,
+                            cops;
+
+    struct video_compositor_stats   st;
+};
+
+/*****************************************************************************
+ * Regions
+ *****************************************************************************/
+
+static inline int comp_min( int a, int b ) {
+    return (a < b) ? a : b;
+}
+
+static inline int comp_max( int a, int b ) {
+    return (a > b) ? a : b;
+}
+
+/* a and b overlap in "out" */
+static inline int comp_intersect( const struct video_rect *a, const struct video_rect *b, struct video_rect *out ) {
+    int x0 = comp_max(a->x, b->x),
+        y0 = comp_max(a->y, b->y),
+        x1 = comp_min(a->x + a->width, b->x + b->width),
+        y1 = comp_min(a->y + a->height, b->y + b->height);
+
+    if (x1 <= x0 || y1 <= y0) return 0;
+    out->x      = x0;
+    out->y      = y0;
+    out->width  = x1 - x0;
+    out->height = y1 - y0;
+    return 1;
+}
+
+static int region_add( struct comp_region *g, int x, int y, int w, int h ) {
+    struct video_rect   *r;
+    size_t              cap;
+
+    if (w <= 0 || h <= 0) return 0;
+    if (g->n == g->cap) {
+        cap = g->cap ? g->cap * 2 : 32;
+        if (!(r = (struct video_rect *)realloc(g->r, cap * sizeof(*r)))) return -1;
+        g->r   = r;
+        g->cap = cap;
+    }
+    r           = &g->r[g->n++];
+    r->x        = x;
+    r->y        = y;
+    r->width    = w;
+    r->height   = h;
+    return 0;
+}
+
+static int comp_cmp_int( const void *a, const void *b ) {
+    int x = *(const int *)a,
+        y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Makes "g" disjoint, covering the same pixels: the rows are
+ * cut into bands wherever a rectangle starts or ends, each
+ * band's runs merged, and a run that continues one of the
+ * band above unchanged makes that one taller.
+ *
+ * \return ZERO, -1 if out of memory.
+ **/
+static int region_normalize( struct comp_region *g, struct comp_region *out ) {
+    struct video_rect   *a;
+    size_t              *above, *here, *t,
+                        ny, nx, na, nh, i, j, k, p;
+    int                 *ys, *xs, y0, y1, x0, x1;
+    void                *mem;
+
+    out->n = 0;
+    if (g->n < 2) {
+        for (i = 0; i < g->n; i++) {
+            if (region_add(out, g->r[i].x, g->r[i].y, g->r[i].width, g->r[i].height)) return -1;
+        }
+        return 0;
+    }
+    if (!(mem = malloc(g->n * (4 * sizeof(int) + 2 * sizeof(size_t))))) return -1;
+    above   = (size_t *)mem;
+    here    = above + g->n;
+    ys      = (int *)(here + g->n);
+    xs      = ys + 2 * g->n;
+
+    for (i = 0; i < g->n; i++) {
+        ys[2 * i]     = g->r[i].y;
+        ys[2 * i + 1] = g->r[i].y + g->r[i].height;
+    }
+    qsort(ys, 2 * g->n, sizeof(int), &comp_cmp_int);
+    for (i = ny = 0; i < 2 * g->n; i++) {
+        if (!ny || ys[i] != ys[ny - 1]) ys[ny++] = ys[i];
+    }
+
+    na = 0;
+    for (i = 0; i + 1 < ny; i++) {
+        y0 = ys[i];
+        y1 = ys[i + 1];
+
+        /* Runs in this band, as (x0, x1) pairs by x0 */
+        for (j = nx = 0; j < g->n; j++) {
+            if (g->r[j].y > y0 || g->r[j].y + g->r[j].height < y1) continue;
+            xs[nx++] = g->r[j].x;
+            xs[nx++] = g->r[j].x + g->r[j].width;
+        }
+        qsort(xs, nx / 2, 2 * sizeof(int), &comp_cmp_int);
+
+        for (j = nh = p = 0; j < nx; j = k) {
+            x0 = xs[j];
+            x1 = xs[j + 1];
+            for (k = j + 2; k < nx && xs[k] <= x1; k += 2) x1 = comp_max(x1, xs[k + 1]);
+
+            for (; p < na && out->r[above[p]].x < x0; p++);
+            a = (p < na) ? &out->r[above[p]] : 0;
+            if (a && a->x == x0 && a->width == x1 - x0 && a->y + a->height == y0) {
+                a->height += y1 - y0;
+                here[nh++] = above[p];
+                continue;
+            }
+            if (region_add(out, x0, y0, x1 - x0, y1 - y0)) {
+                free(mem);
+                return -1;
+            }
+            here[nh++] = out->n - 1;
+        }
+
+        t     = above;
+        above = here;
+        here  = t;
+        na    = nh;
+    }
+
+    free(mem);
+    return 0;
+}
+
+/**
+ * What's left of "g" after taking "r" away, each rectangle
+ * cut into at most four (above, below, left, right of it).
+ **/
+static int region_subtract( struct comp_region *g, const struct video_rect *r, struct comp_region *out ) {
+    struct video_rect   *a, o;
+    size_t              i;
+
+    out->n = 0;
+    for (i = 0; i < g->n; i++) {
+        a = &g->r[i];
+        if (!comp_intersect(a, r, &o)) {
+            if (region_add(out, a->x, a->y, a->width, a->height)) return -1;
+            continue;
+        }
+        if (region_add(out, a->x, a->y, a->width, o.y - a->y) ||
+            region_add(out, a->x, o.y + o.height, a->width, a->y + a->height - o.y - o.height) ||
+            region_add(out, a->x, o.y, o.x - a->x, o.height) ||
+            region_add(out, o.x + o.width, o.y, a->x + a->width - o.x - o.width, o.height)) return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * Layers
+ *****************************************************************************/
+
+/**
+ * Where "l" is on the screen, clipped to it.
+ *
+ * \return ZERO if none of it is.
+ **/
+static int comp_layer_rect( const struct video_compositor *c, const struct video_layer *l, struct video_rect *r ) {
+    int64_t x0 = (l->x > 0) ? l->x : 0,
+            y0 = (l->y > 0) ? l->y : 0,
+            x1 = (int64_t)l->x + l->s.width,
+            y1 = (int64_t)l->y + l->s.height;
+
+    if (x1 > c->out.width) x1 = c->out.width;
+    if (y1 > c->out.height) y1 = c->out.height;
+    if (x1 <= x0 || y1 <= y0) return 0;
+
+    r->x        = (int)x0;
+    r->y        = (int)y0;
+    r->width    = (int)(x1 - x0);
+    r->height   = (int)(y1 - y0);
+    return 1;
+}
+
+/* Shows this frame */
+static inline int comp_layer_shown( const struct video_layer *l ) {
+    return l->visible && l->opacity;
+}
+
+/* Hides everything under it */
+static inline int comp_layer_hides( const struct video_layer *l ) {
+    return (l->flags & VIDEO_LAYER_OPAQUE) && l->opacity == 255;
+}
+
+/* "r" on the screen has to be composited again */
+static int comp_damage( struct video_compositor *c, const struct video_rect *r ) {
+    struct video_rect   screen = { 0, 0, c->out.width, c->out.height },
+                        o;
+
+    if (!comp_intersect(r, &screen, &o)) return 0;
+    return region_add(&c->damage, o.x, o.y, o.width, o.height);
+}
+
+/* By z, then by creation; it's almost always sorted already */
+static void comp_sort( struct video_compositor *c ) {
+    struct video_layer  *l;
+    size_t              i, j;
+
+    for (i = 1; i < c->nlayers; i++) {
+        l = c->layers[i];
+        for (j = i; j > 0 && (c->layers[j - 1]->z > l->z || (c->layers[j - 1]->z == l->z && c->layers[j - 1]->seq > l->seq)); j--) {
+            c->layers[j] = c->layers[j - 1];
+        }
+        c->layers[j] = l;
+    }
+}
+
+/**
+ * Turns what changed in each layer since the last frame into
+ * damage on the screen.  A layer that moved, changed size,
+ * order or opacity, appeared or went is damaged where it was
+ * and where it is; otherwise just where it was drawn on.
+ **/
+static int comp_collect( struct video_compositor *c ) {
+    struct video_layer  *l;
+    struct video_rect   now, d;
+    size_t              i, j;
+    int                 on;
+
+    for (i = 0; i < c->nlayers; i++) {
+        l  = c->layers[i];
+        on = comp_layer_shown(l) && comp_layer_rect(c, l, &now);
+        if (!on) now.width = now.height = 0;
+
+        if (now.x != l->shown.x || now.y != l->shown.y || now.width != l->shown.width || now.height != l->shown.height ||
+            (on && (l->z != l->shown_z || l->opacity != l->shown_opacity))) {
+            if (comp_damage(c, &l->shown) || comp_damage(c, &now)) return -1;
+        } else if (on) {
+            for (j = 0; j < l->ndamage; j++) {
+                d    = l->damage[j];
+                d.x += l->x;
+                d.y += l->y;
+                if (comp_intersect(&d, &now, &d) && comp_damage(c, &d)) return -1;
+            }
+        }
+
+        l->ndamage          = 0;
+        l->shown            = now;
+        l->shown_z          = l->z;
+        l->shown_opacity    = l->opacity;
+    }
+    return 0;
+}
+
+/**
+ * Composites the damaged rectangle "r" into the frame: finds
+ * what each layer shows of it from the top down, stopping
+ * when opaque layers cover it all, then draws from the
+ * bottom up.
+ **/
+static int comp_rect( struct video_compositor *c, const struct video_rect *r ) {
+    struct video_layer  *l;
+    struct video_rect   lr, o, sr;
+    struct video_surface sub;
+    struct comp_region  swap;
+    struct comp_op      *op;
+    uint64_t            area, drawn;
+    size_t              i, j, k, cap;
+
+    c->vis.n  = 0;
+    c->nops   = 0;
+    if (region_add(&c->vis, r->x, r->y, r->width, r->height)) return -1;
+
+    for (i = c->nlayers; i-- > 0;) {
+        l = c->layers[i];
+        if (!comp_layer_shown(l) || !comp_layer_rect(c, l, &lr) || !comp_intersect(&lr, r, &o)) continue;
+
+        area  = (uint64_t)o.width * o.height;
+        drawn = 0;
+        for (j = 0; j < c->vis.n; j++) {
+            if (!comp_intersect(&c->vis.r[j], &lr, &o)) continue;
+            if (c->nops == c->cops) {
+                cap = c->cops ? c->cops * 2 : 32;
+                if (!(op = (struct comp_op *)realloc(c->ops, cap * sizeof(*op)))) return -1;
+                c->ops  = op;
+                c->cops = cap;
+            }
+            op          = &c->ops[c->nops++];
+            op->l       = l;
+            op->r       = o;
+            op->copy    = comp_layer_hides(l);
+            drawn      += (uint64_t)o.width * o.height;
+        }
+        c->st.occluded_pixels += area - drawn;
+
+        if (comp_layer_hides(l)) {
+            if (region_subtract(&c->vis, &lr, &c->tmp)) return -1;
+            swap    = c->vis;
+            c->vis  = c->tmp;
+            c->tmp  = swap;
+        }
+    }
+
+    for (j = 0; j < c->vis.n; j++) {
+        video_fill_rect(&c->out, &c->vis.r[j], c->background, VIDEO_BLEND_COPY);
+    }
+    for (k = c->nops; k-- > 0;) {
+        op      = &c->ops[k];
+        l       = op->l;
+        sr.x    = op->r.x - l->x;
+        sr.y    = op->r.y - l->y;
+        sr.width    = op->r.width;
+        sr.height   = op->r.height;
+        if (video_surface_sub(&l->s, &sr, &sub)) return -1;
+        if (video_blit_ex(&c->out, &sub, &op->r, op->copy ? VIDEO_BLIT_COPY : (l->flags & VIDEO_LAYER_PREMUL) ? VIDEO_BLIT_PREMUL : VIDEO_BLIT_OVER,
+                          l->opacity, 0)) return -1;
+        c->st.composited_pixels += (uint64_t)op->r.width * op->r.height;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * API
+ *****************************************************************************/
+
+struct video_compositor *video_compositor_create( VIDEO v, uint32_t background ) {
+    struct video_compositor *c;
+    void                    *buf;
+
+    if (!video_is_active(v)) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (!(c = (struct video_compositor *)calloc(1, sizeof(*c)))) return 0;
+    if (!(buf = video_get_empty_buffer(v)) || video_get_surface(v, buf, &c->out)) {
+        free(buf);
+        free(c);
+        return 0;
+    }
+    c->v            = v;
+    c->background   = background;
+    c->first        = 1;
+    return c;
+}
+
+void video_compositor_destroy( struct video_compositor *c ) {
+    size_t  i;
+
+    if (!c) return;
+    for (i = 0; i < c->nlayers; i++) {
+        free(c->layers[i]->s.pixels);
+        free(c->layers[i]);
+    }
+    free(c->layers);
+    free(c->damage.r);
+    free(c->vis.r);
+    free(c->tmp.r);
+    free(c->norm.r);
+    free(c->ops);
+    free(c->out.pixels);
+    free(c);
+}
+
+void video_compositor_set_background( struct video_compositor *c, uint32_t background ) {
+    struct video_rect   all;
+
+    if (!c || c->background == background) return;
+    c->background = background;
+    all.x         = all.y = 0;
+    all.width     = c->out.width;
+    all.height    = c->out.height;
+    if (comp_damage(c, &all)) c->first = 1;
+}
+
+struct video_layer *video_layer_create( struct video_compositor *c, int width, int height, int z, unsigned flags ) {
+    struct video_layer  *l, **layers;
+    size_t              cap;
+
+    if (!c || width <= 0 || height <= 0 || width > (1 << 15) || height > (1 << 15)) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (c->nlayers == c->clayers) {
+        cap = c->clayers ? c->clayers * 2 : 8;
+        if (!(layers = (struct video_layer **)realloc(c->layers, cap * sizeof(*layers)))) return 0;
+        c->layers  = layers;
+        c->clayers = cap;
+    }
+    if (!(l = (struct video_layer *)calloc(1, sizeof(*l)))) return 0;
+    if (!(l->s.pixels = (uint32_t *)calloc((size_t)width * height, sizeof(uint32_t)))) {
+        free(l);
+        return 0;
+    }
+    l->comp     = c;
+    l->s.width  = width;
+    l->s.height = height;
+    l->s.stride = (size_t)width * sizeof(uint32_t);
+    l->z        = z;
+    l->visible  = 1;
+    l->opacity  = 255;
+    l->flags    = flags;
+    l->seq      = c->seq++;
+
+    c->layers[c->nlayers++] = l;
+    return l;
+}
+
+void video_layer_destroy( struct video_layer *l ) {
+    struct video_compositor *c;
+    size_t                  i;
+
+    if (!l) return;
+    c = l->comp;
+    for (i = 0; i < c->nlayers && c->layers[i] != l; i++);
+    if (i < c->nlayers) {
+        memmove(&c->layers[i], &c->layers[i + 1], (c->nlayers - i - 1) * sizeof(*c->layers));
+        c->nlayers--;
+    }
+    if (comp_damage(c, &l->shown)) c->first = 1;
+    free(l->s.pixels);
+    free(l);
+}
+
+int video_layer_get_surface( struct video_layer *l, struct video_surface *s ) {
+    if (!l || !s) {
+        errno = EINVAL;
+        return -1;
+    }
+    *s = l->s;
+    return 0;
+}
+
+void video_layer_move( struct video_layer *l, int x, int y ) {
+    if (!l) return;
+    l->x = x;
+    l->y = y;
+}
+
+void video_layer_set_z( struct video_layer *l, int z ) {
+    if (l) l->z = z;
+}
+
+void video_layer_set_opacity( struct video_layer *l, uint32_t opacity ) {
+    if (l) l->opacity = (opacity > 255) ? 255 : opacity;
+}
+
+void video_layer_set_visible( struct video_layer *l, int visible ) {
+    if (l) l->visible = !!visible;
+}
+
+void video_layer_damage( struct video_layer *l, const struct video_rect *r ) {
+    struct video_rect   all = { 0, 0, 0, 0 },
+                        o, *b;
+    size_t              i;
+    int                 x0, y0, x1, y1;
+
+    if (!l) return;
+    all.width  = l->s.width;
+    all.height = l->s.height;
+    if (!r) r = &all;
+    if (!comp_intersect(r, &all, &o)) return;
+
+    if (l->ndamage < COMP_LAYER_DAMAGE) {
+        l->damage[l->ndamage++] = o;
+        return;
+    }
+
+    /* Too many, keep their bounds */
+    b  = &l->damage[0];
+    x0 = comp_min(b->x, o.x);
+    y0 = comp_min(b->y, o.y);
+    x1 = comp_max(b->x + b->width, o.x + o.width);
+    y1 = comp_max(b->y + b->height, o.y + o.height);
+    for (i = 1; i < l->ndamage; i++) {
+        x0 = comp_min(x0, l->damage[i].x);
+        y0 = comp_min(y0, l->damage[i].y);
+        x1 = comp_max(x1, l->damage[i].x + l->damage[i].width);
+        y1 = comp_max(y1, l->damage[i].y + l->damage[i].height);
+    }
+    b->x        = x0;
+    b->y        = y0;
+    b->width    = x1 - x0;
+    b->height   = y1 - y0;
+    l->ndamage  = 1;
+}
+
+ssize_t video_compositor_present( struct video_compositor *c ) {
+    struct video_rect   all;
+    size_t              i;
+    ssize_t             rv;
+
+    if (!c) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    comp_sort(c);
+    if (comp_collect(c)) goto error;
+    if (c->first) {
+        c->damage.n = 0;
+        all.x       = all.y = 0;
+        all.width   = c->out.width;
+        all.height  = c->out.height;
+        if (comp_damage(c, &all)) goto error;
+    }
+    if (region_normalize(&c->damage, &c->norm)) goto error;
+    c->damage.n = 0;
+
+    for (i = 0; i < c->norm.n; i++) {
+        c->st.damaged_pixels += (uint64_t)c->norm.r[i].width * c->norm.r[i].height;
+        if (comp_rect(c, &c->norm.r[i])) goto error;
+    }
+    c->first = 0;
+    c->st.frames++;
+    c->st.rects += c->norm.n;
+
+    /* If it didn't make it to the screen, all of it goes next time */
+    if ((rv = video_submit_regions(c->v, c->out.pixels, c->norm.r, c->norm.n)) < 0) c->first = 1;
+    return rv;
+
+error:
+    c->first = 1;
+    return -1;
+}
+
+void video_compositor_get_stats( struct video_compositor *c, struct video_compositor_stats *st ) {
+    if (!st) return;
+    if (!c) {
+        memset(st, 0, sizeof(*st));
+        return;
+    }
+    *st = c->st;
+}
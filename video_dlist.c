@@ -0,0 +1,718 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video.h"
+#include "video_draw.h"
+#include "video_path.h"
+#include "video_blit.h"
+#include "video_text.h"
+
+/**
+ * Display lists.  Drawing calls are recorded (paths and text
+ * copied, surfaces by reference) and run at execute time:
+ *
+ *  1. Every command works out the box it touches on the
+ *     target; paths are rasterized to coverage and text laid
+ *     out (its glyphs cached) here, commands spread over the
+ *     workers.
+ *  2. Each command is added to the list of every tile its box
+ *     overlaps, in recording order.
+ *  3. The workers draw tiles, each running its list clipped
+ *     to the tile.
+ *
+ * Every drawing routine gives the same pixel whether it's
+ * clipped or not (nothing is computed from where the clip
+ * starts), and a tile's commands run in order, so the frame
+ * is bit for bit what drawing the calls one by one makes.
+ *
+ * Workers start with an even share of the steps, a run of
+ * consecutive tiles, and steal half of someone else's share
+ * when theirs runs out.  The thread calling
+ * video_dlist_execute() works too.
+ **/
+
+#define DLIST_TILE              64              /* Tiles are DLIST_TILE x DLIST_TILE pixels             */
+#define DLIST_MAX_THREADS       16
+
+#define DL_FILL                 0
+#define DL_BLIT                 1
+#define DL_AFFINE               2
+#define DL_PATH                 3
+#define DL_TEXT                 4
+
+#define DL_PREPARE              0               /* The steps run in parallel                            */
+#define DL_TILES                1
+
+struct dlist_cmd {
+    int                 type,
+                        mode;
+    uint32_t            color;
+    struct video_rect   box;                    /* What it may touch, zero width for nothing            */
+    union {
+        struct video_rect   rect;               /* DL_FILL                                              */
+        struct {
+            struct video_surface    src;
+            struct video_rect       r;
+            uint32_t                opacity,
+                                    key;
+        }                   blit;
+        struct {
+            struct video_surface    src;
+            struct video_matrix     m;
+            int                     filter;
+            uint32_t                opacity;
+        }                   affine;
+        struct {
+            size_t                  path;       /* In "paths"                                           */
+            int                     rule;
+            struct video_path_cover cover;
+        }                   path;
+        struct {
+            struct video_glyph_cache    *cache;
+            const struct video_font     *font;
+            int                         size,
+                                        x, y;
+            size_t                      str;    /* In "strings"                                         */
+        }                   text;
+    } u;
+};
+
+struct dlist_tile {
+    uint32_t    *cmds;
+    size_t      n,
+                cap;
+};
+
+/**
+ * A worker's share of a step: tasks lo up to hi, as (hi << 32)
+ * | lo so the owner (from the bottom) and thieves (from the
+ * top) take them with one compare and swap.  A cache line
+ * each.
+ **/
+struct dlist_queue {
+    uint64_t    range;
+    uint8_t     pad[56];
+};
+
+struct dlist_worker {
+    struct video_dlist  *dl;
+    pthread_t           thread;
+    int                 id;
+};
+
+struct video_dlist {
+    struct dlist_cmd            *cmds;
+    size_t                      ncmds,
+                                ccmds;
+    char                        *strings;
+    size_t                      nstrings,
+                                cstrings;
+    struct video_path           **paths;        /* Copies, kept across resets for their memory          */
+    size_t                      npaths,
+                                cpaths;
+
+    /* Execute */
+    const struct video_surface  *target;
+    struct dlist_tile           *tiles;
+    size_t                      ntiles,
+                                ctiles;
+    int                         tiles_x,
+                                err;            /* errno of a failure while executing                   */
+
+    /* Workers, the caller is number 0 */
+    struct dlist_worker         *workers;
+    struct dlist_queue          *queues;
+    int                         nthreads,
+                                phase,
+                                busy,           /* Workers not done with this step                      */
+                                quit;
+    uint64_t                    step;           /* Bumped to start one                                  */
+    pthread_mutex_t             mtx;
+    pthread_cond_t              go,
+                                done;
+};
+
+/*****************************************************************************
+ * Recording
+ *****************************************************************************/
+
+static struct dlist_cmd *dlist_add( struct video_dlist *dl, int type, int mode, uint32_t color ) {
+    struct dlist_cmd    *cmds, *c;
+    size_t              cap;
+
+    if (dl->ncmds == dl->ccmds) {
+        cap  = dl->ccmds ? dl->ccmds * 2 : 64;
+        if (cap > UINT32_MAX) return 0;
+        cmds = (struct dlist_cmd *)realloc(dl->cmds, cap * sizeof(*cmds));
+        if (!cmds) return 0;
+        dl->cmds  = cmds;
+        dl->ccmds = cap;
+    }
+    c = &dl->cmds[dl->ncmds];
+    memset(c, 0, sizeof(*c));
+    c->type  = type;
+    c->mode  = mode;
+    c->color = color;
+    return c;
+}
+
+/* A path of our own to copy into, NULL if out of memory */
+static struct video_path *dlist_path( struct video_dlist *dl ) {
+    struct video_path   **paths;
+    size_t              cap;
+
+    if (dl->npaths == dl->cpaths) {
+        cap   = dl->cpaths ? dl->cpaths * 2 : 16;
+        paths = (struct video_path **)realloc(dl->paths, cap * sizeof(*paths));
+        if (!paths) return 0;
+        memset(paths + dl->cpaths, 0, (cap - dl->cpaths) * sizeof(*paths));
+        dl->paths  = paths;
+        dl->cpaths = cap;
+    }
+    if (!dl->paths[dl->npaths] && !(dl->paths[dl->npaths] = video_path_create())) return 0;
+    return dl->paths[dl->npaths];
+}
+
+int video_dlist_fill_rect( struct video_dlist *dl, const struct video_rect *r, uint32_t color, int mode ) {
+    struct dlist_cmd    *c;
+
+    if (!dl || !r) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mode == VIDEO_BLEND_OVER && !(color >> 24)) return 0;
+    if (!(c = dlist_add(dl, DL_FILL, mode, color))) return -1;
+    c->u.rect = *r;
+    dl->ncmds++;
+    return 0;
+}
+
+int video_dlist_blit( struct video_dlist *dl, const struct video_surface *src, const struct video_rect *r,
+                      int mode, uint32_t opacity, uint32_t key )
+{
+    struct dlist_cmd    *c;
+
+    if (!dl || !src || mode < VIDEO_BLIT_COPY || mode > VIDEO_BLIT_PREMUL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(c = dlist_add(dl, DL_BLIT, mode, 0))) return -1;
+    c->u.blit.src       = *src;
+    c->u.blit.opacity   = opacity;
+    c->u.blit.key       = key;
+    if (r) {
+        c->u.blit.r = *r;
+    } else {
+        c->u.blit.r.width  = src->width;
+        c->u.blit.r.height = src->height;
+    }
+    dl->ncmds++;
+    return 0;
+}
+
+int video_dlist_blit_affine( struct video_dlist *dl, const struct video_surface *src, const struct video_matrix *m,
+                             int mode, int filter, uint32_t opacity )
+{
+    struct dlist_cmd    *c;
+
+    if (!dl || !src || !m || (mode != VIDEO_BLIT_COPY && mode != VIDEO_BLIT_OVER && mode != VIDEO_BLIT_PREMUL) ||
+        (filter != VIDEO_FILTER_NEAREST && filter != VIDEO_FILTER_BILINEAR))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(c = dlist_add(dl, DL_AFFINE, mode, 0))) return -1;
+    c->u.affine.src     = *src;
+    c->u.affine.m       = *m;
+    c->u.affine.filter  = filter;
+    c->u.affine.opacity = opacity;
+    dl->ncmds++;
+    return 0;
+}
+
+int video_dlist_fill_path( struct video_dlist *dl, const struct video_path *p, uint32_t color, int mode, int rule ) {
+    struct video_path   *copy;
+    struct dlist_cmd    *c;
+
+    if (!dl || !p) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mode == VIDEO_BLEND_OVER && !(color >> 24)) return 0;
+    if (!(c = dlist_add(dl, DL_PATH, mode, color)) || !(copy = dlist_path(dl)) || video_path_copy(copy, p)) return -1;
+    c->u.path.path  = dl->npaths++;
+    c->u.path.rule  = rule;
+    dl->ncmds++;
+    return 0;
+}
+
+int video_dlist_stroke_path( struct video_dlist *dl, const struct video_path *p, const struct video_stroke *stroke,
+                             uint32_t color, int mode )
+{
+    struct video_path   *outline;
+    struct dlist_cmd    *c;
+
+    if (!dl || !p) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mode == VIDEO_BLEND_OVER && !(color >> 24)) return 0;
+    if (!(c = dlist_add(dl, DL_PATH, mode, color)) || !(outline = dlist_path(dl))) return -1;
+    video_path_reset(outline);
+    if (video_path_stroke(outline, p, stroke)) return -1;
+    c->u.path.path  = dl->npaths++;
+    c->u.path.rule  = VIDEO_FILL_NONZERO;
+    dl->ncmds++;
+    return 0;
+}
+
+int video_dlist_text( struct video_dlist *dl, struct video_glyph_cache *cache, const struct video_font *font, int size,
+                      int x, int y, const char *utf8, uint32_t color )
+{
+    struct video_font_metrics   m;
+    struct dlist_cmd            *c;
+    size_t                      len, cap;
+    char                        *strings;
+
+    if (!dl || !cache || !utf8 || video_font_metrics(font, size, &m)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(color >> 24)) return 0;
+
+    len = strlen(utf8) + 1;
+    if (dl->nstrings + len > dl->cstrings) {
+        for (cap = dl->cstrings ? dl->cstrings : 1024; cap < dl->nstrings + len; cap *= 2);
+        if (!(strings = (char *)realloc(dl->strings, cap))) return -1;
+        dl->strings     = strings;
+        dl->cstrings    = cap;
+    }
+    if (!(c = dlist_add(dl, DL_TEXT, VIDEO_BLEND_OVER, color))) return -1;
+    memcpy(dl->strings + dl->nstrings, utf8, len);
+    c->u.text.cache = cache;
+    c->u.text.font  = font;
+    c->u.text.size  = size;
+    c->u.text.x     = x;
+    c->u.text.y     = y;
+    c->u.text.str   = dl->nstrings;
+    dl->nstrings   += len;
+    dl->ncmds++;
+    return 0;
+}
+
+void video_dlist_reset( struct video_dlist *dl ) {
+    if (!dl) return;
+    dl->ncmds       = 0;
+    dl->nstrings    = 0;
+    dl->npaths      = 0;
+}
+
+/*****************************************************************************
+ * Workers
+ *****************************************************************************/
+
+static int dlist_pop( struct dlist_queue *q, uint32_t *task ) {
+    uint64_t    r = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE),
+                lo, hi;
+
+    do {
+        lo = (uint32_t)r;
+        hi = r >> 32;
+        if (lo >= hi) return -1;
+    } while (!__atomic_compare_exchange_n(&q->range, &r, (hi << 32) | (lo + 1), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    *task = (uint32_t)lo;
+    return 0;
+}
+
+/* The top half of what's left in "q" */
+static int dlist_steal( struct dlist_queue *q, uint64_t *range ) {
+    uint64_t    r = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE),
+                lo, hi, mid;
+
+    do {
+        lo  = (uint32_t)r;
+        hi  = r >> 32;
+        if (lo >= hi) return -1;
+        mid = lo + (hi - lo) / 2;
+    } while (!__atomic_compare_exchange_n(&q->range, &r, (mid << 32) | lo, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    *range = (hi << 32) | mid;
+    return 0;
+}
+
+static void dlist_task( struct video_dlist *dl, uint32_t task );
+
+/**
+ * Runs tasks until there are none left anywhere.  Stolen work
+ * goes in our own (empty) queue, where others can steal it
+ * back.
+ **/
+static void dlist_work( struct video_dlist *dl, int id ) {
+    struct dlist_queue  *mine = &dl->queues[id];
+    uint64_t            range = 0;
+    uint32_t            task;
+    int                 i;
+
+    for (;;) {
+        while (!dlist_pop(mine, &task)) dlist_task(dl, task);
+
+        for (i = 1; i < dl->nthreads; i++) {
+            if (!dlist_steal(&dl->queues[(id + i) % dl->nthreads], &range)) break;
+        }
+        if (i == dl->nthreads) return;
+        __atomic_store_n(&mine->range, range, __ATOMIC_RELEASE);
+    }
+}
+
+static void *dlist_thread( void *arg ) {
+    struct dlist_worker *w = (struct dlist_worker *)arg;
+    struct video_dlist  *dl = w->dl;
+    uint64_t            seen = 0;
+
+    pthread_mutex_lock(&dl->mtx);
+    for (;;) {
+        while (dl->step == seen && !dl->quit) pthread_cond_wait(&dl->go, &dl->mtx);
+        if (dl->quit) break;
+        seen = dl->step;
+        pthread_mutex_unlock(&dl->mtx);
+
+        dlist_work(dl, w->id);
+
+        pthread_mutex_lock(&dl->mtx);
+        if (!--dl->busy) pthread_cond_signal(&dl->done);
+    }
+    pthread_mutex_unlock(&dl->mtx);
+    return 0;
+}
+
+/* Tasks 0 up to "n" of "phase" on every worker, returns when they're all done */
+static void dlist_parallel( struct video_dlist *dl, int phase, size_t n ) {
+    uint32_t    task;
+    int         i;
+
+    dl->phase = phase;
+    if (dl->nthreads == 1 || n < 2) {
+        for (task = 0; task < n; task++) dlist_task(dl, task);
+        return;
+    }
+    for (i = 0; i < dl->nthreads; i++) {
+        dl->queues[i].range = ((uint64_t)(n * (i + 1) / dl->nthreads) << 32) | (n * i / dl->nthreads);
+    }
+
+    pthread_mutex_lock(&dl->mtx);
+    dl->busy = dl->nthreads - 1;
+    dl->step++;
+    pthread_cond_broadcast(&dl->go);
+    pthread_mutex_unlock(&dl->mtx);
+
+    dlist_work(dl, 0);
+
+    pthread_mutex_lock(&dl->mtx);
+    while (dl->busy) pthread_cond_wait(&dl->done, &dl->mtx);
+    pthread_mutex_unlock(&dl->mtx);
+}
+
+struct video_dlist *video_dlist_create( int threads ) {
+    struct video_dlist  *dl;
+    long                cpus;
+    int                 i, err;
+
+    if (threads <= 0) threads = ((cpus = sysconf(_SC_NPROCESSORS_ONLN)) > 0) ? (int)cpus : 1;
+    if (threads > DLIST_MAX_THREADS) threads = DLIST_MAX_THREADS;
+
+    if (!(dl = (struct video_dlist *)calloc(1, sizeof(*dl)))) return 0;
+    pthread_mutex_init(&dl->mtx, 0);
+    pthread_cond_init(&dl->go, 0);
+    pthread_cond_init(&dl->done, 0);
+    dl->workers = (struct dlist_worker *)calloc((size_t)threads, sizeof(*dl->workers));
+    dl->queues  = (struct dlist_queue *)calloc((size_t)threads, sizeof(*dl->queues));
+    if (!dl->workers || !dl->queues) goto error;
+
+    /* Fewer workers than asked for is fine, one (the caller) at the least */
+    dl->nthreads = 1;
+    for (i = 1; i < threads; i++) {
+        dl->workers[i].dl = dl;
+        dl->workers[i].id = i;
+        if ((err = pthread_create(&dl->workers[i].thread, 0, &dlist_thread, &dl->workers[i])) != 0) {
+            fprintf(stderr, "libvideo/video_dlist_create(): WARNING - Couldn't start worker %d (%s), using %d.\n", i, strerror(err), i);
+            break;
+        }
+        pthread_setname_np(dl->workers[i].thread, "vid-dlist");
+        dl->nthreads++;
+    }
+    return dl;
+
+error:
+    video_dlist_destroy(dl);
+    return 0;
+}
+
+void video_dlist_destroy( struct video_dlist *dl ) {
+    size_t  i;
+    int     t;
+
+    if (!dl) return;
+
+    pthread_mutex_lock(&dl->mtx);
+    dl->quit = 1;
+    pthread_cond_broadcast(&dl->go);
+    pthread_mutex_unlock(&dl->mtx);
+    for (t = 1; t < dl->nthreads; t++) pthread_join(dl->workers[t].thread, 0);
+
+    for (i = 0; i < dl->cpaths; i++) video_path_destroy(dl->paths[i]);
+    for (i = 0; i < dl->ctiles; i++) free(dl->tiles[i].cmds);
+    free(dl->paths);
+    free(dl->tiles);
+    free(dl->cmds);
+    free(dl->strings);
+    free(dl->workers);
+    free(dl->queues);
+    pthread_cond_destroy(&dl->go);
+    pthread_cond_destroy(&dl->done);
+    pthread_mutex_destroy(&dl->mtx);
+    free(dl);
+}
+
+/*****************************************************************************
+ * Executing
+ *****************************************************************************/
+
+static void dlist_fail( struct video_dlist *dl, int err ) {
+    int none = 0;
+
+    __atomic_compare_exchange_n(&dl->err, &none, err ? err : ENOMEM, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/* "r" cut down to "s", zero width if they don't meet */
+static void dlist_clip( const struct video_surface *s, const struct video_rect *r, struct video_rect *box ) {
+    int64_t x0 = (r->x > 0) ? r->x : 0,
+            y0 = (r->y > 0) ? r->y : 0,
+            x1 = (int64_t)r->x + r->width,
+            y1 = (int64_t)r->y + r->height;
+
+    if (x1 > s->width) x1 = s->width;
+    if (y1 > s->height) y1 = s->height;
+    memset(box, 0, sizeof(*box));
+    if (x1 <= x0 || y1 <= y0) return;
+    box->x      = (int)x0;
+    box->y      = (int)y0;
+    box->width  = (int)(x1 - x0);
+    box->height = (int)(y1 - y0);
+}
+
+/* Step 1: what "c" touches, rasterized or laid out */
+static void dlist_prepare( struct video_dlist *dl, struct dlist_cmd *c ) {
+    const struct video_surface  *s = dl->target;
+    struct video_path_cover     *cv;
+    struct video_rect           r;
+
+    switch (c->type) {
+    case DL_FILL:
+        dlist_clip(s, &c->u.rect, &c->box);
+        break;
+
+    case DL_BLIT:
+        /* As video_blit_ex() clips */
+        r = c->u.blit.r;
+        if (r.width > c->u.blit.src.width) r.width = c->u.blit.src.width;
+        if (r.height > c->u.blit.src.height) r.height = c->u.blit.src.height;
+        if (!c->u.blit.src.pixels || c->u.blit.src.width <= 0 || c->u.blit.src.height <= 0) break;
+        dlist_clip(s, &r, &c->box);
+        break;
+
+    case DL_AFFINE:
+        if (video_blit_affine_bounds(s, &c->u.affine.src, &c->u.affine.m, c->u.affine.filter, &c->box)) {
+            memset(&c->box, 0, sizeof(c->box));
+        }
+        break;
+
+    case DL_PATH:
+        cv = &c->u.path.cover;
+        if (video_path_cover(dl->paths[c->u.path.path], s->width, s->height, c->u.path.rule, cv)) {
+            dlist_fail(dl, errno);
+            break;
+        }
+        r.x         = cv->x;
+        r.y         = cv->y;
+        r.width     = cv->mask ? cv->w : 0;
+        r.height    = cv->h;
+        dlist_clip(s, &r, &c->box);
+        break;
+
+    case DL_TEXT:
+        if (video_text_bounds(c->u.text.cache, c->u.text.font, c->u.text.size, c->u.text.x, c->u.text.y,
+                              dl->strings + c->u.text.str, &r))
+        {
+            dlist_fail(dl, errno);
+            break;
+        }
+        dlist_clip(s, &r, &c->box);
+        break;
+    }
+}
+
+/* Step 3: tile "t", its commands in order */
+static void dlist_tile( struct video_dlist *dl, size_t t ) {
+    const struct video_surface  *s = dl->target;
+    const struct dlist_tile     *tile = &dl->tiles[t];
+    const struct dlist_cmd      *c;
+    struct video_surface        sub;
+    struct video_rect           clip, r;
+    size_t                      i;
+
+    clip.x      = (int)(t % dl->tiles_x) * DLIST_TILE;
+    clip.y      = (int)(t / dl->tiles_x) * DLIST_TILE;
+    clip.width  = (s->width - clip.x < DLIST_TILE) ? s->width - clip.x : DLIST_TILE;
+    clip.height = (s->height - clip.y < DLIST_TILE) ? s->height - clip.y : DLIST_TILE;
+
+    for (i = 0; i < tile->n; i++) {
+        c = &dl->cmds[tile->cmds[i]];
+        switch (c->type) {
+        case DL_FILL:
+            if (video_surface_sub(s, &clip, &sub) == 0) {
+                r    = c->box;
+                r.x -= clip.x;
+                r.y -= clip.y;
+                video_fill_rect(&sub, &r, c->color, c->mode);
+            }
+            break;
+
+        case DL_BLIT:
+            if (video_surface_sub(s, &clip, &sub) == 0) {
+                r    = c->u.blit.r;
+                r.x -= clip.x;
+                r.y -= clip.y;
+                video_blit_ex(&sub, &c->u.blit.src, &r, c->mode, c->u.blit.opacity, c->u.blit.key);
+            }
+            break;
+
+        case DL_AFFINE:
+            video_blit_affine_clip(s, &c->u.affine.src, &c->u.affine.m, c->mode, c->u.affine.filter, c->u.affine.opacity, &clip);
+            break;
+
+        case DL_PATH:
+            video_path_paint(s, &c->u.path.cover, c->color, c->mode, &clip);
+            break;
+
+        case DL_TEXT:
+            if (video_text_draw_clip(s, c->u.text.cache, c->u.text.font, c->u.text.size, c->u.text.x, c->u.text.y,
+                                     dl->strings + c->u.text.str, c->color, &clip) < 0)
+            {
+                dlist_fail(dl, errno);
+            }
+            break;
+        }
+    }
+}
+
+static void dlist_task( struct video_dlist *dl, uint32_t task ) {
+    if (dl->phase == DL_PREPARE) dlist_prepare(dl, &dl->cmds[task]);
+    else dlist_tile(dl, task);
+}
+
+/**
+ * Step 2: adds every command to the tiles its box overlaps.
+ *
+ * \return ZERO, -1 if out of memory.
+ **/
+static int dlist_bin( struct video_dlist *dl ) {
+    const struct video_surface  *s = dl->target;
+    struct dlist_tile           *tiles, *tile;
+    const struct video_rect     *b;
+    uint32_t                    *cmds;
+    size_t                      n, i, cap;
+    int                         tx, ty, tx0, ty0, tx1, ty1;
+
+    dl->tiles_x = (s->width + DLIST_TILE - 1) / DLIST_TILE;
+    n           = (size_t)dl->tiles_x * ((s->height + DLIST_TILE - 1) / DLIST_TILE);
+    if (n > dl->ctiles) {
+        if (!(tiles = (struct dlist_tile *)realloc(dl->tiles, n * sizeof(*tiles)))) return -1;
+        memset(tiles + dl->ctiles, 0, (n - dl->ctiles) * sizeof(*tiles));
+        dl->tiles   = tiles;
+        dl->ctiles  = n;
+    }
+    dl->ntiles = n;
+    for (i = 0; i < n; i++) dl->tiles[i].n = 0;
+
+    for (i = 0; i < dl->ncmds; i++) {
+        b = &dl->cmds[i].box;
+        if (b->width <= 0 || b->height <= 0) continue;
+
+        tx0 = b->x / DLIST_TILE;
+        ty0 = b->y / DLIST_TILE;
+        tx1 = (b->x + b->width - 1) / DLIST_TILE;
+        ty1 = (b->y + b->height - 1) / DLIST_TILE;
+        for (ty = ty0; ty <= ty1; ty++) {
+            for (tx = tx0; tx <= tx1; tx++) {
+                tile = &dl->tiles[(size_t)ty * dl->tiles_x + tx];
+                if (tile->n == tile->cap) {
+                    cap  = tile->cap ? tile->cap * 2 : 32;
+                    cmds = (uint32_t *)realloc(tile->cmds, cap * sizeof(*cmds));
+                    if (!cmds) return -1;
+                    tile->cmds = cmds;
+                    tile->cap  = cap;
+                }
+                tile->cmds[tile->n++] = (uint32_t)i;
+            }
+        }
+    }
+    return 0;
+}
+
+int video_dlist_execute( struct video_dlist *dl, const struct video_surface *s ) {
+    size_t  i;
+    int     err;
+
+    if (!dl || !s) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!s->pixels || s->width <= 0 || s->height <= 0 || !dl->ncmds) return 0;
+
+    dl->target  = s;
+    dl->err     = 0;
+    dlist_parallel(dl, DL_PREPARE, dl->ncmds);
+    if (dlist_bin(dl)) dlist_fail(dl, ENOMEM);
+    else dlist_parallel(dl, DL_TILES, dl->ntiles);
+
+    for (i = 0; i < dl->ncmds; i++) {
+        if (dl->cmds[i].type != DL_PATH) continue;
+        free(dl->cmds[i].u.path.cover.mask);
+        dl->cmds[i].u.path.cover.mask = 0;
+    }
+    dl->target = 0;
+
+    if ((err = dl->err)) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int video_dlist_submit( VIDEO v, struct video_dlist *dl, void *buf_pixels ) {
+    struct video_surface    s;
+
+    if (video_get_surface(v, buf_pixels, &s) || video_dlist_execute(dl, &s)) return -1;
+    video_submit_frame(v, buf_pixels);
+    return 0;
+}
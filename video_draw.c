@@ -0,0 +1,468 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#include "video.h"
+#include "video_draw.h"
+
+#define VIDEO_DRAW_MAX_RADIUS   16384           /* Keeps the ellipse arithmetic inside 64 bits */
+
+static const struct video_kernels   *draw_kern;
+
+const struct video_kernels *video_draw_kernels( void ) {
+    const struct video_kernels *k = __atomic_load_n(&draw_kern, __ATOMIC_RELAXED);
+
+    /* Every thread would pick the same set, a race is harmless */
+    if (!k) {
+        k = video_kernels_select(0);
+        __atomic_store_n(&draw_kern, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+static inline int64_t draw_min( int64_t a, int64_t b ) {
+    return (a < b) ? a : b;
+}
+
+static inline int64_t draw_max( int64_t a, int64_t b ) {
+    return (a > b) ? a : b;
+}
+
+/**
+ * a / b rounded toward minus infinity, b > 0.  "a" is
+ * usually the product of two 32 bit distances plus a bit,
+ * which can need more than 64 bits; quotients that don't
+ * fit are clamped.
+ **/
+static inline int64_t draw_floor_div( __int128 a, int64_t b ) {
+    __int128 q = a / b;
+
+    if (a % b && a < 0) q--;
+    if (q > INT64_MAX) return INT64_MAX;
+    if (q < -INT64_MAX) return -INT64_MAX;
+    return (int64_t)q;
+}
+
+static inline int64_t draw_ceil_div( __int128 a, int64_t b ) {
+    return -draw_floor_div(-a, b);
+}
+
+/**
+ * Row "y" from "x0" up to (not including) "x1", clipped to
+ * the surface's width.  The row must be on the surface.
+ **/
+static inline void draw_span( const struct video_kernels *k, const struct video_surface *s,
+                              int64_t x0, int64_t x1, int y, uint32_t color, int mode )
+{
+    if (x0 < 0) x0 = 0;
+    if (x1 > s->width) x1 = s->width;
+    if (x1 > x0) video_span(k, s, (int)x0, y, (int)(x1 - x0), color, mode);
+}
+
+int video_get_surface( VIDEO v, void *buf_pixels, struct video_surface *s ) {
+    if (!buf_pixels || !s || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    s->pixels   = (uint32_t *)buf_pixels;
+    s->width    = video_get_width(v);
+    s->height   = video_get_height(v);
+    s->stride   = (size_t)s->width * sizeof(uint32_t);
+    return 0;
+}
+
+int video_surface_sub( const struct video_surface *s, const struct video_rect *r, struct video_surface *sub ) {
+    int64_t x0 = draw_max(r->x, 0),
+            y0 = draw_max(r->y, 0),
+            x1 = draw_min((int64_t)r->x + r->width, s->width),
+            y1 = draw_min((int64_t)r->y + r->height, s->height);
+
+    if (x1 <= x0 || y1 <= y0) {
+        errno = EINVAL;
+        return -1;
+    }
+    sub->pixels = video_surface_row(s, (int)y0) + x0;
+    sub->width  = (int)(x1 - x0);
+    sub->height = (int)(y1 - y0);
+    sub->stride = s->stride;
+    return 0;
+}
+
+void video_fill_rect( const struct video_surface *s, const struct video_rect *r, uint32_t color, int mode ) {
+    const struct video_kernels  *k = video_draw_kernels();
+    struct video_surface        c;
+    int                         y;
+
+    if (mode == VIDEO_BLEND_OVER && !(color >> 24)) return;
+    if (video_surface_sub(s, r, &c)) return;
+
+    for (y = 0; y < c.height; y++) video_span(k, &c, 0, y, c.width, color, mode);
+}
+
+void video_draw_hline( const struct video_surface *s, int x, int y, int len, uint32_t color, int mode ) {
+    if (y < 0 || y >= s->height || len <= 0) return;
+    draw_span(video_draw_kernels(), s, x, (int64_t)x + len, y, color, mode);
+}
+
+void video_draw_vline( const struct video_surface *s, int x, int y, int len, uint32_t color, int mode ) {
+    int64_t y0 = draw_max(y, 0),
+            y1 = draw_min((int64_t)y + len, s->height);
+    uint8_t *d;
+
+    if (x < 0 || x >= s->width || y1 <= y0) return;
+    if (mode == VIDEO_BLEND_OVER) {
+        if (!(color >> 24)) return;
+        if ((color >> 24) == 0xFF) mode = VIDEO_BLEND_COPY;
+    }
+
+    d = (uint8_t *)(video_surface_row(s, (int)y0) + x);
+    for (; y0 < y1; y0++, d += s->stride) {
+        *(uint32_t *)d = (mode == VIDEO_BLEND_OVER) ? video_blend_px(*(uint32_t *)d, color) : color;
+    }
+}
+
+void video_draw_rect( const struct video_surface *s, const struct video_rect *r, uint32_t color, int mode ) {
+    if (r->width <= 0 || r->height <= 0) return;
+
+    video_draw_hline(s, r->x, r->y, r->width, color, mode);
+    if (r->height > 1) video_draw_hline(s, r->x, r->y + r->height - 1, r->width, color, mode);
+    if (r->height > 2) {
+        video_draw_vline(s, r->x, r->y + 1, r->height - 2, color, mode);
+        if (r->width > 1) video_draw_vline(s, r->x + r->width - 1, r->y + 1, r->height - 2, color, mode);
+    }
+}
+
+/**
+ * Bresenham in closed form.  Along the major axis "u" the
+ * line takes du steps; at step k the minor axis "v" has
+ * moved
+ *
+ *      m(k) = floor((2 k dv + du) / (2 du))
+ *
+ * which is what the usual error term loop produces.  That
+ * lets us work out which steps are on the surface before
+ * drawing, start the error term part way along, and never
+ * look at a pixel that's off it.  Pixels on the same row
+ * are written as one span.
+ *
+ * "last" includes the end point.
+ **/
+static void draw_line( const struct video_kernels *k, const struct video_surface *s,
+                       int x0, int y0, int x1, int y1, uint32_t color, int mode, int last )
+{
+    int64_t     dx = (x1 > x0) ? (int64_t)x1 - x0 : (int64_t)x0 - x1,
+                dy = (y1 > y0) ? (int64_t)y1 - y0 : (int64_t)y0 - y1;
+    int         xmajor = dx >= dy,
+                su, sv;
+    int64_t     du, dv, u0, v0, usize, vsize,
+                kmin = 0, kmax, ma, mb,
+                m, r, i,
+                run = 0, run_m = -1, u, v;
+    __int128    n;
+
+    du      = xmajor ? dx : dy;
+    dv      = xmajor ? dy : dx;
+    u0      = xmajor ? x0 : y0;
+    v0      = xmajor ? y0 : x0;
+    su      = (xmajor ? x1 >= x0 : y1 >= y0) ? 1 : -1;
+    sv      = (xmajor ? y1 >= y0 : x1 >= x0) ? 1 : -1;
+    usize   = xmajor ? s->width : s->height;
+    vsize   = xmajor ? s->height : s->width;
+    kmax    = last ? du : du - 1;
+
+    if (kmax < 0 || s->width <= 0 || s->height <= 0) return;
+
+    /* Steps where the major axis is on the surface */
+    if (su > 0) {
+        kmin = draw_max(kmin, -u0);
+        kmax = draw_min(kmax, usize - 1 - u0);
+    } else {
+        kmin = draw_max(kmin, u0 - usize + 1);
+        kmax = draw_min(kmax, u0);
+    }
+
+    /* ...and the minor axis: m(k) must be in [ma, mb] */
+    ma = (sv > 0) ? -v0 : v0 - vsize + 1;
+    mb = (sv > 0) ? vsize - 1 - v0 : v0;
+    if (mb < 0) return;
+    if (ma > 0) {
+        if (!dv) return;
+        kmin = draw_max(kmin, draw_ceil_div((__int128)(2 * ma - 1) * du, 2 * dv));
+    }
+    if (dv) kmax = draw_min(kmax, draw_ceil_div((__int128)(2 * mb + 1) * du, 2 * dv) - 1);
+    if (kmin > kmax) return;
+
+    if (!du) {
+        video_plot(s, x0, y0, color, mode);
+        return;
+    }
+
+    n = (__int128)2 * kmin * dv + du;
+    m = (int64_t)(n / (2 * du));
+    r = (int64_t)(n % (2 * du));
+
+    for (i = kmin; i <= kmax; i++) {
+        u = u0 + su * i;
+        v = v0 + sv * m;
+        if (!xmajor) {
+            video_plot(s, (int)v, (int)u, color, mode);
+        } else if (m != run_m) {
+            if (run_m >= 0) {
+                draw_span(k, s, draw_min(run, u - su), draw_max(run, u - su) + 1, (int)(v0 + sv * run_m), color, mode);
+            }
+            run     = u;
+            run_m   = m;
+        }
+        if ((r += 2 * dv) >= 2 * du) {
+            r -= 2 * du;
+            m++;
+        }
+    }
+    if (xmajor) {
+        u = u0 + su * kmax;
+        draw_span(k, s, draw_min(run, u), draw_max(run, u) + 1, (int)(v0 + sv * run_m), color, mode);
+    }
+}
+
+void video_draw_line( const struct video_surface *s, int x0, int y0, int x1, int y1, uint32_t color, int mode ) {
+    if (mode == VIDEO_BLEND_OVER && !(color >> 24)) return;
+    draw_line(video_draw_kernels(), s, x0, y0, x1, y1, color, mode, 1);
+}
+
+static uint64_t draw_isqrt( uint64_t n ) {
+    uint64_t    root = 0,
+                bit = 1ULL << 62;
+
+    while (bit > n) bit >>= 2;
+    for (; bit; bit >>= 2) {
+        if (n >= root + bit) {
+            n   -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+/**
+ * Half width of row "dy" of an ellipse: the largest x whose
+ * pixel center is inside an ellipse half a pixel bigger than
+ * the radii, which is what makes a circle of radius r come
+ * out 2r + 1 wide.  In doubled coordinates, with
+ * A = (2 rx + 1)^2 and B = (2 ry + 1)^2,
+ *
+ *      (2x)^2 B + (2dy)^2 A <= A B
+ *
+ * \return -1 if the row is outside the ellipse.
+ **/
+static int64_t draw_ellipse_w( int64_t a, int64_t b, int64_t dy ) {
+    int64_t rhs = a * b - 4 * dy * dy * a;
+
+    if (rhs < 0) return -1;
+    return (int64_t)draw_isqrt((uint64_t)(rhs / (4 * b)));
+}
+
+static void draw_ellipse( const struct video_surface *s, int cx, int cy, int rx, int ry, 
+                          uint32_t color, int mode, int fill ) 
+{
+    const struct video_kernels  *k = video_draw_kernels();
+    int64_t                     a, b, dy, dy1, w, wa, wb, lo;
+    int                         y;
+
+    if (rx < 0 || ry < 0 || (mode == VIDEO_BLEND_OVER && !(color >> 24))) return;
+    if (rx > VIDEO_DRAW_MAX_RADIUS) rx = VIDEO_DRAW_MAX_RADIUS;
+    if (ry > VIDEO_DRAW_MAX_RADIUS) ry = VIDEO_DRAW_MAX_RADIUS;
+
+    a   = (2 * (int64_t)rx + 1) * (2 * (int64_t)rx + 1);
+    b   = (2 * (int64_t)ry + 1) * (2 * (int64_t)ry + 1);
+    dy  = draw_max(-ry, -(int64_t)cy);
+    dy1 = draw_min(ry, (int64_t)s->height - 1 - cy);
+    if (dy > dy1) return;
+
+    wa  = draw_ellipse_w(a, b, dy - 1);
+    w   = draw_ellipse_w(a, b, dy);
+    for (; dy <= dy1; dy++, wa = w, w = wb) {
+        wb  = draw_ellipse_w(a, b, dy + 1);
+        y   = (int)(cy + dy);
+
+        /**
+         * Outline: the pixels at the ends of the row, and any
+         * the row above or below doesn't reach out to.
+         **/
+        lo = fill ? 0 : draw_min(draw_min(wa, wb) + 1, w);
+        if (!lo) {
+            draw_span(k, s, cx - w, cx + w + 1, y, color, mode);
+        } else {
+            draw_span(k, s, cx - w, cx - lo + 1, y, color, mode);
+            draw_span(k, s, cx + lo, cx + w + 1, y, color, mode);
+        }
+    }
+}
+
+void video_draw_ellipse( const struct video_surface *s, int cx, int cy, int rx, int ry, uint32_t color, int mode ) {
+    draw_ellipse(s, cx, cy, rx, ry, color, mode, 0);
+}
+
+void video_fill_ellipse( const struct video_surface *s, int cx, int cy, int rx, int ry, uint32_t color, int mode ) {
+    draw_ellipse(s, cx, cy, rx, ry, color, mode, 1);
+}
+
+void video_draw_circle( const struct video_surface *s, int cx, int cy, int r, uint32_t color, int mode ) {
+    draw_ellipse(s, cx, cy, r, r, color, mode, 0);
+}
+
+void video_fill_circle( const struct video_surface *s, int cx, int cy, int r, uint32_t color, int mode ) {
+    draw_ellipse(s, cx, cy, r, r, color, mode, 1);
+}
+
+/**
+ * Each edge draws up to but not including its end point, so
+ * where two edges meet the corner is drawn once.
+ **/
+void video_draw_polygon( const struct video_surface *s, const struct video_point *pts, size_t n, uint32_t color, int mode ) {
+    const struct video_kernels  *k = video_draw_kernels();
+    size_t                      i;
+
+    if (!pts || !n || (mode == VIDEO_BLEND_OVER && !(color >> 24))) return;
+
+    if (n <= 2) {
+        draw_line(k, s, pts[0].x, pts[0].y, pts[n - 1].x, pts[n - 1].y, color, mode, 1);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        draw_line(k, s, pts[i].x, pts[i].y, pts[(i + 1) % n].x, pts[(i + 1) % n].y, color, mode, 0);
+    }
+}
+
+struct draw_edge {
+    int64_t     top,                    /* First row it crosses             */
+                bottom,                 /* Row after the last one           */
+                x0, y0,                 /* Its upper end                    */
+                dx, dy;                 /* To the lower end, dy > 0         */
+    int         dir;                    /* +1 going down, -1 going up       */
+};
+
+struct draw_cross {
+    int64_t     x;
+    int         dir;
+};
+
+static int draw_cmp_edge( const void *a, const void *b ) {
+    const struct draw_edge  *x = (const struct draw_edge *)a,
+                            *y = (const struct draw_edge *)b;
+    return (x->top > y->top) - (x->top < y->top);
+}
+
+/**
+ * Scanline fill.  Rows are sampled through pixel centers: an
+ * edge from y0 down to y1 crosses rows y0 .. y1 - 1, at
+ *
+ *      x = x0 + (y + 1/2 - y0) dx / dy
+ *
+ * and the first pixel right of it (center at or past x) is
+ * ceil(x - 1/2), worked out exactly in integers.  Edges are
+ * sorted by their top row and only the ones crossing the
+ * current row are looked at.
+ **/
+int video_fill_polygon( const struct video_surface *s, const struct video_point *pts, size_t n, uint32_t color, int mode ) {
+    const struct video_kernels  *k = video_draw_kernels();
+    const struct video_point    *a,
+                                *b;
+    struct draw_edge            *edges,
+                                **active,
+                                *e;
+    struct draw_cross           *cross,
+                                c;
+    size_t                      ne = 0,
+                                na = 0,
+                                next = 0,
+                                nc,
+                                i, j, p;
+    int64_t                     y, y1, x0 = 0;
+    int                         wind, was;
+
+    if (!pts || n < 3 || (mode == VIDEO_BLEND_OVER && !(color >> 24))) return 0;
+
+    edges   = (struct draw_edge *)malloc(n * (sizeof(*edges) + sizeof(*active) + sizeof(*cross)));
+    if (!edges) return -1;
+    active  = (struct draw_edge **)(edges + n);
+    cross   = (struct draw_cross *)(active + n);
+
+    y  = INT64_MAX;
+    y1 = INT64_MIN;
+    for (i = 0; i < n; i++) {
+        a = &pts[i];
+        b = &pts[(i + 1) % n];
+        if (a->y == b->y) continue;
+
+        e       = &edges[ne++];
+        e->dir  = (a->y < b->y) ? 1 : -1;
+        if (e->dir < 0) {
+            a = b;
+            b = &pts[i];
+        }
+        e->x0   = a->x;
+        e->y0   = a->y;
+        e->dx   = (int64_t)b->x - a->x;
+        e->dy   = (int64_t)b->y - a->y;
+        e->top      = e->y0;
+        e->bottom   = e->y0 + e->dy;
+        y           = draw_min(y, e->top);
+        y1          = draw_max(y1, e->bottom);
+    }
+    qsort(edges, ne, sizeof(*edges), &draw_cmp_edge);
+
+    y  = draw_max(y, 0);
+    y1 = draw_min(y1, s->height);
+
+    for (; y < y1; y++) {
+        while (next < ne && edges[next].top <= y) active[na++] = &edges[next++];
+
+        for (i = j = 0, nc = 0; i < na; i++) {
+            e = active[i];
+            if (e->bottom <= y) continue;
+            active[j++] = e;
+
+            /* ceil(x - 1/2) = ceil((2 dy x0 + (2 (y - y0) + 1) dx - dy) / (2 dy)) */
+            c.x     = draw_ceil_div((__int128)2 * e->dy * e->x0 + (__int128)(2 * (y - e->y0) + 1) * e->dx - e->dy, 2 * e->dy);
+            c.dir   = e->dir;
+
+            /* Insertion sort, the order barely changes from row to row */
+            for (p = nc++; p && cross[p - 1].x > c.x; p--) cross[p] = cross[p - 1];
+            cross[p] = c;
+        }
+        na = j;
+
+        /* Non-zero: fill wherever the winding count isn't zero */
+        for (i = 0, wind = 0; i < nc; i++) {
+            was   = wind;
+            wind += cross[i].dir;
+            if (!was && wind) {
+                x0 = cross[i].x;
+            } else if (was && !wind) {
+                draw_span(k, s, x0, cross[i].x, (int)y, color, mode);
+            }
+        }
+    }
+
+    free(edges);
+    return 0;
+}
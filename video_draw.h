@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_DRAW_H_
+#define _VIDEO_DRAW_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * What every drawing module (primitives, paths, blits, text)
+ * ends up doing: writing a run of pixels along one row of a
+ * surface.  Callers clip first, so nothing here checks bounds.
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "video.h"
+#include "video_kernels.h"
+
+/**
+ * Kernels for drawing on surfaces, which aren't tied to a
+ * display: the best set for this CPU, picked on first use.
+ **/
+const struct video_kernels *video_draw_kernels( void );
+
+static inline uint32_t *video_surface_row( const struct video_surface *s, int y ) {
+    return (uint32_t *)((uint8_t *)s->pixels + (size_t)y * s->stride);
+}
+
+/**
+ * "n" pixels of "color" from (x, y), already clipped.  
+ * VIDEO_BLEND_OVER skips transparent colors and fills
+ * opaque ones.
+ **/
+static inline void video_span( const struct video_kernels *k, const struct video_surface *s, 
+                               int x, int y, int n, uint32_t color, int mode ) 
+{
+    uint32_t    *d = video_surface_row(s, y) + x;
+
+    if (mode == VIDEO_BLEND_OVER && (color >> 24) != 0xFF) {
+        if (color >> 24) k->blend_fill(d, color, n);
+    } else {
+        k->fill(d, color, (size_t)n * sizeof(uint32_t));
+    }
+}
+
+static inline void video_plot( const struct video_surface *s, int x, int y, uint32_t color, int mode ) {
+    uint32_t    *d = video_surface_row(s, y) + x;
+
+    *d = (mode == VIDEO_BLEND_OVER) ? video_blend_px(*d, color) : color;
+}
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#include <string.h>
+
+#include "video_format.h"
+
+static const uint8_t bayer4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 }
+};
+
+static int video_format_is( const struct fb_var_screeninfo *var, int bpp, 
+                            int roff, int rlen, int goff, int glen, int boff, int blen ) 
+{
+    return var->bits_per_pixel == bpp &&
+           var->red.offset   == roff && var->red.length   == rlen &&
+           var->green.offset == goff && var->green.length == glen &&
+           var->blue.offset  == boff && var->blue.length  == blen;
+}
+
+int video_format_init( struct video_format *f, const struct fb_var_screeninfo *var, int dither ) {
+    int x, 
+        y,
+        m;
+
+    memset(f, 0, sizeof(struct video_format));
+
+    if (var->grayscale || var->nonstd) return -1;
+    if (var->bits_per_pixel != 16 && 
+        var->bits_per_pixel != 24 && 
+        var->bits_per_pixel != 32) 
+    {
+        return -1;
+    }
+
+    f->bytespp  = var->bits_per_pixel / 8;
+    f->red      = var->red;
+    f->green    = var->green;
+    f->blue     = var->blue;
+    f->transp   = var->transp;
+
+    if (video_format_is(var, 32, 16, 8, 8, 8, 0, 8)) {
+        f->id = VIDEO_FMT_XRGB8888;
+    } else if (video_format_is(var, 32, 0, 8, 8, 8, 16, 8)) {
+        f->id = VIDEO_FMT_XBGR8888;
+    } else if (video_format_is(var, 24, 16, 8, 8, 8, 0, 8)) {
+        f->id = VIDEO_FMT_RGB888;
+    } else if (video_format_is(var, 16, 11, 5, 5, 6, 0, 5)) {
+        f->id = VIDEO_FMT_RGB565;
+    } else {
+        if (!f->red.length || !f->green.length || !f->blue.length) return -1;
+        f->id = VIDEO_FMT_GENERIC;
+    }
+
+    if (f->id == VIDEO_FMT_RGB565 && dither) {
+        f->dither = 1;
+        for (y = 0; y < 4; y++) {
+            for (x = 0; x < 8; x++) {
+                /* Up to one step of the 5 bit (8) and 6 bit (4) channels */
+                m = bayer4[y][x & 3];
+                f->dither_tab[y][x] = ((m >> 1) << 16) | ((m >> 2) << 8) | (m >> 1);
+            }
+        }
+    }
+    return 0;
+}
+
+const char *video_format_name( const struct video_format *f ) {
+    switch (f->id) {
+        case VIDEO_FMT_XRGB8888:    return "XRGB8888";
+        case VIDEO_FMT_XBGR8888:    return "XBGR8888";
+        case VIDEO_FMT_RGB888:      return "RGB888";
+        case VIDEO_FMT_RGB565:      return "RGB565";
+    }
+    return "generic";
+}
+
+/**
+ * Moves an 8 bit channel value into a bitfield.
+ **/
+static inline uint32_t video_format_pack( uint32_t c, const struct fb_bitfield *bf ) {
+    if (!bf->length) return 0;
+    if (bf->length <= 8) return (c >> (8 - bf->length)) << bf->offset;
+    return (c << (bf->length - 8)) << bf->offset;
+}
+
+/**
+ * Pulls a bitfield out to 8 bits, repeating the top bits into
+ * the bottom so full scale stays full scale.
+ **/
+static inline uint32_t video_format_unpack( uint32_t p, const struct fb_bitfield *bf ) {
+    uint32_t    c,
+                s;
+
+    if (!bf->length) return 0xFF;
+    c = (p >> bf->offset) & ((1u << bf->length) - 1);
+    if (bf->length >= 8) return c >> (bf->length - 8);
+    c <<= (8 - bf->length);
+    for (s = bf->length; s < 8; s += bf->length) c |= c >> s;
+    return c & 0xFF;
+}
+
+static void video_format_put_generic( const struct video_format *f, uint8_t *d, 
+                                      const uint32_t *src, size_t npx ) 
+{
+    uint32_t    p,
+                o;
+    size_t      i;
+    int         b;
+
+    for (i = 0; i < npx; i++) {
+        p = src[i];
+        o = video_format_pack((p >> 16) & 0xFF, &f->red)   |
+            video_format_pack((p >>  8) & 0xFF, &f->green) |
+            video_format_pack( p        & 0xFF, &f->blue)  |
+            video_format_pack((p >> 24) & 0xFF, &f->transp);
+        for (b = 0; b < f->bytespp; b++, o >>= 8) *d++ = o;
+    }
+}
+
+void video_format_put_row( const struct video_format *f, const struct video_kernels *k,
+                           void *dst, const uint32_t *src, size_t npx, int x, int y )
+{
+    switch (f->id) {
+        case VIDEO_FMT_XRGB8888:
+            k->copy(dst, src, npx * sizeof(uint32_t));
+            break;
+        case VIDEO_FMT_XBGR8888:
+            k->to_xbgr8888(dst, src, npx);
+            break;
+        case VIDEO_FMT_RGB888:
+            k->to_rgb888(dst, src, npx);
+            break;
+        case VIDEO_FMT_RGB565:
+            k->to_rgb565(dst, src, npx, f->dither ? &f->dither_tab[y & 3][x & 3] : 0);
+            break;
+        default:
+            video_format_put_generic(f, (uint8_t *)dst, src, npx);
+            break;
+    }
+}
+
+void video_format_get_row( const struct video_format *f, const struct video_kernels *k,
+                           uint32_t *dst, const void *src, size_t npx, void *scratch )
+{
+    const uint8_t   *s = (const uint8_t *)scratch;
+    uint32_t        p;
+    size_t          i;
+    int             b;
+
+    if (f->id == VIDEO_FMT_XRGB8888) {
+        k->read(dst, src, npx * sizeof(uint32_t));
+        return;
+    }
+
+    /* Whole pixels only, the kernels work in four byte steps */
+    k->read(scratch, src, ((npx * f->bytespp) + 3) & ~(size_t)3);
+
+    for (i = 0; i < npx; i++) {
+        p = 0;
+        for (b = 0; b < f->bytespp; b++) p |= (uint32_t)*s++ << (b * 8);
+        dst[i] = (video_format_unpack(p, &f->transp) << 24) |
+                 (video_format_unpack(p, &f->red)    << 16) |
+                 (video_format_unpack(p, &f->green)  <<  8) |
+                  video_format_unpack(p, &f->blue);
+    }
+}
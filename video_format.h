@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_FORMAT_H_
+#define _VIDEO_FORMAT_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Applications always draw in ARGB8888 with rows packed
+ * back to back.  This is what gets those pixels into
+ * whatever layout the panel actually uses, one row at a
+ * time, and back out again for readback.
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/fb.h>
+
+#include "video_kernels.h"
+
+#define VIDEO_FMT_XRGB8888          0   /* Same as what we draw in, straight copy        */
+#define VIDEO_FMT_XBGR8888          1   /* 32 bit, red and blue swapped                  */
+#define VIDEO_FMT_RGB888            2   /* 24 bit, blue byte first                       */
+#define VIDEO_FMT_RGB565            3   /* 16 bit                                        */
+#define VIDEO_FMT_GENERIC           4   /* Anything else truecolor, done with bitfields  */
+
+struct video_format {
+    int                 id,
+                        bytespp,
+                        dither;
+
+    struct fb_bitfield  red,
+                        green,
+                        blue,
+                        transp;
+
+    /**
+     * Ordered (4x4 Bayer) dither thresholds for RGB565, as ARGB
+     * words.  Row y & 3 starting at column x & 3 gives the four
+     * words the to_rgb565 kernel wants.
+     **/
+    uint32_t            dither_tab[4][8];
+};
+
+/**
+ * Works out the panel's layout from its mode.
+ *
+ * \return ZERO on success, -1 if the mode isn't truecolor at
+ * 16, 24 or 32 bits per pixel.
+ **/
+int         video_format_init( struct video_format *f, const struct fb_var_screeninfo *var, int dither );
+
+/**
+ * \return A short name for the layout, e.g. "RGB565".
+ **/
+const char  *video_format_name( const struct video_format *f );
+
+/**
+ * Writes "npx" ARGB8888 pixels from "src" to "dst" in the
+ * panel's layout.  "x" and "y" are the screen position of the
+ * first pixel (they pick the dither phase).
+ **/
+void        video_format_put_row( const struct video_format *f, const struct video_kernels *k,
+                                  void *dst, const uint32_t *src, size_t npx, int x, int y );
+
+/**
+ * Reads "npx" pixels in the panel's layout from "src" (video
+ * memory) into "dst" as ARGB8888.  "scratch" must hold one
+ * row of video memory; the row is pulled out of video memory
+ * in one go before it's converted.
+ **/
+void        video_format_get_row( const struct video_format *f, const struct video_kernels *k,
+                                  uint32_t *dst, const void *src, size_t npx, void *scratch );
+
+#endif
@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video.h"
+
+#include <time.h>
+
+/**
+ * Display groups.  Presenting is mostly waiting for VBLANK,
+ * and each display waits for its own, so one thread taking
+ * turns makes every frame wait for the sum of them.  A group
+ * gives each display after the first a worker: a submit
+ * hands every display its frame and the caller presents the
+ * first, so the waits overlap and it returns after the
+ * slowest instead.
+ **/
+
+struct group_member {
+    VIDEO               v;
+    pthread_t           thread;
+    void                *frame;                 /* This round's, NULL to leave the display be       */
+    uint64_t            frames,
+                        skipped,
+                        presented_ns,
+                        skew_ns;
+};
+
+struct video_group {
+    struct group_member *m;
+    size_t              n,
+                        nthreads,               /* Workers started                                  */
+                        pending;                /* Still presenting this round                      */
+    unsigned            flags;
+
+    pthread_mutex_t     mtx;
+    pthread_cond_t      go,
+                        done;
+    uint64_t            step;                   /* Rounds started                                   */
+    int                 quit;
+
+    pthread_barrier_t   sync;                   /* VIDEO_GROUP_SYNC: everyone in before anyone presents */
+};
+
+struct group_arg {
+    struct video_group  *g;
+    size_t              i;
+};
+
+static inline uint64_t group_now( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void group_present( struct video_group *g, size_t i ) {
+    struct group_member *m = &g->m[i];
+
+    if (g->flags & VIDEO_GROUP_SYNC) pthread_barrier_wait(&g->sync);
+    if (!m->frame) {
+        m->skipped++;
+        return;
+    }
+    video_submit_frame(m->v, m->frame);
+    m->presented_ns = group_now();
+    m->frames++;
+}
+
+static void *group_worker( void *arg ) {
+    struct video_group  *g = ((struct group_arg *)arg)->g;
+    size_t              i = ((struct group_arg *)arg)->i;
+    uint64_t            seen = 0;
+
+    free(arg);
+    for (;;) {
+        pthread_mutex_lock(&g->mtx);
+        while (g->step == seen && !g->quit) pthread_cond_wait(&g->go, &g->mtx);
+        if (g->quit) {
+            pthread_mutex_unlock(&g->mtx);
+            break;
+        }
+        seen = g->step;
+        pthread_mutex_unlock(&g->mtx);
+
+        group_present(g, i);
+
+        pthread_mutex_lock(&g->mtx);
+        if (!--g->pending) pthread_cond_signal(&g->done);
+        pthread_mutex_unlock(&g->mtx);
+    }
+    return 0;
+}
+
+/**
+ * Displays synced together have to refresh at the same rate
+ * (within half a percent), as far as we know it.
+ **/
+static int group_same_rate( const VIDEO *displays, size_t n ) {
+    struct video_pace_stats st;
+    uint64_t                period = 0,
+                            d;
+    size_t                  i;
+
+    for (i = 0; i < n; i++) {
+        if (video_get_pace_stats(displays[i], &st) || !st.period_ns) continue;
+        if (!period) {
+            period = st.period_ns;
+            continue;
+        }
+        d = (st.period_ns > period) ? st.period_ns - period : period - st.period_ns;
+        if (d * 200 > period) return 0;
+    }
+    return 1;
+}
+
+struct video_group *video_group_create( const VIDEO *displays, size_t n, unsigned flags ) {
+    struct video_group  *g;
+    struct group_arg    *a;
+    size_t              i, j;
+    int                 err;
+
+    if (!displays || !n) goto invalid;
+    for (i = 0; i < n; i++) {
+        if (!video_is_active(displays[i])) goto invalid;
+        for (j = 0; j < i; j++) {
+            if (displays[j] == displays[i]) goto invalid;
+        }
+    }
+    if ((flags & VIDEO_GROUP_SYNC) && !group_same_rate(displays, n)) {
+        fprintf(stderr, "libvideo/video_group_create(): ERROR - Displays don't refresh at the same rate, can't sync them.\n");
+        goto invalid;
+    }
+
+    if (!(g = (struct video_group *)calloc(1, sizeof(*g)))) return 0;
+    if (!(g->m = (struct group_member *)calloc(n, sizeof(*g->m)))) {
+        free(g);
+        return 0;
+    }
+    for (i = 0; i < n; i++) g->m[i].v = displays[i];
+    g->n        = n;
+    g->flags    = flags;
+    pthread_mutex_init(&g->mtx, 0);
+    pthread_cond_init(&g->go, 0);
+    pthread_cond_init(&g->done, 0);
+    if (flags & VIDEO_GROUP_SYNC) pthread_barrier_init(&g->sync, 0, (unsigned)n);
+
+    for (i = 1; i < n; i++) {
+        if (!(a = (struct group_arg *)malloc(sizeof(*a)))) goto fail;
+        a->g = g;
+        a->i = i;
+        if ((err = pthread_create(&g->m[i].thread, 0, &group_worker, a))) {
+            fprintf(stderr, "libvideo/video_group_create(): ERROR - Can't start a worker: %s\n", strerror(err));
+            free(a);
+            errno = err;
+            goto fail;
+        }
+        pthread_setname_np(g->m[i].thread, "vid-group");
+        g->nthreads++;
+    }
+    return g;
+
+fail:
+    err = errno;
+    video_group_destroy(g);
+    errno = err;
+    return 0;
+
+invalid:
+    errno = EINVAL;
+    return 0;
+}
+
+void video_group_destroy( struct video_group *g ) {
+    size_t  i;
+
+    if (!g) return;
+    pthread_mutex_lock(&g->mtx);
+    g->quit = 1;
+    pthread_cond_broadcast(&g->go);
+    pthread_mutex_unlock(&g->mtx);
+    for (i = 1; i <= g->nthreads; i++) pthread_join(g->m[i].thread, 0);
+
+    if (g->flags & VIDEO_GROUP_SYNC) pthread_barrier_destroy(&g->sync);
+    pthread_cond_destroy(&g->done);
+    pthread_cond_destroy(&g->go);
+    pthread_mutex_destroy(&g->mtx);
+    free(g->m);
+    free(g);
+}
+
+int video_group_submit( struct video_group *g, void *const *frames ) {
+    uint64_t    first = 0;
+    size_t      i;
+
+    if (!g || !frames) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < g->n; i++) {
+        if (frames[i] && !video_is_active(g->m[i].v)) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    for (i = 0; i < g->n; i++) g->m[i].frame = frames[i];
+
+    pthread_mutex_lock(&g->mtx);
+    g->pending = g->n - 1;
+    g->step++;
+    pthread_cond_broadcast(&g->go);
+    pthread_mutex_unlock(&g->mtx);
+
+    group_present(g, 0);
+
+    pthread_mutex_lock(&g->mtx);
+    while (g->pending) pthread_cond_wait(&g->done, &g->mtx);
+    pthread_mutex_unlock(&g->mtx);
+
+    /* How far behind the first one to get there each display was */
+    for (i = 0; i < g->n; i++) {
+        if (frames[i] && (!first || g->m[i].presented_ns < first)) first = g->m[i].presented_ns;
+    }
+    for (i = 0; i < g->n; i++) {
+        if (frames[i]) g->m[i].skew_ns = g->m[i].presented_ns - first;
+    }
+    return 0;
+}
+
+int video_group_get_stats( struct video_group *g, size_t i, struct video_group_stats *st ) {
+    if (!g || !st || i >= g->n) {
+        errno = EINVAL;
+        return -1;
+    }
+    st->frames          = g->m[i].frames;
+    st->skipped         = g->m[i].skipped;
+    st->presented_ns    = g->m[i].presented_ns;
+    st->skew_ns         = g->m[i].skew_ns;
+    return 0;
+}
@@ -0,0 +1,1391 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#include <string.h>
+
+#include "video_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VIDEO_KERNELS_X86
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VIDEO_KERNELS_NEON
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON          (1 << 12)
+#endif
+#endif
+#endif
+
+/**
+ * Video memory is mapped write-combining on the Pi (and on
+ * most PCs).  The CPU gathers stores into 64 byte lines and
+ * sends whole lines out, so the SIMD loops below always
+ * write a full 64 bytes per iteration, in order.
+ **/
+#define VIDEO_BURST             64
+
+/**
+ * Copies at least this big bypass the cache (non-temporal
+ * stores) where the CPU has them.  Smaller ones, like the
+ * spans from video_submit_regions(), don't gain anything.
+ **/
+#define VIDEO_NT_THRESHOLD      (64 * 1024)
+
+
+/*
+ +================================================================================+
+ |                          Scalar (reference) kernels                            |
+ +================================================================================+
+*/
+
+static void scalar_copy( void *dst, const void *src, size_t bytes ) {
+    uint32_t        *d32 = (uint32_t *)dst;
+    const uint32_t  *s32 = (const uint32_t *)src;
+    uint64_t        *d64;
+    const uint64_t  *s64;
+    size_t          i,
+                    n;
+
+    if (((uintptr_t)dst & 7) != ((uintptr_t)src & 7)) {
+        for (i = 0; i < bytes / 4; i++)
+            d32[i] = s32[i];
+        return;
+    }
+
+    if (((uintptr_t)dst & 7) && bytes >= 4) {
+        *d32++ = *s32++;
+        bytes -= 4;
+    }
+
+    d64 = (uint64_t *)d32;
+    s64 = (const uint64_t *)s32;
+    n   = bytes / 8;
+    for (i = 0; i < n; i++)
+        d64[i] = s64[i];
+
+    if (bytes & 4) *(uint32_t *)&d64[n] = *(const uint32_t *)&s64[n];
+}
+
+static void scalar_fill( void *dst, uint32_t color, size_t bytes ) {
+    uint32_t    *d32 = (uint32_t *)dst;
+    uint64_t    *d64,
+                c = ((uint64_t)color << 32) | color;
+    size_t      i,
+                n;
+
+    if (((uintptr_t)dst & 7) && bytes >= 4) {
+        *d32++ = color;
+        bytes -= 4;
+    }
+
+    d64 = (uint64_t *)d32;
+    n   = bytes / 8;
+    for (i = 0; i < n; i++)
+        d64[i] = c;
+
+    if (bytes & 4) *(uint32_t *)&d64[n] = color;
+}
+
+static void scalar_to_xbgr8888( void *dst, const uint32_t *src, size_t npx ) {
+    uint32_t    *d = (uint32_t *)dst,
+                p;
+    size_t      i;
+
+    for (i = 0; i < npx; i++) {
+        p    = src[i];
+        d[i] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+    }
+}
+
+static void scalar_to_rgb888( void *dst, const uint32_t *src, size_t npx ) {
+    uint8_t     *d = (uint8_t *)dst;
+    uint32_t    p;
+    size_t      i;
+
+    for (i = 0; i < npx; i++, d += 3) {
+        p    = src[i];
+        d[0] = p;
+        d[1] = p >> 8;
+        d[2] = p >> 16;
+    }
+}
+
+/**
+ * Adds each byte of "d" to the same byte of "p", stopping at 0xFF.
+ **/ 
+static inline uint32_t scalar_adds8( uint32_t p, uint32_t d ) {
+    uint32_t    r = 0,
+                c;
+    int         shift;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        c  = ((p >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+        r |= ((c > 0xFF) ? 0xFF : c) << shift;
+    }
+    return r;
+}
+
+static inline uint16_t scalar_565( uint32_t p ) {
+    return ((p >> 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 3) & 0x001F);
+}
+
+static void scalar_to_rgb565( void *dst, const uint32_t *src, size_t npx, const uint32_t *dither ) {
+    uint16_t    *d = (uint16_t *)dst;
+    size_t      i;
+
+    if (dither) {
+        for (i = 0; i < npx; i++)
+            d[i] = scalar_565(scalar_adds8(src[i], dither[i & 3]));
+    } else {
+        for (i = 0; i < npx; i++)
+            d[i] = scalar_565(src[i]);
+    }
+}
+
+static inline uint32_t scalar_hash_step( uint32_t h, uint32_t w ) {
+    h = (h ^ w) * VIDEO_HASH_PRIME;
+    return (h << 15) | (h >> 17);
+}
+
+static void scalar_hash( uint32_t lanes[8], const void *src, size_t bytes ) {
+    const uint32_t  *s = (const uint32_t *)src;
+    size_t          i,
+                    n = bytes / 4;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        lanes[0] = scalar_hash_step(lanes[0], s[i + 0]);
+        lanes[1] = scalar_hash_step(lanes[1], s[i + 1]);
+        lanes[2] = scalar_hash_step(lanes[2], s[i + 2]);
+        lanes[3] = scalar_hash_step(lanes[3], s[i + 3]);
+        lanes[4] = scalar_hash_step(lanes[4], s[i + 4]);
+        lanes[5] = scalar_hash_step(lanes[5], s[i + 5]);
+        lanes[6] = scalar_hash_step(lanes[6], s[i + 6]);
+        lanes[7] = scalar_hash_step(lanes[7], s[i + 7]);
+    }
+    for (; i < n; i++) lanes[i & 7] = scalar_hash_step(lanes[i & 7], s[i]);
+}
+
+static void scalar_blend_fill( uint32_t *dst, uint32_t color, size_t npx ) {
+    size_t  i;
+
+    for (i = 0; i < npx; i++) dst[i] = video_blend_px(dst[i], color);
+}
+
+static void scalar_blend_mask( uint32_t *dst, uint32_t color, const uint8_t *mask, size_t npx ) {
+    uint32_t    a   = color >> 24,
+                rgb = color & 0xFFFFFF;
+    size_t      i;
+
+    for (i = 0; i < npx; i++) {
+        dst[i] = video_blend_px(dst[i], rgb | (video_div255(a * mask[i]) << 24));
+    }
+}
+
+/**
+ * The blits are written per row; this runs one over a whole
+ * rectangle.
+ **/
+#define BLIT_ROWS( row, dst, dst_stride, src, src_stride, w, h, arg )                                          \
+    for (; (h) > 0; (h)--, (dst) = (uint32_t *)((uint8_t *)(dst) + (dst_stride)),                              \
+                           (src) = (const uint32_t *)((const uint8_t *)(src) + (src_stride))) {                \
+        row((dst), (src), (size_t)(w), (arg));                                                                 \
+    }
+
+static void scalar_over_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t opacity ) {
+    uint32_t    s, a;
+    size_t      i;
+
+    for (i = 0; i < npx; i++) {
+        s = src[i];
+        a = s >> 24;
+        if (opacity != 255) a = video_div255(a * opacity);
+        if (a == 255) {
+            dst[i] = s;
+        } else if (a) {
+            dst[i] = video_blend_px(dst[i], (s & 0xFFFFFF) | (a << 24));
+        }
+    }
+}
+
+static void scalar_premul_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t opacity ) {
+    uint32_t    s;
+    size_t      i;
+
+    for (i = 0; i < npx; i++) {
+        s = src[i];
+        if (opacity != 255) s = video_scale_px(s, opacity);
+        if ((s >> 24) == 255) {
+            dst[i] = s;
+        } else if (s) {
+            dst[i] = video_premul_px(dst[i], s);
+        }
+    }
+}
+
+static void scalar_key_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t key ) {
+    size_t  i;
+
+    for (i = 0; i < npx; i++) {
+        if ((src[i] ^ key) & 0xFFFFFF) dst[i] = src[i];
+    }
+}
+
+static void scalar_blit_over( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                              int w, int h, uint32_t opacity ) 
+{
+    BLIT_ROWS(scalar_over_row, dst, dst_stride, src, src_stride, w, h, opacity);
+}
+
+static void scalar_blit_premul( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                                int w, int h, uint32_t opacity ) 
+{
+    BLIT_ROWS(scalar_premul_row, dst, dst_stride, src, src_stride, w, h, opacity);
+}
+
+static void scalar_blit_key( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                             int w, int h, uint32_t key ) 
+{
+    BLIT_ROWS(scalar_key_row, dst, dst_stride, src, src_stride, w, h, key);
+}
+
+static void scalar_sample_bilinear( uint32_t *dst, const uint32_t *src, size_t src_stride, 
+                                    int32_t u, int32_t v, int32_t du, int32_t dv, size_t npx ) 
+{
+    const uint32_t  *r0,
+                    *r1;
+    size_t          i;
+
+    for (i = 0; i < npx; i++, u += du, v += dv) {
+        r0      = (const uint32_t *)((const uint8_t *)src + (size_t)(v >> 16) * src_stride) + (u >> 16);
+        r1      = (const uint32_t *)((const uint8_t *)r0 + src_stride);
+        dst[i]  = video_bilerp_px(r0[0], r0[1], r1[0], r1[1], (u >> 8) & 0xFF, (v >> 8) & 0xFF);
+    }
+}
+
+static const struct video_kernels kernels_scalar = {
+    "scalar",
+    &scalar_copy,
+    &scalar_fill,
+    &scalar_copy,
+    &scalar_to_xbgr8888,
+    &scalar_to_rgb888,
+    &scalar_to_rgb565,
+    &scalar_hash,
+    &scalar_blend_fill,
+    &scalar_blend_mask,
+    &scalar_blit_over,
+    &scalar_blit_premul,
+    &scalar_blit_key,
+    &scalar_sample_bilinear
+};
+
+
+/*
+ +================================================================================+
+ |                              SSE2 / AVX2 kernels                               |
+ +================================================================================+
+*/
+
+#ifdef VIDEO_KERNELS_X86
+
+/**
+ * Steps "dst" (and "src") a pixel at a time until "dst" is
+ * aligned to "align" bytes.
+ *
+ * \return Bytes consumed.
+ **/
+static inline size_t x86_align_head( uint8_t **dst, const uint8_t **src, uint32_t color,
+                                     size_t bytes, size_t align )
+{
+    size_t done = 0;
+
+    while (((uintptr_t)*dst & (align - 1)) && done < bytes) {
+        *(uint32_t *)*dst = src ? *(const uint32_t *)*src : color;
+        *dst += 4;
+        if (src) *src += 4;
+        done += 4;
+    }
+    return done;
+}
+
+static inline void x86_tail( uint8_t *d, const uint8_t *s, uint32_t color, size_t bytes ) {
+    for (; bytes >= 4; bytes -= 4, d += 4) {
+        *(uint32_t *)d = s ? *(const uint32_t *)s : color;
+        if (s) s += 4;
+    }
+}
+
+__attribute__((target("sse2")))
+static void sse2_copy( void *dst, const void *src, size_t bytes ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const uint8_t   *s  = (const uint8_t *)src;
+    const int       nt  = bytes >= VIDEO_NT_THRESHOLD;
+    __m128i         a, b, c, e;
+
+    bytes -= x86_align_head(&d, &s, 0, bytes, 16);
+
+    for (; bytes >= VIDEO_BURST; bytes -= VIDEO_BURST, d += VIDEO_BURST, s += VIDEO_BURST) {
+        a = _mm_loadu_si128((const __m128i *)(s +  0));
+        b = _mm_loadu_si128((const __m128i *)(s + 16));
+        c = _mm_loadu_si128((const __m128i *)(s + 32));
+        e = _mm_loadu_si128((const __m128i *)(s + 48));
+        if (nt) {
+            _mm_stream_si128((__m128i *)(d +  0), a);
+            _mm_stream_si128((__m128i *)(d + 16), b);
+            _mm_stream_si128((__m128i *)(d + 32), c);
+            _mm_stream_si128((__m128i *)(d + 48), e);
+        } else {
+            _mm_store_si128((__m128i *)(d +  0), a);
+            _mm_store_si128((__m128i *)(d + 16), b);
+            _mm_store_si128((__m128i *)(d + 32), c);
+            _mm_store_si128((__m128i *)(d + 48), e);
+        }
+    }
+    for (; bytes >= 16; bytes -= 16, d += 16, s += 16)
+        _mm_store_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+
+    if (nt) _mm_sfence();
+    x86_tail(d, s, 0, bytes);
+}
+
+__attribute__((target("sse2")))
+static void sse2_fill( void *dst, uint32_t color, size_t bytes ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const int       nt  = bytes >= VIDEO_NT_THRESHOLD;
+    const __m128i   c   = _mm_set1_epi32((int)color);
+
+    bytes -= x86_align_head(&d, 0, color, bytes, 16);
+
+    for (; bytes >= VIDEO_BURST; bytes -= VIDEO_BURST, d += VIDEO_BURST) {
+        if (nt) {
+            _mm_stream_si128((__m128i *)(d +  0), c);
+            _mm_stream_si128((__m128i *)(d + 16), c);
+            _mm_stream_si128((__m128i *)(d + 32), c);
+            _mm_stream_si128((__m128i *)(d + 48), c);
+        } else {
+            _mm_store_si128((__m128i *)(d +  0), c);
+            _mm_store_si128((__m128i *)(d + 16), c);
+            _mm_store_si128((__m128i *)(d + 32), c);
+            _mm_store_si128((__m128i *)(d + 48), c);
+        }
+    }
+    for (; bytes >= 16; bytes -= 16, d += 16)
+        _mm_store_si128((__m128i *)d, c);
+
+    if (nt) _mm_sfence();
+    x86_tail(d, 0, color, bytes);
+}
+
+/**
+ * Reading: the source is what's aligned this time.
+ **/
+__attribute__((target("sse2")))
+static void sse2_read( void *dst, const void *src, size_t bytes ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const uint8_t   *s  = (const uint8_t *)src;
+    __m128i         a, b, c, e;
+
+    while (((uintptr_t)s & 15) && bytes >= 4) {
+        *(uint32_t *)d = *(const uint32_t *)s;
+        d += 4; s += 4; bytes -= 4;
+    }
+
+    for (; bytes >= VIDEO_BURST; bytes -= VIDEO_BURST, d += VIDEO_BURST, s += VIDEO_BURST) {
+        a = _mm_load_si128((const __m128i *)(s +  0));
+        b = _mm_load_si128((const __m128i *)(s + 16));
+        c = _mm_load_si128((const __m128i *)(s + 32));
+        e = _mm_load_si128((const __m128i *)(s + 48));
+        _mm_storeu_si128((__m128i *)(d +  0), a);
+        _mm_storeu_si128((__m128i *)(d + 16), b);
+        _mm_storeu_si128((__m128i *)(d + 32), c);
+        _mm_storeu_si128((__m128i *)(d + 48), e);
+    }
+    x86_tail(d, s, 0, bytes);
+}
+
+__attribute__((target("sse2")))
+static void sse2_to_xbgr8888( void *dst, const uint32_t *src, size_t npx ) {
+    uint32_t        *d      = (uint32_t *)dst;
+    const __m128i   m_ag    = _mm_set1_epi32((int)0xFF00FF00),
+                    m_lo    = _mm_set1_epi32(0xFF);
+    __m128i         p;
+
+    for (; npx >= 4; npx -= 4, d += 4, src += 4) {
+        p = _mm_loadu_si128((const __m128i *)src);
+        p = _mm_or_si128(_mm_and_si128(p, m_ag),
+            _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), m_lo),
+                         _mm_slli_epi32(_mm_and_si128(p, m_lo), 16)));
+        _mm_storeu_si128((__m128i *)d, p);
+    }
+    scalar_to_xbgr8888(d, src, npx);
+}
+
+/**
+ * SSE2 has no unsigned 32 -> 16 bit pack, so the 565 values
+ * are sign extended from bit 15 first; the signed saturating
+ * pack then passes all 16 bits through untouched.
+ **/ 
+__attribute__((target("sse2")))
+static inline __m128i sse2_565x4( __m128i p ) {
+    p = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xF800)),
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07E0)),
+                     _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001F))));
+    return _mm_srai_epi32(_mm_slli_epi32(p, 16), 16);
+}
+
+__attribute__((target("sse2")))
+static void sse2_to_rgb565( void *dst, const uint32_t *src, size_t npx, const uint32_t *dither ) {
+    uint16_t        *d  = (uint16_t *)dst;
+    const __m128i   dv  = dither ? _mm_loadu_si128((const __m128i *)dither) : _mm_setzero_si128();
+    __m128i         a, b;
+
+    for (; npx >= 8; npx -= 8, d += 8, src += 8) {
+        a = _mm_adds_epu8(_mm_loadu_si128((const __m128i *)(src + 0)), dv);
+        b = _mm_adds_epu8(_mm_loadu_si128((const __m128i *)(src + 4)), dv);
+        _mm_storeu_si128((__m128i *)d, _mm_packs_epi32(sse2_565x4(a), sse2_565x4(b)));
+    }
+    /* Eight pixels a step keeps the dither phase where it was */
+    scalar_to_rgb565(d, src, npx, dither);
+}
+
+/**
+ * SSE2 has no 32 bit multiply keeping the low half, build it
+ * from two 32x32->64 multiplies of the even and odd lanes.
+ **/ 
+__attribute__((target("sse2")))
+static inline __m128i sse2_mullo32( __m128i a, __m128i b ) {
+    __m128i even    = _mm_mul_epu32(a, b),
+            odd     = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_hash_step( __m128i h, __m128i w, __m128i p ) {
+    h = sse2_mullo32(_mm_xor_si128(h, w), p);
+    return _mm_or_si128(_mm_slli_epi32(h, 15), _mm_srli_epi32(h, 17));
+}
+
+__attribute__((target("sse2")))
+static void sse2_hash( uint32_t lanes[8], const void *src, size_t bytes ) {
+    const uint8_t   *s  = (const uint8_t *)src;
+    const __m128i   p   = _mm_set1_epi32((int)VIDEO_HASH_PRIME);
+    __m128i         lo  = _mm_loadu_si128((const __m128i *)&lanes[0]),
+                    hi  = _mm_loadu_si128((const __m128i *)&lanes[4]);
+
+    for (; bytes >= 32; bytes -= 32, s += 32) {
+        lo = sse2_hash_step(lo, _mm_loadu_si128((const __m128i *)(s +  0)), p);
+        hi = sse2_hash_step(hi, _mm_loadu_si128((const __m128i *)(s + 16)), p);
+    }
+    _mm_storeu_si128((__m128i *)&lanes[0], lo);
+    _mm_storeu_si128((__m128i *)&lanes[4], hi);
+    scalar_hash(lanes, s, bytes);
+}
+
+/**
+ * Channels are widened to 16 bits: src * a + 128 is worked
+ * out once, then each pixel is one multiply, one add and the
+ * divide by 255.  Nothing goes over 255 * 255 + 128.
+ **/
+__attribute__((target("sse2")))
+static void sse2_blend_fill( uint32_t *dst, uint32_t color, size_t npx ) {
+    const __m128i   z   = _mm_setzero_si128(),
+                    ia  = _mm_set1_epi16((short)(255 - (color >> 24))),
+                    s   = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32((int)(color | 0xFF000000)), z),
+                                                        _mm_set1_epi16((short)(color >> 24))),
+                                        _mm_set1_epi16(128));
+    __m128i         d, lo, hi;
+
+    for (; npx >= 4; npx -= 4, dst += 4) {
+        d  = _mm_loadu_si128((const __m128i *)dst);
+        lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, z), ia), s);
+        hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, z), ia), s);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+    }
+    scalar_blend_fill(dst, color, npx);
+}
+
+/**
+ * Each pixel has its own alpha here: work out four of them
+ * in 16 bit lanes, then spread each across its pixel's four
+ * channels with unpacks.
+ **/
+__attribute__((target("sse2")))
+static void sse2_blend_mask( uint32_t *dst, uint32_t color, const uint8_t *mask, size_t npx ) {
+    const __m128i   z   = _mm_setzero_si128(),
+                    ff  = _mm_set1_epi16(255),
+                    rnd = _mm_set1_epi16(128),
+                    ca  = _mm_set1_epi16((short)(color >> 24)),
+                    s   = _mm_unpacklo_epi8(_mm_set1_epi32((int)(color | 0xFF000000)), z);
+    __m128i         d, m, alo, ahi, lo, hi;
+    uint32_t        m4;
+
+    for (; npx >= 4; npx -= 4, dst += 4, mask += 4) {
+        memcpy(&m4, mask, 4);
+        if (!m4) continue;
+
+        m   = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)m4), z), ca), rnd);
+        m   = _mm_srli_epi16(_mm_add_epi16(m, _mm_srli_epi16(m, 8)), 8);
+        m   = _mm_unpacklo_epi16(m, m);
+        alo = _mm_unpacklo_epi32(m, m);
+        ahi = _mm_unpackhi_epi32(m, m);
+
+        d   = _mm_loadu_si128((const __m128i *)dst);
+        lo  = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s, alo), 
+                                          _mm_mullo_epi16(_mm_unpacklo_epi8(d, z), _mm_sub_epi16(ff, alo))), rnd);
+        hi  = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s, ahi), 
+                                          _mm_mullo_epi16(_mm_unpackhi_epi8(d, z), _mm_sub_epi16(ff, ahi))), rnd);
+        lo  = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi  = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+    }
+    scalar_blend_mask(dst, color, mask, npx);
+}
+
+/**
+ * Blits take four pixels at a time.  Alpha is worked out per
+ * 32 bit lane, copied into both 16 bit halves and then out
+ * to each pixel's channels with unpacks, as in blend_mask.
+ * A group that is all opaque is stored as it is, one that
+ * is all transparent left alone.
+ **/
+__attribute__((target("sse2")))
+static inline __m128i sse2_div255( __m128i x ) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void sse2_over_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t opacity ) {
+    const __m128i   z   = _mm_setzero_si128(),
+                    ff  = _mm_set1_epi16(255),
+                    op  = _mm_set1_epi16((short)opacity),
+                    opq = _mm_set1_epi32(255),
+                    am  = _mm_set1_epi32((int)0xFF000000);
+    __m128i         s, d, a, alo, ahi, lo, hi;
+
+    for (; npx >= 4; npx -= 4, dst += 4, src += 4) {
+        s = _mm_loadu_si128((const __m128i *)src);
+        a = _mm_srli_epi32(s, 24);
+        if (opacity != 255) a = sse2_div255(_mm_mullo_epi16(a, op));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, z)) == 0xFFFF) continue;
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, opq)) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)dst, s);
+            continue;
+        }
+
+        a   = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        alo = _mm_unpacklo_epi32(a, a);
+        ahi = _mm_unpackhi_epi32(a, a);
+        s   = _mm_or_si128(s, am);
+        d   = _mm_loadu_si128((const __m128i *)dst);
+        lo  = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, z), alo),
+                            _mm_mullo_epi16(_mm_unpacklo_epi8(d, z), _mm_sub_epi16(ff, alo)));
+        hi  = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, z), ahi),
+                            _mm_mullo_epi16(_mm_unpackhi_epi8(d, z), _mm_sub_epi16(ff, ahi)));
+        _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(sse2_div255(lo), sse2_div255(hi)));
+    }
+    scalar_over_row(dst, src, npx, opacity);
+}
+
+__attribute__((target("sse2")))
+static void sse2_premul_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t opacity ) {
+    const __m128i   z   = _mm_setzero_si128(),
+                    op  = _mm_set1_epi16((short)opacity),
+                    opq = _mm_set1_epi32(255);
+    __m128i         s, d, a, alo, ahi, lo, hi;
+
+    for (; npx >= 4; npx -= 4, dst += 4, src += 4) {
+        s = _mm_loadu_si128((const __m128i *)src);
+        if (opacity != 255) {
+            s = _mm_packus_epi16(sse2_div255(_mm_mullo_epi16(_mm_unpacklo_epi8(s, z), op)),
+                                 sse2_div255(_mm_mullo_epi16(_mm_unpackhi_epi8(s, z), op)));
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, z)) == 0xFFFF) continue;
+        a = _mm_srli_epi32(s, 24);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, opq)) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)dst, s);
+            continue;
+        }
+
+        a   = _mm_sub_epi32(opq, a);
+        a   = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        alo = _mm_unpacklo_epi32(a, a);
+        ahi = _mm_unpackhi_epi32(a, a);
+        d   = _mm_loadu_si128((const __m128i *)dst);
+        lo  = sse2_div255(_mm_mullo_epi16(_mm_unpacklo_epi8(d, z), alo));
+        hi  = sse2_div255(_mm_mullo_epi16(_mm_unpackhi_epi8(d, z), ahi));
+        _mm_storeu_si128((__m128i *)dst, _mm_adds_epu8(_mm_packus_epi16(lo, hi), s));
+    }
+    scalar_premul_row(dst, src, npx, opacity);
+}
+
+__attribute__((target("sse2")))
+static void sse2_key_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t key ) {
+    const __m128i   rgb = _mm_set1_epi32(0xFFFFFF),
+                    k   = _mm_set1_epi32((int)(key & 0xFFFFFF));
+    __m128i         s, eq;
+    int             m;
+
+    for (; npx >= 4; npx -= 4, dst += 4, src += 4) {
+        s  = _mm_loadu_si128((const __m128i *)src);
+        eq = _mm_cmpeq_epi32(_mm_and_si128(s, rgb), k);
+        m  = _mm_movemask_epi8(eq);
+        if (m == 0xFFFF) continue;
+        if (m) s = _mm_or_si128(_mm_and_si128(eq, _mm_loadu_si128((const __m128i *)dst)), _mm_andnot_si128(eq, s));
+        _mm_storeu_si128((__m128i *)dst, s);
+    }
+    scalar_key_row(dst, src, npx, key);
+}
+
+__attribute__((target("sse2")))
+static void sse2_blit_over( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                            int w, int h, uint32_t opacity ) 
+{
+    BLIT_ROWS(sse2_over_row, dst, dst_stride, src, src_stride, w, h, opacity);
+}
+
+__attribute__((target("sse2")))
+static void sse2_blit_premul( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                              int w, int h, uint32_t opacity ) 
+{
+    BLIT_ROWS(sse2_premul_row, dst, dst_stride, src, src_stride, w, h, opacity);
+}
+
+__attribute__((target("sse2")))
+static void sse2_blit_key( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                           int w, int h, uint32_t key ) 
+{
+    BLIT_ROWS(sse2_key_row, dst, dst_stride, src, src_stride, w, h, key);
+}
+
+/**
+ * One sample per step, the vector runs across channels:
+ * both texel rows go in one register, the horizontal mix
+ * leaves top and bottom side by side and the vertical mix
+ * folds those two.  Weights are 256 - f and f, so no lane
+ * goes past 255 * 256 + 128; each pair is spread out to
+ * four lanes apiece with two shuffles rather than built
+ * with broadcasts.
+ **/
+__attribute__((target("sse2")))
+static void sse2_sample_bilinear( uint32_t *dst, const uint32_t *src, size_t src_stride, 
+                                  int32_t u, int32_t v, int32_t du, int32_t dv, size_t npx ) 
+{
+    const __m128i   z   = _mm_setzero_si128(),
+                    rnd = _mm_set1_epi16(128);
+    const uint8_t   *r0;
+    __m128i         p, wx, wy, lo, hi, t;
+    int             fx, fy;
+    size_t          i;
+
+    for (i = 0; i < npx; i++, u += du, v += dv) {
+        r0  = (const uint8_t *)src + (size_t)(v >> 16) * src_stride + (size_t)(u >> 16) * 4;
+        fx  = (u >> 8) & 0xFF;
+        fy  = (v >> 8) & 0xFF;
+        wx  = _mm_cvtsi32_si128((256 - fx) | (fx << 16));
+        wy  = _mm_cvtsi32_si128((256 - fy) | (fy << 16));
+        wx  = _mm_shuffle_epi32(_mm_unpacklo_epi16(wx, wx), 0x50);
+        wy  = _mm_shuffle_epi32(_mm_unpacklo_epi16(wy, wy), 0x50);
+
+        p   = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)r0), _mm_loadl_epi64((const __m128i *)(r0 + src_stride)));
+        lo  = _mm_mullo_epi16(_mm_unpacklo_epi8(p, z), wx);
+        hi  = _mm_mullo_epi16(_mm_unpackhi_epi8(p, z), wx);
+        t   = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        t   = _mm_srli_epi16(_mm_add_epi16(t, rnd), 8);
+        t   = _mm_mullo_epi16(t, wy);
+        t   = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t, _mm_srli_si128(t, 8)), rnd), 8);
+        dst[i] = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(t, t));
+    }
+}
+
+static const struct video_kernels kernels_sse2 = {
+    "sse2",
+    &sse2_copy,
+    &sse2_fill,
+    &sse2_read,
+    &sse2_to_xbgr8888,
+    &scalar_to_rgb888,
+    &sse2_to_rgb565,
+    &sse2_hash,
+    &sse2_blend_fill,
+    &sse2_blend_mask,
+    &sse2_blit_over,
+    &sse2_blit_premul,
+    &sse2_blit_key,
+    &sse2_sample_bilinear
+};
+
+__attribute__((target("avx2")))
+static void avx2_copy( void *dst, const void *src, size_t bytes ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const uint8_t   *s  = (const uint8_t *)src;
+    const int       nt  = bytes >= VIDEO_NT_THRESHOLD;
+    __m256i         a, b;
+
+    bytes -= x86_align_head(&d, &s, 0, bytes, 32);
+
+    for (; bytes >= VIDEO_BURST; bytes -= VIDEO_BURST, d += VIDEO_BURST, s += VIDEO_BURST) {
+        a = _mm256_loadu_si256((const __m256i *)(s +  0));
+        b = _mm256_loadu_si256((const __m256i *)(s + 32));
+        if (nt) {
+            _mm256_stream_si256((__m256i *)(d +  0), a);
+            _mm256_stream_si256((__m256i *)(d + 32), b);
+        } else {
+            _mm256_store_si256((__m256i *)(d +  0), a);
+            _mm256_store_si256((__m256i *)(d + 32), b);
+        }
+    }
+    for (; bytes >= 16; bytes -= 16, d += 16, s += 16)
+        _mm_store_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+
+    if (nt) _mm_sfence();
+    _mm256_zeroupper();
+    x86_tail(d, s, 0, bytes);
+}
+
+__attribute__((target("avx2")))
+static void avx2_fill( void *dst, uint32_t color, size_t bytes ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const int       nt  = bytes >= VIDEO_NT_THRESHOLD;
+    const __m256i   c   = _mm256_set1_epi32((int)color);
+
+    bytes -= x86_align_head(&d, 0, color, bytes, 32);
+
+    for (; bytes >= VIDEO_BURST; bytes -= VIDEO_BURST, d += VIDEO_BURST) {
+        if (nt) {
+            _mm256_stream_si256((__m256i *)(d +  0), c);
+            _mm256_stream_si256((__m256i *)(d + 32), c);
+        } else {
+            _mm256_store_si256((__m256i *)(d +  0), c);
+            _mm256_store_si256((__m256i *)(d + 32), c);
+        }
+    }
+    for (; bytes >= 16; bytes -= 16, d += 16)
+        _mm_store_si128((__m128i *)d, _mm256_castsi256_si128(c));
+
+    if (nt) _mm_sfence();
+    _mm256_zeroupper();
+    x86_tail(d, 0, color, bytes);
+}
+
+/**
+ * MOVNTDQA is the one load that is faster from write-combining
+ * memory: it pulls a whole 64 byte line into a streaming buffer
+ * instead of doing an uncached read per load.
+ **/
+__attribute__((target("avx2")))
+static void avx2_read( void *dst, const void *src, size_t bytes ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const uint8_t   *s  = (const uint8_t *)src;
+    __m256i         a, b;
+
+    while (((uintptr_t)s & 31) && bytes >= 4) {
+        *(uint32_t *)d = *(const uint32_t *)s;
+        d += 4; s += 4; bytes -= 4;
+    }
+
+    for (; bytes >= VIDEO_BURST; bytes -= VIDEO_BURST, d += VIDEO_BURST, s += VIDEO_BURST) {
+        a = _mm256_stream_load_si256((const __m256i *)(s +  0));
+        b = _mm256_stream_load_si256((const __m256i *)(s + 32));
+        _mm256_storeu_si256((__m256i *)(d +  0), a);
+        _mm256_storeu_si256((__m256i *)(d + 32), b);
+    }
+    _mm256_zeroupper();
+    x86_tail(d, s, 0, bytes);
+}
+
+__attribute__((target("avx2")))
+static void avx2_to_xbgr8888( void *dst, const uint32_t *src, size_t npx ) {
+    uint32_t        *d  = (uint32_t *)dst;
+    const __m256i   sh  = _mm256_setr_epi8(2, 1, 0, 3,  6, 5, 4, 7,  10, 9, 8, 11,  14, 13, 12, 15,
+                                           2, 1, 0, 3,  6, 5, 4, 7,  10, 9, 8, 11,  14, 13, 12, 15);
+
+    for (; npx >= 8; npx -= 8, d += 8, src += 8) {
+        _mm256_storeu_si256((__m256i *)d, 
+            _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)src), sh));
+    }
+    _mm256_zeroupper();
+    scalar_to_xbgr8888(d, src, npx);
+}
+
+/**
+ * Four pixels become twelve bytes.  The store writes sixteen,
+ * the last four are overwritten by the next step, which is why
+ * we stop while there are still pixels left after this group.
+ **/ 
+__attribute__((target("avx2")))
+static void avx2_to_rgb888( void *dst, const uint32_t *src, size_t npx ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const __m128i   sh  = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    for (; npx >= 8; npx -= 4, d += 12, src += 4) {
+        _mm_storeu_si128((__m128i *)d, 
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), sh));
+    }
+    scalar_to_rgb888(d, src, npx);
+}
+
+/* All eight lanes fit one register */
+__attribute__((target("avx2")))
+static void avx2_hash( uint32_t lanes[8], const void *src, size_t bytes ) {
+    const uint8_t   *s  = (const uint8_t *)src;
+    const __m256i   p   = _mm256_set1_epi32((int)VIDEO_HASH_PRIME);
+    __m256i         h   = _mm256_loadu_si256((const __m256i *)lanes);
+
+    for (; bytes >= 32; bytes -= 32, s += 32) {
+        h = _mm256_mullo_epi32(_mm256_xor_si256(h, _mm256_loadu_si256((const __m256i *)s)), p);
+        h = _mm256_or_si256(_mm256_slli_epi32(h, 15), _mm256_srli_epi32(h, 17));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, h);
+    scalar_hash(lanes, s, bytes);
+}
+
+__attribute__((target("avx2")))
+static void avx2_blend_fill( uint32_t *dst, uint32_t color, size_t npx ) {
+    const __m256i   z   = _mm256_setzero_si256(),
+                    ia  = _mm256_set1_epi16((short)(255 - (color >> 24))),
+                    s   = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(_mm256_set1_epi32((int)(color | 0xFF000000)), z),
+                                                              _mm256_set1_epi16((short)(color >> 24))),
+                                           _mm256_set1_epi16(128));
+    __m256i         d, lo, hi;
+
+    for (; npx >= 8; npx -= 8, dst += 8) {
+        d  = _mm256_loadu_si256((const __m256i *)dst);
+        lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, z), ia), s);
+        hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, z), ia), s);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_packus_epi16(lo, hi));
+    }
+    _mm256_zeroupper();
+    sse2_blend_fill(dst, color, npx);
+}
+
+/**
+ * The same blits eight pixels at a time.  Unpacks and packs
+ * stay within each 128 bit half, so the SSE2 steps carry
+ * over as they are.
+ **/
+__attribute__((target("avx2")))
+static inline __m256i avx2_div255( __m256i x ) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void avx2_over_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t opacity ) {
+    const __m256i   z   = _mm256_setzero_si256(),
+                    ff  = _mm256_set1_epi16(255),
+                    op  = _mm256_set1_epi16((short)opacity),
+                    opq = _mm256_set1_epi32(255),
+                    am  = _mm256_set1_epi32((int)0xFF000000);
+    __m256i         s, d, a, alo, ahi, lo, hi;
+
+    for (; npx >= 8; npx -= 8, dst += 8, src += 8) {
+        s = _mm256_loadu_si256((const __m256i *)src);
+        a = _mm256_srli_epi32(s, 24);
+        if (opacity != 255) a = avx2_div255(_mm256_mullo_epi16(a, op));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, z)) == -1) continue;
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, opq)) == -1) {
+            _mm256_storeu_si256((__m256i *)dst, s);
+            continue;
+        }
+
+        a   = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+        alo = _mm256_unpacklo_epi32(a, a);
+        ahi = _mm256_unpackhi_epi32(a, a);
+        s   = _mm256_or_si256(s, am);
+        d   = _mm256_loadu_si256((const __m256i *)dst);
+        lo  = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, z), alo),
+                               _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, z), _mm256_sub_epi16(ff, alo)));
+        hi  = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, z), ahi),
+                               _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, z), _mm256_sub_epi16(ff, ahi)));
+        _mm256_storeu_si256((__m256i *)dst, _mm256_packus_epi16(avx2_div255(lo), avx2_div255(hi)));
+    }
+    _mm256_zeroupper();
+    sse2_over_row(dst, src, npx, opacity);
+}
+
+__attribute__((target("avx2")))
+static void avx2_premul_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t opacity ) {
+    const __m256i   z   = _mm256_setzero_si256(),
+                    op  = _mm256_set1_epi16((short)opacity),
+                    opq = _mm256_set1_epi32(255);
+    __m256i         s, d, a, alo, ahi, lo, hi;
+
+    for (; npx >= 8; npx -= 8, dst += 8, src += 8) {
+        s = _mm256_loadu_si256((const __m256i *)src);
+        if (opacity != 255) {
+            s = _mm256_packus_epi16(avx2_div255(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, z), op)),
+                                    avx2_div255(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, z), op)));
+        }
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, z)) == -1) continue;
+        a = _mm256_srli_epi32(s, 24);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, opq)) == -1) {
+            _mm256_storeu_si256((__m256i *)dst, s);
+            continue;
+        }
+
+        a   = _mm256_sub_epi32(opq, a);
+        a   = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+        alo = _mm256_unpacklo_epi32(a, a);
+        ahi = _mm256_unpackhi_epi32(a, a);
+        d   = _mm256_loadu_si256((const __m256i *)dst);
+        lo  = avx2_div255(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, z), alo));
+        hi  = avx2_div255(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, z), ahi));
+        _mm256_storeu_si256((__m256i *)dst, _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), s));
+    }
+    _mm256_zeroupper();
+    sse2_premul_row(dst, src, npx, opacity);
+}
+
+__attribute__((target("avx2")))
+static void avx2_key_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t key ) {
+    const __m256i   rgb = _mm256_set1_epi32(0xFFFFFF),
+                    k   = _mm256_set1_epi32((int)(key & 0xFFFFFF));
+    __m256i         s, eq;
+    int             m;
+
+    for (; npx >= 8; npx -= 8, dst += 8, src += 8) {
+        s  = _mm256_loadu_si256((const __m256i *)src);
+        eq = _mm256_cmpeq_epi32(_mm256_and_si256(s, rgb), k);
+        m  = _mm256_movemask_epi8(eq);
+        if (m == -1) continue;
+        if (m) s = _mm256_blendv_epi8(s, _mm256_loadu_si256((const __m256i *)dst), eq);
+        _mm256_storeu_si256((__m256i *)dst, s);
+    }
+    _mm256_zeroupper();
+    sse2_key_row(dst, src, npx, key);
+}
+
+__attribute__((target("avx2")))
+static void avx2_blit_over( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                            int w, int h, uint32_t opacity ) 
+{
+    BLIT_ROWS(avx2_over_row, dst, dst_stride, src, src_stride, w, h, opacity);
+}
+
+__attribute__((target("avx2")))
+static void avx2_blit_premul( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                              int w, int h, uint32_t opacity ) 
+{
+    BLIT_ROWS(avx2_premul_row, dst, dst_stride, src, src_stride, w, h, opacity);
+}
+
+__attribute__((target("avx2")))
+static void avx2_blit_key( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                           int w, int h, uint32_t key ) 
+{
+    BLIT_ROWS(avx2_key_row, dst, dst_stride, src, src_stride, w, h, key);
+}
+
+static const struct video_kernels kernels_avx2 = {
+    "avx2",
+    &avx2_copy,
+    &avx2_fill,
+    &avx2_read,
+    &avx2_to_xbgr8888,
+    &avx2_to_rgb888,
+    &sse2_to_rgb565,
+    &avx2_hash,
+    &avx2_blend_fill,
+    &sse2_blend_mask,
+    &avx2_blit_over,
+    &avx2_blit_premul,
+    &avx2_blit_key,
+    &sse2_sample_bilinear
+};
+
+#endif /* VIDEO_KERNELS_X86 */
+
+
+/*
+ +================================================================================+
+ |                                 NEON kernels                                   |
+ +================================================================================+
+*/
+
+#ifdef VIDEO_KERNELS_NEON
+
+static void neon_copy( void *dst, const void *src, size_t bytes ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const uint8_t   *s  = (const uint8_t *)src;
+    uint8x16_t      a, b, c, e;
+
+    for (; bytes >= VIDEO_BURST; bytes -= VIDEO_BURST, d += VIDEO_BURST, s += VIDEO_BURST) {
+        a = vld1q_u8(s +  0);
+        b = vld1q_u8(s + 16);
+        c = vld1q_u8(s + 32);
+        e = vld1q_u8(s + 48);
+        vst1q_u8(d +  0, a);
+        vst1q_u8(d + 16, b);
+        vst1q_u8(d + 32, c);
+        vst1q_u8(d + 48, e);
+    }
+    for (; bytes >= 16; bytes -= 16, d += 16, s += 16)
+        vst1q_u8(d, vld1q_u8(s));
+
+    for (; bytes >= 4; bytes -= 4, d += 4, s += 4)
+        *(uint32_t *)d = *(const uint32_t *)s;
+}
+
+static void neon_fill( void *dst, uint32_t color, size_t bytes ) {
+    uint8_t         *d  = (uint8_t *)dst;
+    const uint32x4_t c  = vdupq_n_u32(color);
+
+    for (; bytes >= VIDEO_BURST; bytes -= VIDEO_BURST, d += VIDEO_BURST) {
+        vst1q_u32((uint32_t *)(d +  0), c);
+        vst1q_u32((uint32_t *)(d + 16), c);
+        vst1q_u32((uint32_t *)(d + 32), c);
+        vst1q_u32((uint32_t *)(d + 48), c);
+    }
+    for (; bytes >= 4; bytes -= 4, d += 4)
+        *(uint32_t *)d = color;
+}
+
+static void neon_to_xbgr8888( void *dst, const uint32_t *src, size_t npx ) {
+    uint8_t         *d = (uint8_t *)dst;
+    uint8x16x4_t    p;
+    uint8x16_t      t;
+
+    for (; npx >= 16; npx -= 16, d += 64, src += 16) {
+        p        = vld4q_u8((const uint8_t *)src);
+        t        = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = t;
+        vst4q_u8(d, p);
+    }
+    scalar_to_xbgr8888(d, src, npx);
+}
+
+static void neon_to_rgb888( void *dst, const uint32_t *src, size_t npx ) {
+    uint8_t         *d = (uint8_t *)dst;
+    uint8x16x4_t    p;
+    uint8x16x3_t    o;
+
+    for (; npx >= 16; npx -= 16, d += 48, src += 16) {
+        p        = vld4q_u8((const uint8_t *)src);
+        o.val[0] = p.val[0];
+        o.val[1] = p.val[1];
+        o.val[2] = p.val[2];
+        vst3q_u8(d, o);
+    }
+    scalar_to_rgb888(d, src, npx);
+}
+
+/**
+ * De-interleaving loads give us planes of blue, green and red;
+ * the shift-right-and-insert builds RRRRRGGGGGGBBBBB directly.
+ **/ 
+static void neon_to_rgb565( void *dst, const uint32_t *src, size_t npx, const uint32_t *dither ) {
+    uint16_t        *d = (uint16_t *)dst;
+    uint32_t        dd[16];
+    uint8x16x4_t    p,
+                    dv;
+    uint16x8_t      lo,
+                    hi;
+    int             i;
+
+    if (dither) {
+        for (i = 0; i < 16; i++) dd[i] = dither[i & 3];
+    } else {
+        memset(dd, 0, sizeof(dd));
+    }
+    dv = vld4q_u8((const uint8_t *)dd);
+
+    for (; npx >= 16; npx -= 16, d += 16, src += 16) {
+        p        = vld4q_u8((const uint8_t *)src);
+        p.val[0] = vqaddq_u8(p.val[0], dv.val[0]);
+        p.val[1] = vqaddq_u8(p.val[1], dv.val[1]);
+        p.val[2] = vqaddq_u8(p.val[2], dv.val[2]);
+
+        lo = vshll_n_u8(vget_low_u8(p.val[2]), 8);
+        lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(p.val[1]), 8), 5);
+        lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(p.val[0]), 8), 11);
+        hi = vshll_n_u8(vget_high_u8(p.val[2]), 8);
+        hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(p.val[1]), 8), 5);
+        hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(p.val[0]), 8), 11);
+
+        vst1q_u16(d + 0, lo);
+        vst1q_u16(d + 8, hi);
+    }
+    scalar_to_rgb565(d, src, npx, dither);
+}
+
+static void neon_hash( uint32_t lanes[8], const void *src, size_t bytes ) {
+    const uint8_t   *s  = (const uint8_t *)src;
+    const uint32x4_t p  = vdupq_n_u32(VIDEO_HASH_PRIME);
+    uint32x4_t      lo  = vld1q_u32(&lanes[0]),
+                    hi  = vld1q_u32(&lanes[4]);
+
+    for (; bytes >= 32; bytes -= 32, s += 32) {
+        lo = vmulq_u32(veorq_u32(lo, vreinterpretq_u32_u8(vld1q_u8(s +  0))), p);
+        hi = vmulq_u32(veorq_u32(hi, vreinterpretq_u32_u8(vld1q_u8(s + 16))), p);
+        lo = vsriq_n_u32(vshlq_n_u32(lo, 15), lo, 17);
+        hi = vsriq_n_u32(vshlq_n_u32(hi, 15), hi, 17);
+    }
+    vst1q_u32(&lanes[0], lo);
+    vst1q_u32(&lanes[4], hi);
+    scalar_hash(lanes, s, bytes);
+}
+
+/**
+ * vraddhn(x, vrshr(x, 8)) is (x + ((x + 128) >> 8) + 128) >> 8,
+ * the same rounded divide by 255 as video_div255().
+ **/
+static void neon_blend_fill( uint32_t *dst, uint32_t color, size_t npx ) {
+    const uint8x8_t     ia  = vdup_n_u8((uint8_t)(255 - (color >> 24)));
+    const uint16x8_t    s   = vmull_u8(vreinterpret_u8_u32(vdup_n_u32(color | 0xFF000000)),
+                                       vdup_n_u8((uint8_t)(color >> 24)));
+    uint8x16_t          d;
+    uint16x8_t          lo, 
+                        hi;
+
+    for (; npx >= 4; npx -= 4, dst += 4) {
+        d  = vld1q_u8((const uint8_t *)dst);
+        lo = vmlal_u8(s, vget_low_u8(d), ia);
+        hi = vmlal_u8(s, vget_high_u8(d), ia);
+        vst1q_u8((uint8_t *)dst, vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)),
+                                             vraddhn_u16(hi, vrshrq_n_u16(hi, 8))));
+    }
+    scalar_blend_fill(dst, color, npx);
+}
+
+/**
+ * Eight pixels split into planes, so each pixel's alpha lines
+ * up with its channels without any shuffling.
+ **/
+static inline uint8x8_t neon_div255( uint16x8_t x ) {
+    return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+static void neon_blend_mask( uint32_t *dst, uint32_t color, const uint8_t *mask, size_t npx ) {
+    const uint8x8_t ca  = vdup_n_u8((uint8_t)(color >> 24)),
+                    sb  = vdup_n_u8((uint8_t)color),
+                    sg  = vdup_n_u8((uint8_t)(color >> 8)),
+                    sr  = vdup_n_u8((uint8_t)(color >> 16)),
+                    ff  = vdup_n_u8(0xFF);
+    uint8x8x4_t     d;
+    uint8x8_t       a,
+                    ia;
+
+    for (; npx >= 8; npx -= 8, dst += 8, mask += 8) {
+        a        = neon_div255(vmull_u8(vld1_u8(mask), ca));
+        ia       = vmvn_u8(a);
+        d        = vld4_u8((const uint8_t *)dst);
+        d.val[0] = neon_div255(vmlal_u8(vmull_u8(sb, a), d.val[0], ia));
+        d.val[1] = neon_div255(vmlal_u8(vmull_u8(sg, a), d.val[1], ia));
+        d.val[2] = neon_div255(vmlal_u8(vmull_u8(sr, a), d.val[2], ia));
+        d.val[3] = neon_div255(vmlal_u8(vmull_u8(ff, a), d.val[3], ia));
+        vst4_u8((uint8_t *)dst, d);
+    }
+    scalar_blend_mask(dst, color, mask, npx);
+}
+
+/**
+ * Blits split eight pixels into planes too.  A lane test for
+ * "all opaque" / "all clear" is one 64 bit compare of the
+ * alpha plane.
+ **/
+static inline int neon_all( uint8x8_t v, uint64_t x ) {
+    return vget_lane_u64(vreinterpret_u64_u8(v), 0) == x;
+}
+
+static void neon_over_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t opacity ) {
+    const uint8x8_t op  = vdup_n_u8((uint8_t)opacity),
+                    ff  = vdup_n_u8(0xFF);
+    uint8x8x4_t     s, d;
+    uint8x8_t       a,
+                    ia;
+
+    for (; npx >= 8; npx -= 8, dst += 8, src += 8) {
+        s = vld4_u8((const uint8_t *)src);
+        a = s.val[3];
+        if (opacity != 255) a = neon_div255(vmull_u8(a, op));
+        if (neon_all(a, 0)) continue;
+        if (neon_all(a, ~0ULL)) {
+            vst4_u8((uint8_t *)dst, s);
+            continue;
+        }
+
+        ia       = vmvn_u8(a);
+        d        = vld4_u8((const uint8_t *)dst);
+        d.val[0] = neon_div255(vmlal_u8(vmull_u8(s.val[0], a), d.val[0], ia));
+        d.val[1] = neon_div255(vmlal_u8(vmull_u8(s.val[1], a), d.val[1], ia));
+        d.val[2] = neon_div255(vmlal_u8(vmull_u8(s.val[2], a), d.val[2], ia));
+        d.val[3] = neon_div255(vmlal_u8(vmull_u8(ff, a), d.val[3], ia));
+        vst4_u8((uint8_t *)dst, d);
+    }
+    scalar_over_row(dst, src, npx, opacity);
+}
+
+static void neon_premul_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t opacity ) {
+    const uint8x8_t op  = vdup_n_u8((uint8_t)opacity);
+    uint8x8x4_t     s, d;
+    uint8x8_t       ia;
+    int             c;
+
+    for (; npx >= 8; npx -= 8, dst += 8, src += 8) {
+        s = vld4_u8((const uint8_t *)src);
+        if (opacity != 255) {
+            for (c = 0; c < 4; c++) s.val[c] = neon_div255(vmull_u8(s.val[c], op));
+        }
+        if (neon_all(vorr_u8(vorr_u8(s.val[0], s.val[1]), vorr_u8(s.val[2], s.val[3])), 0)) continue;
+        if (neon_all(s.val[3], ~0ULL)) {
+            vst4_u8((uint8_t *)dst, s);
+            continue;
+        }
+
+        ia = vmvn_u8(s.val[3]);
+        d  = vld4_u8((const uint8_t *)dst);
+        for (c = 0; c < 4; c++) d.val[c] = vqadd_u8(s.val[c], neon_div255(vmull_u8(d.val[c], ia)));
+        vst4_u8((uint8_t *)dst, d);
+    }
+    scalar_premul_row(dst, src, npx, opacity);
+}
+
+static void neon_key_row( uint32_t *dst, const uint32_t *src, size_t npx, uint32_t key ) {
+    const uint32x4_t    rgb = vdupq_n_u32(0xFFFFFF),
+                        k   = vdupq_n_u32(key & 0xFFFFFF);
+    uint32x4_t          s;
+
+    for (; npx >= 4; npx -= 4, dst += 4, src += 4) {
+        s = vld1q_u32(src);
+        vst1q_u32(dst, vbslq_u32(vceqq_u32(vandq_u32(s, rgb), k), vld1q_u32(dst), s));
+    }
+    scalar_key_row(dst, src, npx, key);
+}
+
+static void neon_blit_over( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                            int w, int h, uint32_t opacity ) 
+{
+    BLIT_ROWS(neon_over_row, dst, dst_stride, src, src_stride, w, h, opacity);
+}
+
+static void neon_blit_premul( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                              int w, int h, uint32_t opacity ) 
+{
+    BLIT_ROWS(neon_premul_row, dst, dst_stride, src, src_stride, w, h, opacity);
+}
+
+static void neon_blit_key( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                           int w, int h, uint32_t key ) 
+{
+    BLIT_ROWS(neon_key_row, dst, dst_stride, src, src_stride, w, h, key);
+}
+
+/* As sse2_sample_bilinear(), texel rows in separate registers */
+static void neon_sample_bilinear( uint32_t *dst, const uint32_t *src, size_t src_stride, 
+                                  int32_t u, int32_t v, int32_t du, int32_t dv, size_t npx ) 
+{
+    const uint16x4_t    rnd = vdup_n_u16(128);
+    const uint8_t       *r0;
+    uint16x8_t          wx, wy, t0, t1, tb;
+    uint16x4_t          t;
+    int                 fx, fy;
+    size_t              i;
+
+    for (i = 0; i < npx; i++, u += du, v += dv) {
+        r0  = (const uint8_t *)src + (size_t)(v >> 16) * src_stride + (size_t)(u >> 16) * 4;
+        fx  = (u >> 8) & 0xFF;
+        fy  = (v >> 8) & 0xFF;
+        wx  = vcombine_u16(vdup_n_u16((uint16_t)(256 - fx)), vdup_n_u16((uint16_t)fx));
+        wy  = vcombine_u16(vdup_n_u16((uint16_t)(256 - fy)), vdup_n_u16((uint16_t)fy));
+
+        t0  = vmulq_u16(vmovl_u8(vld1_u8(r0)), wx);
+        t1  = vmulq_u16(vmovl_u8(vld1_u8(r0 + src_stride)), wx);
+        tb  = vcombine_u16(vshr_n_u16(vadd_u16(vadd_u16(vget_low_u16(t0), vget_high_u16(t0)), rnd), 8),
+                           vshr_n_u16(vadd_u16(vadd_u16(vget_low_u16(t1), vget_high_u16(t1)), rnd), 8));
+        tb  = vmulq_u16(tb, wy);
+        t   = vshr_n_u16(vadd_u16(vadd_u16(vget_low_u16(tb), vget_high_u16(tb)), rnd), 8);
+        dst[i] = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(t, t))), 0);
+    }
+}
+
+static const struct video_kernels kernels_neon = {
+    "neon",
+    &neon_copy,
+    &neon_fill,
+    &neon_copy,
+    &neon_to_xbgr8888,
+    &neon_to_rgb888,
+    &neon_to_rgb565,
+    &neon_hash,
+    &neon_blend_fill,
+    &neon_blend_mask,
+    &neon_blit_over,
+    &neon_blit_premul,
+    &neon_blit_key,
+    &neon_sample_bilinear
+};
+
+static int neon_supported( void ) {
+#ifdef __aarch64__
+    return 1;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+}
+
+#endif /* VIDEO_KERNELS_NEON */
+
+
+/*
+ +================================================================================+
+ |                                   Dispatch                                     |
+ +================================================================================+
+*/
+
+const struct video_kernels *video_kernels_select( const char *name ) {
+    const struct video_kernels *best = &kernels_scalar;
+
+#ifdef VIDEO_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        if (name && !strcmp(name, "sse2")) return &kernels_sse2;
+        best = &kernels_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        if (name && !strcmp(name, "avx2")) return &kernels_avx2;
+        best = &kernels_avx2;
+    }
+#endif
+
+#ifdef VIDEO_KERNELS_NEON
+    if (neon_supported()) {
+        if (name && !strcmp(name, "neon")) return &kernels_neon;
+        best = &kernels_neon;
+    }
+#endif
+
+    if (name && !strcmp(name, "scalar")) return &kernels_scalar;
+
+    return best;
+}
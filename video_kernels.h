@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_KERNELS_H_
+#define _VIDEO_KERNELS_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * The loops that move pixels in and out of video memory.
+ * There's a plain C set that everything else is checked
+ * against and SIMD sets for the CPUs we run on.  The best
+ * set the CPU supports is picked when a display is started.
+ *
+ * All lengths are in bytes and must be a multiple of 4
+ * (one pixel).  Pointers must be 4 byte aligned, the
+ * kernels deal with any further alignment themselves.
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct video_kernels {
+    const char  *name;
+
+    /* Write "bytes" from "src" to "dst" (usually video memory) */
+    void        (*copy)( void *dst, const void *src, size_t bytes );
+
+    /* Set "bytes" at "dst" to "color" */
+    void        (*fill)( void *dst, uint32_t color, size_t bytes );
+
+    /* Read "bytes" from "src" (usually video memory) to "dst" */
+    void        (*read)( void *dst, const void *src, size_t bytes );
+
+    /**
+     * Conversions from the ARGB8888 pixels applications draw
+     * in to what the panel wants.  "npx" is in pixels.
+     **/ 
+
+    /* 32 bit with red and blue swapped (red in the low byte) */
+    void        (*to_xbgr8888)( void *dst, const uint32_t *src, size_t npx );
+
+    /* Packed 24 bit, blue byte first in memory */
+    void        (*to_rgb888)( void *dst, const uint32_t *src, size_t npx );
+
+    /**
+     * RGB565.  "dither" is NULL or points to four ARGB words; 
+     * dither[i & 3] is added (saturating, per channel) to pixel
+     * i before its low bits are dropped.
+     **/ 
+    void        (*to_rgb565)( void *dst, const uint32_t *src, size_t npx, const uint32_t *dither );
+
+    /**
+     * Folds "bytes" of "src" into eight 32 bit hash lanes:
+     * word i goes into lane i & 7 as
+     *
+     *      h = rotl((h ^ word) * VIDEO_HASH_PRIME, 15)
+     *
+     * Every set gives the same answer.  Each step can be
+     * undone, so changing one word always changes the hash.
+     **/ 
+    void        (*hash)( uint32_t lanes[8], const void *src, size_t bytes );
+
+    /**
+     * Blends "color" (straight alpha) over "npx" pixels, see
+     * video_blend_px().  Every set gives the same answer.
+     **/ 
+    void        (*blend_fill)( uint32_t *dst, uint32_t color, size_t npx );
+
+    /**
+     * Same, with the color's alpha scaled by mask[i] / 255
+     * (rounded) for pixel i: anti-aliased edges, glyphs.
+     **/ 
+    void        (*blend_mask)( uint32_t *dst, uint32_t color, const uint8_t *mask, size_t npx );
+
+    /**
+     * Blits: "w" x "h" pixels of "src" onto "dst", rows
+     * "src_stride" and "dst_stride" bytes apart.  The two
+     * mustn't overlap.  Whole rectangles go in one call so
+     * there's no call per row.  Runs of pixels that are
+     * fully opaque are copied and fully transparent ones
+     * skipped without blending.
+     *
+     * over:    straight alpha, alpha scaled by "opacity" / 255,
+     *          video_blend_px() per pixel.
+     * premul:  premultiplied alpha, every channel scaled by
+     *          "opacity" / 255, video_premul_px() per pixel.
+     * key:     copies the pixels whose RGB isn't "key"'s.
+     *
+     * Every set gives the same answer.
+     **/ 
+    void        (*blit_over)( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                              int w, int h, uint32_t opacity );
+    void        (*blit_premul)( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                                int w, int h, uint32_t opacity );
+    void        (*blit_key)( uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, 
+                             int w, int h, uint32_t key );
+
+    /**
+     * Bilinear samples of "src" into dst[0 .. npx - 1].  Pixel
+     * i is taken at (u + i du, v + i dv), 16.16 fixed point,
+     * in texels with texel centers at whole numbers; all four
+     * texels around every sample must be inside "src".  See
+     * video_bilerp_px().  Every set gives the same answer.
+     **/ 
+    void        (*sample_bilinear)( uint32_t *dst, const uint32_t *src, size_t src_stride, 
+                                    int32_t u, int32_t v, int32_t du, int32_t dv, size_t npx );
+};
+
+#define VIDEO_HASH_PRIME    0x9E3779B1u
+
+/**
+ * x / 255 rounded to the nearest, for x up to 255 * 255.
+ **/
+static inline uint32_t video_div255( uint32_t x ) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/**
+ * "color" over "dst", straight alpha:
+ *
+ *      dst = (src * a + dst * (255 - a)) / 255
+ *
+ * per channel, rounded.  Alpha is done the same way with
+ * the source channel taken as 255, which comes out as
+ * a + dst_a * (255 - a) / 255.  The SIMD loops match this
+ * bit for bit.
+ **/
+static inline uint32_t video_blend_px( uint32_t dst, uint32_t color ) {
+    uint32_t    a   = color >> 24,
+                ia  = 255 - a,
+                s   = color | 0xFF000000;
+
+    return (video_div255((s & 0xFF) * a + (dst & 0xFF) * ia)) |
+           (video_div255(((s >> 8) & 0xFF) * a + ((dst >> 8) & 0xFF) * ia) << 8) |
+           (video_div255(((s >> 16) & 0xFF) * a + ((dst >> 16) & 0xFF) * ia) << 16) |
+           (video_div255((s >> 24) * a + (dst >> 24) * ia) << 24);
+}
+
+/**
+ * Premultiplied "src" over "dst":
+ *
+ *      dst = src + dst * (255 - src_a) / 255
+ *
+ * per channel, alpha included, rounded and saturated at 255
+ * (which only matters if "src" isn't really premultiplied).
+ **/
+static inline uint32_t video_premul_px( uint32_t dst, uint32_t src ) {
+    uint32_t    ia  = 255 - (src >> 24),
+                out = 0,
+                c;
+    int         sh;
+
+    for (sh = 0; sh < 32; sh += 8) {
+        c    = ((src >> sh) & 0xFF) + video_div255(((dst >> sh) & 0xFF) * ia);
+        out |= ((c > 255) ? 255 : c) << sh;
+    }
+    return out;
+}
+
+/* Every channel of "px" times "k" / 255, rounded */
+static inline uint32_t video_scale_px( uint32_t px, uint32_t k ) {
+    return video_div255((px & 0xFF) * k) |
+           (video_div255(((px >> 8) & 0xFF) * k) << 8) |
+           (video_div255(((px >> 16) & 0xFF) * k) << 16) |
+           (video_div255((px >> 24) * k) << 24);
+}
+
+/**
+ * Bilinear mix of four texels, p00 p01 on top, by "fx", "fy"
+ * (0 - 255, in 256ths across).  Top and bottom rows are mixed
+ * and rounded to 8 bits first, then those two, so the SIMD 
+ * loops can stay in 16 bit lanes and still match this.
+ **/
+static inline uint32_t video_bilerp_px( uint32_t p00, uint32_t p01, uint32_t p10, uint32_t p11, uint32_t fx, uint32_t fy ) {
+    uint32_t    out = 0,
+                t, b;
+    int         sh;
+
+    for (sh = 0; sh < 32; sh += 8) {
+        t    = (((p00 >> sh) & 0xFF) * (256 - fx) + ((p01 >> sh) & 0xFF) * fx + 128) >> 8;
+        b    = (((p10 >> sh) & 0xFF) * (256 - fx) + ((p11 >> sh) & 0xFF) * fx + 128) >> 8;
+        out |= ((t * (256 - fy) + b * fy + 128) >> 8) << sh;
+    }
+    return out;
+}
+
+/**
+ * \param const char *name
+ * NULL for the best set this CPU supports, otherwise the
+ * name of a set to use ("scalar", "sse2", "avx2", "neon").
+ *
+ * \return The kernel set.  If "name" isn't known or this
+ * CPU can't run it, the best supported set is returned.
+ **/
+const struct video_kernels *video_kernels_select( const char *name );
+
+#endif
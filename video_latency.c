@@ -0,0 +1,326 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video.h"
+#include "video_latency.h"
+
+#include <linux/input.h>
+#include <time.h>
+
+/**
+ * Input to photon latency.  Input comes from an evdev device,
+ * with kernel timestamps on CLOCK_MONOTONIC, or from a file of
+ * events recorded from one (cat /dev/input/eventN > file),
+ * played back in real time from when it's opened.  Events are
+ * read in reports (up to SYN_REPORT); one with a key, button,
+ * axis or motion in it is an input.
+ *
+ * When the app marks a frame as responding to input, the
+ * earliest input since the last mark goes with the next
+ * frame submitted.  The first present that starts after that
+ * submit shows it, and the time from the input to when that
+ * present is on the screen goes in the histograms.
+ **/
+
+#define LATENCY_PENDING         16              /* Marked frames not shown yet          */
+
+struct latency_tag {
+    uint64_t            input_ns,
+                        submit_ns;
+};
+
+struct video_latency {
+    VIDEO               v;
+    int                 fd;                     /* Device, -1 when playing back a file  */
+    pthread_mutex_t     mtx;
+
+    /* Playing back */
+    struct input_event  *ev;
+    size_t              nev,
+                        pos;
+    int64_t             shift_ns;               /* Recorded time to now                 */
+
+    /* Report being read */
+    int                 in_report,              /* Has input in it                      */
+                        dropping;               /* SYN_DROPPED: skip to the next report */
+    uint64_t            unanswered_ns,          /* Earliest input since the last mark   */
+                        armed_ns;               /* Marked, goes with the next submit    */
+
+    struct latency_tag  pending[LATENCY_PENDING];
+    size_t              npending;
+
+    struct video_latency_stats
+                        st;
+};
+
+static inline uint64_t latency_now( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t latency_event_ns( const struct input_event *e ) {
+    return (uint64_t)e->input_event_sec * 1000000000ULL + (uint64_t)e->input_event_usec * 1000ULL;
+}
+
+static void latency_record( struct video_latency_hist *h, uint64_t ns ) {
+    uint64_t    b = ns / 1000000;
+
+    if (!h->count || ns < h->min_ns) h->min_ns = ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+    h->total_ns += ns;
+    h->count++;
+    h->hist[(b < VIDEO_LATENCY_BUCKETS) ? b : VIDEO_LATENCY_BUCKETS - 1]++;
+}
+
+/* One event at "ns", lock held */
+static void latency_event( struct video_latency *l, const struct input_event *e, uint64_t ns ) {
+    if (e->type == EV_SYN) {
+        if (e->code == SYN_DROPPED) {
+            l->st.dropped++;
+            l->dropping  = 1;
+            l->in_report = 0;
+        } else if (e->code == SYN_REPORT) {
+            if (l->in_report) {
+                l->st.inputs++;
+                if (!l->unanswered_ns) l->unanswered_ns = ns;
+            }
+            l->in_report = 0;
+            l->dropping  = 0;
+        }
+        return;
+    }
+    if (!l->dropping && (e->type == EV_KEY || e->type == EV_ABS || e->type == EV_REL)) l->in_report = 1;
+}
+
+/**
+ * Reads what's come in, lock held.  A file plays back the
+ * events whose time has come.
+ **/
+static void latency_read( struct video_latency *l ) {
+    struct input_event  buf[64];
+    uint64_t            now;
+    ssize_t             n;
+    size_t              i;
+
+    if (l->fd < 0) {
+        now = latency_now();
+        for (; l->pos < l->nev; l->pos++) {
+            if ((int64_t)latency_event_ns(&l->ev[l->pos]) + l->shift_ns > (int64_t)now) break;
+            latency_event(l, &l->ev[l->pos], (uint64_t)((int64_t)latency_event_ns(&l->ev[l->pos]) + l->shift_ns));
+        }
+        return;
+    }
+
+    while ((n = read(l->fd, buf, sizeof(buf))) > 0) {
+        for (i = 0; i < (size_t)n / sizeof(buf[0]); i++) latency_event(l, &buf[i], latency_event_ns(&buf[i]));
+        if ((size_t)n < sizeof(buf)) break;
+    }
+}
+
+/**
+ * Loads a recording, shifted so its first event happens now.
+ *
+ * \return ZERO, -1 with errno set.
+ **/
+static int latency_load( struct video_latency *l, int fd, size_t len ) {
+    size_t  got = 0;
+    ssize_t n;
+
+    if (!len || len % sizeof(struct input_event)) {
+        errno = ENODEV;
+        return -1;
+    }
+    if (!(l->ev = (struct input_event *)malloc(len))) return -1;
+    while (got < len) {
+        if ((n = read(fd, (char *)l->ev + got, len - got)) <= 0) {
+            if (!n) errno = ENODEV;
+            return -1;
+        }
+        got += (size_t)n;
+    }
+    l->nev      = len / sizeof(struct input_event);
+    l->shift_ns = (int64_t)latency_now() - (int64_t)latency_event_ns(&l->ev[0]);
+    return 0;
+}
+
+struct video_latency *video_latency_open( VIDEO v, const char *path ) {
+    struct video_latency    *l;
+    struct stat             sb;
+    int                     fd,
+                            clk = CLOCK_MONOTONIC,
+                            err;
+
+    if (!video_is_active(v) || !path) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (!(l = (struct video_latency *)calloc(1, sizeof(*l)))) goto fail;
+    l->v  = v;
+    l->fd = -1;
+    pthread_mutex_init(&l->mtx, 0);
+
+    if ((fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0) goto fail;
+    if (fstat(fd, &sb)) {
+        close(fd);
+        goto fail;
+    }
+    if (S_ISCHR(sb.st_mode)) {
+        if (ioctl(fd, EVIOCSCLOCKID, &clk)) {
+            fprintf(stderr, "libvideo/video_latency_open(): ERROR - %s doesn't look like an input device (%s).\n", path, strerror(errno));
+            close(fd);
+            errno = ENODEV;
+            goto fail;
+        }
+        l->fd = fd;
+    } else {
+        err = latency_load(l, fd, (size_t)sb.st_size);
+        close(fd);
+        if (err) goto fail;
+    }
+
+    if (!video_latency_attach(v, l)) return l;
+    if (l->fd >= 0) close(l->fd);
+
+fail:
+    err = errno;
+    if (l) {
+        free(l->ev);
+        pthread_mutex_destroy(&l->mtx);
+        free(l);
+    }
+    errno = err;
+    return 0;
+}
+
+void video_latency_close( struct video_latency *l ) {
+    if (!l) return;
+    video_latency_detach(l->v, l);
+    if (l->fd >= 0) close(l->fd);
+    free(l->ev);
+    pthread_mutex_destroy(&l->mtx);
+    free(l);
+}
+
+int video_latency_get_fd( struct video_latency *l ) {
+    if (!l || l->fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return l->fd;
+}
+
+int video_latency_mark( struct video_latency *l ) {
+    int rv = -1;
+
+    if (!l) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&l->mtx);
+    latency_read(l);
+    if (l->unanswered_ns) {
+        if (!l->armed_ns) l->armed_ns = l->unanswered_ns;
+        l->unanswered_ns = 0;
+        l->st.marked++;
+        rv = 0;
+    } else {
+        errno = EAGAIN;
+    }
+    pthread_mutex_unlock(&l->mtx);
+    return rv;
+}
+
+void video_latency_submitted( struct video_latency *l ) {
+    struct latency_tag  *t;
+
+    pthread_mutex_lock(&l->mtx);
+    if (l->armed_ns) {
+        /* Nothing's been shown for a while, the oldest is forgotten */
+        if (l->npending == LATENCY_PENDING) {
+            memmove(&l->pending[0], &l->pending[1], (LATENCY_PENDING - 1) * sizeof(l->pending[0]));
+            l->npending--;
+            l->st.lost++;
+        }
+        t            = &l->pending[l->npending++];
+        t->input_ns  = l->armed_ns;
+        t->submit_ns = latency_now();
+        l->armed_ns  = 0;
+    }
+    pthread_mutex_unlock(&l->mtx);
+}
+
+void video_latency_shown( struct video_latency *l, uint64_t start_ns, uint64_t shown_ns ) {
+    struct latency_tag  *t;
+    size_t              i, k;
+
+    pthread_mutex_lock(&l->mtx);
+    for (i = k = 0; i < l->npending; i++) {
+        t = &l->pending[i];
+        if (t->submit_ns > start_ns) {
+            l->pending[k++] = *t;
+            continue;
+        }
+        if (shown_ns < t->submit_ns) shown_ns = t->submit_ns;
+        latency_record(&l->st.input_to_submit, t->submit_ns - t->input_ns);
+        latency_record(&l->st.submit_to_photon, shown_ns - t->submit_ns);
+        latency_record(&l->st.input_to_photon, shown_ns - t->input_ns);
+    }
+    l->npending = k;
+    pthread_mutex_unlock(&l->mtx);
+}
+
+int video_latency_get_stats( struct video_latency *l, struct video_latency_stats *st ) {
+    if (!l || !st) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&l->mtx);
+    latency_read(l);
+    *st = l->st;
+    pthread_mutex_unlock(&l->mtx);
+    return 0;
+}
+
+void video_latency_reset( struct video_latency *l ) {
+    if (!l) return;
+    pthread_mutex_lock(&l->mtx);
+    memset(&l->st, 0, sizeof(l->st));
+    pthread_mutex_unlock(&l->mtx);
+}
+
+uint64_t video_latency_percentile( const struct video_latency_hist *h, unsigned pct ) {
+    uint64_t    want, seen = 0;
+    int         i;
+
+    if (!h || !h->count) return 0;
+    if (pct > 100) pct = 100;
+    want = (h->count * pct + 99) / 100;
+    if (!want) want = 1;
+    for (i = 0; i < VIDEO_LATENCY_BUCKETS - 1; i++) {
+        seen += h->hist[i];
+        if (seen >= want) break;
+    }
+    if (i == VIDEO_LATENCY_BUCKETS - 1) return h->max_ns;
+    return ((uint64_t)(i + 1) * 1000000 < h->max_ns) ? (uint64_t)(i + 1) * 1000000 : h->max_ns;
+}
@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_LATENCY_H_
+#define _VIDEO_LATENCY_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Input to photon latency (video_latency_open()).  The
+ * display calls in twice per measured frame: when a marked
+ * frame is submitted, and when a present puts frames on the
+ * screen, with when it started and when they're shown.
+ **/
+
+#include <stdint.h>
+
+#include "video.h"
+
+/**
+ * Hangs "l" on the display, under its lock.
+ *
+ * \return ZERO, -1 (EBUSY) if it already has one.
+ **/
+int         video_latency_attach( VIDEO v, struct video_latency *l );
+
+/* Takes "l" off the display if it's still there and running */
+void        video_latency_detach( VIDEO v, struct video_latency *l );
+
+/* A frame was submitted */
+void        video_latency_submitted( struct video_latency *l );
+
+/**
+ * A present that started at "start_ns" is on the screen
+ * from "shown_ns": every marked frame submitted before it
+ * started is in it (or was replaced by a newer one).
+ **/
+void        video_latency_shown( struct video_latency *l, uint64_t start_ns, uint64_t shown_ns );
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video_pace.h"
+
+#define VIDEO_PACE_MARGIN       1000000ULL      /* Default safety margin, ns                            */
+#define VIDEO_PACE_SETTLE       60              /* Frames on time before the margin is eased back       */
+
+void video_pace_init( struct video_pace *p, uint64_t period_ns, uint64_t margin_ns ) {
+    memset(p, 0, sizeof(*p));
+    pthread_mutex_init(&p->mtx, 0);
+    p->period_ns        = period_ns;
+    p->margin_min_ns    = margin_ns ? margin_ns : VIDEO_PACE_MARGIN;
+    p->margin_ns        = p->margin_min_ns;
+}
+
+void video_pace_destroy( struct video_pace *p ) {
+    pthread_mutex_destroy(&p->mtx);
+}
+
+/**
+ * The period follows the VBLANKs: an interval that's close to
+ * a whole number of periods (some are skipped when nothing is
+ * presented) nudges it by a sixteenth of the difference.  The
+ * mode's timings are only a starting point, and some drivers
+ * don't give any; then the first sane interval is taken.
+ **/
+void video_pace_vblank( struct video_pace *p, uint64_t now ) {
+    uint64_t    dt, n, err;
+
+    pthread_mutex_lock(&p->mtx);
+    if (p->vblank_ns && now > p->vblank_ns) {
+        dt = now - p->vblank_ns;
+        if (!p->period_ns) {
+            if (dt >= 2000000 && dt <= 100000000) p->period_ns = dt;
+        } else if ((n = (dt + p->period_ns / 2) / p->period_ns) >= 1 && n <= 8) {
+            err = (dt > n * p->period_ns) ? dt - n * p->period_ns : n * p->period_ns - dt;
+            if (err < p->period_ns / 8) {
+                p->period_ns = (uint64_t)((int64_t)p->period_ns + ((int64_t)(dt / n) - (int64_t)p->period_ns) / 16);
+            }
+        }
+    }
+    p->vblank_ns = now;
+    pthread_mutex_unlock(&p->mtx);
+}
+
+/**
+ * A frame started by video_pace_wait() is in.  Late (after
+ * its VBLANK) doubles the margin, up to half a period; a
+ * good run of frames on time takes an eighth back off.
+ **/
+void video_pace_submit( struct video_pace *p ) {
+    uint64_t    start, now;
+
+    if (!__atomic_load_n(&p->start_ns, __ATOMIC_RELAXED)) return;
+
+    pthread_mutex_lock(&p->mtx);
+    now = video_pace_now();
+    if ((start = p->start_ns) && now >= start) {
+        p->render[p->render_pos] = now - start;
+        p->render_pos            = (p->render_pos + 1) % VIDEO_PACE_SAMPLES;
+        if (p->nrender < VIDEO_PACE_SAMPLES) p->nrender++;
+
+        if (p->target_ns) {
+            p->frames++;
+            if (now > p->target_ns) {
+                p->misses++;
+                p->hits         = 0;
+                p->margin_ns   *= 2;
+                if (p->period_ns && p->margin_ns > p->period_ns / 2) p->margin_ns = p->period_ns / 2;
+                if (p->margin_ns < p->margin_min_ns) p->margin_ns = p->margin_min_ns;
+            } else if (++p->hits >= VIDEO_PACE_SETTLE) {
+                p->hits         = 0;
+                p->margin_ns   -= p->margin_ns / 4;
+                if (p->margin_ns < p->margin_min_ns) p->margin_ns = p->margin_min_ns;
+            }
+        }
+    }
+    __atomic_store_n(&p->start_ns, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&p->mtx);
+}
+
+/* 95th percentile of the render times, lock held */
+static uint64_t pace_render( struct video_pace *p ) {
+    uint64_t    s[VIDEO_PACE_SAMPLES], t;
+    unsigned    i, j;
+
+    if (!p->nrender) return 0;
+    for (i = 0; i < p->nrender; i++) {
+        t = p->render[i];
+        for (j = i; j > 0 && s[j - 1] > t; j--) s[j] = s[j - 1];
+        s[j] = t;
+    }
+    return s[(p->nrender * 95) / 100];
+}
+
+int video_pace_wait( struct video_pace *p, uint64_t *vblank_ns ) {
+    struct timespec ts;
+    uint64_t        now, budget, target, start;
+
+    pthread_mutex_lock(&p->mtx);
+    now = video_pace_now();
+
+    /* Nothing to go by yet: start now, but time the frame */
+    if (!p->period_ns || !p->vblank_ns) {
+        p->target_ns = 0;
+        __atomic_store_n(&p->start_ns, now, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&p->mtx);
+        if (vblank_ns) *vblank_ns = 0;
+        return 0;
+    }
+
+    /**
+     * The first VBLANK after now that there's time to draw for,
+     * and never the one the last frame went for: with a
+     * presenter video_submit_frame() returns before it.
+     **/
+    budget = pace_render(p) + p->margin_ns;
+    target = p->vblank_ns + ((now - p->vblank_ns) / p->period_ns + 1) * p->period_ns;
+    while (target <= p->last_target_ns + p->period_ns / 2) target += p->period_ns;
+    while (target < now + budget) target += p->period_ns;
+    start = target - budget;
+
+    p->target_ns      = target;
+    p->last_target_ns = target;
+    __atomic_store_n(&p->start_ns, start, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&p->mtx);
+
+    if (vblank_ns) *vblank_ns = target;
+    if (start > now) {
+        ts.tv_sec  = (time_t)(start / 1000000000ULL);
+        ts.tv_nsec = (long)(start % 1000000000ULL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+    }
+    return 0;
+}
+
+void video_pace_get_stats( struct video_pace *p, struct video_pace_stats *st ) {
+    pthread_mutex_lock(&p->mtx);
+    st->period_ns   = p->period_ns;
+    st->vblank_ns   = p->vblank_ns;
+    st->render_ns   = pace_render(p);
+    st->margin_ns   = p->margin_ns;
+    st->frames      = p->frames;
+    st->misses      = p->misses;
+    pthread_mutex_unlock(&p->mtx);
+}
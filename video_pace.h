@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_PACE_H_
+#define _VIDEO_PACE_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Frame pacing for video_wait_until_render_start().  Every
+ * FBIO_WAITFORVSYNC that returns gives a VBLANK timestamp,
+ * which tracks the refresh period and phase.  Every submit
+ * after a paced start gives a render time.  From those the
+ * start of the next frame is put as late as it can be and
+ * still make its VBLANK.
+ *
+ * VBLANKs are recorded by whoever presents (the presenter
+ * thread, if there is one), starts and submits by the app,
+ * so the state is under its own mutex.
+ **/
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "video.h"
+
+#define VIDEO_PACE_SAMPLES      64              /* Render times kept                            */
+
+struct video_pace {
+    pthread_mutex_t mtx;
+
+    uint64_t        period_ns,                  /* Refresh period, ZERO until known             */
+                    vblank_ns,                  /* Last VBLANK seen, ZERO until one is          */
+                    margin_min_ns,              /* As asked for                                 */
+                    margin_ns,                  /* Now, after backing off                       */
+                    start_ns,                   /* Paced frame being drawn, ZERO if none        */
+                    target_ns,                  /* Its VBLANK                                   */
+                    last_target_ns,
+                    render[VIDEO_PACE_SAMPLES];
+    unsigned        nrender,
+                    render_pos,
+                    hits;                       /* Frames on time since the margin last moved   */
+
+    uint64_t        frames,
+                    misses;
+};
+
+void        video_pace_init( struct video_pace *p, uint64_t period_ns, uint64_t margin_ns );
+void        video_pace_destroy( struct video_pace *p );
+
+/* FBIO_WAITFORVSYNC returned at "now" */
+void        video_pace_vblank( struct video_pace *p, uint64_t now );
+
+/* A frame was submitted, cheap unless it was paced */
+void        video_pace_submit( struct video_pace *p );
+
+/**
+ * Sleeps until the next frame should be started.
+ *
+ * \return ZERO, with the VBLANK it's for in "vblank_ns"
+ * (ZERO if the refresh isn't known yet and it didn't wait).
+ **/
+int         video_pace_wait( struct video_pace *p, uint64_t *vblank_ns );
+
+void        video_pace_get_stats( struct video_pace *p, struct video_pace_stats *st );
+
+static inline uint64_t video_pace_now( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
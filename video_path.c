@@ -0,0 +1,958 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#include "video.h"
+#include "video_draw.h"
+#include "video_path.h"
+
+#include <math.h>
+
+/**
+ * Anti-aliased paths.  Curves are flattened to lines, then
+ * each line adds the signed area it covers to an accumulation
+ * buffer the size of the path's bounding box (clipped to the
+ * surface), the way font rasterizers do it.  Summing a row
+ * from the left gives each pixel's winding, fractional at
+ * the edges, which turns into coverage by the fill rule.
+ * Rows are then written as runs: solid ones with the fill
+ * and blend loops, edges with the mask blend.
+ **/
+
+#define PATH_MOVE               0
+#define PATH_LINE               1
+#define PATH_QUAD               2
+#define PATH_CUBIC              3
+#define PATH_CLOSE              4
+
+#define PATH_TOLERANCE          0.1f            /* Furthest a flattened curve strays, in pixels         */
+#define PATH_MAX_STEPS          1024            /* Line segments per curve at most                      */
+#define PATH_MAX_COORD          4194304.0f      /* Coordinates are clamped to this before rasterizing   */
+#define PATH_MITER_LIMIT        4.0f            /* Default for video_stroke.miter_limit                 */
+
+struct video_path {
+    uint8_t     *verbs;
+    float       *pts;                   /* x, y pairs, as many as each verb takes               */
+    size_t      nverbs,
+                cverbs,
+                npts,                   /* Points, not floats                                   */
+                cpts;
+    float       cx, cy,                 /* Current point                                        */
+                sx, sy;                 /* Where the current subpath started                    */
+    int         has_point,
+                open;                   /* A subpath is under way (close or move ends it)       */
+};
+
+/**
+ * Growable list of points, and the flattened path: every
+ * subpath as a run of points in "pts".
+ **/
+struct path_pts {
+    float       *xy;
+    size_t      n,
+                cap;
+};
+
+struct path_contour {
+    size_t      first,
+                count;
+    int         closed;
+};
+
+struct path_flat {
+    struct path_pts     pts;
+    struct path_contour *c;
+    size_t              nc,
+                        cc;
+};
+
+static inline float path_min( float a, float b ) {
+    return (a < b) ? a : b;
+}
+
+static inline float path_max( float a, float b ) {
+    return (a > b) ? a : b;
+}
+
+static inline float path_clamp( float x, float lo, float hi ) {
+    return (x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+/* floor() and ceil() for values well inside an int, without libm */
+static inline int path_floor( float x ) {
+    int i = (int)x;
+    return i - (x < (float)i);
+}
+
+static inline int path_ceil( float x ) {
+    int i = (int)x;
+    return i + (x > (float)i);
+}
+
+static inline int path_finite( float x ) {
+    return x - x == 0.0f;
+}
+
+/*****************************************************************************
+ * Building paths
+ *****************************************************************************/
+
+struct video_path *video_path_create( void ) {
+    return (struct video_path *)calloc(1, sizeof(struct video_path));
+}
+
+void video_path_destroy( struct video_path *p ) {
+    if (!p) return;
+    free(p->verbs);
+    free(p->pts);
+    free(p);
+}
+
+void video_path_reset( struct video_path *p ) {
+    if (!p) return;
+    p->nverbs       = 0;
+    p->npts         = 0;
+    p->cx = p->cy   = 0;
+    p->sx = p->sy   = 0;
+    p->has_point    = 0;
+    p->open         = 0;
+}
+
+/**
+ * Appends "verb" with its "n" points.
+ *
+ * \return ZERO, or -1 with errno set.
+ **/
+static int path_add( struct video_path *p, int verb, const float *xy, size_t n ) {
+    uint8_t *verbs;
+    float   *pts;
+    size_t  cap, i;
+
+    if (!p) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < 2 * n; i++) {
+        if (!path_finite(xy[i])) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (p->nverbs == p->cverbs) {
+        cap     = p->cverbs ? p->cverbs * 2 : 16;
+        verbs   = (uint8_t *)realloc(p->verbs, cap);
+        if (!verbs) return -1;
+        p->verbs    = verbs;
+        p->cverbs   = cap;
+    }
+    if (p->npts + n > p->cpts) {
+        for (cap = p->cpts ? p->cpts : 32; cap < p->npts + n; cap *= 2);
+        pts     = (float *)realloc(p->pts, cap * 2 * sizeof(float));
+        if (!pts) return -1;
+        p->pts      = pts;
+        p->cpts     = cap;
+    }
+    p->verbs[p->nverbs++] = (uint8_t)verb;
+    if (n) memcpy(p->pts + 2 * p->npts, xy, 2 * n * sizeof(float));
+    p->npts += n;
+    return 0;
+}
+
+int video_path_copy( struct video_path *dst, const struct video_path *src ) {
+    uint8_t *verbs;
+    float   *pts;
+
+    if (src->nverbs > dst->cverbs) {
+        if (!(verbs = (uint8_t *)realloc(dst->verbs, src->nverbs))) return -1;
+        dst->verbs  = verbs;
+        dst->cverbs = src->nverbs;
+    }
+    if (src->npts > dst->cpts) {
+        if (!(pts = (float *)realloc(dst->pts, src->npts * 2 * sizeof(float)))) return -1;
+        dst->pts    = pts;
+        dst->cpts   = src->npts;
+    }
+    if (src->nverbs) memcpy(dst->verbs, src->verbs, src->nverbs);
+    if (src->npts) memcpy(dst->pts, src->pts, src->npts * 2 * sizeof(float));
+    dst->nverbs     = src->nverbs;
+    dst->npts       = src->npts;
+    dst->cx         = src->cx;
+    dst->cy         = src->cy;
+    dst->sx         = src->sx;
+    dst->sy         = src->sy;
+    dst->has_point  = src->has_point;
+    dst->open       = src->open;
+    return 0;
+}
+
+int video_path_move_to( struct video_path *p, float x, float y ) {
+    float   xy[2] = { x, y };
+
+    if (path_add(p, PATH_MOVE, xy, 1)) return -1;
+    p->cx = p->sx   = x;
+    p->cy = p->sy   = y;
+    p->has_point    = 1;
+    p->open         = 1;
+    return 0;
+}
+
+/**
+ * Drawing with no subpath under way starts one at the
+ * current point (the start of the last one after a close),
+ * or, on an empty path, at the command's end point.
+ **/
+static int path_begin( struct video_path *p, float x, float y ) {
+    if (!p) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (p->open) return 0;
+    return p->has_point ? video_path_move_to(p, p->cx, p->cy) : video_path_move_to(p, x, y);
+}
+
+int video_path_line_to( struct video_path *p, float x, float y ) {
+    float   xy[2] = { x, y };
+
+    if (path_begin(p, x, y) || path_add(p, PATH_LINE, xy, 1)) return -1;
+    p->cx = x;
+    p->cy = y;
+    return 0;
+}
+
+int video_path_quad_to( struct video_path *p, float cx, float cy, float x, float y ) {
+    float   xy[4] = { cx, cy, x, y };
+
+    if (path_begin(p, cx, cy) || path_add(p, PATH_QUAD, xy, 2)) return -1;
+    p->cx = x;
+    p->cy = y;
+    return 0;
+}
+
+int video_path_cubic_to( struct video_path *p, float c1x, float c1y, float c2x, float c2y, float x, float y ) {
+    float   xy[6] = { c1x, c1y, c2x, c2y, x, y };
+
+    if (path_begin(p, c1x, c1y) || path_add(p, PATH_CUBIC, xy, 3)) return -1;
+    p->cx = x;
+    p->cy = y;
+    return 0;
+}
+
+int video_path_close( struct video_path *p ) {
+    if (!p) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!p->open) return 0;
+    if (path_add(p, PATH_CLOSE, 0, 0)) return -1;
+    p->cx   = p->sx;
+    p->cy   = p->sy;
+    p->open = 0;
+    return 0;
+}
+
+/*****************************************************************************
+ * Flattening
+ *****************************************************************************/
+
+static int path_pts_add( struct path_pts *l, float x, float y ) {
+    float   *xy;
+    size_t  cap;
+
+    if (l->n == l->cap) {
+        cap = l->cap ? l->cap * 2 : 64;
+        xy  = (float *)realloc(l->xy, cap * 2 * sizeof(float));
+        if (!xy) return -1;
+        l->xy   = xy;
+        l->cap  = cap;
+    }
+    l->xy[2 * l->n]     = x;
+    l->xy[2 * l->n + 1] = y;
+    l->n++;
+    return 0;
+}
+
+static void path_flat_free( struct path_flat *f ) {
+    free(f->pts.xy);
+    free(f->c);
+}
+
+static int path_flat_contour( struct path_flat *f ) {
+    struct path_contour *c;
+    size_t              cap;
+
+    if (f->nc == f->cc) {
+        cap = f->cc ? f->cc * 2 : 8;
+        c   = (struct path_contour *)realloc(f->c, cap * sizeof(*c));
+        if (!c) return -1;
+        f->c    = c;
+        f->cc   = cap;
+    }
+    c           = &f->c[f->nc++];
+    c->first    = f->pts.n;
+    c->count    = 0;
+    c->closed   = 0;
+    return 0;
+}
+
+static int path_flat_point( struct path_flat *f, float x, float y ) {
+    if (path_pts_add(&f->pts, x, y)) return -1;
+    f->c[f->nc - 1].count++;
+    return 0;
+}
+
+/**
+ * Segments a curve needs to stay within PATH_TOLERANCE, from
+ * its second derivative "dd" at the worst point: splitting
+ * into n steps is off by at most |dd| / (8 n^2).
+ **/
+static int path_steps( float ddx, float ddy ) {
+    float   n2 = sqrtf(ddx * ddx + ddy * ddy) / (8.0f * PATH_TOLERANCE);
+
+    if (n2 <= 1.0f) return 1;
+    if (n2 >= (float)PATH_MAX_STEPS * PATH_MAX_STEPS) return PATH_MAX_STEPS;
+    return path_ceil(sqrtf(n2));
+}
+
+static int path_flatten( const struct video_path *p, struct path_flat *f ) {
+    const float *q = p->pts;
+    float       x = 0, y = 0,
+                t, u, ax, ay, bx, by, n;
+    size_t      i;
+    int         j, steps;
+
+    memset(f, 0, sizeof(*f));
+
+    for (i = 0; i < p->nverbs; i++) {
+        switch (p->verbs[i]) {
+        case PATH_MOVE:
+            if (path_flat_contour(f) || path_flat_point(f, q[0], q[1])) goto error;
+            x = q[0];
+            y = q[1];
+            q += 2;
+            break;
+
+        case PATH_LINE:
+            if (path_flat_point(f, q[0], q[1])) goto error;
+            x = q[0];
+            y = q[1];
+            q += 2;
+            break;
+
+        case PATH_QUAD:
+            ax      = x - 2 * q[0] + q[2];
+            ay      = y - 2 * q[1] + q[3];
+            steps   = path_steps(2 * ax, 2 * ay);
+            for (j = 1; j < steps; j++) {
+                t = (float)j / steps;
+                u = 1 - t;
+                if (path_flat_point(f, u * u * x + 2 * u * t * q[0] + t * t * q[2],
+                                       u * u * y + 2 * u * t * q[1] + t * t * q[3])) goto error;
+            }
+            if (path_flat_point(f, q[2], q[3])) goto error;
+            x = q[2];
+            y = q[3];
+            q += 4;
+            break;
+
+        case PATH_CUBIC:
+            ax      = x - 2 * q[0] + q[2];
+            ay      = y - 2 * q[1] + q[3];
+            bx      = q[0] - 2 * q[2] + q[4];
+            by      = q[1] - 2 * q[3] + q[5];
+            n       = path_max(ax * ax + ay * ay, bx * bx + by * by);
+            steps   = path_steps(6 * sqrtf(n), 0);
+            for (j = 1; j < steps; j++) {
+                t = (float)j / steps;
+                u = 1 - t;
+                if (path_flat_point(f, u * u * u * x + 3 * u * t * (u * q[0] + t * q[2]) + t * t * t * q[4],
+                                       u * u * u * y + 3 * u * t * (u * q[1] + t * q[3]) + t * t * t * q[5])) goto error;
+            }
+            if (path_flat_point(f, q[4], q[5])) goto error;
+            x = q[4];
+            y = q[5];
+            q += 6;
+            break;
+
+        case PATH_CLOSE:
+            f->c[f->nc - 1].closed = 1;
+            break;
+        }
+    }
+    return 0;
+
+error:
+    path_flat_free(f);
+    memset(f, 0, sizeof(*f));
+    return -1;
+}
+
+/*****************************************************************************
+ * Stroking
+ *****************************************************************************/
+
+/**
+ * A stroke is built as a union of pieces: a rectangle per
+ * segment plus the joins and caps, each its own closed
+ * subpath turned the same way round.  Filled with
+ * VIDEO_FILL_NONZERO overlaps count once, and pieces that
+ * meet along an edge (a segment and its join) add up to
+ * full coverage there instead of leaving a seam.
+ **/
+struct path_stroker {
+    struct video_path   *dst;
+    struct path_pts     poly;
+    float               hw,                 /* Half the width   */
+                        limit;
+    int                 join,
+                        cap;
+};
+
+static int stroke_emit( struct path_stroker *st ) {
+    const float *xy = st->poly.xy;
+    size_t      n = st->poly.n,
+                i, j;
+    float       area = 0;
+    int         rv = 0;
+
+    for (i = 0; i < n; i++) {
+        j     = (i + 1) % n;
+        area += xy[2 * i] * xy[2 * j + 1] - xy[2 * j] * xy[2 * i + 1];
+    }
+    st->poly.n = 0;
+    if (n < 3 || area == 0) return 0;
+
+    for (i = 0; i < n && !rv; i++) {
+        j  = (area > 0) ? i : n - 1 - i;
+        rv = i ? video_path_line_to(st->dst, xy[2 * j], xy[2 * j + 1])
+               : video_path_move_to(st->dst, xy[2 * j], xy[2 * j + 1]);
+    }
+    return rv ? rv : video_path_close(st->dst);
+}
+
+static inline int stroke_point( struct path_stroker *st, float x, float y ) {
+    return path_pts_add(&st->poly, x, y);
+}
+
+/**
+ * Arc around (cx, cy) from offset a to offset b (both "hw"
+ * long, less than a half turn apart), b's end included.
+ * Halves the angle until the chord is within tolerance.
+ **/
+static int stroke_arc( struct path_stroker *st, float cx, float cy, float ax, float ay, float bx, float by, int depth ) {
+    float   mx = ax + bx,
+            my = ay + by,
+            len = sqrtf(mx * mx + my * my);
+
+    if (depth < 16 && len > 0 && st->hw - 0.5f * len > PATH_TOLERANCE) {
+        mx *= st->hw / len;
+        my *= st->hw / len;
+        return stroke_arc(st, cx, cy, ax, ay, mx, my, depth + 1) ||
+               stroke_arc(st, cx, cy, mx, my, bx, by, depth + 1);
+    }
+    return stroke_point(st, cx + bx, cy + by);
+}
+
+/**
+ * Half disc at (x, y), flat side along the normal (nx, ny),
+ * bulging toward the direction (dx, dy).  Both are hw long.
+ **/
+static int stroke_half_disc( struct path_stroker *st, float x, float y, float nx, float ny, float dx, float dy ) {
+    if (stroke_point(st, x + nx, y + ny) ||
+        stroke_arc(st, x, y, nx, ny, dx, dy, 0) ||
+        stroke_arc(st, x, y, dx, dy, -nx, -ny, 0)) return -1;
+    return stroke_emit(st);
+}
+
+/**
+ * End of an open subpath at (x, y), heading out along the
+ * unit vector (dx, dy).
+ **/
+static int stroke_cap( struct path_stroker *st, float x, float y, float dx, float dy ) {
+    float   hw = st->hw,
+            nx = -dy * hw,
+            ny = dx * hw;
+
+    dx *= hw;
+    dy *= hw;
+    switch (st->cap) {
+    case VIDEO_CAP_ROUND:
+        return stroke_half_disc(st, x, y, nx, ny, dx, dy);
+
+    case VIDEO_CAP_SQUARE:
+        if (stroke_point(st, x + nx, y + ny) ||
+            stroke_point(st, x + nx + dx, y + ny + dy) ||
+            stroke_point(st, x - nx + dx, y - ny + dy) ||
+            stroke_point(st, x - nx, y - ny)) return -1;
+        return stroke_emit(st);
+    }
+    return 0;
+}
+
+/**
+ * Join at (x, y) between a segment coming in along (ax, ay)
+ * and one going out along (bx, by), both unit vectors.
+ **/
+static int stroke_join( struct path_stroker *st, float x, float y, float ax, float ay, float bx, float by ) {
+    float   hw = st->hw,
+            cross = ax * by - ay * bx,
+            dot = ax * bx + ay * by,
+            side = (cross > 0) ? -hw : hw,
+            o0x = -ay * side, o0y = ax * side,      /* Offsets on the outside of the turn */
+            o1x = -by * side, o1y = bx * side,
+            mx, my, len, r;
+
+    if (cross == 0 && dot > 0) return 0;
+
+    if (stroke_point(st, x, y) || stroke_point(st, x + o0x, y + o0y)) return -1;
+
+    mx  = o0x + o1x;
+    my  = o0y + o1y;
+    len = sqrtf(mx * mx + my * my);
+
+    switch (st->join) {
+    case VIDEO_JOIN_ROUND:
+        /* Through the middle of the turn (straight on for a U-turn) so each half is under 90 degrees */
+        if (len > hw * 1e-3f) {
+            mx *= hw / len;
+            my *= hw / len;
+        } else {
+            mx = ax * hw;
+            my = ay * hw;
+        }
+        if (stroke_arc(st, x, y, o0x, o0y, mx, my, 0) ||
+            stroke_arc(st, x, y, mx, my, o1x, o1y, 0)) return -1;
+        return stroke_emit(st);
+
+    case VIDEO_JOIN_MITER:
+        /* The miter tip is hw / cos(turn / 2) out, cos^2(turn / 2) = (1 + dot) / 2 */
+        if (len > 0 && (1 + dot) * 0.5f * st->limit * st->limit >= 1) {
+            r = hw * hw * 2 / (len * len);
+            if (stroke_point(st, x + mx * r, y + my * r)) return -1;
+        }
+        break;
+    }
+    if (stroke_point(st, x + o1x, y + o1y)) return -1;
+    return stroke_emit(st);
+}
+
+/**
+ * Strokes one flattened subpath.  Repeated points are
+ * dropped first so every segment has a direction.
+ **/
+static int stroke_contour( struct path_stroker *st, const float *xy, size_t n, int closed ) {
+    struct path_pts pts = { 0, 0, 0 };
+    const float     *p;
+    float           *d = 0,
+                    hw = st->hw,
+                    dx, dy, len;
+    size_t          i, nseg;
+    int             rv = -1;
+
+    for (i = 0; i < n; i++) {
+        if (pts.n && xy[2 * i] == pts.xy[2 * pts.n - 2] && xy[2 * i + 1] == pts.xy[2 * pts.n - 1]) continue;
+        if (path_pts_add(&pts, xy[2 * i], xy[2 * i + 1])) goto done;
+    }
+    n = pts.n;
+    p = pts.xy;
+    if (closed && n > 1 && p[0] == p[2 * n - 2] && p[1] == p[2 * n - 1]) n--;
+
+    /* A lone point only shows with round or square caps */
+    if (n == 1) {
+        rv = 0;
+        if (st->cap == VIDEO_CAP_ROUND) {
+            rv = stroke_half_disc(st, p[0], p[1], 0, hw, hw, 0) ||
+                 stroke_half_disc(st, p[0], p[1], 0, -hw, -hw, 0);
+        } else if (st->cap == VIDEO_CAP_SQUARE) {
+            rv = stroke_point(st, p[0] - hw, p[1] - hw) || stroke_point(st, p[0] + hw, p[1] - hw) ||
+                 stroke_point(st, p[0] + hw, p[1] + hw) || stroke_point(st, p[0] - hw, p[1] + hw) ||
+                 stroke_emit(st);
+        }
+        goto done;
+    }
+    if (n < 2) {
+        rv = 0;
+        goto done;
+    }
+
+    /* Unit direction of every segment */
+    nseg = closed ? n : n - 1;
+    if (!(d = (float *)malloc(nseg * 2 * sizeof(float)))) goto done;
+    for (i = 0; i < nseg; i++) {
+        dx  = p[2 * ((i + 1) % n)] - p[2 * i];
+        dy  = p[2 * ((i + 1) % n) + 1] - p[2 * i + 1];
+        len = sqrtf(dx * dx + dy * dy);
+        d[2 * i]        = dx / len;
+        d[2 * i + 1]    = dy / len;
+    }
+
+    for (i = 0; i < nseg; i++) {
+        const float *a = &p[2 * i],
+                    *b = &p[2 * ((i + 1) % n)];
+        float       nx = -d[2 * i + 1] * hw,
+                    ny = d[2 * i] * hw;
+
+        if (stroke_point(st, a[0] + nx, a[1] + ny) ||
+            stroke_point(st, b[0] + nx, b[1] + ny) ||
+            stroke_point(st, b[0] - nx, b[1] - ny) ||
+            stroke_point(st, a[0] - nx, a[1] - ny) ||
+            stroke_emit(st)) goto done;
+
+        if ((i + 1 < nseg || closed) &&
+            stroke_join(st, b[0], b[1], d[2 * i], d[2 * i + 1],
+                        d[2 * ((i + 1) % nseg)], d[2 * ((i + 1) % nseg) + 1])) goto done;
+    }
+
+    if (!closed &&
+        (stroke_cap(st, p[0], p[1], -d[0], -d[1]) ||
+         stroke_cap(st, p[2 * n - 2], p[2 * n - 1], d[2 * nseg - 2], d[2 * nseg - 1]))) goto done;
+    rv = 0;
+
+done:
+    free(d);
+    free(pts.xy);
+    return rv ? -1 : 0;
+}
+
+int video_path_stroke( struct video_path *dst, const struct video_path *src, const struct video_stroke *stroke ) {
+    struct path_stroker st;
+    struct path_flat    f;
+    size_t              i;
+    int                 rv = 0;
+
+    if (!dst || !src || !stroke || dst == src || !path_finite(stroke->width) || stroke->width <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (path_flatten(src, &f)) return -1;
+
+    memset(&st, 0, sizeof(st));
+    st.dst      = dst;
+    st.hw       = stroke->width * 0.5f;
+    st.limit    = (stroke->miter_limit >= 1) ? stroke->miter_limit : PATH_MITER_LIMIT;
+    st.join     = stroke->join;
+    st.cap      = stroke->cap;
+
+    for (i = 0; i < f.nc && !rv; i++) {
+        rv = stroke_contour(&st, f.pts.xy + 2 * f.c[i].first, f.c[i].count, f.c[i].closed);
+    }
+
+    free(st.poly.xy);
+    path_flat_free(&f);
+    return rv;
+}
+
+/*****************************************************************************
+ * Rasterizing
+ *****************************************************************************/
+
+/**
+ * The accumulation buffer: "h" rows of w + 2 cells (a line
+ * can touch two cells past its last pixel).  Cell (x, y)
+ * gets the change in winding from pixel x - 1 to pixel x
+ * along row y.
+ **/
+struct path_raster {
+    float       *acc;
+    int         w,
+                h;
+    size_t      stride;
+};
+
+/**
+ * Line from (x0, y0) to (x1, y1) with both x inside [0, w].
+ * For each row it crosses, the covered height (signed by
+ * direction) goes into the cells under it, split by how much
+ * of each pixel lies to the right of the line.
+ **/
+static void path_accumulate( struct path_raster *r, float x0, float y0, float x1, float y1 ) {
+    float   dir = 1,
+            w = (float)r->w,
+            dxdy, x, xnext, dy, d, xa, xb, xmf,
+            s, x0f, x1f, a0, a1, a2, am, t;
+    float   *row;
+    int     y, yend, i0, i1, i;
+
+    if (y0 == y1) return;
+    if (y0 > y1) {
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+        dir = -1;
+    }
+    if (y1 <= 0 || y0 >= r->h) return;
+
+    dxdy = (x1 - x0) / (y1 - y0);
+    x    = x0;
+    if (y0 < 0) {
+        x  = path_clamp(x - y0 * dxdy, 0, w);
+        y  = 0;
+    } else {
+        y  = (int)y0;
+    }
+    yend = (y1 >= r->h) ? r->h : path_ceil(y1);
+
+    for (; y < yend; y++) {
+        row     = r->acc + (size_t)y * r->stride;
+        dy      = path_min((float)(y + 1), y1) - path_max((float)y, y0);
+        xnext   = path_clamp(x + dxdy * dy, 0, w);
+        d       = dy * dir;
+        xa      = path_min(x, xnext);
+        xb      = path_max(x, xnext);
+        i0      = path_floor(xa);
+        i1      = path_ceil(xb);
+
+        if (i1 <= i0 + 1) {
+            /* Inside one pixel: split by the line's middle */
+            xmf          = 0.5f * (x + xnext) - i0;
+            row[i0]     += d - d * xmf;
+            row[i0 + 1] += d * xmf;
+        } else {
+            s   = 1 / (xb - xa);
+            x0f = xa - i0;
+            a0  = 0.5f * s * (1 - x0f) * (1 - x0f);
+            x1f = xb - i1 + 1;
+            am  = 0.5f * s * x1f * x1f;
+
+            row[i0] += d * a0;
+            if (i1 == i0 + 2) {
+                row[i0 + 1] += d * (1 - a0 - am);
+            } else {
+                a1           = s * (1.5f - x0f);
+                row[i0 + 1] += d * (a1 - a0);
+                for (i = i0 + 2; i < i1 - 1; i++) row[i] += d * s;
+                a2           = a1 + (i1 - i0 - 3) * s;
+                row[i1 - 1] += d * (1 - a2 - am);
+            }
+            row[i1] += d * am;
+        }
+        x = xnext;
+    }
+}
+
+/**
+ * Any line, in buffer coordinates.  The parts left or right
+ * of the buffer are pushed onto its edge: left of it they
+ * still change the winding of every pixel in the row, right
+ * of it they only touch the spare cells.
+ **/
+static void path_line( struct path_raster *r, float x0, float y0, float x1, float y1 ) {
+    float   w = (float)r->w,
+            ym;
+
+    if ((x0 < 0 && x1 > 0) || (x0 > 0 && x1 < 0)) {
+        ym = y0 + (y1 - y0) * (0 - x0) / (x1 - x0);
+        path_line(r, x0, y0, 0, ym);
+        path_line(r, 0, ym, x1, y1);
+        return;
+    }
+    if ((x0 < w && x1 > w) || (x0 > w && x1 < w)) {
+        ym = y0 + (y1 - y0) * (w - x0) / (x1 - x0);
+        path_line(r, x0, y0, w, ym);
+        path_line(r, w, ym, x1, y1);
+        return;
+    }
+    path_accumulate(r, path_clamp(x0, 0, w), y0, path_clamp(x1, 0, w), y1);
+}
+
+/**
+ * Row "y" of the buffer to 8 bit coverage in "cov".
+ **/
+static void path_coverage( const struct path_raster *r, int y, int rule, uint8_t *cov ) {
+    const float *row = r->acc + (size_t)y * r->stride;
+    float       acc = 0,
+                c;
+    int         x;
+
+    for (x = 0; x < r->w; x++) {
+        acc += row[x];
+        c    = (acc < 0) ? -acc : acc;
+        if (rule == VIDEO_FILL_EVENODD) {
+            c -= 2 * (float)(int)(c * 0.5f);
+            if (c > 1) c = 2 - c;
+        }
+        cov[x] = (c >= 1) ? 255 : (uint8_t)(c * 255 + 0.5f);
+    }
+}
+
+static inline int path_run_class( uint8_t c ) {
+    return (c == 0) ? 0 : (c == 255) ? 2 : 1;
+}
+
+/**
+ * Accumulates every line of "f" (each subpath closed) into
+ * a new buffer for the w x h box at x0, y0.  The buffer has
+ * room after it for a row of coverage.
+ *
+ * \return ZERO, -1 if out of memory.
+ **/
+static int path_raster( const struct path_flat *f, int x0, int y0, int w, int h, struct path_raster *r ) {
+    const float *xy;
+    float       ox = (float)x0,
+                oy = (float)y0;
+    size_t      i, j, n;
+
+    r->w        = w;
+    r->h        = h;
+    r->stride   = (size_t)w + 2;
+    r->acc      = (float *)calloc(r->stride * h + w, sizeof(float));
+    if (!r->acc) return -1;
+
+    for (i = 0; i < f->nc; i++) {
+        xy = f->pts.xy + 2 * f->c[i].first;
+        n  = f->c[i].count;
+        for (j = 0; j < n; j++) {
+            const float *a = &xy[2 * j],
+                        *b = &xy[2 * ((j + 1) % n)];
+
+            path_line(r, path_clamp(a[0], -PATH_MAX_COORD, PATH_MAX_COORD) - ox,
+                         path_clamp(a[1], -PATH_MAX_COORD, PATH_MAX_COORD) - oy,
+                         path_clamp(b[0], -PATH_MAX_COORD, PATH_MAX_COORD) - ox,
+                         path_clamp(b[1], -PATH_MAX_COORD, PATH_MAX_COORD) - oy);
+        }
+    }
+    return 0;
+}
+
+int video_path_cover( const struct video_path *p, int width, int height, int rule, struct video_path_cover *c ) {
+    struct path_raster  r;
+    struct path_flat    f;
+    const float         *xy;
+    float               minx, miny, maxx, maxy;
+    size_t              i;
+    int                 x1, y1, y;
+
+    memset(c, 0, sizeof(*c));
+    if (width <= 0 || height <= 0) return 0;
+    if (path_flatten(p, &f)) return -1;
+
+    /* Bounding box, on the surface */
+    minx = miny = PATH_MAX_COORD;
+    maxx = maxy = -PATH_MAX_COORD;
+    for (i = 0; i < f.pts.n; i++) {
+        xy = &f.pts.xy[2 * i];
+        minx = path_min(minx, xy[0]);
+        maxx = path_max(maxx, xy[0]);
+        miny = path_min(miny, xy[1]);
+        maxy = path_max(maxy, xy[1]);
+    }
+    c->x = path_floor(path_clamp(minx, 0, (float)width));
+    c->y = path_floor(path_clamp(miny, 0, (float)height));
+    x1   = path_ceil(path_clamp(maxx, 0, (float)width));
+    y1   = path_ceil(path_clamp(maxy, 0, (float)height));
+    if (x1 <= c->x || y1 <= c->y) {
+        path_flat_free(&f);
+        return 0;
+    }
+    if (path_raster(&f, c->x, c->y, x1 - c->x, y1 - c->y, &r)) {
+        path_flat_free(&f);
+        return -1;
+    }
+    path_flat_free(&f);
+    if (!(c->mask = (uint8_t *)malloc((size_t)r.w * r.h))) {
+        free(r.acc);
+        return -1;
+    }
+    c->w = r.w;
+    c->h = r.h;
+    for (y = 0; y < r.h; y++) path_coverage(&r, y, rule, c->mask + (size_t)y * r.w);
+
+    free(r.acc);
+    return 0;
+}
+
+void video_path_paint( const struct video_surface *s, const struct video_path_cover *c, uint32_t color, int mode,
+                       const struct video_rect *clip )
+{
+    const struct video_kernels  *k = video_draw_kernels();
+    const uint8_t               *cov;
+    uint32_t                    edge;
+    int                         x0, y0, x1, y1, x, e, y, cls;
+
+    x0 = c->x;
+    y0 = c->y;
+    x1 = c->x + c->w;
+    y1 = c->y + c->h;
+    if (clip) {
+        if (x0 < clip->x) x0 = clip->x;
+        if (y0 < clip->y) y0 = clip->y;
+        if (x1 > clip->x + clip->width) x1 = clip->x + clip->width;
+        if (y1 > clip->y + clip->height) y1 = clip->y + clip->height;
+    }
+    if (!c->mask || x1 <= x0 || y1 <= y0) return;
+
+    /* COPY mixes the edges in as if the color were opaque */
+    edge = (mode == VIDEO_BLEND_OVER) ? color : (color | 0xFF000000);
+    for (y = y0; y < y1; y++) {
+        cov = c->mask + (size_t)(y - c->y) * c->w + (x0 - c->x);
+        for (x = 0; x < x1 - x0; x = e) {
+            cls = path_run_class(cov[x]);
+            for (e = x + 1; e < x1 - x0 && path_run_class(cov[e]) == cls; e++);
+
+            if (cls == 2) {
+                video_span(k, s, x0 + x, y, e - x, color, mode);
+            } else if (cls == 1) {
+                k->blend_mask(video_surface_row(s, y) + x0 + x, edge, cov + x, (size_t)(e - x));
+            }
+        }
+    }
+}
+
+int video_fill_path( const struct video_surface *s, const struct video_path *p, uint32_t color, int mode, int rule ) {
+    struct video_path_cover c;
+
+    if (!s || !p) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!s->pixels || s->width <= 0 || s->height <= 0 || (mode == VIDEO_BLEND_OVER && !(color >> 24))) return 0;
+    if (video_path_cover(p, s->width, s->height, rule, &c)) return -1;
+
+    video_path_paint(s, &c, color, mode, 0);
+    free(c.mask);
+    return 0;
+}
+
+int video_path_mask( const struct video_path *p, uint8_t *mask, int w, int h, size_t stride, int rule ) {
+    struct path_raster  r;
+    struct path_flat    f;
+    int                 y;
+
+    if (w <= 0 || h <= 0) return 0;
+    if (path_flatten(p, &f)) return -1;
+    if (path_raster(&f, 0, 0, w, h, &r)) {
+        path_flat_free(&f);
+        return -1;
+    }
+    for (y = 0; y < h; y++) path_coverage(&r, y, rule, mask + (size_t)y * stride);
+
+    free(r.acc);
+    path_flat_free(&f);
+    return 0;
+}
+
+int video_stroke_path( const struct video_surface *s, const struct video_path *p, const struct video_stroke *stroke, uint32_t color, int mode ) {
+    struct video_path   *outline;
+    int                 rv;
+
+    if (!(outline = video_path_create())) return -1;
+    rv = video_path_stroke(outline, p, stroke);
+    if (!rv) rv = video_fill_path(s, outline, color, mode, VIDEO_FILL_NONZERO);
+    video_path_destroy(outline);
+    return rv;
+}
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_PATH_H_
+#define _VIDEO_PATH_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * The path rasterizer for modules that want coverage rather
+ * than pixels (glyphs for the text cache), or that rasterize
+ * once and paint in pieces (tiles of the display list).
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "video.h"
+
+/**
+ * Coverage of "p" by "rule" (VIDEO_FILL_*), 0 - 255, into the
+ * w x h bytes at "mask", rows "stride" apart.  Path
+ * coordinates are mask coordinates; every byte is written.
+ *
+ * \return ZERO, -1 with errno set if out of memory.
+ **/
+int         video_path_mask( const struct video_path *p, uint8_t *mask, int w, int h, size_t stride, int rule );
+
+/**
+ * A path's coverage over its bounding box on a surface, as
+ * video_fill_path() works it out.
+ **/
+struct video_path_cover {
+    int         x, y, w, h;             /* The box, on the surface                              */
+    uint8_t     *mask;                  /* w x h, malloc()ed, NULL if the path misses           */
+};
+
+/**
+ * Rasterizes "p" for a "width" x "height" surface.
+ *
+ * \return ZERO (free c->mask when done), -1 with errno set.
+ **/
+int         video_path_cover( const struct video_path *p, int width, int height, int rule, struct video_path_cover *c );
+
+/**
+ * Paints "c" on "s" as video_fill_path() would, only the
+ * pixels inside "clip" (NULL for all of them).  Pixels come
+ * out the same however the cover is cut up.
+ **/
+void        video_path_paint( const struct video_surface *s, const struct video_path_cover *c, uint32_t color, int mode,
+                              const struct video_rect *clip );
+
+/**
+ * Makes "dst" the same path as "src", reusing its memory.
+ *
+ * \return ZERO, -1 if out of memory.
+ **/
+int         video_path_copy( struct video_path *dst, const struct video_path *src );
+
+#endif
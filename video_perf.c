@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video_perf.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#define VPERF_LOAD( p )             __atomic_load_n((p), __ATOMIC_RELAXED)
+#define VPERF_ADD( p, x )           __atomic_fetch_add((p), (x), __ATOMIC_RELAXED)
+
+/* Indexed by VIDEO_PERF_* */
+static const uint64_t perf_config[VIDEO_PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_STALLED_CYCLES_BACKEND
+};
+
+static inline uint64_t perf_now( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Opens counter "c" for the calling thread, in "group"'s
+ * group (or as a new leader if "group" is -1).
+ *
+ * \return The fd, or -1.
+ **/
+static int perf_open( int c, int group, int kernel ) {
+    struct perf_event_attr  a;
+
+    memset(&a, 0, sizeof(a));
+    a.size              = sizeof(a);
+    a.type              = PERF_TYPE_HARDWARE;
+    a.config            = perf_config[c];
+    a.read_format       = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    a.exclude_kernel    = !kernel;
+    a.exclude_hv        = 1;
+
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * Opens a group with every counter that was available at
+ * start, for the calling thread.
+ *
+ * \return ZERO if at least one counter opened.
+ **/
+static int perf_group_open( struct video_perf_ctx *p, struct video_perf_group *g ) {
+    int     c;
+
+    g->leader   = -1;
+    g->n        = 0;
+    for (c = 0; c < VIDEO_PERF_COUNTERS; c++) {
+        g->fd[c] = -1;
+        if (!(p->available & (1u << c))) continue;
+        if ((g->fd[c] = perf_open(c, g->leader, p->kernel)) < 0) continue;
+        if (g->leader < 0) g->leader = g->fd[c];
+        g->pos[c] = g->n++;
+    }
+    return (g->leader < 0) ? -1 : 0;
+}
+
+static void perf_group_close( struct video_perf_group *g ) {
+    int     c;
+
+    for (c = 0; c < VIDEO_PERF_COUNTERS; c++) {
+        if (g->fd[c] >= 0) close(g->fd[c]);
+        g->fd[c] = -1;
+    }
+    g->leader = -1;
+}
+
+/**
+ * \return ZERO and "m" filled in, or -1 if the read failed.
+ **/
+static int perf_group_read( struct video_perf_group *g, struct video_perf_mark *m ) {
+    uint64_t    buf[3 + VIDEO_PERF_COUNTERS];
+    ssize_t     len = sizeof(uint64_t) * (3 + g->n);
+    int         c;
+
+    if (read(g->leader, buf, len) != len) return -1;
+
+    /* nr, time_enabled, time_running, values... */
+    m->enabled = buf[1];
+    m->running = buf[2];
+    for (c = 0; c < VIDEO_PERF_COUNTERS; c++) {
+        m->val[c] = (g->fd[c] >= 0) ? buf[3 + g->pos[c]] : 0;
+    }
+    return 0;
+}
+
+/**
+ * \return The calling thread's counter group, opened if this
+ * is the first time we've seen it.  NULL if the table is full
+ * or the thread can't have counters.
+ **/
+static struct video_perf_group *perf_thread_group( struct video_perf_ctx *p ) {
+    struct video_perf_group *g = 0;
+    pid_t                   tid = (pid_t)syscall(SYS_gettid);
+    int                     i;
+
+    pthread_mutex_lock(&p->mtx);
+    for (i = 0; i < p->ngroups; i++) {
+        if (p->groups[i].tid == tid) {
+            g = &p->groups[i];
+            break;
+        }
+    }
+    if (!g && p->ngroups < VIDEO_PERF_THREADS) {
+        g       = &p->groups[p->ngroups++];
+        g->tid  = tid;
+        perf_group_open(p, g);
+    }
+    pthread_mutex_unlock(&p->mtx);
+
+    return (g && g->leader >= 0) ? g : 0;
+}
+
+void video_perf_init( struct video_perf_ctx *p ) {
+    int     c,
+            fd;
+
+    memset(p, 0, sizeof(*p));
+    pthread_mutex_init(&p->mtx, 0);
+
+    /**
+     * Kernel time matters here (the VBLANK wait and page faults
+     * on video memory are in the kernel) but counting it needs
+     * perf_event_paranoid <= 1 or CAP_PERFMON.  Settle for user
+     * time without it.
+     **/
+    p->kernel = 1;
+    for (c = 0; c < VIDEO_PERF_COUNTERS; c++) {
+        fd = perf_open(c, -1, p->kernel);
+        if (fd < 0 && p->kernel && (errno == EACCES || errno == EPERM)) {
+            p->kernel = 0;
+            fd = perf_open(c, -1, p->kernel);
+        }
+        if (fd < 0) continue;
+        p->available |= 1u << c;
+        close(fd);
+    }
+
+    if (!p->available) {
+        fprintf(stderr, "libvideo/video_start(): WARNING - No hardware performance counters (%s), only timing phases.\n", strerror(errno));
+        p->kernel = 0;
+    }
+    p->enabled = 1;
+}
+
+void video_perf_close( struct video_perf_ctx *p ) {
+    int     i;
+
+    if (!p->enabled) return;
+    p->enabled = 0;
+    for (i = 0; i < p->ngroups; i++) perf_group_close(&p->groups[i]);
+    p->ngroups = 0;
+    pthread_mutex_destroy(&p->mtx);
+}
+
+void video_perf_begin( struct video_perf_ctx *p, struct video_perf_mark *m ) {
+    m->g = p->available ? perf_thread_group(p) : 0;
+    if (m->g && perf_group_read(m->g, m)) m->g = 0;
+    m->ns = perf_now();
+}
+
+void video_perf_end( struct video_perf_ctx *p, int phase, struct video_perf_mark *m ) {
+    struct video_perf_phase *ph = &p->phase[phase];
+    struct video_perf_mark  e;
+    uint64_t                d,
+                            en,
+                            run;
+    int                     c;
+
+    VPERF_ADD(&ph->time_ns, perf_now() - m->ns);
+    VPERF_ADD(&ph->calls, 1);
+
+    if (!m->g || perf_group_read(m->g, &e)) return;
+
+    /**
+     * If the PMU was shared with other groups the counters only
+     * ran part of the time, scale up to what they'd have seen.
+     **/
+    en  = e.enabled - m->enabled;
+    run = e.running - m->running;
+    for (c = 0; c < VIDEO_PERF_COUNTERS; c++) {
+        if (m->g->fd[c] < 0) continue;
+        d = e.val[c] - m->val[c];
+        if (run && run < en) d = (uint64_t)((double)d * en / run);
+        VPERF_ADD(&ph->count[c], d);
+    }
+}
+
+void video_perf_get( struct video_perf_ctx *p, struct video_perf *out ) {
+    int     i,
+            c;
+
+    memset(out, 0, sizeof(*out));
+    out->available  = p->available;
+    out->kernel     = p->kernel;
+    for (i = 0; i < VIDEO_PHASES; i++) {
+        out->phase[i].calls     = VPERF_LOAD(&p->phase[i].calls);
+        out->phase[i].time_ns   = VPERF_LOAD(&p->phase[i].time_ns);
+        for (c = 0; c < VIDEO_PERF_COUNTERS; c++) {
+            out->phase[i].count[c] = VPERF_LOAD(&p->phase[i].count[c]);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_PERF_H_
+#define _VIDEO_PERF_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Hardware counters (perf_event_open) around the phases of
+ * a present, when a display is started with perf_counters
+ * set.  Counters only count the thread that opened them, and
+ * a display's phases run on the application's threads or
+ * its presenter, so each display keeps one counter group
+ * per thread that has run a phase, opened the first time
+ * that thread shows up.
+ *
+ * Any counter the kernel or CPU won't give us is left out.
+ * With none at all, phases are still counted and timed.
+ **/
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "video.h"
+
+#define VIDEO_PERF_THREADS      4       /* Threads per display we'll open counters for */
+
+struct video_perf_group {
+    pid_t       tid;
+    int         leader,
+                fd[VIDEO_PERF_COUNTERS],    /* -1 if this counter isn't in the group       */
+                pos[VIDEO_PERF_COUNTERS];   /* Its place in a PERF_FORMAT_GROUP read       */
+    int         n;
+};
+
+struct video_perf_ctx {
+    int                     enabled;
+    unsigned                available;      /* Bit per VIDEO_PERF_* that opened at start    */
+    int                     kernel;         /* Kernel time is counted too                   */
+
+    pthread_mutex_t         mtx;            /* Guards groups/ngroups                        */
+    struct video_perf_group groups[VIDEO_PERF_THREADS];
+    int                     ngroups;
+
+    struct video_perf_phase phase[VIDEO_PHASES];
+};
+
+/* Counter values at the start of a phase */
+struct video_perf_mark {
+    struct video_perf_group *g;
+    uint64_t                ns,
+                            enabled,
+                            running,
+                            val[VIDEO_PERF_COUNTERS];
+};
+
+/**
+ * Probes which counters this machine gives us and turns
+ * profiling on.  Never fails: with no counters only calls
+ * and time are kept.
+ **/
+void        video_perf_init( struct video_perf_ctx *p );
+void        video_perf_close( struct video_perf_ctx *p );
+
+void        video_perf_begin( struct video_perf_ctx *p, struct video_perf_mark *m );
+void        video_perf_end( struct video_perf_ctx *p, int phase, struct video_perf_mark *m );
+
+void        video_perf_get( struct video_perf_ctx *p, struct video_perf *out );
+
+#define VPERF_BEGIN( p, m )         do { if ((p)->enabled) video_perf_begin((p), (m)); } while (0)
+#define VPERF_END( p, phase, m )    do { if ((p)->enabled) video_perf_end((p), (phase), (m)); } while (0)
+
+#endif
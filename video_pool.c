@@ -0,0 +1,188 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video_pool.h"
+
+#define VIDEO_HUGE_PAGE         (2UL << 20)     /* MAP_HUGETLB default size on ARM64/x86 */
+
+static size_t pool_round( size_t n, size_t to ) {
+    return (n + to - 1) & ~(to - 1);
+}
+
+/**
+ * Maps one buffer.  Huge pages are asked for first if wanted,
+ * a normal mapping (with THP advice) is the fallback.
+ *
+ * \return ZERO on success.
+ **/
+static int pool_map( struct video_pool *p, struct video_pool_buf *b ) {
+    size_t  page = (size_t)sysconf(_SC_PAGESIZE);
+    int     populate = (p->flags & VIDEO_POOL_PREFAULT) ? MAP_POPULATE : 0;
+
+    memset(b, 0, sizeof(*b));
+
+#ifdef MAP_HUGETLB
+    if (p->flags & VIDEO_POOL_HUGETLB) {
+        b->len = pool_round(p->size, VIDEO_HUGE_PAGE);
+        b->ptr = mmap(0, b->len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+        if (b->ptr != MAP_FAILED) {
+            b->huge = 1;
+        } else if (!p->warned_huge++) {
+            fprintf(stderr, "libvideo/video_buffer_acquire(): WARNING - MAP_HUGETLB failed (%s), using normal pages.\n", strerror(errno));
+        }
+    }
+#endif
+    if (!b->huge) {
+        b->len = pool_round(p->size, page);
+        b->ptr = mmap(0, b->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+        if (b->ptr == MAP_FAILED) {
+            b->ptr = 0;
+            return -1;
+        }
+#ifdef MADV_HUGEPAGE
+        if (p->flags & VIDEO_POOL_THP) madvise(b->ptr, b->len, MADV_HUGEPAGE);
+#endif
+    }
+
+    /**
+     * MAP_POPULATE on anonymous memory maps the shared zero
+     * page on some kernels, writing makes sure every page is
+     * really ours before the first frame.
+     **/
+    if (p->flags & VIDEO_POOL_PREFAULT) memset(b->ptr, 0, b->len);
+
+    if (p->flags & VIDEO_POOL_MLOCK) {
+        if (mlock(b->ptr, b->len) == 0) {
+            b->locked = 1;
+        } else if (!p->warned_lock++) {
+            fprintf(stderr, "libvideo/video_buffer_acquire(): WARNING - mlock() failed (%s), buffers may be paged out.\n", strerror(errno));
+        }
+    }
+    return 0;
+}
+
+/**
+ * Adds a buffer to the pool, lock held.
+ *
+ * \return Its index, or -1.
+ **/
+static long pool_grow( struct video_pool *p ) {
+    struct video_pool_buf   *bufs;
+    size_t                  cap;
+
+    if (p->nbufs == p->cap) {
+        cap  = p->cap ? p->cap * 2 : 4;
+        bufs = (struct video_pool_buf *)realloc(p->bufs, cap * sizeof(*bufs));
+        if (!bufs) return -1;
+        p->bufs = bufs;
+        p->cap  = cap;
+    }
+    if (pool_map(p, &p->bufs[p->nbufs])) return -1;
+    return (long)p->nbufs++;
+}
+
+int video_pool_init( struct video_pool *p, size_t size, unsigned flags, int count ) {
+    memset(p, 0, sizeof(*p));
+    pthread_mutex_init(&p->mtx, 0);
+    p->size     = size;
+    p->flags    = flags;
+
+    while (count-- > 0) {
+        if (pool_grow(p) < 0) return -1;
+    }
+    return 0;
+}
+
+void video_pool_destroy( struct video_pool *p ) {
+    size_t  i;
+
+    for (i = 0; i < p->nbufs; i++) {
+        if (p->bufs[i].locked) munlock(p->bufs[i].ptr, p->bufs[i].len);
+        munmap(p->bufs[i].ptr, p->bufs[i].len);
+    }
+    free(p->bufs);
+    pthread_mutex_destroy(&p->mtx);
+    memset(p, 0, sizeof(*p));
+}
+
+void *video_pool_acquire( struct video_pool *p ) {
+    void    *ptr = 0;
+    long    i;
+
+    pthread_mutex_lock(&p->mtx);
+    p->acquires++;
+    for (i = 0; i < (long)p->nbufs; i++) {
+        if (!p->bufs[i].in_use) break;
+    }
+    if (i == (long)p->nbufs) {
+        p->misses++;
+        i = pool_grow(p);
+    }
+    if (i >= 0) {
+        p->bufs[i].in_use = 1;
+        ptr = p->bufs[i].ptr;
+        if (++p->in_use > p->peak) p->peak = p->in_use;
+    }
+    pthread_mutex_unlock(&p->mtx);
+
+    return ptr;
+}
+
+int video_pool_release( struct video_pool *p, void *ptr ) {
+    size_t  i;
+    int     rv = -1;
+
+    pthread_mutex_lock(&p->mtx);
+    for (i = 0; i < p->nbufs; i++) {
+        if (p->bufs[i].ptr != ptr) continue;
+        if (p->bufs[i].in_use) {
+            p->bufs[i].in_use = 0;
+            p->in_use--;
+            rv = 0;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&p->mtx);
+
+    return rv;
+}
+
+void video_pool_get_stats( struct video_pool *p, struct video_pool_stats *st ) {
+    size_t  i;
+
+    memset(st, 0, sizeof(*st));
+
+    pthread_mutex_lock(&p->mtx);
+    st->buffers         = p->nbufs;
+    st->in_use          = p->in_use;
+    st->peak_in_use     = p->peak;
+    st->buffer_bytes    = p->size;
+    st->acquires        = p->acquires;
+    st->misses          = p->misses;
+    for (i = 0; i < p->nbufs; i++) {
+        st->mapped_bytes += p->bufs[i].len;
+        if (p->bufs[i].huge) st->hugetlb++;
+        if (p->bufs[i].locked) st->locked++;
+    }
+    pthread_mutex_unlock(&p->mtx);
+}
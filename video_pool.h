@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_POOL_H_
+#define _VIDEO_POOL_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Frame sized buffers that are handed out and taken back
+ * instead of allocated and freed.  Each one is its own
+ * mapping, so it's page aligned (huge page aligned with
+ * MAP_HUGETLB), can be advised/locked on its own and
+ * starts out zeroed.  The pool grows to the most buffers
+ * ever out at once and gives the memory back at
+ * video_stop().
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "video.h"
+
+struct video_pool_buf {
+    void        *ptr;
+    size_t      len;                    /* Mapped length (rounded up to the page size)  */
+    int         huge,                   /* MAP_HUGETLB backed                           */
+                locked,
+                in_use;
+};
+
+struct video_pool {
+    pthread_mutex_t         mtx;
+    size_t                  size;       /* Bytes asked for per buffer                   */
+    unsigned                flags;      /* VIDEO_POOL_*                                 */
+
+    struct video_pool_buf   *bufs;
+    size_t                  nbufs,
+                            cap,
+                            in_use,
+                            peak;
+    uint64_t                acquires,
+                            misses;
+    int                     warned_huge,/* Said once why MAP_HUGETLB failed             */
+                            warned_lock;/* Said once why mlock() failed                 */
+};
+
+/**
+ * \return ZERO on success.  The first "count" buffers are
+ * allocated (and prefaulted, locked) here.
+ **/
+int         video_pool_init( struct video_pool *p, size_t size, unsigned flags, int count );
+void        video_pool_destroy( struct video_pool *p );
+
+void        *video_pool_acquire( struct video_pool *p );
+
+/**
+ * \return ZERO, or -1 if "ptr" didn't come from this pool
+ * or is already released.
+ **/
+int         video_pool_release( struct video_pool *p, void *ptr );
+
+void        video_pool_get_stats( struct video_pool *p, struct video_pool_stats *st );
+
+#endif
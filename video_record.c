@@ -0,0 +1,613 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video_record.h"
+
+#include <endian.h>
+#include <time.h>
+
+#define VIDEO_REC_QUEUE         4               /* Frames queued if video_record_start() is given ZERO  */
+#define VIDEO_REC_MIN_RUN       2               /* Shorter repeats are cheaper as literals              */
+
+static inline uint64_t rec_now( clockid_t clk ) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void rec_put32( uint8_t *p, uint32_t x ) {
+    x = htole32(x);
+    memcpy(p, &x, 4);
+}
+
+static inline void rec_put64( uint8_t *p, uint64_t x ) {
+    x = htole64(x);
+    memcpy(p, &x, 8);
+}
+
+static inline uint32_t rec_get32( const uint8_t *p ) {
+    uint32_t x;
+    memcpy(&x, p, 4);
+    return le32toh(x);
+}
+
+static inline uint64_t rec_get64( const uint8_t *p ) {
+    uint64_t x;
+    memcpy(&x, p, 8);
+    return le64toh(x);
+}
+
+/**
+ * Most bytes a frame of "n" pixels can encode to: a literal
+ * pixel costs 4, a run (at least two pixels) a tag each side
+ * of it, which never comes to more than 5 per pixel.
+ **/
+static inline size_t rec_max_encoded( size_t n ) {
+    return n * 5 + 16;
+}
+
+static size_t rec_put_op( uint8_t *out, unsigned op, size_t count ) {
+    uint64_t    x = ((uint64_t)count << 2) | op;
+    size_t      o = 0;
+
+    while (x >= 0x80) {
+        out[o++] = (uint8_t)(x | 0x80);
+        x >>= 7;
+    }
+    out[o++] = (uint8_t)x;
+    return o;
+}
+
+static size_t rec_put_lit( uint8_t *out, const uint32_t *px, size_t count ) {
+    size_t  o = rec_put_op(out, VIDEO_REC_LIT, count),
+            i;
+
+    for (i = 0; i < count; i++, o += 4) rec_put32(out + o, px[i]);
+    return o;
+}
+
+/**
+ * Encodes "cur" against "prev" (NULL for a key frame).  At
+ * each pixel takes the longer of "same as last frame" and
+ * "same as the pixel to the left", anything else piles up
+ * as literals.
+ *
+ * \return Bytes written to "out".
+ **/
+static size_t rec_encode( const uint32_t *cur, const uint32_t *prev, size_t n, uint8_t *out ) {
+    size_t      i = 0,
+                lit = 0,
+                o = 0,
+                same,
+                run;
+    uint32_t    left;
+
+    while (i < n) {
+        same = 0;
+        if (prev) {
+            while (i + same < n && cur[i + same] == prev[i + same]) same++;
+        }
+        left = i ? cur[i - 1] : 0;
+        for (run = 0; i + run < n && cur[i + run] == left; run++);
+
+        if (same < VIDEO_REC_MIN_RUN && run < VIDEO_REC_MIN_RUN) {
+            i++;
+            continue;
+        }
+        if (i > lit) o += rec_put_lit(out + o, cur + lit, i - lit);
+        if (same >= run) {
+            o += rec_put_op(out + o, VIDEO_REC_SAME, same);
+            i += same;
+        } else {
+            o += rec_put_op(out + o, VIDEO_REC_RUN, run);
+            i += run;
+        }
+        lit = i;
+    }
+    if (i > lit) o += rec_put_lit(out + o, cur + lit, i - lit);
+    return o;
+}
+
+/**
+ * Decodes a frame over "px", which holds the frame before it.
+ *
+ * \return ZERO, or -1 if the data is damaged.
+ **/
+static int rec_decode( uint32_t *px, size_t n, const uint8_t *d, size_t len ) {
+    size_t      i = 0,
+                p = 0,
+                count,
+                k;
+    uint64_t    x;
+    uint32_t    c;
+    int         shift;
+
+    while (p < len) {
+        x = 0;
+        for (shift = 0; ; shift += 7) {
+            if (p == len || shift > 63) return -1;
+            x |= (uint64_t)(d[p] & 0x7F) << shift;
+            if (!(d[p++] & 0x80)) break;
+        }
+        count = (size_t)(x >> 2);
+        if (count > n - i) return -1;
+
+        switch (x & 3) {
+            case VIDEO_REC_SAME:
+                i += count;
+                break;
+            case VIDEO_REC_RUN:
+                c = i ? px[i - 1] : 0;
+                for (k = 0; k < count; k++) px[i++] = c;
+                break;
+            case VIDEO_REC_LIT:
+                if ((len - p) / 4 < count) return -1;
+                for (k = 0; k < count; k++, p += 4) px[i++] = rec_get32(d + p);
+                break;
+            default:
+                return -1;
+        }
+    }
+    return (i == n) ? 0 : -1;
+}
+
+static void rec_write_frame( struct video_recorder *r, struct video_rec_slot *s ) {
+    uint8_t     hdr[VIDEO_REC_FRAME_HEADER];
+    size_t      len;
+    int         key = (!r->recorded || r->since_key >= VIDEO_REC_KEY_INTERVAL);
+
+    len = rec_encode(s->px, key ? 0 : r->prev, r->px_count, r->out);
+
+    rec_put32(hdr, VIDEO_REC_FRAME);
+    rec_put32(hdr + 4, key ? VIDEO_REC_KEY : 0);
+    rec_put64(hdr + 8, s->ts);
+    rec_put32(hdr + 16, (uint32_t)len);
+
+    if (fwrite(hdr, sizeof(hdr), 1, r->f) != 1 || fwrite(r->out, len, 1, r->f) != 1) {
+        fprintf(stderr, "libvideo/video_record_start(): ERROR - Writing the recording failed (%s), recording stopped.\n", strerror(errno));
+        __atomic_store_n(&r->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    r->since_key = key ? 1 : r->since_key + 1;
+
+    __atomic_fetch_add(&r->recorded, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&r->bytes_raw, r->px_count * sizeof(uint32_t), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&r->bytes_written, sizeof(hdr) + len, __ATOMIC_RELAXED);
+}
+
+/**
+ * Fills in what a partial frame left out from the frame
+ * before it.
+ **/
+static void rec_complete( struct video_recorder *r, struct video_rec_slot *s ) {
+    const struct video_rect *c;
+    size_t                  i,
+                            off;
+    int                     y;
+
+    for (y = 0; y < r->height; y++) {
+        off = (size_t)y * r->width;
+        memcpy(r->row, r->prev + off, r->width * sizeof(uint32_t));
+        for (i = 0; i < s->nrects; i++) {
+            c = &s->rects[i];
+            if (y < c->y || y >= c->y + c->height) continue;
+            memcpy(r->row + c->x, s->px + off + c->x, c->width * sizeof(uint32_t));
+        }
+        memcpy(s->px + off, r->row, r->width * sizeof(uint32_t));
+    }
+}
+
+/**
+ * Encoder thread.  Works through the ring until it's empty,
+ * pushes what it wrote out to the file, sleeps.  The frame
+ * just encoded swaps places with "prev" so the next one is
+ * compared against it without a copy.
+ **/
+static void *rec_thread( void *arg ) {
+    struct video_recorder   *r = (struct video_recorder *)arg;
+    struct video_rec_slot   *s;
+    uint32_t                *px;
+    uint64_t                tail;
+    int                     running;
+
+    for (;;) {
+        while (sem_wait(&r->sem) != 0 && errno == EINTR);
+        running = r->running;
+
+        while ((tail = r->tail) != __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+            s = &r->slots[tail % r->nslots];
+            if (!__atomic_load_n(&r->failed, __ATOMIC_RELAXED)) {
+                if (s->partial) rec_complete(r, s);
+                rec_write_frame(r, s);
+                px      = s->px;
+                s->px   = r->prev;
+                r->prev = px;
+            }
+            __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+        }
+        fflush(r->f);
+
+        if (!running) break;
+    }
+    return 0;
+}
+
+static void rec_free( struct video_recorder *r ) {
+    size_t  i;
+
+    if (r->slots) {
+        for (i = 0; i < r->nslots; i++) {
+            free(r->slots[i].px);
+            free(r->slots[i].rects);
+        }
+    }
+    free(r->slots);
+    free(r->prev);
+    free(r->row);
+    free(r->pend);
+    free(r->pend_rects);
+    free(r->out);
+    if (r->f) fclose(r->f);
+    free(r);
+}
+
+struct video_recorder *video_recorder_start( const char *path, int width, int height, int queue ) {
+    struct video_recorder   *r;
+    uint8_t                 hdr[VIDEO_REC_HEADER];
+    size_t                  bytes,
+                            i;
+    int                     err;
+
+    if (queue <= 0) queue = VIDEO_REC_QUEUE;
+
+    if (!(r = (struct video_recorder *)calloc(1, sizeof(*r)))) return 0;
+
+    r->width    = width;
+    r->height   = height;
+    r->px_count = (size_t)width * height;
+    r->nslots   = queue;
+    bytes       = r->px_count * sizeof(uint32_t);
+
+    if (!(r->slots = (struct video_rec_slot *)calloc(r->nslots, sizeof(*r->slots))) ||
+        posix_memalign((void **)&r->prev, 64, bytes) ||
+        !(r->row = (uint32_t *)malloc(r->width * sizeof(uint32_t))) ||
+        !(r->out = (uint8_t *)malloc(rec_max_encoded(r->px_count)))) 
+    {
+        goto rs_fail;
+    }
+    for (i = 0; i < r->nslots; i++) {
+        if (posix_memalign((void **)&r->slots[i].px, 64, bytes)) goto rs_fail;
+    }
+    memset(r->prev, 0, bytes);
+
+    if (!(r->f = fopen(path, "wb"))) goto rs_fail;
+    setvbuf(r->f, 0, _IOFBF, 1 << 18);
+
+    r->start = rec_now(CLOCK_MONOTONIC);
+    rec_put32(hdr, VIDEO_REC_MAGIC);
+    rec_put32(hdr + 4, VIDEO_REC_VERSION);
+    rec_put32(hdr + 8, (uint32_t)width);
+    rec_put32(hdr + 12, (uint32_t)height);
+    rec_put64(hdr + 16, rec_now(CLOCK_REALTIME));
+    if (fwrite(hdr, sizeof(hdr), 1, r->f) != 1 || fflush(r->f)) goto rs_fail;
+
+    sem_init(&r->sem, 0, 0);
+    r->running = 1;
+    if ((err = pthread_create(&r->thread, 0, &rec_thread, r)) != 0) {
+        sem_destroy(&r->sem);
+        errno = err;
+        goto rs_fail;
+    }
+    pthread_setname_np(r->thread, "vid-record");
+    return r;
+
+    rs_fail:
+    err = errno;
+    rec_free(r);
+    errno = err;
+    return 0;
+}
+
+void video_recorder_stop( struct video_recorder *r ) {
+    struct timespec ms = { 0, 1000000 };
+    size_t          row = (size_t)r->width * sizeof(uint32_t);
+
+    /* The last frames were dropped, wait for room to get what they showed in */
+    if ((r->pend_whole || r->npend) && !__atomic_load_n(&r->failed, __ATOMIC_RELAXED)) {
+        while (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->nslots) nanosleep(&ms, 0);
+        video_recorder_frame(r, r->pend, row, r->pend_whole ? 0 : r->pend_rects, r->npend);
+    }
+
+    r->running = 0;
+    sem_post(&r->sem);
+    pthread_join(r->thread, 0);
+    sem_destroy(&r->sem);
+    rec_free(r);
+}
+
+/**
+ * Copies the areas "rects" of "src" into "dst", a whole
+ * frame.  NULL "rects" is all of it.
+ **/
+static void rec_copy( struct video_recorder *r, uint32_t *dst, const void *src, size_t stride,
+                      const struct video_rect *rects, size_t n )
+{
+    const uint8_t   *p = (const uint8_t *)src;
+    size_t          row = (size_t)r->width * sizeof(uint32_t),
+                    i;
+    int             y;
+
+    if (!rects) {
+        if (stride == row) {
+            memcpy(dst, p, row * r->height);
+            return;
+        }
+        for (y = 0; y < r->height; y++) memcpy(dst + (size_t)y * r->width, p + (size_t)y * stride, row);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        for (y = rects[i].y; y < rects[i].y + rects[i].height; y++) {
+            memcpy(dst + (size_t)y * r->width + rects[i].x, p + (size_t)y * stride + rects[i].x * sizeof(uint32_t),
+                   rects[i].width * sizeof(uint32_t));
+        }
+    }
+}
+
+/**
+ * Adds "n" rectangles to a list.
+ *
+ * \return ZERO, -1 if out of memory.
+ **/
+static int rec_add_rects( struct video_rect **list, size_t *count, size_t *cap,
+                          const struct video_rect *rects, size_t n )
+{
+    struct video_rect   *l;
+    size_t              want = *cap ? *cap : 16;
+
+    while (want < *count + n) want *= 2;
+    if (want > *cap) {
+        if (!(l = (struct video_rect *)realloc(*list, want * sizeof(*l)))) return -1;
+        *list   = l;
+        *cap    = want;
+    }
+    memcpy(*list + *count, rects, n * sizeof(*rects));
+    *count += n;
+    return 0;
+}
+
+static void rec_oom( struct video_recorder *r ) {
+    fprintf(stderr, "libvideo/video_record_start(): ERROR - Out of memory, recording stopped.\n");
+    __atomic_store_n(&r->failed, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * No room for the frame: keep what it put on the screen for
+ * the next one.
+ **/
+static void rec_drop( struct video_recorder *r, const void *pixels, size_t stride,
+                      const struct video_rect *rects, size_t n )
+{
+    __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+
+    if (!r->pend && posix_memalign((void **)&r->pend, 64, r->px_count * sizeof(uint32_t))) {
+        r->pend = 0;
+        rec_oom(r);
+        return;
+    }
+    rec_copy(r, r->pend, pixels, stride, rects, n);
+    if (!rects) {
+        r->pend_whole   = 1;
+        r->npend        = 0;
+    } else if (!r->pend_whole && rec_add_rects(&r->pend_rects, &r->npend, &r->pend_cap, rects, n)) {
+        rec_oom(r);
+    }
+}
+
+void video_recorder_frame( struct video_recorder *r, const void *pixels, size_t stride,
+                           const struct video_rect *rects, size_t n )
+{
+    struct video_rec_slot   *s;
+    uint64_t                head = r->head;
+
+    if (__atomic_load_n(&r->failed, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->nslots) {
+        rec_drop(r, pixels, stride, rects, n);
+        return;
+    }
+
+    s           = &r->slots[head % r->nslots];
+    s->partial  = 0;
+    s->nrects   = 0;
+    if (rects && r->pend_whole) {
+        rec_copy(r, s->px, r->pend, (size_t)r->width * sizeof(uint32_t), 0, 0);
+    } else if (rects) {
+        s->partial = 1;
+        if (r->npend) {
+            rec_copy(r, s->px, r->pend, (size_t)r->width * sizeof(uint32_t), r->pend_rects, r->npend);
+            if (rec_add_rects(&s->rects, &s->nrects, &s->cap, r->pend_rects, r->npend)) goto rf_oom;
+        }
+        if (rec_add_rects(&s->rects, &s->nrects, &s->cap, rects, n)) goto rf_oom;
+    }
+    rec_copy(r, s->px, pixels, stride, rects, n);
+    r->pend_whole   = 0;
+    r->npend        = 0;
+
+    s->ts = rec_now(CLOCK_MONOTONIC) - r->start;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    sem_post(&r->sem);
+    return;
+
+    rf_oom:
+    __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+    rec_oom(r);
+}
+
+void video_recorder_get_stats( struct video_recorder *r, struct video_record_stats *st ) {
+    st->frames_recorded = __atomic_load_n(&r->recorded, __ATOMIC_RELAXED);
+    st->frames_dropped  = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    st->bytes_raw       = __atomic_load_n(&r->bytes_raw, __ATOMIC_RELAXED);
+    st->bytes_written   = __atomic_load_n(&r->bytes_written, __ATOMIC_RELAXED);
+}
+
+/**
+ * Reads and checks a recording's header.
+ *
+ * \return ZERO, or -1 with errno set.
+ **/
+static int rec_read_header( FILE *f, struct video_record_info *info ) {
+    uint8_t     hdr[VIDEO_REC_HEADER];
+
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 ||
+        rec_get32(hdr) != VIDEO_REC_MAGIC || 
+        rec_get32(hdr + 4) != VIDEO_REC_VERSION) 
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(info, 0, sizeof(*info));
+    info->width     = (int)rec_get32(hdr + 8);
+    info->height    = (int)rec_get32(hdr + 12);
+    info->start_ns  = rec_get64(hdr + 16);
+    if (info->width <= 0 || info->height <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Reads the header of the next frame.
+ *
+ * \return ONE if there is one, ZERO at the end of the file
+ * (or where it was cut short).
+ **/
+static int rec_next_frame( FILE *f, uint64_t *ts, uint32_t *len ) {
+    uint8_t     hdr[VIDEO_REC_FRAME_HEADER];
+
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 || rec_get32(hdr) != VIDEO_REC_FRAME) return 0;
+    *ts     = rec_get64(hdr + 8);
+    *len    = rec_get32(hdr + 16);
+    return 1;
+}
+
+int video_record_info( const char *path, struct video_record_info *info ) {
+    struct stat sb;
+    FILE        *f;
+    uint64_t    ts;
+    uint32_t    len;
+
+    if (!path || !info) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(f = fopen(path, "rb"))) return -1;
+    if (rec_read_header(f, info)) {
+        fclose(f);
+        return -1;
+    }
+    info->bytes = VIDEO_REC_HEADER;
+    if (fstat(fileno(f), &sb)) sb.st_size = 0;
+
+    /* Seeking past the end works, so check the frame is all there */
+    while (rec_next_frame(f, &ts, &len) && 
+           info->bytes + VIDEO_REC_FRAME_HEADER + len <= (uint64_t)sb.st_size &&
+           fseeko(f, len, SEEK_CUR) == 0) 
+    {
+        info->frames++;
+        info->duration_ns   = ts;
+        info->bytes        += VIDEO_REC_FRAME_HEADER + len;
+    }
+    fclose(f);
+    return 0;
+}
+
+ssize_t video_replay( VIDEO v, const char *path ) {
+    struct video_record_info    info;
+    struct timespec             at;
+    FILE                        *f;
+    uint32_t                    *px = 0;
+    uint8_t                     *data = 0;
+    uint64_t                    ts,
+                                base = 0,
+                                t;
+    uint32_t                    len;
+    size_t                      n;
+    ssize_t                     frames = 0;
+    int                         err = 0;
+
+    if (!path || !video_is_active(v)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(f = fopen(path, "rb"))) return -1;
+    if (rec_read_header(f, &info)) {
+        fprintf(stderr, "libvideo/video_replay(): ERROR - %s isn't a recording.\n", path);
+        err = EINVAL;
+        goto rp_done;
+    }
+    if (info.width != video_get_width(v) || info.height != video_get_height(v)) {
+        fprintf(stderr, "libvideo/video_replay(): ERROR - Recorded at %dx%d, the display is %dx%d.\n",
+                info.width, info.height, video_get_width(v), video_get_height(v));
+        err = EINVAL;
+        goto rp_done;
+    }
+
+    n = (size_t)info.width * info.height;
+    if (!(px = (uint32_t *)video_buffer_acquire(v)) || !(data = (uint8_t *)malloc(rec_max_encoded(n)))) {
+        err = ENOMEM;
+        goto rp_done;
+    }
+
+    /**
+     * The first frame goes up right away, every one after it 
+     * as long after the first as it was when recorded.
+     **/
+    while (rec_next_frame(f, &ts, &len)) {
+        if (len > rec_max_encoded(n) || fread(data, len, 1, f) != 1) break;
+        if (rec_decode(px, n, data, len)) {
+            fprintf(stderr, "libvideo/video_replay(): ERROR - Frame %zd of %s is damaged.\n", frames, path);
+            break;
+        }
+        if (!frames) base = rec_now(CLOCK_MONOTONIC) - ts;
+
+        t           = base + ts;
+        at.tv_sec   = t / 1000000000ULL;
+        at.tv_nsec  = t % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, 0) == EINTR);
+
+        video_submit_frame(v, px);
+        frames++;
+    }
+
+    rp_done:
+    if (px) video_buffer_release(v, px);
+    free(data);
+    fclose(f);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return frames;
+}
@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_RECORD_H_
+#define _VIDEO_RECORD_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Frame recorder.  The present path copies each frame into
+ * a free slot of a small ring and moves on; a thread of the
+ * recorder's own compresses the frames and writes them out.
+ * If the ring is full the frame is dropped (and counted),
+ * presenting never waits on the encoder or the disk; what it
+ * put on the screen goes in with the next frame queued.
+ * Region presents only copy their regions, the encoder fills
+ * in the rest from the frame before, so a recording shows
+ * what reached the screen and not the whole buffer.
+ *
+ * The file is a stream of frames, each one compressed against
+ * the one before it, so a recording cut short (power pulled)
+ * still plays back up to the last whole frame.  All numbers
+ * in it are little endian.
+ *
+ *   header     "VREC" version width height start_ns (u32 x4, u64)
+ *   frame      "VFRM" flags ts_ns size (u32 x2, u64, u32) data
+ *
+ * ts_ns is CLOCK_MONOTONIC from the start of the recording,
+ * start_ns CLOCK_REALTIME when it started.  flags has
+ * VIDEO_REC_KEY set for frames that don't depend on the one
+ * before.
+ *
+ * Frame data is a run of ops over the frame's 32 bit pixels,
+ * each a LEB128 varint (count << 2 | op):
+ *
+ *   VIDEO_REC_SAME     count pixels as in the frame before
+ *   VIDEO_REC_RUN      count copies of the pixel before this one
+ *                      (ZERO at the top left)
+ *   VIDEO_REC_LIT      count pixels follow, 4 bytes each
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "video.h"
+
+#define VIDEO_REC_MAGIC         0x43455256u     /* "VREC"   */
+#define VIDEO_REC_FRAME         0x4D524656u     /* "VFRM"   */
+#define VIDEO_REC_VERSION       1
+
+#define VIDEO_REC_HEADER        24              /* Bytes in the file header     */
+#define VIDEO_REC_FRAME_HEADER  20              /* Bytes before each frame's data */
+
+#define VIDEO_REC_KEY           0x01
+
+#define VIDEO_REC_SAME          0
+#define VIDEO_REC_RUN           1
+#define VIDEO_REC_LIT           2
+
+#define VIDEO_REC_KEY_INTERVAL  300             /* Key frame at least this often, so a damaged file recovers */
+
+/**
+ * A queued frame.  A partial one only has the pixels inside
+ * "rects" filled in, the encoder takes the rest from the
+ * frame before it.
+ **/
+struct video_rec_slot {
+    uint32_t            *px;
+    uint64_t            ts;
+    int                 partial;
+    struct video_rect   *rects;
+    size_t              nrects,
+                        cap;
+};
+
+struct video_recorder {
+    FILE                *f;
+    int                 width,
+                        height;
+    size_t              px_count;
+    uint64_t            start;                  /* CLOCK_MONOTONIC when recording started               */
+
+    /**
+     * Ring of frames waiting to be encoded.  "head" is only
+     * written by whoever is presenting (under the display's
+     * lock), "tail" only by the encoder thread.
+     **/ 
+    struct video_rec_slot 
+                        *slots;
+    size_t              nslots;
+    uint64_t            head,
+                        tail;
+    sem_t               sem;
+    pthread_t           thread;
+    volatile int        running;
+
+    uint32_t            *prev;                  /* Last frame encoded, what the next one is a delta of  */
+    uint32_t            *row;                   /* Encoder: one row, putting partial frames together    */
+    uint8_t             *out;                   /* One encoded frame, worst case sized                  */
+
+    /**
+     * What dropped frames put on the screen, carried into the
+     * next frame queued so the recording doesn't lose it.
+     * Presenting side only.
+     **/ 
+    uint32_t            *pend;
+    int                 pend_whole;             /* All of pend, not just pend_rects                     */
+    struct video_rect   *pend_rects;
+    size_t              npend,
+                        pend_cap;
+    uint64_t            since_key;
+    int                 failed;                 /* Write error, the rest is dropped                     */
+
+    uint64_t            recorded,
+                        dropped,
+                        bytes_raw,
+                        bytes_written;
+};
+
+/**
+ * Opens "path" and starts the encoder thread.
+ *
+ * \return The recorder, or NULL with errno set.
+ **/
+struct video_recorder *video_recorder_start( const char *path, int width, int height, int queue );
+
+/**
+ * Flushes what's queued, stops the thread and closes the file.
+ **/
+void        video_recorder_stop( struct video_recorder *r );
+
+/**
+ * Queues a frame, rows "stride" bytes apart.  If "rects"
+ * isn't NULL only those "n" areas (clipped to the frame)
+ * were put on the screen, the rest of it is as before.
+ * Never blocks, if every slot is taken the frame is dropped
+ * (what it changed goes in the next one).  One caller at a
+ * time.
+ **/
+void        video_recorder_frame( struct video_recorder *r, const void *pixels, size_t stride,
+                                  const struct video_rect *rects, size_t n );
+
+void        video_recorder_get_stats( struct video_recorder *r, struct video_record_stats *st );
+
+#endif
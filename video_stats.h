@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_STATS_H_
+#define _VIDEO_STATS_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Frame timing counters kept per display.  Samples are
+ * written by whoever holds the display's prerender lock,
+ * so there's one writer at a time, but video_get_stats()
+ * can read from any thread.  Every field is read and
+ * written with relaxed atomics so a reader never sees a
+ * torn 64 bit value; it may see a sample half recorded
+ * (count bumped, total not yet), which is fine for stats.
+ *
+ * Build with -DVIDEO_NO_STATS (make STATS=0) and the
+ * VSTAT_*() macros compile to nothing.
+ **/
+
+#include <stdint.h>
+#include <time.h>
+
+#include "video.h"
+
+#ifndef VIDEO_NO_STATS
+
+struct video_stat_acc {
+    uint64_t    count,
+                total_ns,
+                min_ns,
+                max_ns,
+                last_ns,
+                hist[VIDEO_STATS_BUCKETS];
+};
+
+struct video_stats_acc {
+    uint64_t    frames_presented,
+                frames_replaced,
+                frames_unchanged,
+                vblanks_missed,
+                bytes_written,
+                refresh_ns,
+                last_present;               /* CLOCK_MONOTONIC of the last present, 0 = none yet */
+
+    struct video_stat_acc
+                vsync_wait,
+                copy,
+                lock_wait,
+                interval;
+};
+
+#define VSTAT_LOAD( p )             __atomic_load_n((p), __ATOMIC_RELAXED)
+#define VSTAT_STORE( p, x )         __atomic_store_n((p), (x), __ATOMIC_RELAXED)
+#define VSTAT_ADD( p, x )           __atomic_fetch_add((p), (x), __ATOMIC_RELAXED)
+
+static inline uint64_t video_stats_now( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Bucket i holds samples from 2^i up to 2^(i+1) microseconds,
+ * bucket 0 also takes anything under a microsecond and the
+ * last one anything too long for the others.
+ **/
+static inline int video_stats_bucket( uint64_t ns ) {
+    uint64_t    us = ns / 1000;
+    int         b = 0;
+
+    while (us > 1 && b < VIDEO_STATS_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static inline void video_stat_record( struct video_stat_acc *s, uint64_t ns ) {
+    uint64_t    n = VSTAT_LOAD(&s->count);
+
+    if (!n || ns < VSTAT_LOAD(&s->min_ns)) VSTAT_STORE(&s->min_ns, ns);
+    if (ns > VSTAT_LOAD(&s->max_ns)) VSTAT_STORE(&s->max_ns, ns);
+    VSTAT_STORE(&s->last_ns, ns);
+    VSTAT_ADD(&s->total_ns, ns);
+    VSTAT_ADD(&s->hist[video_stats_bucket(ns)], 1);
+    VSTAT_ADD(&s->count, 1);
+}
+
+/**
+ * A frame reached the screen at "now".  Anything longer than
+ * one and a half refreshes since the last one means we missed
+ * at least one VBLANK.
+ **/
+static inline void video_stats_presented( struct video_stats_acc *st, uint64_t now, size_t bytes ) {
+    uint64_t    last    = VSTAT_LOAD(&st->last_present),
+                period  = VSTAT_LOAD(&st->refresh_ns),
+                dt;
+
+    if (last) {
+        dt = now - last;
+        video_stat_record(&st->interval, dt);
+        if (period && dt > period + period / 2) {
+            VSTAT_ADD(&st->vblanks_missed, (dt + period / 2) / period - 1);
+        }
+    }
+    VSTAT_STORE(&st->last_present, now);
+    VSTAT_ADD(&st->frames_presented, 1);
+    VSTAT_ADD(&st->bytes_written, bytes);
+}
+
+#define VSTAT_CLOCK( t )                    ((t) = video_stats_now())
+#define VSTAT_RECORD( st, field, ns )       video_stat_record(&(st)->field, (ns))
+#define VSTAT_COUNT( st, field, n )         VSTAT_ADD(&(st)->field, (n))
+#define VSTAT_PRESENTED( st, bytes )        video_stats_presented((st), video_stats_now(), (bytes))
+
+#else
+
+#define VSTAT_CLOCK( t )                    ((t) = 0)
+#define VSTAT_RECORD( st, field, ns )       ((void)(ns))
+#define VSTAT_COUNT( st, field, n )         ((void)0)
+#define VSTAT_PRESENTED( st, bytes )        ((void)(bytes))
+
+#endif
+
+#endif
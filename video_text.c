@@ -0,0 +1,1343 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#include "video.h"
+#include "video_draw.h"
+#include "video_path.h"
+#include "video_text.h"
+
+/**
+ * Text.  Fonts are TrueType (outlines: the glyf table, with
+ * cmap, hmtx and kern) or PSF console fonts (bitmaps).  Each
+ * glyph is rasterized once, at a given size, into an 8 bit
+ * coverage atlas and drawn from there with the mask blend.
+ *
+ * The atlas is split into pages, each packed in shelves (rows
+ * as tall as the glyphs that opened them).  Glyphs can't be
+ * taken out of a shelf one by one, so when every page is full
+ * the least recently used page is emptied as a whole and its
+ * glyphs forgotten.  The budget is a number of pages.
+ **/
+
+#define TEXT_PAGE               256             /* Atlas pages are TEXT_PAGE x TEXT_PAGE bytes          */
+#define TEXT_PAGE_BYTES         (TEXT_PAGE * TEXT_PAGE)
+#define TEXT_MAX_SIZE           1024            /* Largest size in pixels a font is drawn at            */
+#define TEXT_MAX_DEPTH          8               /* Nested composite glyphs                              */
+#define TEXT_MAX_PARTS          64              /* Glyphs making up one composite, all levels           */
+#define TEXT_MAX_GLYPH          (4 * TEXT_MAX_SIZE) /* Bigger bitmaps or bearings are a broken font     */
+
+#define FONT_TTF                1
+#define FONT_PSF                2
+
+struct video_font {
+    uint32_t        id;                 /* Never reused, glyphs are cached under it             */
+    int             type;
+    uint8_t         *data;
+    size_t          len;
+
+    /* TrueType: table offsets into "data" */
+    size_t          glyf,
+                    glyf_len,
+                    loca,
+                    hmtx,
+                    cmap,               /* The subtable used                                    */
+                    kern;               /* First pair of a format 0 subtable, ZERO for none     */
+    uint32_t        kern_pairs;
+    int             cmap_format,
+                    loca_long,
+                    units_per_em,
+                    num_glyphs,
+                    num_hmetrics,
+                    ascent,
+                    descent,
+                    line_gap;
+
+    /* PSF */
+    size_t          psf_glyphs,         /* Offset of the first bitmap                           */
+                    psf_charsize;
+    int             psf_width,
+                    psf_height,
+                    psf_count;
+    uint32_t        *psf_map;           /* (codepoint, glyph) pairs by codepoint, NULL if none  */
+    size_t          psf_nmap;
+};
+
+struct text_glyph {
+    uint32_t        face,
+                    cp,
+                    gid;
+    int32_t         next,               /* Hash chain                                           */
+                    page_next;          /* Glyphs on the same page                              */
+    int32_t         adv;                /* 26.6 pixels                                          */
+    uint16_t        size,
+                    x, y, w, h;         /* In the page                                          */
+    int32_t         bx, by;             /* Bitmap's top left from the pen on the baseline       */
+    int16_t         page;               /* -1 no bitmap (a space), -2 a free entry              */
+};
+
+struct text_shelf {
+    uint16_t        y,
+                    h,
+                    x;                  /* Used so far                                          */
+};
+
+struct text_page {
+    uint8_t             *px;            /* NULL until first needed                              */
+    uint64_t            stamp;          /* Last used                                            */
+    int32_t             first;          /* Glyph list                                           */
+    int                 nshelves,
+                        bottom;         /* Below the last shelf                                 */
+    struct text_shelf   shelves[TEXT_PAGE];
+};
+
+/**
+ * Hits only read the tables, so draws share the lock and a
+ * glyph's bitmap can't be evicted while one is blending it.
+ * Its LRU stamp and the hit count are bumped with relaxed
+ * atomics.  A miss drops the lock and takes it exclusive.
+ **/
+struct video_glyph_cache {
+    pthread_rwlock_t    lock;           /* Drawing holds it shared, rasterizing exclusive       */
+    struct text_page    *pages;
+    int                 npages;
+    uint64_t            clock;
+
+    struct text_glyph   *glyphs;
+    int32_t             *buckets,
+                        free_glyph;
+    size_t              nglyphs,        /* In use                                               */
+                        cglyphs,        /* Allocated                                            */
+                        nbuckets;
+
+    struct video_path   *outline;       /* Scratch for rasterizing                              */
+
+    uint64_t            hits,
+                        misses,
+                        evictions,
+                        uncached;
+};
+
+static uint32_t         font_ids;
+
+/*****************************************************************************
+ * Reading fonts
+ *****************************************************************************/
+
+/* Big endian reads that come back ZERO past the end of the file */
+static inline uint32_t font_u8( const struct video_font *f, size_t off ) {
+    return (off < f->len) ? f->data[off] : 0;
+}
+
+static inline uint32_t font_u16( const struct video_font *f, size_t off ) {
+    return (off + 2 <= f->len && off + 2 > off) ? ((uint32_t)f->data[off] << 8) | f->data[off + 1] : 0;
+}
+
+static inline int32_t font_i16( const struct video_font *f, size_t off ) {
+    return (int16_t)font_u16(f, off);
+}
+
+static inline uint32_t font_u32( const struct video_font *f, size_t off ) {
+    return (font_u16(f, off) << 16) | font_u16(f, off + 2);
+}
+
+/**
+ * \return The table's offset (length in *len), ZERO if it
+ * isn't there or runs past the end of the file.
+ **/
+static size_t ttf_table( const struct video_font *f, size_t base, const char *tag, size_t *len ) {
+    uint32_t    n = font_u16(f, base + 4),
+                i;
+    size_t      rec, off, l;
+
+    for (i = 0; i < n; i++) {
+        rec = base + 12 + 16 * (size_t)i;
+        if (rec + 16 > f->len || memcmp(f->data + rec, tag, 4)) continue;
+        off = font_u32(f, rec + 8);
+        l   = font_u32(f, rec + 12);
+        if (!off || off > f->len || l > f->len - off) return 0;
+        if (len) *len = l;
+        return off;
+    }
+    return 0;
+}
+
+/**
+ * Picks a Unicode cmap subtable: a full one (format 12) over
+ * one for the BMP (format 4).
+ **/
+static void ttf_pick_cmap( struct video_font *f, size_t cmap ) {
+    uint32_t    n = font_u16(f, cmap + 2),
+                i, plat, enc, fmt;
+    size_t      sub;
+    int         best = 0, score;
+
+    for (i = 0; i < n; i++) {
+        plat    = font_u16(f, cmap + 4 + 8 * i);
+        enc     = font_u16(f, cmap + 4 + 8 * i + 2);
+        sub     = cmap + font_u32(f, cmap + 4 + 8 * i + 4);
+        fmt     = font_u16(f, sub);
+        score   = 0;
+        if (plat == 0 || (plat == 3 && (enc == 1 || enc == 10))) {
+            if (fmt == 12) score = 2;
+            else if (fmt == 4) score = 1;
+        }
+        if (score > best) {
+            best            = score;
+            f->cmap         = sub;
+            f->cmap_format  = (int)fmt;
+        }
+    }
+}
+
+/* First format 0 horizontal kerning subtable of a version 0 kern table */
+static void ttf_pick_kern( struct video_font *f, size_t kern ) {
+    uint32_t    n = font_u16(f, kern + 2),
+                i, cov;
+    size_t      sub = kern + 4;
+
+    if (font_u16(f, kern)) return;
+    for (i = 0; i < n && sub < f->len; i++) {
+        cov = font_u16(f, sub + 4);
+        if ((cov >> 8) == 0 && (cov & 0x7) == 1) {
+            f->kern         = sub + 14;
+            f->kern_pairs   = font_u16(f, sub + 6);
+            return;
+        }
+        sub += font_u16(f, sub + 2);
+    }
+}
+
+static int ttf_init( struct video_font *f ) {
+    size_t  base = 0,
+            head, maxp, hhea, cmap, kern, len;
+
+    if (!memcmp(f->data, "ttcf", 4)) base = font_u32(f, 12);         /* First font of a collection */
+
+    head    = ttf_table(f, base, "head", 0);
+    maxp    = ttf_table(f, base, "maxp", 0);
+    hhea    = ttf_table(f, base, "hhea", 0);
+    cmap    = ttf_table(f, base, "cmap", 0);
+    f->loca = ttf_table(f, base, "loca", 0);
+    f->hmtx = ttf_table(f, base, "hmtx", 0);
+    f->glyf = ttf_table(f, base, "glyf", &len);
+    if (!head || !maxp || !hhea || !cmap || !f->loca || !f->hmtx || !f->glyf) return -1;
+
+    f->glyf_len     = len;
+    f->units_per_em = (int)font_u16(f, head + 18);
+    f->loca_long    = font_i16(f, head + 50) != 0;
+    f->num_glyphs   = (int)font_u16(f, maxp + 4);
+    f->ascent       = font_i16(f, hhea + 4);
+    f->descent      = font_i16(f, hhea + 6);
+    f->line_gap     = font_i16(f, hhea + 8);
+    f->num_hmetrics = (int)font_u16(f, hhea + 34);
+    if (f->units_per_em < 16 || f->units_per_em > 16384 || !f->num_glyphs || !f->num_hmetrics) return -1;
+
+    ttf_pick_cmap(f, cmap);
+    if (!f->cmap) return -1;
+    if ((kern = ttf_table(f, base, "kern", 0))) ttf_pick_kern(f, kern);
+    return 0;
+}
+
+static uint32_t ttf_glyph_index( const struct video_font *f, uint32_t cp ) {
+    size_t      t = f->cmap,
+                ends, starts, deltas, ranges, g;
+    uint32_t    segs, lo, hi, mid, start, ro, gid;
+
+    if (f->cmap_format == 12) {
+        lo = 0;
+        hi = font_u32(f, t + 12);
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            g   = t + 16 + 12 * (size_t)mid;
+            if (cp < font_u32(f, g)) {
+                hi = mid;
+            } else if (cp > font_u32(f, g + 4)) {
+                lo = mid + 1;
+            } else {
+                return font_u32(f, g + 8) + (cp - font_u32(f, g));
+            }
+        }
+        return 0;
+    }
+
+    if (cp > 0xFFFF) return 0;
+    segs    = font_u16(f, t + 6) / 2;
+    ends    = t + 14;
+    starts  = ends + 2 * (size_t)segs + 2;
+    deltas  = starts + 2 * (size_t)segs;
+    ranges  = deltas + 2 * (size_t)segs;
+
+    /* First segment that ends at or after cp */
+    lo = 0;
+    hi = segs;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (font_u16(f, ends + 2 * (size_t)mid) < cp) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == segs || (start = font_u16(f, starts + 2 * (size_t)lo)) > cp) return 0;
+
+    ro = font_u16(f, ranges + 2 * (size_t)lo);
+    if (!ro) return (cp + font_u16(f, deltas + 2 * (size_t)lo)) & 0xFFFF;
+    gid = font_u16(f, ranges + 2 * (size_t)lo + ro + 2 * (size_t)(cp - start));
+    return gid ? (gid + font_u16(f, deltas + 2 * (size_t)lo)) & 0xFFFF : 0;
+}
+
+/* Font units */
+static int32_t ttf_kern( const struct video_font *f, uint32_t left, uint32_t right ) {
+    uint32_t    key = (left << 16) | right,
+                lo = 0,
+                hi = f->kern_pairs,
+                mid, k;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        k   = font_u32(f, f->kern + 6 * (size_t)mid);
+        if (k < key) lo = mid + 1;
+        else if (k > key) hi = mid;
+        else return font_i16(f, f->kern + 6 * (size_t)mid + 4);
+    }
+    return 0;
+}
+
+/**
+ * Where glyph "gid" is in the glyf table.
+ *
+ * \return Its offset, ZERO if it has no outline.
+ **/
+static size_t ttf_glyph( const struct video_font *f, uint32_t gid, size_t *len ) {
+    size_t  a, b;
+
+    if (gid >= (uint32_t)f->num_glyphs) return 0;
+    if (f->loca_long) {
+        a = font_u32(f, f->loca + 4 * (size_t)gid);
+        b = font_u32(f, f->loca + 4 * (size_t)gid + 4);
+    } else {
+        a = 2 * (size_t)font_u16(f, f->loca + 2 * (size_t)gid);
+        b = 2 * (size_t)font_u16(f, f->loca + 2 * (size_t)gid + 2);
+    }
+    if (b <= a || b > f->glyf_len || b - a < 10) return 0;
+    *len = b - a;
+    return f->glyf + a;
+}
+
+/**
+ * Adds glyph "gid" to "p" through "m" (font units to pixels,
+ * X = m[0] x + m[1] y + m[2], Y = m[3] x + m[4] y + m[5]).
+ * Off-curve points are quadratic control points, with an
+ * on-curve point implied halfway between two of them.
+ **/
+static int ttf_outline( const struct video_font *f, uint32_t gid, const float *m, struct video_path *p, int depth, int *parts ) {
+    size_t      g, len, q, end;
+    uint32_t    ncont, npts, i, j, c, first, last, flags, gi, n, rep;
+    int32_t     x, y, dx, dy;
+    uint8_t     *fl = 0;
+    float       *pt = 0,
+                cm[6], a, b, cc, d, e, ff,
+                sx, sy, cx, cy, px, py;
+    int         have_ctrl, rv = -1, k;
+
+    if (!(g = ttf_glyph(f, gid, &len))) return 0;
+    end   = g + len;
+    ncont = (uint32_t)font_i16(f, g);
+
+    if ((int32_t)ncont < 0) {
+        /* Composite: other glyphs, each moved (and maybe scaled) */
+        if (depth >= TEXT_MAX_DEPTH) return 0;
+        q = g + 10;
+        do {
+            if (q + 4 > end) break;
+            flags   = font_u16(f, q);
+            gi      = font_u16(f, q + 2);
+            q      += 4;
+            if (flags & 1) {
+                dx = font_i16(f, q);
+                dy = font_i16(f, q + 2);
+                q += 4;
+            } else {
+                dx = (int8_t)font_u8(f, q);
+                dy = (int8_t)font_u8(f, q + 1);
+                q += 2;
+            }
+            if (!(flags & 2)) dx = dy = 0;              /* Anchored by point numbers: not supported */
+
+            a = d = 1;
+            b = cc = 0;
+            if (flags & 0x8) {
+                a = d = font_i16(f, q) / 16384.0f;
+                q += 2;
+            } else if (flags & 0x40) {
+                a = font_i16(f, q) / 16384.0f;
+                d = font_i16(f, q + 2) / 16384.0f;
+                q += 4;
+            } else if (flags & 0x80) {
+                a  = font_i16(f, q) / 16384.0f;
+                b  = font_i16(f, q + 2) / 16384.0f;
+                cc = font_i16(f, q + 4) / 16384.0f;
+                d  = font_i16(f, q + 6) / 16384.0f;
+                q += 8;
+            }
+
+            /* m after the component's x' = a x + cc y + dx, y' = b x + d y + dy */
+            e     = (float)dx;
+            ff    = (float)dy;
+            cm[0] = m[0] * a + m[1] * b;
+            cm[1] = m[0] * cc + m[1] * d;
+            cm[2] = m[0] * e + m[1] * ff + m[2];
+            cm[3] = m[3] * a + m[4] * b;
+            cm[4] = m[3] * cc + m[4] * d;
+            cm[5] = m[3] * e + m[4] * ff + m[5];
+            if (++*parts > TEXT_MAX_PARTS) return 0;
+            if (ttf_outline(f, gi, cm, p, depth + 1, parts)) return -1;
+        } while (flags & 0x20);
+        return 0;
+    }
+
+    if (!ncont) return 0;
+    npts = font_u16(f, g + 10 + 2 * (size_t)(ncont - 1)) + 1;
+    q    = g + 10 + 2 * (size_t)ncont;
+    q   += 2 + font_u16(f, q);
+    if (q > end) return 0;
+
+    fl = (uint8_t *)malloc(npts);
+    pt = (float *)malloc(npts * 2 * sizeof(float));
+    if (!fl || !pt) goto done;
+
+    for (i = 0; i < npts;) {
+        flags   = font_u8(f, q++);
+        rep     = (flags & 8) ? font_u8(f, q++) : 0;
+        for (n = 0; n <= rep && i < npts; n++) fl[i++] = (uint8_t)flags;
+    }
+    for (i = 0, x = 0; i < npts; i++) {
+        if (fl[i] & 2) {
+            x += (fl[i] & 16) ? (int32_t)font_u8(f, q) : -(int32_t)font_u8(f, q);
+            q += 1;
+        } else if (!(fl[i] & 16)) {
+            x += font_i16(f, q);
+            q += 2;
+        }
+        pt[2 * i] = (float)x;
+    }
+    for (i = 0, y = 0; i < npts; i++) {
+        if (fl[i] & 4) {
+            y += (fl[i] & 32) ? (int32_t)font_u8(f, q) : -(int32_t)font_u8(f, q);
+            q += 1;
+        } else if (!(fl[i] & 32)) {
+            y += font_i16(f, q);
+            q += 2;
+        }
+        px              = pt[2 * i];
+        pt[2 * i]       = m[0] * px + m[1] * (float)y + m[2];
+        pt[2 * i + 1]   = m[3] * px + m[4] * (float)y + m[5];
+    }
+    if (q > end) {
+        rv = 0;
+        goto done;
+    }
+
+    for (c = 0, first = 0; c < ncont; c++, first = last + 1) {
+        last = font_u16(f, g + 10 + 2 * (size_t)c);
+        if (last >= npts || last < first) break;
+        n = last - first + 1;
+        if (n < 2) continue;
+
+        /**
+         * Start on an on-curve point and go round back to it,
+         * or if there's none, halfway between the last and the
+         * first point and round all of them.
+         **/
+        for (k = 0; k < (int)n && !(fl[first + k] & 1); k++);
+        if (k < (int)n) {
+            sx = pt[2 * (first + k)];
+            sy = pt[2 * (first + k) + 1];
+            k++;
+        } else {
+            sx = (pt[2 * first] + pt[2 * last]) * 0.5f;
+            sy = (pt[2 * first + 1] + pt[2 * last + 1]) * 0.5f;
+            k  = 0;
+        }
+        if (video_path_move_to(p, sx, sy)) goto done;
+
+        have_ctrl = 0;
+        cx = cy = 0;
+        for (i = 0; i < n; i++) {
+            j  = first + ((uint32_t)k + i) % n;
+            px = pt[2 * j];
+            py = pt[2 * j + 1];
+            if (fl[j] & 1) {
+                if (have_ctrl ? video_path_quad_to(p, cx, cy, px, py) : video_path_line_to(p, px, py)) goto done;
+                have_ctrl = 0;
+            } else {
+                if (have_ctrl && video_path_quad_to(p, cx, cy, (cx + px) * 0.5f, (cy + py) * 0.5f)) goto done;
+                cx          = px;
+                cy          = py;
+                have_ctrl   = 1;
+            }
+        }
+        if (have_ctrl && video_path_quad_to(p, cx, cy, sx, sy)) goto done;
+        if (video_path_close(p)) goto done;
+    }
+    rv = 0;
+
+done:
+    free(fl);
+    free(pt);
+    return rv;
+}
+
+static int psf_cmp( const void *a, const void *b ) {
+    const uint32_t  *x = (const uint32_t *)a,
+                    *y = (const uint32_t *)b;
+
+    return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+/**
+ * Reads the Unicode table, if there is one, into pairs of
+ * (codepoint, glyph) sorted by codepoint.  Sequences (a
+ * character and combining marks) are skipped.
+ **/
+static int psf_map( struct video_font *f, size_t off, int v2 ) {
+    uint32_t    *pairs = 0,
+                *tmp,
+                cp, g = 0;
+    size_t      n = 0, cap = 0, i;
+    int         seq = 0, len;
+
+    while (off < f->len && g < (uint32_t)f->psf_count) {
+        if (v2) {
+            cp = f->data[off];
+            if (cp == 0xFF) {
+                g++;
+                seq = 0;
+                off++;
+                continue;
+            }
+            if (cp == 0xFE) {
+                seq = 1;
+                off++;
+                continue;
+            }
+            len = (cp >= 0xF0) ? 4 : (cp >= 0xE0) ? 3 : (cp >= 0xC0) ? 2 : 1;
+            cp &= (len == 1) ? 0x7F : (0x3F >> (len - 1));
+            for (i = 1; i < (size_t)len; i++) cp = (cp << 6) | (font_u8(f, off + i) & 0x3F);
+            off += (size_t)len;
+        } else {
+            cp   = f->data[off] | (font_u8(f, off + 1) << 8);
+            off += 2;
+            if (cp == 0xFFFF) {
+                g++;
+                seq = 0;
+                continue;
+            }
+            if (cp == 0xFFFE) {
+                seq = 1;
+                continue;
+            }
+        }
+        if (seq) continue;
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            if (!(tmp = (uint32_t *)realloc(pairs, cap * 2 * sizeof(uint32_t)))) {
+                free(pairs);
+                return -1;
+            }
+            pairs = tmp;
+        }
+        pairs[2 * n]        = cp;
+        pairs[2 * n + 1]    = g;
+        n++;
+    }
+    if (!n) return 0;
+
+    qsort(pairs, n, 2 * sizeof(uint32_t), &psf_cmp);
+    f->psf_map  = pairs;
+    f->psf_nmap = n;
+    return 0;
+}
+
+static int psf_init( struct video_font *f ) {
+    uint32_t    mode, flags, hsize;
+
+    if (f->len >= 4 && f->data[0] == 0x36 && f->data[1] == 0x04) {
+        mode                = f->data[2];
+        f->psf_charsize     = f->data[3];
+        f->psf_width        = 8;
+        f->psf_height       = (int)f->psf_charsize;
+        f->psf_count        = (mode & 1) ? 512 : 256;
+        f->psf_glyphs       = 4;
+        if (f->psf_glyphs + (size_t)f->psf_count * f->psf_charsize > f->len || !f->psf_height) return -1;
+        if (mode & 6) return psf_map(f, f->psf_glyphs + (size_t)f->psf_count * f->psf_charsize, 0);
+        return 0;
+    }
+
+    if (f->len >= 32 && f->data[0] == 0x72 && f->data[1] == 0xB5 && f->data[2] == 0x4A && f->data[3] == 0x86) {
+        hsize               = f->data[8] | (f->data[9] << 8) | (f->data[10] << 16) | ((uint32_t)f->data[11] << 24);
+        flags               = f->data[12] | (f->data[13] << 8) | (f->data[14] << 16) | ((uint32_t)f->data[15] << 24);
+        f->psf_count        = (int)(f->data[16] | (f->data[17] << 8) | (f->data[18] << 16) | ((uint32_t)(f->data[19] & 0x7F) << 24));
+        f->psf_charsize     = f->data[20] | (f->data[21] << 8) | (f->data[22] << 16) | ((uint32_t)(f->data[23] & 0x7F) << 24);
+        f->psf_height       = (int)(f->data[24] | (f->data[25] << 8));
+        f->psf_width        = (int)(f->data[28] | (f->data[29] << 8));
+        f->psf_glyphs       = hsize;
+        if (!f->psf_width || !f->psf_height || f->psf_width > TEXT_PAGE || f->psf_height > TEXT_PAGE ||
+            f->psf_charsize < (size_t)((f->psf_width + 7) / 8) * f->psf_height ||
+            hsize > f->len || (size_t)f->psf_count > (f->len - hsize) / f->psf_charsize) return -1;
+        if (flags & 1) return psf_map(f, hsize + (size_t)f->psf_count * f->psf_charsize, 1);
+        return 0;
+    }
+    return -1;
+}
+
+static uint32_t psf_glyph_index( const struct video_font *f, uint32_t cp ) {
+    size_t  lo = 0,
+            hi = f->psf_nmap,
+            mid;
+
+    if (!f->psf_map) return (cp < (uint32_t)f->psf_count) ? cp : 0;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (f->psf_map[2 * mid] < cp) lo = mid + 1;
+        else if (f->psf_map[2 * mid] > cp) hi = mid;
+        else return f->psf_map[2 * mid + 1];
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * Glyphs at a size
+ *****************************************************************************/
+
+static inline int text_floor( float v ) {
+    int i = (int)v;
+    return i - (v < (float)i);
+}
+
+static inline int text_ceil( float v ) {
+    int i = (int)v;
+    return i + (v > (float)i);
+}
+
+/* Font units to 26.6 pixels, to nearest */
+static inline int32_t ttf_to_26_6( const struct video_font *f, int size, int32_t units ) {
+    int64_t v = (int64_t)units * size * 64;
+
+    return (int32_t)((v >= 0) ? (v + f->units_per_em / 2) / f->units_per_em
+                              : -((-v + f->units_per_em / 2) / f->units_per_em));
+}
+
+/* PSF glyphs are drawn at a whole multiple of their size */
+static inline int psf_scale( const struct video_font *f, int size ) {
+    int k   = (size > f->psf_height) ? size / f->psf_height : 1,
+        max = TEXT_MAX_GLYPH / ((f->psf_width > f->psf_height) ? f->psf_width : f->psf_height);
+
+    return (k < max) ? k : max;
+}
+
+static uint32_t font_glyph_index( const struct video_font *f, uint32_t cp ) {
+    return (f->type == FONT_TTF) ? ttf_glyph_index(f, cp) : psf_glyph_index(f, cp);
+}
+
+static int32_t font_advance( const struct video_font *f, int size, uint32_t gid ) {
+    uint32_t    m;
+
+    if (f->type == FONT_PSF) return f->psf_width * psf_scale(f, size) * 64;
+    m = (gid < (uint32_t)f->num_hmetrics) ? gid : (uint32_t)f->num_hmetrics - 1;
+    return ttf_to_26_6(f, size, (int32_t)font_u16(f, f->hmtx + 4 * (size_t)m));
+}
+
+static int32_t font_kern( const struct video_font *f, int size, uint32_t left, uint32_t right ) {
+    if (f->type != FONT_TTF || !f->kern) return 0;
+    return ttf_to_26_6(f, size, ttf_kern(f, left, right));
+}
+
+/**
+ * Fills in everything about glyph "g" (gid and cp set) but
+ * where it is in the atlas: advance, bitmap size and where
+ * the bitmap goes from the pen.
+ **/
+static void font_measure( const struct video_font *f, int size, struct text_glyph *g ) {
+    size_t      o, len;
+    float       scale;
+    int         k, x0, y0, w, h;
+
+    g->adv  = font_advance(f, size, g->gid);
+    g->w    = g->h = 0;
+    g->bx   = g->by = 0;
+
+    if (f->type == FONT_PSF) {
+        k       = psf_scale(f, size);
+        g->w    = (uint16_t)(f->psf_width * k);
+        g->h    = (uint16_t)(f->psf_height * k);
+        g->by   = -(f->psf_height - f->psf_height / 4) * k;
+        return;
+    }
+
+    if (!(o = ttf_glyph(f, g->gid, &len))) return;
+    scale   = (float)size / (float)f->units_per_em;
+    x0      = text_floor(scale * (float)font_i16(f, o + 2));
+    y0      = text_floor(-scale * (float)font_i16(f, o + 8));
+    w       = text_ceil(scale * (float)font_i16(f, o + 6)) - x0;
+    h       = text_ceil(-scale * (float)font_i16(f, o + 4)) - y0;
+    if (w <= 0 || h <= 0 || w > TEXT_MAX_GLYPH || h > TEXT_MAX_GLYPH ||
+        x0 < -TEXT_MAX_GLYPH || x0 > TEXT_MAX_GLYPH || y0 < -TEXT_MAX_GLYPH || y0 > TEXT_MAX_GLYPH) return;
+    g->w    = (uint16_t)w;
+    g->h    = (uint16_t)h;
+    g->bx   = x0;
+    g->by   = y0;
+}
+
+/**
+ * Renders measured glyph "g" into the g->w x g->h bytes at
+ * "mask", rows "stride" apart.
+ *
+ * \return ZERO, -1 if out of memory.
+ **/
+static int font_render( const struct video_font *f, int size, const struct text_glyph *g,
+                        struct video_path *outline, uint8_t *mask, size_t stride )
+{
+    const uint8_t   *bits;
+    size_t          row;
+    float           m[6];
+    int             k, x, y, parts = 0;
+
+    if (f->type == FONT_PSF) {
+        k    = psf_scale(f, size);
+        row  = (size_t)(f->psf_width + 7) / 8;
+        bits = f->data + f->psf_glyphs + (size_t)g->gid * f->psf_charsize;
+        for (y = 0; y < g->h; y++) {
+            for (x = 0; x < g->w; x++) {
+                mask[(size_t)y * stride + x] = (bits[(y / k) * row + (x / k) / 8] & (0x80 >> ((x / k) & 7))) ? 0xFF : 0;
+            }
+        }
+        return 0;
+    }
+
+    /* Font units, y up, to the bitmap, y down */
+    m[0] = (float)size / (float)f->units_per_em;
+    m[1] = 0;
+    m[2] = (float)-g->bx;
+    m[3] = 0;
+    m[4] = -m[0];
+    m[5] = (float)-g->by;
+
+    video_path_reset(outline);
+    if (ttf_outline(f, g->gid, m, outline, 0, &parts)) return -1;
+    return video_path_mask(outline, mask, g->w, g->h, stride, VIDEO_FILL_NONZERO);
+}
+
+/*****************************************************************************
+ * The cache
+ *****************************************************************************/
+
+static inline size_t text_hash( const struct video_glyph_cache *c, uint32_t face, uint32_t size, uint32_t cp ) {
+    uint32_t    h = face * 0x9E3779B1u ^ size * 0x85EBCA77u ^ cp * 0xC2B2AE3Du;
+
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h & (c->nbuckets - 1);
+}
+
+static struct text_glyph *text_find( struct video_glyph_cache *c, uint32_t face, int size, uint32_t cp ) {
+    struct text_glyph   *g;
+    int32_t             i;
+
+    if (!c->nbuckets) return 0;
+    for (i = c->buckets[text_hash(c, face, (uint32_t)size, cp)]; i >= 0; i = g->next) {
+        g = &c->glyphs[i];
+        if (g->cp == cp && g->face == face && g->size == size) return g;
+    }
+    return 0;
+}
+
+static inline void text_touch( struct video_glyph_cache *c, struct text_page *pg ) {
+    __atomic_store_n(&pg->stamp, __atomic_add_fetch(&c->clock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+static inline void text_hit( struct video_glyph_cache *c, const struct text_glyph *g ) {
+    __atomic_add_fetch(&c->hits, 1, __ATOMIC_RELAXED);
+    if (g->page >= 0) text_touch(c, &c->pages[g->page]);
+}
+
+/* A free entry, growing the table (and the buckets with it) if there's none */
+static int32_t text_new( struct video_glyph_cache *c ) {
+    struct text_glyph   *glyphs;
+    int32_t             *buckets,
+                        i;
+    size_t              n, b;
+
+    if (c->free_glyph < 0) {
+        n = c->cglyphs ? c->cglyphs * 2 : 256;
+        if (!(glyphs = (struct text_glyph *)realloc(c->glyphs, n * sizeof(*glyphs)))) return -1;
+        c->glyphs = glyphs;
+        for (i = (int32_t)n - 1; i >= (int32_t)c->cglyphs; i--) {
+            glyphs[i].page  = -2;
+            glyphs[i].next  = c->free_glyph;
+            c->free_glyph   = i;
+        }
+        c->cglyphs = n;
+    }
+
+    if (c->nglyphs >= c->nbuckets) {
+        n = c->nbuckets ? c->nbuckets * 2 : 256;
+        if (!(buckets = (int32_t *)malloc(n * sizeof(*buckets)))) return -1;
+        free(c->buckets);
+        c->buckets  = buckets;
+        c->nbuckets = n;
+        for (b = 0; b < n; b++) buckets[b] = -1;
+        for (i = 0; i < (int32_t)c->cglyphs; i++) {
+            if (c->glyphs[i].page == -2) continue;
+            b                   = text_hash(c, c->glyphs[i].face, c->glyphs[i].size, c->glyphs[i].cp);
+            c->glyphs[i].next   = buckets[b];
+            buckets[b]          = i;
+        }
+    }
+
+    i               = c->free_glyph;
+    c->free_glyph   = c->glyphs[i].next;
+    c->nglyphs++;
+    return i;
+}
+
+/**
+ * Empties the least recently used page, every glyph on it is
+ * forgotten.
+ **/
+static struct text_page *text_evict( struct video_glyph_cache *c ) {
+    struct text_page    *pg = &c->pages[0];
+    struct text_glyph   *g;
+    int32_t             i, *link;
+    int                 p;
+
+    for (p = 1; p < c->npages; p++) {
+        if (c->pages[p].stamp < pg->stamp) pg = &c->pages[p];
+    }
+
+    while ((i = pg->first) >= 0) {
+        g = &c->glyphs[i];
+        for (link = &c->buckets[text_hash(c, g->face, g->size, g->cp)]; *link != i; link = &c->glyphs[*link].next);
+        *link           = g->next;
+        pg->first       = g->page_next;
+        g->page         = -2;
+        g->next         = c->free_glyph;
+        c->free_glyph   = i;
+        c->nglyphs--;
+        c->evictions++;
+    }
+    pg->nshelves    = 0;
+    pg->bottom      = 0;
+    return pg;
+}
+
+/* Room for w x h on "pg", -1 if there's none */
+static int text_place( struct text_page *pg, int w, int h, uint16_t *x, uint16_t *y ) {
+    struct text_shelf   *sh, *best = 0;
+    int                 i;
+
+    /* The lowest shelf it fits on without wasting more than a third of the shelf */
+    for (i = 0; i < pg->nshelves; i++) {
+        sh = &pg->shelves[i];
+        if (sh->h < h || sh->h > h + h / 2 + 1 || sh->x + w > TEXT_PAGE) continue;
+        if (!best || sh->h < best->h) best = sh;
+    }
+    if (!best) {
+        if (pg->bottom + h > TEXT_PAGE || pg->nshelves == TEXT_PAGE) return -1;
+        best        = &pg->shelves[pg->nshelves++];
+        best->y     = (uint16_t)pg->bottom;
+        best->h     = (uint16_t)h;
+        best->x     = 0;
+        pg->bottom += h;
+    }
+    *x       = best->x;
+    *y       = best->y;
+    best->x += (uint16_t)w;
+    return 0;
+}
+
+/**
+ * A place in the atlas for "g": on a page with room, a page
+ * not used yet, or the least recently used one emptied.
+ *
+ * \return The page, NULL if out of memory.
+ **/
+static struct text_page *text_alloc( struct video_glyph_cache *c, struct text_glyph *g ) {
+    struct text_page    *pg;
+    int                 p;
+
+    for (p = 0; p < c->npages && c->pages[p].px; p++) {
+        if (!text_place(&c->pages[p], g->w, g->h, &g->x, &g->y)) return &c->pages[p];
+    }
+    if (p < c->npages) {
+        pg = &c->pages[p];
+        if (!(pg->px = (uint8_t *)malloc(TEXT_PAGE_BYTES))) return 0;
+    } else {
+        pg = text_evict(c);
+    }
+    text_place(pg, g->w, g->h, &g->x, &g->y);
+    return pg;
+}
+
+/**
+ * Glyph for "cp", rendered into the atlas if it isn't there
+ * yet.  If it's too big for a page it isn't cached: "*px" is
+ * set to a bitmap the caller frees and "tmp" is filled in.
+ *
+ * \return The glyph, NULL if out of memory.
+ **/
+static const struct text_glyph *text_get( struct video_glyph_cache *c, const struct video_font *f, int size, uint32_t cp,
+                                          struct text_glyph *tmp, uint8_t **px )
+{
+    struct text_glyph   *g;
+    struct text_page    *pg;
+    int32_t             i;
+
+    *px = 0;
+    if ((g = text_find(c, f->id, size, cp))) {
+        text_hit(c, g);
+        return g;
+    }
+    c->misses++;
+
+    memset(tmp, 0, sizeof(*tmp));
+    tmp->face   = f->id;
+    tmp->size   = (uint16_t)size;
+    tmp->cp     = cp;
+    tmp->gid    = font_glyph_index(f, cp);
+    tmp->page   = -1;
+    font_measure(f, size, tmp);
+
+    if (tmp->w > TEXT_PAGE || tmp->h > TEXT_PAGE) {
+        c->uncached++;
+        if (!(*px = (uint8_t *)malloc((size_t)tmp->w * tmp->h))) return 0;
+        if (font_render(f, size, tmp, c->outline, *px, tmp->w)) {
+            free(*px);
+            *px = 0;
+            return 0;
+        }
+        return tmp;
+    }
+
+    if ((i = text_new(c)) < 0) return 0;
+    g               = &c->glyphs[i];
+    *g              = *tmp;
+    g->next         = -1;
+    g->page_next    = -1;
+
+    if (g->w && g->h) {
+        if (!(pg = text_alloc(c, g)) ||
+            font_render(f, size, g, c->outline, pg->px + (size_t)g->y * TEXT_PAGE + g->x, TEXT_PAGE))
+        {
+            /* Still on the page's shelf, the space is lost until the page is reused */
+            g->page         = -2;
+            g->next         = c->free_glyph;
+            c->free_glyph   = i;
+            c->nglyphs--;
+            return 0;
+        }
+        g->page         = (int16_t)(pg - c->pages);
+        g->page_next    = pg->first;
+        pg->first       = i;
+        text_touch(c, pg);
+    }
+
+    i               = (int32_t)text_hash(c, g->face, g->size, g->cp);
+    g->next         = c->buckets[i];
+    c->buckets[i]   = (int32_t)(g - c->glyphs);
+    return g;
+}
+
+struct video_glyph_cache *video_glyph_cache_create( size_t budget ) {
+    struct video_glyph_cache    *c;
+    int                         p;
+
+    if (!(c = (struct video_glyph_cache *)calloc(1, sizeof(*c)))) return 0;
+    pthread_rwlock_init(&c->lock, 0);
+    c->npages       = (int)((budget / TEXT_PAGE_BYTES) ? (budget / TEXT_PAGE_BYTES < INT16_MAX ? budget / TEXT_PAGE_BYTES : INT16_MAX) : 1);
+    c->free_glyph   = -1;
+    c->pages        = (struct text_page *)calloc((size_t)c->npages, sizeof(*c->pages));
+    c->outline      = video_path_create();
+    if (!c->pages || !c->outline) {
+        video_glyph_cache_destroy(c);
+        return 0;
+    }
+    for (p = 0; p < c->npages; p++) c->pages[p].first = -1;
+    return c;
+}
+
+void video_glyph_cache_destroy( struct video_glyph_cache *c ) {
+    int p;
+
+    if (!c) return;
+    for (p = 0; c->pages && p < c->npages; p++) free(c->pages[p].px);
+    free(c->pages);
+    free(c->glyphs);
+    free(c->buckets);
+    video_path_destroy(c->outline);
+    pthread_rwlock_destroy(&c->lock);
+    free(c);
+}
+
+void video_glyph_cache_get_stats( struct video_glyph_cache *c, struct video_glyph_cache_stats *st ) {
+    int p;
+
+    memset(st, 0, sizeof(*st));
+    if (!c) return;
+
+    pthread_rwlock_wrlock(&c->lock);
+    st->hits        = c->hits;
+    st->misses      = c->misses;
+    st->evictions   = c->evictions;
+    st->uncached    = c->uncached;
+    st->glyphs      = c->nglyphs;
+    st->budget      = (size_t)c->npages * TEXT_PAGE_BYTES;
+    for (p = 0; p < c->npages; p++) {
+        if (!c->pages[p].px) continue;
+        st->pages++;
+        st->bytes += TEXT_PAGE_BYTES;
+    }
+    pthread_rwlock_unlock(&c->lock);
+}
+
+/*****************************************************************************
+ * Fonts
+ *****************************************************************************/
+
+/**
+ * Takes "data" (malloc()ed), freed if it isn't a font we
+ * can read.
+ **/
+static struct video_font *font_new( uint8_t *data, size_t len ) {
+    struct video_font   *f;
+
+    if (!(f = (struct video_font *)calloc(1, sizeof(*f)))) {
+        free(data);
+        return 0;
+    }
+    f->data = data;
+    f->len  = len;
+
+    if (len >= 12 && (!memcmp(data, "\0\1\0\0", 4) || !memcmp(data, "true", 4) || !memcmp(data, "ttcf", 4))) {
+        f->type = FONT_TTF;
+        if (ttf_init(f)) goto error;
+    } else {
+        f->type = FONT_PSF;
+        if (psf_init(f)) goto error;
+    }
+    f->id = __atomic_add_fetch(&font_ids, 1, __ATOMIC_RELAXED);
+    return f;
+
+error:
+    fprintf(stderr, "libvideo/video_font_load(): ERROR - Not a TrueType (glyf outlines) or PSF font.\n");
+    video_font_free(f);
+    errno = EINVAL;
+    return 0;
+}
+
+struct video_font *video_font_load( const char *path ) {
+    struct stat st;
+    uint8_t     *data;
+    size_t      got = 0;
+    ssize_t     n;
+    int         fd;
+
+    if (!path) {
+        errno = EINVAL;
+        return 0;
+    }
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return 0;
+    if (fstat(fd, &st) || !(data = (uint8_t *)malloc(st.st_size ? (size_t)st.st_size : 1))) {
+        close(fd);
+        return 0;
+    }
+    while (got < (size_t)st.st_size) {
+        if ((n = read(fd, data + got, (size_t)st.st_size - got)) <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            free(data);
+            close(fd);
+            if (!n) errno = EIO;
+            return 0;
+        }
+        got += (size_t)n;
+    }
+    close(fd);
+    return font_new(data, got);
+}
+
+struct video_font *video_font_load_mem( const void *data, size_t len ) {
+    uint8_t *copy;
+
+    if (!data || !len) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (!(copy = (uint8_t *)malloc(len))) return 0;
+    memcpy(copy, data, len);
+    return font_new(copy, len);
+}
+
+void video_font_free( struct video_font *f ) {
+    if (!f) return;
+    free(f->psf_map);
+    free(f->data);
+    free(f);
+}
+
+int video_font_metrics( const struct video_font *f, int size, struct video_font_metrics *m ) {
+    int k;
+
+    if (!f || !m || size <= 0 || size > TEXT_MAX_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (f->type == FONT_PSF) {
+        k               = psf_scale(f, size);
+        m->ascent       = (f->psf_height - f->psf_height / 4) * k;
+        m->descent      = f->psf_height * k - m->ascent;
+        m->line_height  = f->psf_height * k;
+    } else {
+        m->ascent       = (ttf_to_26_6(f, size, f->ascent) + 32) >> 6;
+        m->descent      = (ttf_to_26_6(f, size, -f->descent) + 32) >> 6;
+        m->line_height  = (ttf_to_26_6(f, size, f->ascent - f->descent + f->line_gap) + 32) >> 6;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * Drawing
+ *****************************************************************************/
+
+/**
+ * Next code point of "*s", moving past it.  Anything that
+ * isn't well formed UTF-8 (overlong, surrogates, cut short)
+ * is one U+FFFD per byte.
+ **/
+static uint32_t text_utf8( const uint8_t **s ) {
+    const uint8_t   *p = *s;
+    uint32_t        cp = p[0],
+                    min;
+    int             n, i;
+
+    if (cp < 0x80) {
+        *s = p + 1;
+        return cp;
+    }
+    if ((cp & 0xE0) == 0xC0) {
+        n   = 1;
+        cp &= 0x1F;
+        min = 0x80;
+    } else if ((cp & 0xF0) == 0xE0) {
+        n   = 2;
+        cp &= 0x0F;
+        min = 0x800;
+    } else if ((cp & 0xF8) == 0xF0) {
+        n   = 3;
+        cp &= 0x07;
+        min = 0x10000;
+    } else {
+        goto bad;
+    }
+    for (i = 1; i <= n; i++) {
+        if ((p[i] & 0xC0) != 0x80) goto bad;
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) goto bad;
+    *s = p + n + 1;
+    return cp;
+
+bad:
+    *s = p + 1;
+    return 0xFFFD;
+}
+
+int video_text_width( const struct video_font *f, int size, const char *utf8 ) {
+    const uint8_t   *s = (const uint8_t *)utf8;
+    uint32_t        cp, gid, prev = 0;
+    int32_t         pen = 0;
+    int             width = 0, w;
+
+    if (!f || !utf8 || size <= 0 || size > TEXT_MAX_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (*s) {
+        if ((cp = text_utf8(&s)) == '\n') {
+            pen  = 0;
+            prev = 0;
+            continue;
+        }
+        gid = font_glyph_index(f, cp);
+        if (prev) pen += font_kern(f, size, prev, gid);
+        pen += font_advance(f, size, gid);
+        prev = gid;
+        if ((w = (pen + 32) >> 6) > width) width = w;
+    }
+    return width;
+}
+
+/* Blends the w x h coverage at "mask" with its top left at (x, y), clipped to "clip" */
+static void text_blit( const struct video_kernels *k, const struct video_surface *s, const struct video_rect *clip,
+                       int x, int y, int w, int h, const uint8_t *mask, size_t stride, uint32_t color )
+{
+    int cx1 = clip->x + clip->width,
+        cy1 = clip->y + clip->height;
+
+    if (x < clip->x) {
+        mask += clip->x - x;
+        w    -= clip->x - x;
+        x     = clip->x;
+    }
+    if (y < clip->y) {
+        mask += (size_t)(clip->y - y) * stride;
+        h    -= clip->y - y;
+        y     = clip->y;
+    }
+    if (w > cx1 - x) w = cx1 - x;
+    if (h > cy1 - y) h = cy1 - y;
+    for (; w > 0 && h > 0; h--, y++, mask += stride) {
+        k->blend_mask(video_surface_row(s, y) + x, color, mask, (size_t)w);
+    }
+}
+
+/**
+ * Lays out "utf8" and draws it on "s" (if not NULL) inside
+ * "clip", adding where each glyph lands to "bounds" (if not
+ * NULL).
+ *
+ * \return The width as video_text_width(), -1 if out of
+ * memory.
+ **/
+static int text_run( const struct video_surface *s, struct video_glyph_cache *c, const struct video_font *f, int size,
+                     int x, int y, const char *utf8, uint32_t color, const struct video_rect *clip, int64_t *bounds )
+{
+    const struct video_kernels  *k = video_draw_kernels();
+    const struct text_glyph     *g;
+    struct text_glyph           tmp;
+    struct video_font_metrics   m;
+    const uint8_t               *str = (const uint8_t *)utf8;
+    uint8_t                     *px;
+    uint32_t                    cp, prev = 0;
+    int32_t                     pen = 0;
+    int                         width = 0, gx, gy, w, shared;
+
+    video_font_metrics(f, size, &m);
+
+    pthread_rwlock_rdlock(&c->lock);
+    shared = 1;
+    while (*str) {
+        if ((cp = text_utf8(&str)) == '\n') {
+            pen  = 0;
+            prev = 0;
+            y   += m.line_height;
+            continue;
+        }
+
+        px = 0;
+        if ((g = text_find(c, f->id, size, cp))) {
+            text_hit(c, g);
+        } else {
+            if (shared) {
+                pthread_rwlock_unlock(&c->lock);
+                pthread_rwlock_wrlock(&c->lock);
+                shared = 0;
+            }
+            if (!(g = text_get(c, f, size, cp, &tmp, &px))) {
+                width = -1;
+                break;
+            }
+        }
+        if (prev) pen += font_kern(f, size, prev, g->gid);
+        prev = g->gid;
+
+        gx = x + ((pen + 32) >> 6) + g->bx;
+        gy = y + g->by;
+        if (g->w && g->h) {
+            if (bounds) {
+                if (gx < bounds[0]) bounds[0] = gx;
+                if (gy < bounds[1]) bounds[1] = gy;
+                if (gx + g->w > bounds[2]) bounds[2] = gx + g->w;
+                if (gy + g->h > bounds[3]) bounds[3] = gy + g->h;
+            }
+            if (s) {
+                if (px) text_blit(k, s, clip, gx, gy, g->w, g->h, px, g->w, color);
+                else text_blit(k, s, clip, gx, gy, g->w, g->h, c->pages[g->page].px + (size_t)g->y * TEXT_PAGE + g->x, TEXT_PAGE, color);
+            }
+        }
+        free(px);
+
+        pen += g->adv;
+        if ((w = (pen + 32) >> 6) > width) width = w;
+    }
+    pthread_rwlock_unlock(&c->lock);
+
+    return width;
+}
+
+int video_text_draw_clip( const struct video_surface *s, struct video_glyph_cache *c, const struct video_font *f, int size,
+                          int x, int y, const char *utf8, uint32_t color, const struct video_rect *clip )
+{
+    struct video_rect   r;
+
+    if (!s || !c || !f || !utf8 || size <= 0 || size > TEXT_MAX_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!s->pixels || !(color >> 24) || s->width <= 0 || s->height <= 0) return text_run(0, c, f, size, x, y, utf8, color, 0, 0);
+
+    r.x         = 0;
+    r.y         = 0;
+    r.width     = s->width;
+    r.height    = s->height;
+    if (clip) {
+        if (r.x < clip->x) r.x = clip->x;
+        if (r.y < clip->y) r.y = clip->y;
+        r.width     = ((clip->x + clip->width < s->width) ? clip->x + clip->width : s->width) - r.x;
+        r.height    = ((clip->y + clip->height < s->height) ? clip->y + clip->height : s->height) - r.y;
+    }
+    return text_run(s, c, f, size, x, y, utf8, color, &r, 0);
+}
+
+int video_text_bounds( struct video_glyph_cache *c, const struct video_font *f, int size, int x, int y, const char *utf8,
+                       struct video_rect *r )
+{
+    int64_t b[4] = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+
+    if (!c || !f || !utf8 || size <= 0 || size > TEXT_MAX_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (text_run(0, c, f, size, x, y, utf8, 0, 0, b) < 0) return -1;
+
+    memset(r, 0, sizeof(*r));
+    if (b[2] > b[0]) {
+        r->x        = (int)b[0];
+        r->y        = (int)b[1];
+        r->width    = (int)(b[2] - b[0]);
+        r->height   = (int)(b[3] - b[1]);
+    }
+    return 0;
+}
+
+int video_draw_text( const struct video_surface *s, struct video_glyph_cache *c, const struct video_font *f, int size,
+                     int x, int y, const char *utf8, uint32_t color )
+{
+    return video_text_draw_clip(s, c, f, size, x, y, utf8, color, 0);
+}
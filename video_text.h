@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_TEXT_H_
+#define _VIDEO_TEXT_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Text in pieces, for the display list: where a string's
+ * glyphs land, and the string drawn inside a rectangle.
+ **/
+
+#include "video.h"
+
+/**
+ * video_draw_text(), only the pixels inside "clip" (NULL for
+ * the whole surface).  They come out exactly as unclipped.
+ **/
+int         video_text_draw_clip( const struct video_surface *s, struct video_glyph_cache *c, const struct video_font *f, int size,
+                                  int x, int y, const char *utf8, uint32_t color, const struct video_rect *clip );
+
+/**
+ * The box around every glyph of "utf8" drawn at (x, y),
+ * rasterizing them into the cache on the way.  An empty box
+ * (zero width) if nothing shows.
+ *
+ * \return ZERO, -1 with errno set.
+ **/
+int         video_text_bounds( struct video_glyph_cache *c, const struct video_font *f, int size, int x, int y, const char *utf8,
+                               struct video_rect *r );
+
+#endif
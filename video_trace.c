@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#define _GNU_SOURCE
+#include "video.h"
+#include "video_trace.h"
+
+#include <sys/syscall.h>
+#include <time.h>
+
+#define VIDEO_TRACE_DEFAULT     16384       /* Events per thread if video_trace_start() is given ZERO */
+
+struct video_trace_event {
+    uint64_t        ts;                     /* CLOCK_MONOTONIC, ns  */
+    const char      *name;
+    int32_t         display;
+    char            ph;
+};
+
+/**
+ * One per thread.  "head" counts every event the thread has
+ * recorded, the last "mask + 1" are still in "ev".  Only the
+ * owning thread writes; it publishes an event by storing
+ * head with release so a reader that loads head with acquire
+ * sees the whole event.
+ *
+ * "gen" is the trace the events are from.  A restart only
+ * bumps trace_gen, the owner empties its ring the next time
+ * it records, and until then the dump leaves it out.
+ **/
+struct video_trace_ring {
+    struct video_trace_ring     *next;
+    pid_t                       tid;
+    char                        name[16];               /* Thread name when the ring was made   */
+    uint64_t                    head;
+    unsigned                    gen;
+    uint64_t                    mask;
+    struct video_trace_event    ev[];
+};
+
+int                                     video_trace_on = 0;
+
+static pthread_mutex_t                  trace_mtx   = PTHREAD_MUTEX_INITIALIZER;
+static struct video_trace_ring          *trace_rings;           /* Every thread that has recorded, guarded by trace_mtx */
+static size_t                           trace_size;             /* Events per ring, a power of two                      */
+static unsigned                         trace_gen;              /* Bumped by every video_trace_start()                  */
+static __thread struct video_trace_ring *trace_mine;
+
+static inline uint64_t trace_now( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * First event from this thread: give it a ring.  Rings are
+ * never freed, a thread's ring outlives it so its events
+ * still make it into the dump.
+ **/
+static struct video_trace_ring *trace_ring_new( void ) {
+    struct video_trace_ring *r;
+
+    pthread_mutex_lock(&trace_mtx);
+    r = (struct video_trace_ring *)malloc(sizeof(*r) + trace_size * sizeof(struct video_trace_event));
+    if (r) {
+        r->tid      = (pid_t)syscall(SYS_gettid);
+        if (pthread_getname_np(pthread_self(), r->name, sizeof(r->name))) r->name[0] = 0;
+        r->head     = 0;
+        r->gen      = __atomic_load_n(&trace_gen, __ATOMIC_RELAXED);
+        r->mask     = trace_size - 1;
+        r->next     = trace_rings;
+        trace_rings = r;
+    }
+    pthread_mutex_unlock(&trace_mtx);
+
+    return r;
+}
+
+void video_trace_emit( char ph, const char *name, int display ) {
+    struct video_trace_ring     *r = trace_mine;
+    struct video_trace_event    *e;
+    uint64_t                    h;
+    unsigned                    g;
+
+    if (!r && !(r = trace_mine = trace_ring_new())) return;
+
+    /* Restarted since our last event: what's in the ring is from the trace before */
+    g = __atomic_load_n(&trace_gen, __ATOMIC_RELAXED);
+    if (r->gen != g) {
+        __atomic_store_n(&r->head, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&r->gen, g, __ATOMIC_RELEASE);
+    }
+
+    h           = r->head;
+    e           = &r->ev[h & r->mask];
+    e->ts       = trace_now();
+    e->name     = name;
+    e->display  = display;
+    e->ph       = ph;
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+int video_trace_start( size_t events_per_thread ) {
+    size_t  n = 1;
+
+    pthread_mutex_lock(&trace_mtx);
+    if (!events_per_thread) events_per_thread = trace_size ? trace_size : VIDEO_TRACE_DEFAULT;
+    while (n < events_per_thread) n <<= 1;
+
+    /* The rings that are out there can't be resized */
+    if (trace_size && n != trace_size) {
+        pthread_mutex_unlock(&trace_mtx);
+        fprintf(stderr, "libvideo/video_trace_start(): ERROR - Rings are %zu events, can't change to %zu.\n", trace_size, n);
+        errno = EINVAL;
+        return -1;
+    }
+    trace_size = n;
+    __atomic_store_n(&trace_gen, trace_gen + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&trace_mtx);
+
+    __atomic_store_n(&video_trace_on, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void video_trace_stop( void ) {
+    __atomic_store_n(&video_trace_on, 0, __ATOMIC_RELAXED);
+}
+
+void video_trace_begin( const char *name ) {
+    VTRACE_BEGIN(name, -1);
+}
+
+void video_trace_end( const char *name ) {
+    VTRACE_END(name, -1);
+}
+
+void video_trace_instant( const char *name ) {
+    VTRACE_INSTANT(name, -1);
+}
+
+static void trace_put_string( FILE *f, const char *s ) {
+    fputc('"', f);
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+            fputc(*s, f);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(f, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+/**
+ * Thread name from /proc, if the thread is still around
+ * (it may have been renamed since it first recorded).
+ **/
+static int trace_thread_name( pid_t tid, char *name, size_t len ) {
+    char    path[64];
+    FILE    *f;
+    size_t  n;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", (int)tid);
+    if (!(f = fopen(path, "r"))) return -1;
+    n = fread(name, 1, len - 1, f);
+    fclose(f);
+    while (n && (name[n - 1] == '\n' || name[n - 1] == '\r')) n--;
+    name[n] = 0;
+    return n ? 0 : -1;
+}
+
+int video_trace_dump( const char *path ) {
+    struct video_trace_ring     *r;
+    struct video_trace_event    *ev,
+                                *e;
+    uint64_t                    head,
+                                first,
+                                i;
+    pid_t                       pid = getpid();
+    FILE                        *f;
+    char                        name[32];
+    int                         comma = 0;
+    unsigned                    gen;
+
+    if (!path || !trace_size) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(ev = (struct video_trace_event *)malloc(trace_size * sizeof(*ev)))) return -1;
+    if (!(f = fopen(path, "w"))) {
+        free(ev);
+        return -1;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    pthread_mutex_lock(&trace_mtx);
+    gen = trace_gen;
+    for (r = trace_rings; r; r = r->next) {
+        /**
+         * Nothing recorded since the restart.  Once the owner has
+         * taken up this trace head was reset before gen changed,
+         * so the head we load below is from this trace.
+         **/
+        if (__atomic_load_n(&r->gen, __ATOMIC_ACQUIRE) != gen) continue;
+
+        if (trace_thread_name(r->tid, name, sizeof(name))) {
+            snprintf(name, sizeof(name), "%s", r->name);
+        }
+        if (name[0]) {
+            fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                    comma++ ? "," : "", (int)pid, (int)r->tid);
+            trace_put_string(f, name);
+            fprintf(f, "}}");
+        }
+
+        /**
+         * The thread may still be recording.  Copy what's there,
+         * then look at head again: anything it could have written
+         * over while we copied (and the slot it may be writing
+         * right now) is thrown away.
+         **/
+        head    = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        first   = (head > trace_size) ? head - trace_size : 0;
+        for (i = first; i < head; i++) ev[i & r->mask] = r->ev[i & r->mask];
+
+        i = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (i + 1 > first + trace_size) first = i + 1 - trace_size;
+
+        for (i = first; i < head; i++) {
+            e = &ev[i & r->mask];
+            fprintf(f, "%s\n{\"name\":", comma++ ? "," : "");
+            trace_put_string(f, e->name);
+            fprintf(f, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d",
+                    (e->display < 0) ? "app" : "video", e->ph,
+                    (unsigned long long)(e->ts / 1000), (unsigned)(e->ts % 1000),
+                    (int)pid, (int)r->tid);
+            if (e->ph == VIDEO_TRACE_INSTANT) fprintf(f, ",\"s\":\"t\"");
+            if (e->display >= 0) fprintf(f, ",\"args\":{\"display\":%d}", e->display);
+            fputc('}', f);
+        }
+    }
+    pthread_mutex_unlock(&trace_mtx);
+
+    fprintf(f, "\n]}\n");
+    free(ev);
+
+    if (fclose(f)) return -1;
+    return 0;
+}
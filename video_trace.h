@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2020 Justin Jack
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+#ifndef _VIDEO_TRACE_H_
+#define _VIDEO_TRACE_H_
+
+/**
+ * Internal to the library, not installed.
+ *
+ * Event tracing.  Every thread that records an event gets
+ * its own ring of the last N events, written only by that
+ * thread, so recording is a clock read and a few stores
+ * with no locks or shared cache lines.  When tracing is
+ * off the hooks in the library are a single load and
+ * branch.  video_trace_dump() copies the rings out from
+ * any thread and writes Chrome trace-event JSON.
+ **/
+
+#include <stdint.h>
+
+#define VIDEO_TRACE_BEGIN       'B'
+#define VIDEO_TRACE_END         'E'
+#define VIDEO_TRACE_INSTANT     'i'
+
+extern int  video_trace_on;
+
+/**
+ * Records an event for the calling thread.  "name" is kept
+ * as a pointer, it has to outlive the trace (a literal).
+ * "display" is the framebuffer number, -1 for none.
+ **/
+void        video_trace_emit( char ph, const char *name, int display );
+
+#define VTRACE( ph, name, display )                                         \
+    do {                                                                    \
+        if (__builtin_expect(__atomic_load_n(&video_trace_on, __ATOMIC_RELAXED), 0)) \
+            video_trace_emit((ph), (name), (display));                      \
+    } while (0)
+
+#define VTRACE_BEGIN( name, display )       VTRACE(VIDEO_TRACE_BEGIN, (name), (display))
+#define VTRACE_END( name, display )         VTRACE(VIDEO_TRACE_END, (name), (display))
+#define VTRACE_INSTANT( name, display )     VTRACE(VIDEO_TRACE_INSTANT, (name), (display))
+
+#endif